@@ -44,34 +44,49 @@ typedef char *sds;
 /* Note: sdshdr5 is never used, we just access the flags byte directly.
  * However is here to document the layout of type 5 SDS strings. */
 struct __attribute__ ((__packed__)) sdshdr5 {
+    unsigned location:2; /* addb hash location information */
     unsigned char flags; /* 3 lsb of type, and 5 msb of string length */
     char buf[];
 };
 struct __attribute__ ((__packed__)) sdshdr8 {
     uint8_t len; /* used */
     uint8_t alloc; /* excluding the header and null terminator */
+    unsigned location:2; /* addb hash location information */
     unsigned char flags; /* 3 lsb of type, 5 unused bits */
     char buf[];
 };
 struct __attribute__ ((__packed__)) sdshdr16 {
     uint16_t len; /* used */
     uint16_t alloc; /* excluding the header and null terminator */
+    unsigned location:2; /* addb hash location information */
     unsigned char flags; /* 3 lsb of type, 5 unused bits */
     char buf[];
 };
 struct __attribute__ ((__packed__)) sdshdr32 {
     uint32_t len; /* used */
     uint32_t alloc; /* excluding the header and null terminator */
+    unsigned location:2; /* addb hash location information */
     unsigned char flags; /* 3 lsb of type, 5 unused bits */
     char buf[];
 };
 struct __attribute__ ((__packed__)) sdshdr64 {
     uint64_t len; /* used */
     uint64_t alloc; /* excluding the header and null terminator */
+    unsigned location:2; /* addb hash location information */
     unsigned char flags; /* 3 lsb of type, 5 unused bits */
     char buf[];
 };
 
+/* addb
+ * TODO(totorody): Removes these unused sdshdr structure.
+ * Add sdshdr struct */
+struct sdshdr{
+    unsigned int len;
+    unsigned int free;
+    unsigned location:2;
+    char init[];
+};
+
 #define SDS_TYPE_5  0
 #define SDS_TYPE_8  1
 #define SDS_TYPE_16 2
@@ -79,10 +94,35 @@ struct __attribute__ ((__packed__)) sdshdr64 {
 #define SDS_TYPE_64 4
 #define SDS_TYPE_MASK 7
 #define SDS_TYPE_BITS 3
-#define SDS_HDR_VAR(T,s) struct sdshdr##T *sh = (struct sdshdr##T *)((s)-(sizeof(struct sdshdr##T)));
+#define SDS_HDR_VAR(T,s) struct sdshdr##T *sh = (void*)((s)-(sizeof(struct sdshdr##T)));
 #define SDS_HDR(T,s) ((struct sdshdr##T *)((s)-(sizeof(struct sdshdr##T))))
 #define SDS_TYPE_5_LEN(f) ((f)>>SDS_TYPE_BITS)
 
+/* addb */
+#define SDS_ADDB_LOCATION_NONE 0
+#define SDS_ADDB_LOCATION_REDIS 1
+#define SDS_ADDB_LOCATION_FLUSHING 2
+#define SDS_ADDB_LOCATION_ROCKSDB 3
+#define SDS_ADDB_LOCATION_MASK 3        // Masking by '0b11'
+
+/* addb */
+static inline size_t sdsloc(const sds s) {
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_5:
+            return SDS_HDR(5,s)->location;
+        case SDS_TYPE_8:
+            return SDS_HDR(8,s)->location;
+        case SDS_TYPE_16:
+            return SDS_HDR(16,s)->location;
+        case SDS_TYPE_32:
+            return SDS_HDR(32,s)->location;
+        case SDS_TYPE_64:
+            return SDS_HDR(64,s)->location;
+    }
+    return 0;
+}
+
 static inline size_t sdslen(const sds s) {
     unsigned char flags = s[-1];
     switch(flags&SDS_TYPE_MASK) {
@@ -126,6 +166,28 @@ static inline size_t sdsavail(const sds s) {
     return 0;
 }
 
+/* addb */
+static inline void sdssetloc(sds s, size_t newloc) {
+    unsigned char flags = s[-1];
+    switch(flags&SDS_TYPE_MASK) {
+        case SDS_TYPE_5:
+            SDS_HDR(5,s)->location = newloc;
+            break;
+        case SDS_TYPE_8:
+            SDS_HDR(8,s)->location = newloc;
+            break;
+        case SDS_TYPE_16:
+            SDS_HDR(16,s)->location = newloc;
+            break;
+        case SDS_TYPE_32:
+            SDS_HDR(32,s)->location = newloc;
+            break;
+        case SDS_TYPE_64:
+            SDS_HDR(64,s)->location = newloc;
+            break;
+    }
+}
+
 static inline void sdssetlen(sds s, size_t newlen) {
     unsigned char flags = s[-1];
     switch(flags&SDS_TYPE_MASK) {
@@ -214,6 +276,14 @@ static inline void sdssetalloc(sds s, size_t newlen) {
     }
 }
 
+/* addb
+ * implementer: totorody (kem2182@yonsei.ac.kr)
+ * sds with location header API
+ */
+sds sdsnewlenloc(const void *init, size_t initlen, size_t location);
+sds sdsnewloc(const char *init, size_t location);
+sds sdsduploc(const sds s);
+
 sds sdsnewlen(const void *init, size_t initlen);
 sds sdsnew(const char *init);
 sds sdsempty(void);
@@ -241,6 +311,8 @@ void sdsupdatelen(sds s);
 void sdsclear(sds s);
 int sdscmp(const sds s1, const sds s2);
 sds *sdssplitlen(const char *s, int len, const char *sep, int seplen, int *count);
+/* ADDB sds tokenizer */
+sds *sdssplit(const sds s, const char *sep, int *count);
 void sdsfreesplitres(sds *tokens, int count);
 void sdstolower(sds s);
 void sdstoupper(sds s);
@@ -0,0 +1,670 @@
+/*
+ * addb_coordinator.c
+ *
+ * ADDB table-wide scans and aggregates, coordinated on a cluster.
+ *
+ * DESIGN
+ * ------
+ *
+ * The data keys of a partition are hash tagged as "D:{table:partition}", so
+ * the partitions of a table are spread over every master of a cluster and a
+ * client scanning a table used to ask METAKEYS and FPSCAN of every node.
+ *
+ * FPTABLESCAN and FPTABLEAGG work on a whole table. Every node runs them on
+ * the partitions of the slots it serves, pruned by the partition index with
+ * the FILTER statements. With cluster_coordinator enabled, the node a
+ * client asks becomes the coordinator of the command:
+ *  - It runs its own part, then sends the command with LOCAL to every
+ *    other master, pipelined over one pooled non blocking connection per
+ *    node (the hiredis async API on the event loop, as Sentinel links).
+ *  - The client is blocked (BLOCKED_COORDINATOR) until every node replied,
+ *    or cluster_coordinator_timeout milliseconds elapsed.
+ *  - A scan replies one array of values per node, streamed to the client
+ *    as every node replies. An error takes the place of a node which
+ *    failed.
+ *  - Aggregates are computed by every node, the coordinator only merges
+ *    the partial count, sum, min and max of every group.
+ *
+ * A node never coordinates a command with LOCAL, so a command is sent to a
+ * node at most once and coordinators do not wait for each other.
+ */
+
+#include "server.h"
+#include "cluster.h"
+#include "addb_relational.h"
+#include "hiredis.h"
+#include "async.h"
+
+/* Defined in sentinel.c */
+int redisAeAttach(aeEventLoop *loop, redisAsyncContext *ac);
+
+uint64_t dictSdsHash(const void *key);
+int dictSdsKeyCompare(void *privdata, const void *key1, const void *key2);
+void dictSdsDestructor(void *privdata, void *val);
+
+typedef struct tableAggregateGroup {
+    long long count;        /* Rows with a numeric value */
+    long double sum;
+    long double min;
+    long double max;
+} tableAggregateGroup;
+
+typedef struct tableAggregate {
+    dict *groups;           /* Group value -> tableAggregateGroup */
+    int grouped;            /* If the rows are grouped by a column */
+    int column;             /* Column of the next scanned value */
+    int numeric;            /* If 'value' is a number */
+    long double value;      /* Aggregated column of the current row */
+    sds lookup;             /* Group of the current row */
+} tableAggregate;
+
+typedef struct coordinatorRequest {
+    client *c;              /* NULL once the client was unblocked */
+    int pending;            /* Nodes which did not reply yet */
+    tableAggregate *agg;    /* NULL for a scan */
+    sds err;                /* First node error of an aggregate */
+} coordinatorRequest;
+
+/* "ip:port" -> redisAsyncContext, the key is the data of the context */
+static dict *coordinatorLinks = NULL;
+
+static void _dictGroupDestructor(void *privdata, void *val) {
+    DICT_NOTUSED(privdata);
+    zfree(val);
+}
+
+static dictType tableAggregateDictType = {
+    dictSdsHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    dictSdsKeyCompare,          /* key compare */
+    dictSdsDestructor,          /* key destructor */
+    _dictGroupDestructor        /* val destructor */
+};
+
+/* Links */
+
+/* Forget a link, the replies it still has to run use its host and port
+ * only. */
+static void _linkClosed(const redisAsyncContext *ac) {
+    dictDelete(coordinatorLinks, ac->data);
+}
+
+static void _linkConnected(const redisAsyncContext *ac, int status) {
+    if (status == REDIS_OK) return;
+    serverLog(LL_WARNING, "[COORDINATOR] Can't connect to %s: %s",
+              (char *) ac->data, ac->errstr);
+    _linkClosed(ac);
+}
+
+static void _linkDisconnected(const redisAsyncContext *ac, int status) {
+    if (status != REDIS_OK)
+        serverLog(LL_WARNING, "[COORDINATOR] Lost link to %s: %s",
+                  (char *) ac->data, ac->errstr);
+    _linkClosed(ac);
+}
+
+/* A failed AUTH is only logged, the commands sent after it fail with
+ * -NOAUTH and are reported by their own callbacks. */
+static void _linkAuthReply(redisAsyncContext *ac, void *r, void *privdata) {
+    redisReply *reply = r;
+    UNUSED(privdata);
+
+    if (reply && reply->type == REDIS_REPLY_ERROR)
+        serverLog(LL_WARNING, "[COORDINATOR] Can't AUTH to %s: %s",
+                  (char *) ac->data, reply->str);
+}
+
+/* Return the pooled link to 'ip':'port', connecting it if needed, or NULL
+ * if the connection can't be started. The links are shared with the
+ * partition migrations of addb_migrate.c. Like the RocksDB sync of the
+ * slaves, a new link is authenticated with masterauth, the password of
+ * the other nodes. */
+redisAsyncContext *coordinatorGetLink(const char *ip, int port) {
+    sds name = sdscatprintf(sdsempty(), "%s:%d", ip, port);
+    redisAsyncContext *ac;
+
+    if (coordinatorLinks == NULL)
+        coordinatorLinks = dictCreate(&migrateCacheDictType, NULL);
+    if ((ac = dictFetchValue(coordinatorLinks, name)) != NULL) {
+        sdsfree(name);
+        return ac;
+    }
+
+    ac = redisAsyncConnectBind(ip, port, NET_FIRST_BIND_ADDR);
+    if (ac->err) {
+        serverLog(LL_WARNING, "[COORDINATOR] Can't connect to %s: %s",
+                  name, ac->errstr);
+        redisAsyncFree(ac);
+        sdsfree(name);
+        return NULL;
+    }
+    if (redisAeAttach(server.el, ac) != C_OK) {
+        redisAsyncFree(ac);
+        sdsfree(name);
+        return NULL;
+    }
+    ac->data = name;
+    redisAsyncSetConnectCallback(ac, _linkConnected);
+    redisAsyncSetDisconnectCallback(ac, _linkDisconnected);
+    dictAdd(coordinatorLinks, name, ac);
+    /* Pipelined before any command of the link. */
+    if (server.masterauth)
+        redisAsyncCommand(ac, _linkAuthReply, NULL, "AUTH %s",
+                          server.masterauth);
+    return ac;
+}
+
+/* Aggregates */
+
+static tableAggregate *_createAggregate(int grouped) {
+    tableAggregate *agg = zmalloc(sizeof(*agg));
+
+    agg->groups = dictCreate(&tableAggregateDictType, NULL);
+    agg->grouped = grouped;
+    agg->column = 0;
+    agg->numeric = 0;
+    agg->value = 0;
+    agg->lookup = sdsempty();
+    return agg;
+}
+
+static void _freeAggregate(tableAggregate *agg) {
+    dictRelease(agg->groups);
+    sdsfree(agg->lookup);
+    zfree(agg);
+}
+
+static void _aggregateAdd(tableAggregate *agg, const char *group, size_t len,
+                          long long count, long double sum, long double min,
+                          long double max) {
+    tableAggregateGroup *g;
+
+    agg->lookup = sdscpylen(agg->lookup, group, len);
+    if ((g = dictFetchValue(agg->groups, agg->lookup)) == NULL) {
+        g = zmalloc(sizeof(*g));
+        g->count = count;
+        g->sum = sum;
+        g->min = min;
+        g->max = max;
+        dictAdd(agg->groups, sdsdup(agg->lookup), g);
+        return;
+    }
+    g->count += count;
+    g->sum += sum;
+    if (min < g->min) g->min = min;
+    if (max > g->max) g->max = max;
+}
+
+/* scanValueProc of a local aggregate: the rows are scanned as the
+ * aggregated column, followed by the group column if any. Values which
+ * are not numbers are left out. */
+static void _aggregateValue(void *privdata, const char *value, size_t len) {
+    tableAggregate *agg = privdata;
+
+    if (agg->column == 0) {
+        agg->numeric = string2ld(value, len, &agg->value);
+        if (agg->numeric && !agg->grouped)
+            _aggregateAdd(agg, "", 0, 1, agg->value, agg->value, agg->value);
+    } else if (agg->numeric) {
+        _aggregateAdd(agg, value, len, 1, agg->value, agg->value, agg->value);
+    }
+    if (agg->grouped) agg->column = !agg->column;
+}
+
+/* Merge the FPTABLEAGG reply of a node. Returns C_ERR if it is not one. */
+static int _mergeAggregate(tableAggregate *agg, redisReply *reply) {
+    if (reply->type != REDIS_REPLY_ARRAY) return C_ERR;
+    for (size_t i = 0; i < reply->elements; i++) {
+        redisReply *g = reply->element[i], **e;
+        long double sum, min, max;
+
+        if (g->type != REDIS_REPLY_ARRAY || g->elements != 5) return C_ERR;
+        e = g->element;
+        if ((e[0]->type != REDIS_REPLY_STRING &&
+             e[0]->type != REDIS_REPLY_NIL) ||
+            e[1]->type != REDIS_REPLY_INTEGER ||
+            e[2]->type != REDIS_REPLY_STRING ||
+            e[3]->type != REDIS_REPLY_STRING ||
+            e[4]->type != REDIS_REPLY_STRING ||
+            !string2ld(e[2]->str, e[2]->len, &sum) ||
+            !string2ld(e[3]->str, e[3]->len, &min) ||
+            !string2ld(e[4]->str, e[4]->len, &max))
+            return C_ERR;
+        if (e[0]->type == REDIS_REPLY_NIL)
+            _aggregateAdd(agg, "", 0, e[1]->integer, sum, min, max);
+        else
+            _aggregateAdd(agg, e[0]->str, e[0]->len, e[1]->integer, sum, min,
+                          max);
+    }
+    return C_OK;
+}
+
+static void _addReplyLongDouble(client *c, long double value) {
+    char buf[256];
+    int len = ld2string(buf, sizeof(buf), value, 1);
+
+    addReplyBulkCBuffer(c, buf, len);
+}
+
+static void _addReplyAggregate(client *c, tableAggregate *agg) {
+    dictIterator *di = dictGetIterator(agg->groups);
+    dictEntry *de;
+
+    addReplyMultiBulkLen(c, dictSize(agg->groups));
+    while ((de = dictNext(di)) != NULL) {
+        sds group = dictGetKey(de);
+        tableAggregateGroup *g = dictGetVal(de);
+
+        addReplyMultiBulkLen(c, 5);
+        if (agg->grouped)
+            addReplyBulkCBuffer(c, group, sdslen(group));
+        else
+            addReply(c, shared.nullbulk);
+        addReplyLongLong(c, g->count);
+        _addReplyLongDouble(c, g->sum);
+        _addReplyLongDouble(c, g->min);
+        _addReplyLongDouble(c, g->max);
+    }
+    dictReleaseIterator(di);
+}
+
+/* Local part */
+
+/* The master of the partitions of this node. */
+static clusterNode *_self(void) {
+    return nodeIsSlave(server.cluster->myself) ?
+           server.cluster->myself->slaveof : server.cluster->myself;
+}
+
+/* Return 1 if this node serves the partitions of 'slot'. The partitions of
+ * a slot being migrated are moved one at a time by FPMIGRATE, the node
+ * importing the slot serves those it received already. */
+static int _servesSlot(int slot) {
+    clusterNode *owner;
+
+    if (!server.cluster_enabled) return 1;
+    owner = _self();
+    return owner != NULL && (server.cluster->slots[slot] == owner ||
+                             server.cluster->importing_slots_from[slot]);
+}
+
+/* Add to 'dataKeys' the data keys of the partitions of 'tableId' served by
+ * this node which satisfy every program of 'filters'. */
+static void _localDataKeys(redisDb *db, long long tableId, Vector *filters,
+                           Vector *dataKeys) {
+    sds pattern = sdscatfmt(sdsempty(), "%s%s%s%I%s*%s",
+                            RELMODEL_META_PREFIX, RELMODEL_DELIMITER,
+                            RELMODEL_BRACE_PREFIX, tableId,
+                            RELMODEL_DELIMITER, RELMODEL_BRACE_SUFFIX);
+    Vector metakeys;
+
+    vectorTypeInit(&metakeys, STL_TYPE_SDS);
+    loadMetadictIfNeeded(db);
+    if (vectorCount(filters) == 0)
+        partitionIndexList(db, pattern, &metakeys);
+    else
+        partitionIndexFilter(db, pattern, filters, &metakeys);
+
+    for (size_t i = 0; i < vectorCount(&metakeys); ++i) {
+        sds metakey = vectorGet(&metakeys, i), dataKey;
+
+        if (!_servesSlot(keyHashSlot(metakey, sdslen(metakey)))) continue;
+        dataKey = sdsdup(metakey);
+        dataKey[0] = RELMODEL_DATA_PREFIX[0];
+        vectorAdd(dataKeys, dataKey);
+    }
+    vectorFree(&metakeys);
+    sdsfree(pattern);
+}
+
+/* Scan 'rawColumnIds' of the local partitions of 'tableId', to the client
+ * or to 'valueProc'. Returns the number of values. */
+static long _localScan(client *c, long long tableId, Vector *filters,
+                       sds rawColumnIds, scanValueProc *valueProc,
+                       void *privdata) {
+    Vector dataKeys;
+    long numreplies = 0;
+
+    vectorTypeInit(&dataKeys, STL_TYPE_SDS);
+    _localDataKeys(c->db, tableId, filters, &dataKeys);
+    for (size_t i = 0; i < vectorCount(&dataKeys); ++i) {
+        ScanParameter *scanParam = createScanParameterForKey(
+                c->db, vectorGet(&dataKeys, i), rawColumnIds);
+
+        scanParam->valueProc = valueProc;
+        scanParam->privdata = privdata;
+        populateScanParameter(c->db, scanParam);
+        numreplies += scanDataFromADDB(c, c->db, scanParam);
+        freeScanParameter(scanParam);
+    }
+    vectorFreeDeep(&dataKeys);
+    return numreplies;
+}
+
+/* Fan-out */
+
+static void _freeRequest(coordinatorRequest *req) {
+    if (req->agg) _freeAggregate(req->agg);
+    sdsfree(req->err);
+    zfree(req);
+}
+
+/* Record that the node at 'ip':'port' failed with 'err'. */
+static void _nodeError(coordinatorRequest *req, const char *ip, int port,
+                       const char *err) {
+    if (req->agg == NULL) {
+        addReplyErrorFormat(req->c, "%s:%d %s", ip, port, err);
+    } else if (req->err == NULL) {
+        req->err = sdscatprintf(sdsempty(), "%s:%d %s", ip, port, err);
+    }
+}
+
+/* Reply the merged aggregate, the parts of a scan are already replied. */
+static void _finishRequest(coordinatorRequest *req) {
+    if (req->agg == NULL) return;
+    if (req->err)
+        addReplyError(req->c, req->err);
+    else
+        _addReplyAggregate(req->c, req->agg);
+}
+
+static void _nodeReply(redisAsyncContext *ac, void *r, void *privdata) {
+    coordinatorRequest *req = privdata;
+    redisReply *reply = r;
+    const char *ip = ac->c.tcp.host;
+    int port = ac->c.tcp.port;
+
+    req->pending--;
+    if (req->c == NULL) {
+        if (req->pending == 0) _freeRequest(req);
+        return;
+    }
+
+    if (reply == NULL) {
+        _nodeError(req, ip, port, "connection lost");
+    } else if (reply->type == REDIS_REPLY_ERROR) {
+        _nodeError(req, ip, port, reply->str);
+    } else if (req->agg) {
+        if (_mergeAggregate(req->agg, reply) != C_OK)
+            _nodeError(req, ip, port, "invalid FPTABLEAGG reply");
+    } else if (reply->type != REDIS_REPLY_ARRAY) {
+        _nodeError(req, ip, port, "invalid FPTABLESCAN reply");
+    } else {
+        addReplyMultiBulkLen(req->c, reply->elements);
+        for (size_t i = 0; i < reply->elements; i++) {
+            redisReply *e = reply->element[i];
+
+            if (e->type == REDIS_REPLY_STRING)
+                addReplyBulkCBuffer(req->c, e->str, e->len);
+            else if (e->type == REDIS_REPLY_INTEGER)
+                addReplyLongLong(req->c, e->integer);
+            else
+                addReply(req->c, shared.nullbulk);
+        }
+    }
+
+    if (req->pending == 0) {
+        _finishRequest(req);
+        unblockClient(req->c);
+    }
+}
+
+static int _isTarget(clusterNode *node) {
+    return node != _self() && nodeIsMaster(node) && node->numslots > 0;
+}
+
+static int _countTargets(void) {
+    dictIterator *di = dictGetIterator(server.cluster->nodes);
+    dictEntry *de;
+    int count = 0;
+
+    while ((de = dictNext(di)) != NULL) count += _isTarget(dictGetVal(de));
+    dictReleaseIterator(di);
+    return count;
+}
+
+/* Send the command of the client of 'req' with LOCAL to every master but
+ * the one of this node. The command is formatted here, as the sds of
+ * hiredis differ from ours. */
+static void _fanOut(coordinatorRequest *req) {
+    client *c = req->c;
+    sds cmd = sdscatfmt(sdsempty(), "*%i\r\n", c->argc + 1);
+    dictIterator *di;
+    dictEntry *de;
+
+    for (int j = 0; j < c->argc; j++) {
+        sds arg = c->argv[j]->ptr;
+
+        cmd = sdscatfmt(cmd, "$%u\r\n", (unsigned) sdslen(arg));
+        cmd = sdscatlen(cmd, arg, sdslen(arg));
+        cmd = sdscatlen(cmd, "\r\n", 2);
+    }
+    cmd = sdscat(cmd, "$5\r\nLOCAL\r\n");
+
+    di = dictGetSafeIterator(server.cluster->nodes);
+    while ((de = dictNext(di)) != NULL) {
+        clusterNode *node = dictGetVal(de);
+        redisAsyncContext *ac;
+
+        if (!_isTarget(node)) continue;
+        if ((ac = coordinatorGetLink(node->ip, node->port)) == NULL ||
+            redisAsyncFormattedCommand(ac, _nodeReply, req, cmd,
+                                       sdslen(cmd)) != REDIS_OK) {
+            _nodeError(req, node->ip, node->port, "can't send the command");
+            continue;
+        }
+        req->pending++;
+    }
+    dictReleaseIterator(di);
+    sdsfree(cmd);
+}
+
+void unblockClientFromCoordinator(client *c) {
+    coordinatorRequest *req = c->bpop.coordinator_request;
+
+    c->bpop.coordinator_request = NULL;
+    req->c = NULL;
+    if (req->pending == 0) _freeRequest(req);
+}
+
+void coordinatorBlockedClientTimedOut(client *c) {
+    coordinatorRequest *req = c->bpop.coordinator_request;
+
+    if (req->agg == NULL) {
+        for (int j = 0; j < req->pending; j++)
+            addReplyError(c, "node did not reply in time");
+    } else if (req->err == NULL) {
+        req->err = sdsnew("node did not reply in time");
+    }
+    _finishRequest(req);
+}
+
+/* Run the command of 'c', of which the local part is computed by 'proc'.
+ * The other nodes are asked for their part unless the command has LOCAL. */
+static void _coordinate(client *c, int local, tableAggregate *agg,
+                        void (*proc)(client *c, coordinatorRequest *req,
+                                     void *privdata),
+                        void *privdata) {
+    coordinatorRequest *req;
+    int fanout = !local && server.cluster_enabled &&
+                 server.cluster_coordinator;
+
+    if (fanout && server.cluster->state != CLUSTER_OK) {
+        addReplySds(c, sdsnew("-CLUSTERDOWN The cluster is down\r\n"));
+        if (agg) _freeAggregate(agg);
+        return;
+    }
+    if (fanout && (c->flags & (CLIENT_MULTI|CLIENT_LUA))) {
+        addReplyErrorFormat(c,
+                "%s can't be coordinated inside MULTI or scripts, use LOCAL",
+                c->cmd->name);
+        if (agg) _freeAggregate(agg);
+        return;
+    }
+
+    req = zmalloc(sizeof(*req));
+    req->c = c;
+    req->pending = 0;
+    req->agg = agg;
+    req->err = NULL;
+
+    /* A scan replies the values of every node as soon as they are there,
+     * in one array per node. */
+    if (fanout && agg == NULL) addReplyMultiBulkLen(c, 1 + _countTargets());
+    proc(c, req, privdata);
+    if (fanout) _fanOut(req);
+
+    if (req->pending == 0) {
+        _finishRequest(req);
+        _freeRequest(req);
+        return;
+    }
+    c->bpop.timeout = mstime() + server.cluster_coordinator_timeout;
+    c->bpop.coordinator_request = req;
+    blockClient(c, BLOCKED_COORDINATOR);
+}
+
+/* Commands */
+
+typedef struct tableCommand {
+    long long tableId;
+    sds columns;            /* Scanned column ids, comma separated */
+    Vector filters;
+    int local;
+} tableCommand;
+
+/* Parse the options of FPTABLESCAN and FPTABLEAGG from 'j'. Returns C_ERR
+ * after replying to the client on error. */
+static int _parseTableCommand(client *c, int j, int groupby,
+                              tableCommand *cmd) {
+    vectorInit(&cmd->filters);
+    cmd->local = 0;
+    for (; j < c->argc; j++) {
+        char *opt = c->argv[j]->ptr;
+        int moreargs = j < c->argc - 1;
+
+        if (!strcasecmp(opt, "LOCAL")) {
+            cmd->local = 1;
+        } else if (!strcasecmp(opt, "FILTER") && moreargs &&
+                   vectorCount(&cmd->filters) == 0) {
+            vectorFree(&cmd->filters);
+            if (getPartitionFiltersOrReply(c, c->argv[++j]->ptr,
+                                           &cmd->filters) != C_OK)
+                return C_ERR;
+        } else if (groupby && !strcasecmp(opt, "GROUPBY") && moreargs &&
+                   strchr(cmd->columns, ',') == NULL) {
+            long long columnId;
+
+            if (getLongLongFromObjectOrReply(c, c->argv[++j], &columnId,
+                                             NULL) != C_OK) {
+                releasePartitionFilters(&cmd->filters);
+                return C_ERR;
+            }
+            cmd->columns = sdscatfmt(cmd->columns, "%s%I",
+                                     RELMODEL_COLUMN_DELIMITER, columnId);
+        } else {
+            addReply(c, shared.syntaxerr);
+            releasePartitionFilters(&cmd->filters);
+            return C_ERR;
+        }
+    }
+    return C_OK;
+}
+
+static void _tableScanProc(client *c, coordinatorRequest *req,
+                           void *privdata) {
+    tableCommand *cmd = privdata;
+    void *replylen = addDeferredMultiBulkLength(c);
+
+    UNUSED(req);
+    setDeferredMultiBulkLength(c, replylen,
+            _localScan(c, cmd->tableId, &cmd->filters, cmd->columns, NULL,
+                       NULL));
+}
+
+static void _tableAggProc(client *c, coordinatorRequest *req,
+                          void *privdata) {
+    tableCommand *cmd = privdata;
+
+    _localScan(c, cmd->tableId, &cmd->filters, cmd->columns, _aggregateValue,
+               req->agg);
+}
+
+/*
+ * fpTableScanCommand
+ *  Scan columns of every partition of a table, as FPSCAN does for one
+ *  partition. With the cluster coordinator enabled the values of every
+ *  node are replied in an array per node, this node first.
+ * --- Parameters ---
+ *  arg1: tableId
+ *  arg2: Column IDs to find
+ *  FILTER statements: METAKEYS statements the partitions must satisfy
+ *  LOCAL: only the partitions of this node, in a single array
+ *
+ * --- Usage Examples ---
+ *  Command:
+ *      redis-cli> FPTABLESCAN 100 1,2 FILTER 3*2*EqualTo:$
+ *  Results:
+ *      redis-cli> 1) 1) "20180509"         // this node
+ *                    2) "Do young Kim"
+ *                    3) ...
+ *                 2) 1) "20180510"         // another master
+ *                    2) ...
+ */
+void fpTableScanCommand(client *c) {
+    tableCommand cmd;
+
+    if (getLongLongFromObjectOrReply(c, c->argv[1], &cmd.tableId,
+                                     NULL) != C_OK)
+        return;
+    cmd.columns = sdsdup(c->argv[2]->ptr);
+    if (_parseTableCommand(c, 3, 0, &cmd) == C_OK) {
+        _coordinate(c, cmd.local, NULL, _tableScanProc, &cmd);
+        releasePartitionFilters(&cmd.filters);
+    }
+    sdsfree(cmd.columns);
+}
+
+/*
+ * fpTableAggCommand
+ *  Count, sum, min and max of the numeric values of a column of every
+ *  partition of a table, grouped by another column. With the cluster
+ *  coordinator enabled every node aggregates its partitions, the partial
+ *  aggregates are merged.
+ * --- Parameters ---
+ *  arg1: tableId
+ *  arg2: Column ID to aggregate
+ *  GROUPBY columnId: column of the groups, one group (nil) without it
+ *  FILTER statements: METAKEYS statements the partitions must satisfy
+ *  LOCAL: only the partitions of this node
+ *
+ * --- Usage Examples ---
+ *  Command:
+ *      redis-cli> FPTABLEAGG 100 3 GROUPBY 2
+ *  Results:
+ *      redis-cli> 1) 1) "Yonsei Univ"  // group
+ *                    2) (integer) 2    // count
+ *                    3) "41"           // sum
+ *                    4) "20"           // min
+ *                    5) "21"           // max
+ *      redis-cli> ...
+ */
+void fpTableAggCommand(client *c) {
+    tableCommand cmd;
+    long long columnId;
+    tableAggregate *agg;
+
+    if (getLongLongFromObjectOrReply(c, c->argv[1], &cmd.tableId,
+                                     NULL) != C_OK ||
+        getLongLongFromObjectOrReply(c, c->argv[2], &columnId,
+                                     NULL) != C_OK)
+        return;
+    cmd.columns = sdsfromlonglong(columnId);
+    if (_parseTableCommand(c, 3, 1, &cmd) == C_OK) {
+        agg = _createAggregate(strchr(cmd.columns, ',') != NULL);
+        _coordinate(c, cmd.local, agg, _tableAggProc, &cmd);
+        releasePartitionFilters(&cmd.filters);
+    }
+    sdsfree(cmd.columns);
+}
@@ -0,0 +1,706 @@
+/*
+ * addb_migrate.c
+ *
+ * ADDB migration of the relational partitions of a cluster slot.
+ *
+ * DESIGN
+ * ------
+ *
+ * MIGRATE moves the keys of a slot as DUMP payloads of in-memory objects,
+ * but a relational partition is more than its keys: its Metadict entry
+ * lives beside the keyspace, and its tiered rowgroups only live in
+ * RocksDB, as column vectors in the column family of the table and as row
+ * counts in the META column family. FPMIGRATE moves every partition of a
+ * slot to another node, one partition after the other, in the background:
+ *  - The target first drops what a failed attempt may have left of the
+ *    partition (FPRESTORE RESET).
+ *  - The column vectors of the partition are streamed from a RocksDB
+ *    iterator in FPRESTORE TIERED chunks of about
+ *    PARTITION_MIGRATION_CHUNK_BYTES, up to PARTITION_MIGRATION_WINDOW
+ *    commands in flight over the pooled link of addb_coordinator.c, which
+ *    is authenticated with masterauth. The target ingests every chunk as
+ *    an SST file (tiering_sst_ingest) or writes it in a WriteBatch. The
+ *    iterator reads a snapshot, so the partition keeps being written and
+ *    tiered meanwhile.
+ *  - Once the snapshot is sent, the rest of the partition is sent at once
+ *    from the event loop: the row counts of the rowgroups of the snapshot
+ *    (FPRESTORE META), the rowgroups in memory and those tiered after the
+ *    snapshot (FPRESTORE ROWGROUP), and last the Metadict entry
+ *    (FPMETALOAD) which makes the partition visible on the target.
+ *  - Until the target acknowledged all of it, writes to the partition are
+ *    refused with -TRYAGAIN. Then the partition is dropped here, as by an
+ *    FPDROP which is propagated to the AOF and the replicas.
+ *
+ * With the slot MIGRATING, the commands about a partition already moved
+ * are redirected to the target with -ASK, as the commands about missing
+ * keys are. An error, or no reply of the target for 'timeout'
+ * milliseconds, stops the migration: the partition being moved stays here
+ * and is sent again by the next FPMIGRATE.
+ */
+
+#include "server.h"
+#include "cluster.h"
+#include "addb_relational.h"
+#include "intset.h"
+#include "hiredis.h"
+#include "async.h"
+
+#define PARTITION_MIGRATION_CHUNK_BYTES (1024*1024)
+#define PARTITION_MIGRATION_WINDOW 4
+
+/* Defined in addb_coordinator.c */
+redisAsyncContext *coordinatorGetLink(const char *ip, int port);
+
+typedef struct partitionMigration {
+    client *c;              /* NULL once the client was unblocked */
+    redisDb *db;
+    sds host;
+    int port;
+    long long timeout;      /* Milliseconds without a reply of the target */
+    mstime_t lastReply;
+    Vector metaKeys;        /* Partitions of the slot */
+    size_t next;            /* Partition following the one being moved */
+    NewDataKeyInfo *info;   /* Partition being moved, NULL between two */
+    sds metaKey;            /* Its Metadict key, owned by 'metaKeys' */
+    sds dataKey;            /* "D:{table:partition}" */
+    sds prefix;             /* RocksDB prefix of its column vectors */
+    rocksdb_iterator_t *it; /* Column vectors left to send, NULL once sent */
+    intset *tiered;         /* Rowgroups of the snapshot */
+    int locked;             /* Rest of the partition sent, writes refused */
+    int gone;               /* The partition was dropped meanwhile */
+    int pending;            /* Commands without a reply */
+    int aborted;
+    long long moved;        /* Partitions moved */
+} partitionMigration;
+
+/* At most one migration runs at a time. */
+static partitionMigration *migration = NULL;
+
+static void _continue(partitionMigration *m);
+
+static sds _catBulk(sds cmd, const char *p, size_t len) {
+    cmd = sdscatfmt(cmd, "$%u\r\n", (unsigned) len);
+    cmd = sdscatlen(cmd, p, len);
+    return sdscatlen(cmd, "\r\n", 2);
+}
+
+static sds _catBulkLongLong(sds cmd, long long value) {
+    char buf[LONG_STR_SIZE];
+    int len = ll2string(buf, sizeof(buf), value);
+
+    return _catBulk(cmd, buf, len);
+}
+
+/* Return the FPRESTORE 'sub' command of the partition being moved, with the
+ * 'argc' arguments formatted in 'args', which is freed. */
+static sds _restoreCommand(partitionMigration *m, const char *sub, sds args,
+                           int argc) {
+    sds cmd = sdscatfmt(sdsempty(), "*%i\r\n", argc + 3);
+
+    cmd = _catBulk(cmd, "FPRESTORE", 9);
+    cmd = _catBulk(cmd, m->dataKey, sdslen(m->dataKey));
+    cmd = _catBulk(cmd, sub, strlen(sub));
+    cmd = sdscatsds(cmd, args);
+    sdsfree(args);
+    return cmd;
+}
+
+/* Partition state */
+
+static void _stopPartition(partitionMigration *m) {
+    if (m->it) rocksdb_iter_destroy(m->it);
+    m->it = NULL;
+    zfree(m->info);
+    m->info = NULL;
+    m->metaKey = NULL;
+    sdsfree(m->dataKey);
+    m->dataKey = NULL;
+    sdsfree(m->prefix);
+    m->prefix = NULL;
+    zfree(m->tiered);
+    m->tiered = NULL;
+    m->locked = 0;
+    m->gone = 0;
+}
+
+static void _free(partitionMigration *m) {
+    _stopPartition(m);
+    vectorFreeDeep(&m->metaKeys);
+    sdsfree(m->host);
+    zfree(m);
+}
+
+/* Stop the migration after 'err'. The commands in flight still call back,
+ * the migration is freed after the last one. */
+static void _abort(partitionMigration *m, const char *err) {
+    if (m->aborted) return;
+    m->aborted = 1;
+    if (migration == m) migration = NULL;
+    if (m->dataKey) {
+        serverLog(LL_WARNING, "[FPMIGRATE] Moving %s to %s:%d failed: %s",
+                  m->dataKey, m->host, m->port, err);
+    }
+    if (m->c) {
+        addReplyErrorFormat(m->c, "[FPMIGRATE] %s:%d %s", m->host, m->port,
+                            err);
+        unblockClient(m->c);
+    }
+    if (m->it) rocksdb_iter_destroy(m->it);
+    m->it = NULL;
+    if (m->pending == 0) _free(m);
+}
+
+static void _reply(redisAsyncContext *ac, void *r, void *privdata) {
+    partitionMigration *m = privdata;
+    redisReply *reply = r;
+
+    UNUSED(ac);
+    m->pending--;
+    if (m->aborted) {
+        if (m->pending == 0) _free(m);
+        return;
+    }
+    if (reply == NULL) {
+        _abort(m, "connection lost");
+    } else if (reply->type == REDIS_REPLY_ERROR) {
+        _abort(m, reply->str);
+    } else {
+        m->lastReply = mstime();
+        _continue(m);
+    }
+}
+
+/* Send 'cmd' to the target and free it. Returns C_ERR if the migration was
+ * aborted, 'm' must not be used then. The AUTH of a new link is pipelined
+ * before 'cmd' by coordinatorGetLink(), a -NOAUTH aborts the migration. */
+static int _send(partitionMigration *m, sds cmd) {
+    redisAsyncContext *ac = coordinatorGetLink(m->host, m->port);
+    int sent = ac != NULL &&
+               redisAsyncFormattedCommand(ac, _reply, m, cmd,
+                                          sdslen(cmd)) == REDIS_OK;
+
+    sdsfree(cmd);
+    if (!sent) {
+        _abort(m, "can't send the partition");
+        return C_ERR;
+    }
+    m->pending++;
+    return C_OK;
+}
+
+/* Start moving the next partition of the slot, unless it was dropped since
+ * the migration started. */
+static int _startPartition(partitionMigration *m) {
+    sds metaKey = vectorGet(&m->metaKeys, m->next++);
+    persistent_store_t *ps = m->db->persistent_store;
+    const char *partition;
+
+    if (lookupSDSKeyForMetadict(m->db, metaKey) == NULL ||
+        (m->info = parsingDataKeyInfo(metaKey)) == NULL)
+        return C_OK;
+
+    partition = m->info->partitionInfo.partitionString;
+    m->metaKey = metaKey;
+    m->dataKey = sdsdup(metaKey);
+    m->dataKey[0] = RELMODEL_DATA_PREFIX[0];
+    m->prefix = persistentStorePartitionPrefix(m->info->tableId, partition,
+                                               strlen(partition));
+    m->tiered = intsetNew();
+    m->it = createPersistentStorePrefixIterator(ps, m->prefix,
+                                                sdslen(m->prefix));
+    return _send(m, _restoreCommand(m, "RESET", sdsempty(), 0));
+}
+
+static int _iterInPrefix(partitionMigration *m) {
+    size_t keylen;
+    const char *key;
+
+    if (!rocksdb_iter_valid(m->it)) return 0;
+    key = rocksdb_iter_key(m->it, &keylen);
+    return keylen >= sdslen(m->prefix) &&
+           memcmp(key, m->prefix, sdslen(m->prefix)) == 0;
+}
+
+/* Send the next chunk of column vectors of the snapshot. */
+static int _sendTieredChunk(partitionMigration *m) {
+    sds args = sdsempty();
+    int argc = 0;
+
+    while (_iterInPrefix(m) && sdslen(args) < PARTITION_MIGRATION_CHUNK_BYTES) {
+        size_t keylen, vallen;
+        const char *key = rocksdb_iter_key(m->it, &keylen);
+        const char *val = rocksdb_iter_value(m->it, &vallen);
+
+        if (keylen == PERSISTENT_STORE_KEY_LEN) {
+            m->tiered = intsetAdd(m->tiered,
+                persistentStoreKeyRowGroupId(key, keylen), NULL);
+        }
+        args = _catBulk(args, key, keylen);
+        args = _catBulk(args, val, vallen);
+        argc += 2;
+        rocksdb_iter_next(m->it);
+    }
+    if (!_iterInPrefix(m)) {
+        rocksdb_iter_destroy(m->it);
+        m->it = NULL;
+    }
+    if (argc == 0) {
+        sdsfree(args);
+        return C_OK;
+    }
+    return _send(m, _restoreCommand(m, "TIERED", args, argc));
+}
+
+static int _sendRowGroup(partitionMigration *m, int rowGroupId, robj *o,
+                         int location) {
+    dictIterator *di = dictGetIterator(o->ptr);
+    dictEntry *de;
+    sds args = sdsempty();
+    int argc = 2;
+
+    args = _catBulkLongLong(args, rowGroupId);
+    args = _catBulkLongLong(args, location);
+    while ((de = dictNext(di)) != NULL) {
+        sds field = dictGetKey(de);
+        Vector *v = ((robj *) dictGetVal(de))->ptr;
+
+        args = _catBulk(args, field, sdslen(field));
+        args = _catBulkLongLong(args, v->count);
+        for (size_t j = 0; j < v->count; j++) {
+            sds value = v->data[j];
+            args = _catBulk(args, value, sdslen(value));
+        }
+        argc += 2 + v->count;
+    }
+    dictReleaseIterator(di);
+    return _send(m, _restoreCommand(m, "ROWGROUP", args, argc));
+}
+
+/* Send the rowgroup 'rowGroupId' unless it is in the snapshot already and
+ * not in memory. A rowgroup tiered after the snapshot was taken is read
+ * back from RocksDB, it may be partially in memory, and is sent to be
+ * tiered again by the target. */
+static int _sendRowGroupIfNeeded(partitionMigration *m, int rowGroupId) {
+    robj *dataKey, *o, *loaded = NULL;
+    dictEntry *de;
+    int ret = C_OK;
+
+    m->info->rowGroupId = rowGroupId;
+    dataKey = generateDataKey(m->info);
+    de = dictFind(m->db->dict, dataKey->ptr);
+    o = de ? dictGetVal(de) : NULL;
+
+    if (intsetFind(m->tiered, rowGroupId)) {
+        if (o) ret = _sendRowGroup(m, rowGroupId, o, LOCATION_PERSISTED);
+    } else {
+        if (o == NULL || objGetLocation(o) == LOCATION_PERSISTED)
+            loaded = loadRowGroupFromRocksDB(m->db, dataKey->ptr);
+        if (loaded) o = loaded;
+        if (o) ret = _sendRowGroup(m, rowGroupId, o, LOCATION_REDIS_ONLY);
+        if (loaded) decrRefCount(loaded);
+    }
+    decrRefCount(dataKey);
+    return ret;
+}
+
+/* Send what the snapshot misses of the partition, then its Metadict
+ * entry. The writes to the partition are refused from now on. */
+static int _sendPartition(partitionMigration *m) {
+    persistent_store_t *ps = m->db->persistent_store;
+    robj *meta = lookupSDSKeyForMetadict(m->db, m->metaKey);
+    hashTypeIterator *hi;
+    sds args;
+    int argc = 0, rowGroupCount;
+
+    m->locked = 1;
+    if (meta == NULL) {
+        m->gone = 1;
+        return _send(m, _restoreCommand(m, "RESET", sdsempty(), 0));
+    }
+
+    rowGroupCount = getRowGroupInfoAndSetRowGroupInfo(m->db, m->info);
+    args = sdsempty();
+    for (int i = 1; i <= rowGroupCount; i++) {
+        uint32_t rowCount;
+
+        if (!intsetFind(m->tiered, i) ||
+            !getPersistentStoreRowGroupMeta(ps, m->metaKey,
+                                            sdslen(m->metaKey), i, &rowCount))
+            continue;
+        args = _catBulkLongLong(args, i);
+        args = _catBulkLongLong(args, rowCount);
+        argc += 2;
+    }
+    if (argc && _send(m, _restoreCommand(m, "META", args, argc)) == C_ERR)
+        return C_ERR;
+    if (argc == 0) sdsfree(args);
+
+    for (int i = 1; i <= rowGroupCount; i++) {
+        if (_sendRowGroupIfNeeded(m, i) == C_ERR) return C_ERR;
+    }
+
+    args = sdsempty();
+    argc = 0;
+    hi = hashTypeInitIterator(meta);
+    while (hashTypeNext(hi) != C_ERR) {
+        sds field = hashTypeCurrentObjectNewSds(hi, OBJ_HASH_KEY);
+        sds value = hashTypeCurrentObjectNewSds(hi, OBJ_HASH_VALUE);
+
+        args = _catBulk(args, field, sdslen(field));
+        args = _catBulk(args, value, sdslen(value));
+        argc += 2;
+        sdsfree(field);
+        sdsfree(value);
+    }
+    hashTypeReleaseIterator(hi);
+    args = sdscatsds(_catBulk(_catBulk(sdscatfmt(sdsempty(), "*%i\r\n",
+                                                 argc + 2),
+                                       "FPMETALOAD", 10),
+                              m->metaKey, sdslen(m->metaKey)),
+                     args);
+    return _send(m, args);
+}
+
+/* The target has the whole partition, drop it here. */
+static int _finishPartition(partitionMigration *m) {
+    robj *argv[2];
+    sds err = NULL;
+
+    if (dropPartition(m->db, m->info, &err) == -1) {
+        _abort(m, err);
+        sdsfree(err);
+        return C_ERR;
+    }
+    argv[0] = createStringObject("FPDROP", 6);
+    argv[1] = createStringObject(m->dataKey, sdslen(m->dataKey));
+    propagate(lookupCommandByCString("fpdrop"), m->db->id, argv, 2,
+              PROPAGATE_AOF|PROPAGATE_REPL);
+    decrRefCount(argv[0]);
+    decrRefCount(argv[1]);
+    server.dirty++;
+
+    if (!m->gone) {
+        m->moved++;
+        serverLog(LL_VERBOSE, "[FPMIGRATE] %s moved to %s:%d", m->dataKey,
+                  m->host, m->port);
+    }
+    _stopPartition(m);
+    return C_OK;
+}
+
+static void _complete(partitionMigration *m) {
+    serverLog(LL_NOTICE, "[FPMIGRATE] %lld partitions moved to %s:%d",
+              m->moved, m->host, m->port);
+    if (m->c) {
+        addReplyLongLong(m->c, m->moved);
+        unblockClient(m->c);
+    }
+    migration = NULL;
+    _free(m);
+}
+
+/* Send what can be sent, called whenever the target replied. */
+static void _continue(partitionMigration *m) {
+    while (1) {
+        if (m->locked) {
+            if (m->pending) return;
+            if (_finishPartition(m) == C_ERR) return;
+        }
+        if (m->info == NULL) {
+            if (m->next == vectorCount(&m->metaKeys)) {
+                _complete(m);
+                return;
+            }
+            if (_startPartition(m) == C_ERR) return;
+            continue;
+        }
+        while (m->it && m->pending < PARTITION_MIGRATION_WINDOW) {
+            if (_sendTieredChunk(m) == C_ERR) return;
+        }
+        if (m->it || m->pending) return;
+        if (_sendPartition(m) == C_ERR) return;
+    }
+}
+
+/* Hooks */
+
+void unblockClientFromPartitionMigration(client *c) {
+    partitionMigration *m = c->bpop.partition_migration;
+
+    c->bpop.partition_migration = NULL;
+    if (m) m->c = NULL;
+}
+
+/* Stop the migration if it reads the table 'tableId', any table if -1,
+ * which is about to be dropped. */
+void abortPartitionMigration(int tableId, const char *reason) {
+    if (migration == NULL || (tableId != -1 && (migration->info == NULL ||
+                                                migration->info->tableId != tableId)))
+        return;
+    _abort(migration, reason);
+}
+
+/* Called by clusterCron(). */
+void partitionMigrationCron(void) {
+    if (migration && mstime() - migration->lastReply > migration->timeout)
+        _abort(migration, "target did not reply in time");
+}
+
+/* Return 1 if writes to 'key' must wait for the partition it belongs to
+ * being handed over to the target. */
+int isPartitionMigrating(sds key) {
+    size_t len;
+
+    if (migration == NULL || !migration->locked) return 0;
+    len = sdslen(migration->dataKey);
+    return sdslen(key) >= len &&
+           memcmp(key + 1, migration->dataKey + 1, len - 1) == 0 &&
+           (sdslen(key) == len || key[len] == ':');
+}
+
+/* Return 1 if 'key' is a data key "D:{table:partition}..." of a partition
+ * of 'db', as the keys of tiered rowgroups and partitions are not in the
+ * keyspace. */
+int partitionKeyExists(redisDb *db, sds key) {
+    char *close;
+    sds metaKey;
+    int found;
+
+    if (sdslen(key) < 4 || key[0] != RELMODEL_DATA_PREFIX[0] ||
+        memcmp(key + 1, RELMODEL_DELIMITER RELMODEL_BRACE_PREFIX, 2) != 0 ||
+        (close = memchr(key, '}', sdslen(key))) == NULL)
+        return 0;
+    metaKey = sdsnewlen(key, close - key + 1);
+    metaKey[0] = RELMODEL_META_PREFIX[0];
+    found = lookupSDSKeyForMetadict(db, metaKey) != NULL;
+    sdsfree(metaKey);
+    return found;
+}
+
+/* Commands */
+
+/*
+ * fpMigrateCommand
+ *  Move every relational partition of a slot to another node: the
+ *  Metadict entries, the rowgroups in memory and the tiered rowgroups
+ *  stored in RocksDB. The partitions are dropped here once the target has
+ *  them. Meant to be called with the slot MIGRATING, before moving the
+ *  other keys of the slot with MIGRATE.
+ * --- Parameters ---
+ *  arg1: host of the target
+ *  arg2: port of the target
+ *  arg3: slot
+ *  arg4: timeout, milliseconds without a reply of the target
+ *
+ * --- Usage Examples ---
+ *  Command:
+ *      redis-cli> FPMIGRATE 127.0.0.1 30002 2417 60000
+ *  Results:
+ *      redis-cli> (integer) 3      // partitions moved
+ */
+void fpMigrateCommand(client *c) {
+    long long port, slot, timeout;
+    partitionMigration *m;
+    dictIterator *di;
+    dictEntry *de;
+
+    if (!server.cluster_enabled) {
+        addReplyError(c, "This instance has cluster support disabled");
+        return;
+    }
+    if (getLongLongFromObjectOrReply(c, c->argv[2], &port, NULL) != C_OK ||
+        getLongLongFromObjectOrReply(c, c->argv[3], &slot, NULL) != C_OK ||
+        getLongLongFromObjectOrReply(c, c->argv[4], &timeout, NULL) != C_OK)
+        return;
+    if (port <= 0 || port > 65535) {
+        addReplyError(c, "Invalid port");
+        return;
+    }
+    if (slot < 0 || slot >= CLUSTER_SLOTS) {
+        addReplyError(c, "Invalid slot");
+        return;
+    }
+    if (timeout <= 0) timeout = 1000;
+    if (c->flags & (CLIENT_MULTI|CLIENT_LUA)) {
+        addReplyError(c, "FPMIGRATE can't run inside MULTI or scripts");
+        return;
+    }
+    if (migration) {
+        addReplyError(c, "A partition migration is already running");
+        return;
+    }
+
+    m = zcalloc(sizeof(*m));
+    vectorTypeInit(&m->metaKeys, STL_TYPE_SDS);
+    loadMetadictIfNeeded(c->db);
+    di = dictGetIterator(c->db->Metadict);
+    while ((de = dictNext(di)) != NULL) {
+        sds metaKey = dictGetKey(de);
+        if (keyHashSlot(metaKey, sdslen(metaKey)) == slot)
+            vectorAdd(&m->metaKeys, sdsdup(metaKey));
+    }
+    dictReleaseIterator(di);
+    if (vectorCount(&m->metaKeys) == 0) {
+        _free(m);
+        addReplyLongLong(c, 0);
+        return;
+    }
+
+    m->c = c;
+    m->db = c->db;
+    m->host = sdsdup(c->argv[1]->ptr);
+    m->port = (int) port;
+    m->timeout = timeout;
+    m->lastReply = mstime();
+    migration = m;
+
+    c->bpop.timeout = 0;
+    c->bpop.partition_migration = m;
+    blockClient(c, BLOCKED_MIGRATION);
+    _continue(m);
+}
+
+/* Apply 'count' pairs of META arguments. */
+static int _restoreMeta(client *c, sds metaKey, robj **argv, int count,
+                        sds *err) {
+    persistent_store_t *ps = c->db->persistent_store;
+    rocksdb_writebatch_t *writeBatch = rocksdb_writebatch_create();
+    int ret;
+
+    for (int j = 0; j < count; j++) {
+        long long rowGroupId, rowCount;
+
+        if (getLongLongFromObject(argv[j*2], &rowGroupId) != C_OK ||
+            getLongLongFromObject(argv[j*2+1], &rowCount) != C_OK ||
+            rowGroupId <= 0 || rowGroupId > UINT32_MAX ||
+            rowCount < 0 || rowCount > UINT32_MAX) {
+            *err = sdsnew("invalid rowgroup metadata");
+            rocksdb_writebatch_destroy(writeBatch);
+            return C_ERR;
+        }
+        setPersistentStoreRowGroupMetaWithBatch(ps, metaKey, sdslen(metaKey),
+                                                (uint32_t) rowGroupId,
+                                                (uint32_t) rowCount,
+                                                writeBatch);
+    }
+    ret = writePersistentStoreBatch(ps, writeBatch, err) == 0 ? C_OK : C_ERR;
+    rocksdb_writebatch_destroy(writeBatch);
+    UNUSED(c);
+    return ret;
+}
+
+/* Apply the ROWGROUP arguments from 'j'. */
+static int _restoreRowGroup(client *c, NewDataKeyInfo *info, int j,
+                            sds *err) {
+    long long rowGroupId, location, count;
+    robj *dataKey;
+    int ret = C_OK;
+
+    if (getLongLongFromObject(c->argv[j], &rowGroupId) != C_OK ||
+        getLongLongFromObject(c->argv[j+1], &location) != C_OK ||
+        rowGroupId <= 0 || rowGroupId > INT_MAX ||
+        (location != LOCATION_REDIS_ONLY && location != LOCATION_PERSISTED)) {
+        *err = sdsnew("invalid rowgroup");
+        return C_ERR;
+    }
+    info->rowGroupId = (int) rowGroupId;
+    dataKey = generateDataKey(info);
+    for (j += 2; j < c->argc && ret == C_OK; j += 2 + count) {
+        if (j + 1 >= c->argc ||
+            getLongLongFromObject(c->argv[j+1], &count) != C_OK ||
+            count < 0 || count > c->argc - j - 2) {
+            *err = sdsnew("invalid column vector");
+            ret = C_ERR;
+        } else if (loadColumnVector(c->db, dataKey, (int) location,
+                                    c->argv[j]->ptr, c->argv + j + 2,
+                                    (int) count) == C_ERR) {
+            *err = sdsnew("the rowgroup holds another type");
+            ret = C_ERR;
+        }
+    }
+    decrRefCount(dataKey);
+    return ret;
+}
+
+/*
+ * fpRestoreCommand
+ *  Receive a part of a partition moved by FPMIGRATE from another node.
+ *  The Metadict entry of the partition is sent last, with FPMETALOAD.
+ * --- Parameters ---
+ *  arg1: dataKeyInfo
+ *  arg2: RESET: drop the partition, what a failed migration left of it
+ *        TIERED key value ...: tiered column vectors, RocksDB keys and
+ *            values of the partition
+ *        META rowGroupId rowCount ...: row counts of tiered rowgroups
+ *        ROWGROUP rowGroupId location field count values ...: column
+ *            vectors of a rowgroup in memory, as FPCVLOAD
+ *
+ * --- Usage Examples ---
+ *  Command:
+ *      redis-cli> FPRESTORE D:{100:1:2} META 1 500 2 500
+ *  Results:
+ *      redis-cli> OK
+ */
+void fpRestoreCommand(client *c) {
+    NewDataKeyInfo *info = parsingDataKeyInfo(c->argv[1]->ptr);
+    char *sub = c->argv[2]->ptr;
+    sds err = NULL;
+    int ret = C_OK;
+
+    if (info == NULL || info->rowGroupId != 0) {
+        addReplyErrorFormat(c, "[FPRESTORE] invalid data key: %s",
+                            (sds) c->argv[1]->ptr);
+        zfree(info);
+        return;
+    }
+
+    if (!strcasecmp(sub, "RESET") && c->argc == 3) {
+        int rowGroupCount = dropPartition(c->db, info, &err);
+        if (rowGroupCount != -1) {
+            addReplyLongLong(c, rowGroupCount);
+            server.dirty++;
+        }
+        ret = rowGroupCount == -1 ? C_ERR : C_OK;
+    } else if (!strcasecmp(sub, "TIERED") && c->argc > 3 &&
+               (c->argc - 3) % 2 == 0) {
+        const char *partition = info->partitionInfo.partitionString;
+        sds prefix = persistentStorePartitionPrefix(info->tableId, partition,
+                                                    strlen(partition));
+
+        for (int j = 3; j < c->argc && ret == C_OK; j += 2) {
+            sds key = c->argv[j]->ptr;
+            if (sdslen(key) != PERSISTENT_STORE_KEY_LEN ||
+                memcmp(key, prefix, sdslen(prefix)) != 0) {
+                err = sdsnew("column vector of another partition");
+                ret = C_ERR;
+            }
+        }
+        if (ret == C_OK)
+            ret = restoreTieredColumnVectors(c->db, info->tableId,
+                                             c->argv + 3, (c->argc - 3) / 2,
+                                             &err);
+        sdsfree(prefix);
+    } else if (!strcasecmp(sub, "META") && c->argc > 3 &&
+               (c->argc - 3) % 2 == 0) {
+        sds metaKey = sdsdup(c->argv[1]->ptr);
+
+        metaKey[0] = RELMODEL_META_PREFIX[0];
+        ret = _restoreMeta(c, metaKey, c->argv + 3, (c->argc - 3) / 2, &err);
+        sdsfree(metaKey);
+    } else if (!strcasecmp(sub, "ROWGROUP") && c->argc >= 5) {
+        ret = _restoreRowGroup(c, info, 3, &err);
+    } else {
+        addReply(c, shared.syntaxerr);
+        zfree(info);
+        return;
+    }
+
+    if (ret == C_ERR) {
+        addReplyErrorFormat(c, "[FPRESTORE] %s", err);
+        sdsfree(err);
+    } else if (strcasecmp(sub, "RESET")) {
+        addReply(c, shared.ok);
+        server.dirty++;
+    }
+    zfree(info);
+}
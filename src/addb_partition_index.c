@@ -0,0 +1,874 @@
+/*
+ * addb_partition_index.c
+ *
+ * ADDB partition index of the Metadict.
+ *
+ * DESIGN
+ * ------
+ *
+ * METAKEYS used to match every key of the Metadict against the pattern and
+ * to parse the partition info of every matching key again for each filter
+ * statement, so pruning partitions cost O(partitions) parses per query.
+ *
+ * Every DB keeps a partition index next to its Metadict, maintained when a
+ * partition is created or dropped: one table per tableId, in which every
+ * partition gets a slot and, for every partition column, a radix tree of
+ * the pre-parsed values in sorted order (longs and dates by value, strings
+ * by bytes) pointing to the intset of the slots with that value.
+ *
+ * A filter statement resolves to a bitmap of slots:
+ *  - EqualTo is a single lookup, LessThan and friends one ordered range of
+ *    the radix tree, StringContains and friends walk the string values
+ *    only, never the partitions.
+ *  - And, Or and Not are bitwise operations on the bitmaps.
+ *
+ * The result is the same as evaluateCondition() on every partition: a
+ * partition without the column of a leaf satisfies it, as well as a
+ * partition whose values of the column are of another type, so every
+ * column also keeps the bitmap of the slots where it is present, and of
+ * the slots with a long or a string value. A partition info that fails to
+ * parse satisfies no statement, it is left out of the 'valid' bitmap.
+ *
+ * TABLES
+ * ------
+ *
+ * The tables of the index are the table registry of the DB: a query
+ * scoped to a table, as "M:{100:*}", only visits that table, and every
+ * table keeps its partition, rowgroup and row counts up to date with the
+ * Metadict (the rowgroup count of a partition is its field "0", its row
+ * count the sum of the other fields), so FPTABLESTATS is O(1).
+ */
+
+#include "server.h"
+#include "addb_relational.h"
+
+#include <ctype.h>
+
+typedef struct partitionIndexColumn {
+    rax *values;            /* Encoded value -> intset of slots */
+    sds present;            /* Slots with the column */
+    sds typed[2];           /* Slots with a long / a string value */
+} partitionIndexColumn;
+
+typedef struct partitionIndexSlot {
+    sds metakey;            /* NULL if the slot is free */
+    long long rowGroups;
+    long long rows;
+} partitionIndexSlot;
+
+typedef struct partitionIndexTable {
+    rax *byKey;             /* Metakey -> slot */
+    partitionIndexSlot *slots;
+    uint32_t slotCount;     /* Slots in use or free */
+    uint32_t slotCap;
+    uint32_t *freeSlots;    /* Stack of the free slots */
+    uint32_t freeCount;
+    sds valid;              /* Slots whose partition info was parsed */
+    rax *columns;           /* Column id -> partitionIndexColumn */
+    long long rowGroups;    /* Sum of the counts of the slots */
+    long long rows;
+} partitionIndexTable;
+
+static inline int _typedIndex(int type) {
+    return type == CONDITION_CHILD_VALUE_TYPE_LONG ? 0 : 1;
+}
+
+/* Keys of the radix trees. Integers are big endian with the sign bit
+ * flipped, so the byte order of the tree is the numeric order. */
+static void _encodeInt(unsigned char *buf, int v) {
+    uint32_t u = (uint32_t) v ^ 0x80000000;
+    buf[0] = u >> 24; buf[1] = u >> 16; buf[2] = u >> 8; buf[3] = u;
+}
+
+static sds _encodeValue(int type, long l, sds s) {
+    unsigned char buf[9];
+
+    buf[0] = (unsigned char) type;
+    if (type == CONDITION_CHILD_VALUE_TYPE_LONG) {
+        uint64_t u = (uint64_t) l ^ 0x8000000000000000ULL;
+        for (int i = 0; i < 8; i++) buf[1 + i] = u >> (56 - i * 8);
+        return sdsnewlen(buf, 9);
+    }
+    return sdscatsds(sdsnewlen(buf, 1), s);
+}
+
+/* Bitmaps of the index are sds grown on demand, a slot past the end of
+ * the string is not set. */
+static sds _bitmapSet(sds bitmap, uint32_t slot) {
+    size_t byte = slot >> 3;
+
+    if (sdslen(bitmap) <= byte) bitmap = sdsgrowzero(bitmap, byte + 1);
+    bitmap[byte] |= 1 << (slot & 7);
+    return bitmap;
+}
+
+static void _bitmapClear(sds bitmap, uint32_t slot) {
+    size_t byte = slot >> 3;
+
+    if (byte < sdslen(bitmap)) bitmap[byte] &= ~(1 << (slot & 7));
+}
+
+/* Split 'metakey' = "M:{tableId:partitionInfo}". 'partitions' is only
+ * filled if the partition info parses as evaluateCondition() would parse
+ * it, '*parsed' tells. Returns C_ERR if the key isn't a metakey. */
+static int _parseMetaKey(sds metakey, int *tableId, Vector *partitions,
+                         int *parsed) {
+    const char *prefix = RELMODEL_META_PREFIX RELMODEL_DELIMITER
+                         RELMODEL_BRACE_PREFIX;
+    char partitionInfo[MAX_TMPBUF_SIZE];
+    char *p, *end;
+    size_t len;
+    long id;
+
+    if (strncmp(metakey, prefix, strlen(prefix)) != 0) return C_ERR;
+    p = metakey + strlen(prefix);
+    id = strtol(p, &end, 10);
+    if (end == p || *end != RELMODEL_DELIMITER[0]) return C_ERR;
+    *tableId = (int) id;
+
+    p = end + 1;
+    len = strcspn(p, RELMODEL_BRACE_SUFFIX);
+    *parsed = 0;
+    if (len + 1 >= MAX_TMPBUF_SIZE) return C_OK;
+    memcpy(partitionInfo, p, len);
+    partitionInfo[len] = '\0';
+    if (parsePartitions(partitionInfo, partitions) == C_ERR) {
+        _freePartitionParameters(partitions);
+        vectorInit(partitions);
+        return C_OK;
+    }
+    *parsed = 1;
+    return C_OK;
+}
+
+static partitionIndexTable *_lookupTable(redisDb *db, int tableId) {
+    unsigned char key[4];
+    void *t;
+
+    _encodeInt(key, tableId);
+    t = raxFind(db->PartitionIndex, key, sizeof(key));
+    return t == raxNotFound ? NULL : t;
+}
+
+static partitionIndexColumn *_lookupColumn(partitionIndexTable *t,
+                                           int columnId, int create) {
+    unsigned char key[4];
+    partitionIndexColumn *col;
+
+    _encodeInt(key, columnId);
+    col = raxFind(t->columns, key, sizeof(key));
+    if (col != raxNotFound) return col;
+    if (!create) return NULL;
+
+    col = zmalloc(sizeof(*col));
+    col->values = raxNew();
+    col->present = sdsempty();
+    col->typed[0] = sdsempty();
+    col->typed[1] = sdsempty();
+    raxInsert(t->columns, key, sizeof(key), col, NULL);
+    return col;
+}
+
+static void _freeColumn(partitionIndexColumn *col) {
+    raxIterator it;
+
+    raxStart(&it, col->values);
+    raxSeek(&it, "^", NULL, 0);
+    while (raxNext(&it)) zfree(it.data);
+    raxStop(&it);
+    raxFree(col->values);
+    sdsfree(col->present);
+    sdsfree(col->typed[0]);
+    sdsfree(col->typed[1]);
+    zfree(col);
+}
+
+static void _freeTable(partitionIndexTable *t) {
+    raxIterator it;
+
+    raxStart(&it, t->columns);
+    raxSeek(&it, "^", NULL, 0);
+    while (raxNext(&it)) _freeColumn(it.data);
+    raxStop(&it);
+    raxFree(t->columns);
+    raxFree(t->byKey);
+    for (uint32_t i = 0; i < t->slotCount; i++) sdsfree(t->slots[i].metakey);
+    zfree(t->slots);
+    zfree(t->freeSlots);
+    sdsfree(t->valid);
+    zfree(t);
+}
+
+/* Index or unindex 'slot' under the first value of every (column, type)
+ * of 'partitions', the only value evaluateCondition() compares. */
+static void _indexPartitions(partitionIndexTable *t, uint32_t slot,
+                             Vector *partitions, int add) {
+    for (size_t i = 0; i < vectorCount(partitions); i++) {
+        PartitionParameter *param = vectorGet(partitions, i);
+        partitionIndexColumn *col;
+        int typed = _typedIndex(param->type), seen = 0;
+        intset *is;
+        sds key;
+
+        for (size_t j = 0; j < i && !seen; j++) {
+            PartitionParameter *prev = vectorGet(partitions, j);
+            seen = prev->columnId == param->columnId &&
+                   prev->type == param->type;
+        }
+        if (seen) continue;
+
+        if ((col = _lookupColumn(t, param->columnId, add)) == NULL) continue;
+        key = _encodeValue(param->type, param->value.l, param->value.s);
+        is = raxFind(col->values, (unsigned char *) key, sdslen(key));
+        if (add) {
+            if (is == raxNotFound) is = intsetNew();
+            is = intsetAdd(is, slot, NULL);
+            raxInsert(col->values, (unsigned char *) key, sdslen(key), is,
+                      NULL);
+            col->present = _bitmapSet(col->present, slot);
+            col->typed[typed] = _bitmapSet(col->typed[typed], slot);
+        } else if (is != raxNotFound) {
+            is = intsetRemove(is, slot, NULL);
+            if (intsetLen(is) == 0) {
+                zfree(is);
+                raxRemove(col->values, (unsigned char *) key, sdslen(key),
+                          NULL);
+            } else {
+                raxInsert(col->values, (unsigned char *) key, sdslen(key),
+                          is, NULL);
+            }
+            _bitmapClear(col->present, slot);
+            _bitmapClear(col->typed[typed], slot);
+        }
+        sdsfree(key);
+    }
+}
+
+/* Find the slot of 'metakey' in the index of 'db'. */
+static partitionIndexTable *_lookupSlot(redisDb *db, sds metakey,
+                                        uint32_t *slot) {
+    const char *prefix = RELMODEL_META_PREFIX RELMODEL_DELIMITER
+                         RELMODEL_BRACE_PREFIX;
+    partitionIndexTable *t;
+    void *found;
+    char *end;
+    long tableId;
+
+    if (strncmp(metakey, prefix, strlen(prefix)) != 0) return NULL;
+    tableId = strtol(metakey + strlen(prefix), &end, 10);
+    if ((t = _lookupTable(db, (int) tableId)) == NULL ||
+        (found = raxFind(t->byKey, (unsigned char *) metakey,
+                         sdslen(metakey))) == raxNotFound)
+        return NULL;
+    *slot = (uint32_t) (uintptr_t) found;
+    return t;
+}
+
+/* Record that the field 'field' of the partition 'metakey' went from
+ * 'oldValue' to 'newValue'. Called by every update of the Metadict. */
+void partitionIndexCount(redisDb *db, sds metakey, long long field,
+                         long long oldValue, long long newValue) {
+    partitionIndexTable *t;
+    uint32_t slot;
+
+    if ((t = _lookupSlot(db, metakey, &slot)) == NULL) return;
+    if (field == 0) {
+        t->slots[slot].rowGroups += newValue - oldValue;
+        t->rowGroups += newValue - oldValue;
+    } else {
+        t->slots[slot].rows += newValue - oldValue;
+        t->rows += newValue - oldValue;
+    }
+}
+
+/* Count the fields of the Metadict entry 'o' of 'metakey'. */
+static void _countMetaFields(redisDb *db, sds metakey, robj *o) {
+    hashTypeIterator *hi;
+
+    if (o->type != OBJ_HASH) return;
+    hi = hashTypeInitIterator(o);
+    while (hashTypeNext(hi) != C_ERR) {
+        sds field = hashTypeCurrentObjectNewSds(hi, OBJ_HASH_KEY);
+        sds value = hashTypeCurrentObjectNewSds(hi, OBJ_HASH_VALUE);
+        long long f, v;
+
+        if (string2ll(field, sdslen(field), &f) &&
+            string2ll(value, sdslen(value), &v))
+            partitionIndexCount(db, metakey, f, 0, v);
+        sdsfree(field);
+        sdsfree(value);
+    }
+    hashTypeReleaseIterator(hi);
+}
+
+/* Index the partition 'metakey' just added to the Metadict of 'db' with
+ * the value 'o'. */
+void partitionIndexAdd(redisDb *db, sds metakey, robj *o) {
+    partitionIndexTable *t;
+    Vector partitions;
+    int tableId, parsed;
+    uint32_t slot;
+    unsigned char key[4];
+
+    vectorInit(&partitions);
+    if (_parseMetaKey(metakey, &tableId, &partitions, &parsed) == C_ERR)
+        return;
+
+    if ((t = _lookupTable(db, tableId)) == NULL) {
+        t = zcalloc(sizeof(*t));
+        t->byKey = raxNew();
+        t->columns = raxNew();
+        t->valid = sdsempty();
+        _encodeInt(key, tableId);
+        raxInsert(db->PartitionIndex, key, sizeof(key), t, NULL);
+    }
+    if (raxFind(t->byKey, (unsigned char *) metakey,
+                sdslen(metakey)) != raxNotFound) {
+        _freePartitionParameters(&partitions);
+        return;
+    }
+
+    if (t->freeCount) {
+        slot = t->freeSlots[--t->freeCount];
+    } else {
+        if (t->slotCount == t->slotCap) {
+            t->slotCap = t->slotCap ? t->slotCap * 2 : 16;
+            t->slots = zrealloc(t->slots,
+                                sizeof(partitionIndexSlot) * t->slotCap);
+            t->freeSlots = zrealloc(t->freeSlots,
+                                    sizeof(uint32_t) * t->slotCap);
+        }
+        slot = t->slotCount++;
+    }
+    t->slots[slot].metakey = sdsdup(metakey);
+    t->slots[slot].rowGroups = 0;
+    t->slots[slot].rows = 0;
+    raxInsert(t->byKey, (unsigned char *) metakey, sdslen(metakey),
+              (void *) (uintptr_t) slot, NULL);
+    if (parsed) {
+        t->valid = _bitmapSet(t->valid, slot);
+        _indexPartitions(t, slot, &partitions, 1);
+    }
+    _freePartitionParameters(&partitions);
+    _countMetaFields(db, metakey, o);
+}
+
+/* Unindex the partition 'metakey' dropped from the Metadict of 'db'. */
+void partitionIndexDelete(redisDb *db, sds metakey) {
+    partitionIndexTable *t;
+    Vector partitions;
+    int tableId, parsed;
+    uint32_t slot;
+    void *found;
+    unsigned char key[4];
+
+    vectorInit(&partitions);
+    if (_parseMetaKey(metakey, &tableId, &partitions, &parsed) == C_ERR ||
+        (t = _lookupTable(db, tableId)) == NULL ||
+        (found = raxFind(t->byKey, (unsigned char *) metakey,
+                         sdslen(metakey))) == raxNotFound) {
+        _freePartitionParameters(&partitions);
+        return;
+    }
+
+    slot = (uint32_t) (uintptr_t) found;
+    if (parsed) _indexPartitions(t, slot, &partitions, 0);
+    _freePartitionParameters(&partitions);
+    _bitmapClear(t->valid, slot);
+    raxRemove(t->byKey, (unsigned char *) metakey, sdslen(metakey), NULL);
+    t->rowGroups -= t->slots[slot].rowGroups;
+    t->rows -= t->slots[slot].rows;
+    sdsfree(t->slots[slot].metakey);
+    t->slots[slot].metakey = NULL;
+    t->freeSlots[t->freeCount++] = slot;
+
+    if (t->byKey->numele == 0) {
+        _encodeInt(key, tableId);
+        raxRemove(db->PartitionIndex, key, sizeof(key), NULL);
+        _freeTable(t);
+    }
+}
+
+/* Unindex every partition of the table 'tableId' of 'db'. */
+void partitionIndexDropTable(redisDb *db, int tableId) {
+    partitionIndexTable *t = _lookupTable(db, tableId);
+    unsigned char key[4];
+
+    if (t == NULL) return;
+    _encodeInt(key, tableId);
+    raxRemove(db->PartitionIndex, key, sizeof(key), NULL);
+    _freeTable(t);
+}
+
+/* Drop the partition index of 'db', when its Metadict is emptied. */
+void partitionIndexEmpty(redisDb *db) {
+    raxIterator it;
+
+    raxStart(&it, db->PartitionIndex);
+    raxSeek(&it, "^", NULL, 0);
+    while (raxNext(&it)) _freeTable(it.data);
+    raxStop(&it);
+    raxFree(db->PartitionIndex);
+    db->PartitionIndex = raxNew();
+}
+
+/* Compiled filters
+ *
+ * A statement is parsed once into a Condition tree, then compiled to a
+ * flat program in postfix order whose instructions push or combine bitmaps
+ * of slots. Every decision evaluateCondition() takes from the operator and
+ * the operand alone is taken at compile time, the operand is encoded as a
+ * key of the radix trees and the string operators get their glob pattern.
+ *
+ * Programs are cached in an LRU keyed by the statement text, holding up to
+ * 'partition_filter_cache_size' programs, so the statements a dashboard
+ * sends again skip the parser. A program is reference counted, it stays
+ * valid for the caller when evicted. */
+#define FILTER_FALSE 0      /* Push no slot */
+#define FILTER_VALID 1      /* Push every slot */
+#define FILTER_ABSENT 2     /* Push the slots without the column */
+#define FILTER_MATCH 3      /* Push the slots without a value of the type of
+                             * the operand or with a matching one */
+#define FILTER_AND 4
+#define FILTER_OR 5
+#define FILTER_NOT 6
+
+typedef struct partitionFilterInstr {
+    int code;
+    int op;                 /* Operator of FILTER_MATCH */
+    int columnId;
+    int type;               /* Type of the operand */
+    sds key;                /* Encoded operand, NULL if nothing matches */
+    sds pattern;            /* Glob of the string operators */
+} partitionFilterInstr;
+
+struct partitionFilter {
+    sds statement;
+    int refcount;
+    int len;
+    int depth;              /* Bitmaps on the stack at most */
+    partitionFilterInstr *code;
+    listNode *lru;          /* Node in the LRU, NULL if not cached */
+};
+
+static dict *filterCache;   /* Statement -> partitionFilter */
+static list *filterLru;     /* Most recently used first */
+
+static int _isStringOperator(int optype) {
+    return optype == CONDITION_OP_TYPE_STRING_CONTAINS ||
+           optype == CONDITION_OP_TYPE_STRING_ENDS_WITH ||
+           optype == CONDITION_OP_TYPE_STRING_STARTS_WITH;
+}
+
+static partitionFilterInstr *_emit(partitionFilter *f, int code) {
+    partitionFilterInstr *in;
+
+    f->code = zrealloc(f->code, sizeof(*in) * (f->len + 1));
+    in = &f->code[f->len++];
+    memset(in, 0, sizeof(*in));
+    in->code = code;
+    return in;
+}
+
+static void _compileLeaf(partitionFilter *f, const Condition *cond) {
+    const ConditionChild *first = cond->first, *second = cond->second;
+    int optype = cond->op;
+    partitionFilterInstr *in;
+
+    switch (optype) {
+    case CONDITION_OP_TYPE_EQ:
+    case CONDITION_OP_TYPE_LT:
+    case CONDITION_OP_TYPE_LTE:
+    case CONDITION_OP_TYPE_GT:
+    case CONDITION_OP_TYPE_GTE:
+    case CONDITION_OP_TYPE_IS_NULL:
+    case CONDITION_OP_TYPE_IS_NOT_NULL:
+    case CONDITION_OP_TYPE_STRING_CONTAINS:
+    case CONDITION_OP_TYPE_STRING_ENDS_WITH:
+    case CONDITION_OP_TYPE_STRING_STARTS_WITH:
+        break;
+    default:
+        _emit(f, FILTER_FALSE);
+        return;
+    }
+    if (first == NULL || first->type != CONDITION_CHILD_VALUE_TYPE_LONG) {
+        _emit(f, FILTER_FALSE);
+        return;
+    }
+    if (optype == CONDITION_OP_TYPE_IS_NOT_NULL) {
+        _emit(f, FILTER_VALID);
+        return;
+    }
+
+    /* A partition without the column satisfies every leaf. */
+    if (optype == CONDITION_OP_TYPE_IS_NULL || second == NULL ||
+        (second->type != CONDITION_CHILD_VALUE_TYPE_LONG &&
+         second->type != CONDITION_CHILD_VALUE_TYPE_SDS)) {
+        in = _emit(f, FILTER_ABSENT);
+        in->columnId = first->value.l;
+        return;
+    }
+
+    /* So does a partition without a value of the type of the operand.
+     * Strings only match string operators and equality, longs don't match
+     * string operators. */
+    in = _emit(f, FILTER_MATCH);
+    in->op = optype;
+    in->columnId = first->value.l;
+    in->type = second->type;
+    if (second->type == CONDITION_CHILD_VALUE_TYPE_SDS ?
+        (optype == CONDITION_OP_TYPE_EQ || _isStringOperator(optype)) :
+        !_isStringOperator(optype)) {
+        in->key = _encodeValue(second->type, second->value.l,
+                               second->value.s);
+        if (_isStringOperator(optype))
+            in->pattern = convertLikeStatementToGlobPattern(optype,
+                                                            second->value.s);
+    }
+}
+
+/* Emit 'cond' in postfix order, returns the stack depth it needs. */
+static int _compileCondition(partitionFilter *f, const Condition *cond) {
+    const ConditionChild *first = cond->first, *second = cond->second;
+    int depth, other;
+
+    if (cond->isLeaf) {
+        _compileLeaf(f, cond);
+        return 1;
+    }
+    if ((cond->op != CONDITION_OP_TYPE_OR &&
+         cond->op != CONDITION_OP_TYPE_AND &&
+         cond->op != CONDITION_OP_TYPE_NOT) ||
+        first == NULL || first->type != CONDITION_CHILD_VALUE_TYPE_COND ||
+        (cond->op != CONDITION_OP_TYPE_NOT &&
+         (second == NULL || second->type != CONDITION_CHILD_VALUE_TYPE_COND))) {
+        _emit(f, FILTER_FALSE);
+        return 1;
+    }
+
+    depth = _compileCondition(f, first->value.cond);
+    if (cond->op == CONDITION_OP_TYPE_NOT) {
+        _emit(f, FILTER_NOT);
+        return depth;
+    }
+    other = _compileCondition(f, second->value.cond) + 1;
+    _emit(f, cond->op == CONDITION_OP_TYPE_OR ? FILTER_OR : FILTER_AND);
+    return depth > other ? depth : other;
+}
+
+static void _freeFilter(partitionFilter *f) {
+    for (int i = 0; i < f->len; i++) {
+        sdsfree(f->code[i].key);
+        sdsfree(f->code[i].pattern);
+    }
+    zfree(f->code);
+    sdsfree(f->statement);
+    zfree(f);
+}
+
+void releasePartitionFilter(partitionFilter *f) {
+    if (--f->refcount == 0) _freeFilter(f);
+}
+
+static void _uncacheFilter(partitionFilter *f) {
+    dictDelete(filterCache, f->statement);
+    listDelNode(filterLru, f->lru);
+    f->lru = NULL;
+    releasePartitionFilter(f);
+}
+
+/* Evict the least recently used programs over 'partition_filter_cache_size'.
+ * Called when the size is set too. */
+void trimPartitionFilterCache(void) {
+    while (filterLru && listLength(filterLru) > 0 &&
+           listLength(filterLru) > (unsigned long)
+                                   server.partition_filter_cache_size)
+        _uncacheFilter(listNodeValue(listLast(filterLru)));
+}
+
+/* Return the program of 'statement', compiled or from the cache, NULL if
+ * it doesn't parse. The caller releases it with releasePartitionFilter(). */
+partitionFilter *getPartitionFilter(const char *statement) {
+    partitionFilter *f;
+    Condition *root;
+    sds text;
+    dictEntry *de;
+
+    if (filterCache == NULL) {
+        filterCache = dictCreate(&keyptrDictType, NULL);
+        filterLru = listCreate();
+    }
+    text = sdsnew(statement);
+    if ((de = dictFind(filterCache, text)) != NULL) {
+        f = dictGetVal(de);
+        listDelNode(filterLru, f->lru);
+        listAddNodeHead(filterLru, f);
+        f->lru = listFirst(filterLru);
+        f->refcount++;
+        server.stat_partition_filter_hits++;
+        sdsfree(text);
+        return f;
+    }
+
+    /* parseStatement() copies the statement to a MAX_TMPBUF_SIZE buffer. */
+    server.stat_partition_filter_misses++;
+    if (sdslen(text) >= MAX_TMPBUF_SIZE ||
+        parseStatement(text, &root) == C_ERR) {
+        sdsfree(text);
+        return NULL;
+    }
+    f = zcalloc(sizeof(*f));
+    f->statement = text;
+    f->refcount = 1;
+    f->depth = _compileCondition(f, root);
+    freeConditions(root);
+
+    if (server.partition_filter_cache_size > 0) {
+        dictAdd(filterCache, f->statement, f);
+        listAddNodeHead(filterLru, f);
+        f->lru = listFirst(filterLru);
+        f->refcount++;
+        trimPartitionFilterCache();
+    }
+    return f;
+}
+
+/* Filter evaluation. A result is a bitmap of 'words' 64 bit words. */
+typedef struct partitionIndexQuery {
+    partitionIndexTable *table;
+    size_t words;
+    uint64_t *valid;
+} partitionIndexQuery;
+
+/* Copy 'bitmap' to 'b', 'invert' sets the valid slots missing from it. */
+static void _bitmapLoad(partitionIndexQuery *q, uint64_t *b, sds bitmap,
+                        int invert) {
+    size_t len = bitmap ? sdslen(bitmap) : 0;
+
+    if (len > q->words * sizeof(uint64_t)) len = q->words * sizeof(uint64_t);
+    memset(b, 0, q->words * sizeof(uint64_t));
+    if (len) memcpy(b, bitmap, len);
+    if (invert)
+        for (size_t i = 0; i < q->words; i++) b[i] = q->valid[i] & ~b[i];
+}
+
+static void _bitmapAddSlots(uint64_t *b, intset *is) {
+    unsigned char *bytes = (unsigned char *) b;
+    int64_t slot;
+
+    for (uint32_t i = 0; intsetGet(is, i, &slot); i++)
+        bytes[slot >> 3] |= 1 << (slot & 7);
+}
+
+/* Set in 'b' the slots of 'col' whose value of the type of the operand
+ * satisfies the operator of 'in'. */
+static void _matchColumnValues(partitionIndexColumn *col,
+                               const partitionFilterInstr *in, uint64_t *b) {
+    unsigned char type = in->type;
+    sds key = in->key;
+    raxIterator it;
+    intset *is;
+
+    if (in->op == CONDITION_OP_TYPE_EQ) {
+        is = raxFind(col->values, (unsigned char *) key, sdslen(key));
+        if (is != raxNotFound) _bitmapAddSlots(b, is);
+        return;
+    }
+
+    raxStart(&it, col->values);
+    if (in->op == CONDITION_OP_TYPE_GT)
+        raxSeek(&it, ">", (unsigned char *) key, sdslen(key));
+    else if (in->op == CONDITION_OP_TYPE_GTE)
+        raxSeek(&it, ">=", (unsigned char *) key, sdslen(key));
+    else
+        raxSeek(&it, ">=", &type, 1);
+    while (raxNext(&it) && it.key[0] == type) {
+        if (in->pattern) {
+            if (stringmatchlen(in->pattern, sdslen(in->pattern),
+                               (char *) it.key + 1, it.key_len - 1, 0))
+                _bitmapAddSlots(b, it.data);
+            continue;
+        }
+
+        /* Long keys all have the same length, memcmp() is their order. */
+        int cmp = memcmp(it.key, key, sdslen(key));
+        if ((in->op == CONDITION_OP_TYPE_LT && cmp >= 0) ||
+            (in->op == CONDITION_OP_TYPE_LTE && cmp > 0))
+            break;
+        _bitmapAddSlots(b, it.data);
+    }
+    raxStop(&it);
+}
+
+/* Run 'f' on the table of 'q', AND the slots it selects into 'result'. */
+static void _runFilter(partitionIndexQuery *q, partitionFilter *f,
+                       uint64_t **stack, uint64_t *result) {
+    partitionIndexColumn *col;
+    int sp = 0;
+
+    for (int pc = 0; pc < f->len; pc++) {
+        const partitionFilterInstr *in = &f->code[pc];
+        uint64_t *top;
+
+        switch (in->code) {
+        case FILTER_FALSE:
+            memset(stack[sp++], 0, q->words * sizeof(uint64_t));
+            break;
+        case FILTER_VALID:
+            memcpy(stack[sp++], q->valid, q->words * sizeof(uint64_t));
+            break;
+        case FILTER_ABSENT:
+            col = _lookupColumn(q->table, in->columnId, 0);
+            _bitmapLoad(q, stack[sp++], col ? col->present : NULL, 1);
+            break;
+        case FILTER_MATCH:
+            col = _lookupColumn(q->table, in->columnId, 0);
+            top = stack[sp++];
+            _bitmapLoad(q, top, col ? col->typed[_typedIndex(in->type)] : NULL,
+                        1);
+            if (col && in->key) _matchColumnValues(col, in, top);
+            break;
+        case FILTER_NOT:
+            top = stack[sp - 1];
+            for (size_t i = 0; i < q->words; i++)
+                top[i] = q->valid[i] & ~top[i];
+            break;
+        case FILTER_AND:
+        case FILTER_OR:
+            top = stack[--sp];
+            for (size_t i = 0; i < q->words; i++) {
+                if (in->code == FILTER_OR) stack[sp - 1][i] |= top[i];
+                else stack[sp - 1][i] &= top[i];
+            }
+            break;
+        }
+    }
+    serverAssert(sp == 1);
+    for (size_t i = 0; i < q->words; i++) result[i] &= stack[0][i];
+}
+
+static void _filterTable(partitionIndexTable *t, sds pattern,
+                         Vector *filters, Vector *metakeys) {
+    partitionIndexQuery q;
+    uint64_t *result, **stack;
+    unsigned char *bytes;
+    int allkeys = pattern[0] == '*' && pattern[1] == '\0', depth = 0;
+
+    q.table = t;
+    q.words = (t->slotCount + 63) / 64;
+    q.valid = zmalloc(q.words * sizeof(uint64_t));
+    _bitmapLoad(&q, q.valid, t->valid, 0);
+    result = zmalloc(q.words * sizeof(uint64_t));
+    memcpy(result, q.valid, q.words * sizeof(uint64_t));
+
+    for (size_t i = 0; i < vectorCount(filters); i++) {
+        partitionFilter *f = vectorGet(filters, i);
+        if (f->depth > depth) depth = f->depth;
+    }
+    stack = zmalloc(sizeof(uint64_t *) * depth);
+    for (int i = 0; i < depth; i++)
+        stack[i] = zmalloc(q.words * sizeof(uint64_t));
+    for (size_t i = 0; i < vectorCount(filters); i++)
+        _runFilter(&q, vectorGet(filters, i), stack, result);
+    for (int i = 0; i < depth; i++) zfree(stack[i]);
+    zfree(stack);
+
+    bytes = (unsigned char *) result;
+    for (uint32_t slot = 0; slot < t->slotCount; slot++) {
+        sds metakey;
+
+        if (!(bytes[slot >> 3] & (1 << (slot & 7)))) continue;
+        metakey = t->slots[slot].metakey;
+        if (allkeys || stringmatchlen(pattern, sdslen(pattern), metakey,
+                                      sdslen(metakey), 0))
+            vectorAdd(metakeys, metakey);
+    }
+    zfree(result);
+    zfree(q.valid);
+}
+
+/* Return 1 and set '*tableId' if only the partitions of one table can
+ * match 'pattern', that is if it starts with a literal "M:{<tableId>:". */
+static int _patternTable(sds pattern, int *tableId) {
+    const char *prefix = RELMODEL_META_PREFIX RELMODEL_DELIMITER
+                         RELMODEL_BRACE_PREFIX;
+    char *p, *end;
+    long id;
+
+    if (strncmp(pattern, prefix, strlen(prefix)) != 0) return 0;
+    p = pattern + strlen(prefix);
+    id = strtol(p, &end, 10);
+    if (end == p || !isdigit(*p) || *end != RELMODEL_DELIMITER[0]) return 0;
+    *tableId = (int) id;
+    return 1;
+}
+
+/* Add to 'metakeys' the partitions of 'db' matching 'pattern' that satisfy
+ * every program of 'filters'. A pattern with a literal table, as in
+ * "M:{100:*}", only looks at that table. The metakeys belong to the index,
+ * they are valid until the Metadict is modified. */
+void partitionIndexFilter(redisDb *db, sds pattern, Vector *filters,
+                          Vector *metakeys) {
+    partitionIndexTable *t;
+    raxIterator it;
+    int tableId;
+
+    if (_patternTable(pattern, &tableId)) {
+        if ((t = _lookupTable(db, tableId)) != NULL)
+            _filterTable(t, pattern, filters, metakeys);
+        return;
+    }
+
+    raxStart(&it, db->PartitionIndex);
+    raxSeek(&it, "^", NULL, 0);
+    while (raxNext(&it)) _filterTable(it.data, pattern, filters, metakeys);
+    raxStop(&it);
+}
+
+/* Add to 'metakeys' the partitions matching 'pattern' of the table it is
+ * scoped to, visiting only that table. Returns C_ERR if 'pattern' isn't
+ * scoped to a table. */
+int partitionIndexList(redisDb *db, sds pattern, Vector *metakeys) {
+    partitionIndexTable *t;
+    int tableId;
+
+    if (!_patternTable(pattern, &tableId)) return C_ERR;
+    if ((t = _lookupTable(db, tableId)) == NULL) return C_OK;
+    for (uint32_t slot = 0; slot < t->slotCount; slot++) {
+        sds metakey = t->slots[slot].metakey;
+
+        if (metakey && stringmatchlen(pattern, sdslen(pattern), metakey,
+                                      sdslen(metakey), 0))
+            vectorAdd(metakeys, metakey);
+    }
+    return C_OK;
+}
+
+/* Table registry */
+
+/* Add the ids of the tables of 'db' to 'ids', a STL_TYPE_LONG vector. */
+void partitionIndexTableIds(redisDb *db, Vector *ids) {
+    raxIterator it;
+
+    raxStart(&it, db->PartitionIndex);
+    raxSeek(&it, "^", NULL, 0);
+    while (raxNext(&it)) {
+        uint32_t u = ((uint32_t) it.key[0] << 24) | (it.key[1] << 16) |
+                     (it.key[2] << 8) | it.key[3];
+        vectorAdd(ids, (void *) (long) (int) (u ^ 0x80000000));
+    }
+    raxStop(&it);
+}
+
+/* Set the counts of the table 'tableId' of 'db'. Returns C_ERR if the
+ * table has no partition. */
+int partitionIndexTableStats(redisDb *db, int tableId, long long *partitions,
+                             long long *rowGroups, long long *rows) {
+    partitionIndexTable *t = _lookupTable(db, tableId);
+
+    if (t == NULL) return C_ERR;
+    *partitions = t->byKey->numele;
+    *rowGroups = t->rowGroups;
+    *rows = t->rows;
+    return C_OK;
+}
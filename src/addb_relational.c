@@ -359,7 +359,7 @@ int incRowNumber(redisDb *db, NewDataKeyInfo *dataKeyInfo, int inc_number){
 
 int IncDecCount(redisDb *db, robj *key, robj *field, long long cnt){
 
-    long long value, oldvalue;
+    long long value, oldvalue, fieldValue;
     robj *o, *new, *cur_obj;
 
     o = lookupKeyWriteForMetadict(db,key);
@@ -398,6 +398,8 @@ int IncDecCount(redisDb *db, robj *key, robj *field, long long cnt){
     hashTypeTryObjectEncoding(o,&field,NULL);
     hashTypeSetWithNoFlags(o, field, new);
     decrRefCount(new);
+    if (getLongLongFromObject(field, &fieldValue) == C_OK)
+        partitionIndexCount(db, key->ptr, fieldValue, oldvalue, value);
 
     signalModifiedKey(db,key);
     notifyKeyspaceEvent(NOTIFY_HASH,"Hash incrby",key,db->id);
@@ -407,6 +409,154 @@ int IncDecCount(redisDb *db, robj *key, robj *field, long long cnt){
 }
 
 
+/* Return the row count of the rowgroup 'dataKey' recorded in the
+ * Metadict. */
+int getRowNumberOfDataKey(redisDb *db, sds dataKey) {
+    sds metaKey;
+    int rowGroupId;
+    if (toMetaKey(dataKey, &metaKey, &rowGroupId) == C_ERR) {
+        serverLog(LL_WARNING,
+                  "[getRowNumberOfDataKey] FATAL: datakey has invalid format! %s",
+                  dataKey);
+        serverAssert(0);
+    }
+    robj *metaObj = lookupSDSKeyForMetadict(db, metaKey);
+    robj *rowGroupField = createStringObjectFromLongLong(
+        (long long) rowGroupId);
+    int rowCount = lookupCompInfoForRowNumberInMeta(metaObj, rowGroupField);
+
+    sdsfree(metaKey);
+    decrRefCount(rowGroupField);
+    return rowCount;
+}
+
+/* ADDB
+ * Lazy load of the Metadict
+ *
+ * Every tiered rowgroup and its row count are recorded in the META column
+ * family, in the WriteBatch of its column vectors. After a restart the
+ * Metadict only has what the RDB had, so a partition is merged with the
+ * META column family the first time it is looked up, and every partition
+ * the first time the Metadict is iterated. The server serves as soon as
+ * RocksDB is open, whatever the size of the tiered data.
+ *
+ * Rowgroup ids and row counts only grow, so the merge keeps the larger
+ * of both sides. 'MetadictChecked' holds the partitions already merged,
+ * it is released once every partition was merged. */
+void resetMetadictLazyLoad(redisDb *db) {
+    dictEmpty(db->MetadictChecked, NULL);
+    db->metadict_lazy = persistentStoreHasMeta(db->persistent_store);
+}
+
+static void _setMetaFieldIfGreater(redisDb *db, sds key, robj *o,
+                                   long long field, long long value) {
+    robj *fieldObj = createStringObjectFromLongLong(field);
+    long long old = lookupCompInfoForRowNumberInMeta(o, fieldObj);
+
+    if (old < value) {
+        robj *valueObj = createStringObjectFromLongLong(value);
+        hashTypeTryObjectEncoding(o, &fieldObj, NULL);
+        hashTypeSetWithNoFlags(o, fieldObj, valueObj);
+        partitionIndexCount(db, key, field, old, value);
+        decrRefCount(valueObj);
+    }
+    decrRefCount(fieldObj);
+}
+
+static void _mergeRowGroupMeta(void *privdata, const char *metaKey,
+                               size_t metaKeylen, uint32_t rowGroupId,
+                               uint32_t rowCount) {
+    redisDb *db = privdata;
+    sds key = sdsnewlen(metaKey, metaKeylen);
+    dictEntry *de;
+    robj *o;
+
+    /* Partitions looked up before the full load are merged already. */
+    if (dictFind(db->MetadictChecked, key) != NULL) {
+        sdsfree(key);
+        return;
+    }
+    de = dictFind(db->Metadict, key);
+    if (de == NULL) {
+        o = createMetaHashdictFordict();
+        dictAdd(db->Metadict, sdsdup(key), o);
+        partitionIndexAdd(db, key, o);
+    } else {
+        o = dictGetVal(de);
+    }
+    _setMetaFieldIfGreater(db, key, o, 0, rowGroupId);
+    _setMetaFieldIfGreater(db, key, o, rowGroupId, rowCount);
+    sdsfree(key);
+}
+
+/* Return 1 if the rowgroup 'dataKey' loaded from an RDB was tiered again
+ * with more rows after the RDB was saved. The copy of the RDB is stale
+ * then, the rowgroup has to be read from RocksDB. Called by rdbLoad()
+ * after the Metadict of the RDB was loaded. */
+int isStaleRowGroup(redisDb *db, sds dataKey) {
+    sds metaKey;
+    int rowGroupId, stale = 0;
+    uint32_t tiered;
+
+    if (!db->metadict_lazy) return 0;
+    if (toMetaKey(dataKey, &metaKey, &rowGroupId) == C_ERR) return 0;
+    if (getPersistentStoreRowGroupMeta(db->persistent_store, metaKey,
+                                       sdslen(metaKey), rowGroupId, &tiered)) {
+        dictEntry *de = dictFind(db->Metadict, metaKey);
+        robj *field = createStringObjectFromLongLong(rowGroupId);
+        int loaded = lookupCompInfoForRowNumberInMeta(
+            de ? dictGetVal(de) : NULL, field);
+        stale = (int) tiered > loaded;
+        decrRefCount(field);
+    }
+    sdsfree(metaKey);
+    return stale;
+}
+
+/* Merge the partition 'metaKey' with the META column family, unless it
+ * was merged already. Called before every lookup of the Metadict. */
+void loadPartitionMetaIfNeeded(redisDb *db, sds metaKey) {
+    if (!db->metadict_lazy) return;
+    if (dictFind(db->MetadictChecked, metaKey) != NULL) return;
+
+    scanPersistentStoreMeta(db->persistent_store, metaKey, sdslen(metaKey),
+                            _mergeRowGroupMeta, db);
+    dictAdd(db->MetadictChecked, sdsdup(metaKey), NULL);
+}
+
+/* Merge every partition with the META column family. Called before the
+ * Metadict is iterated. */
+void loadMetadictIfNeeded(redisDb *db) {
+    long long start;
+
+    if (!db->metadict_lazy) return;
+    start = ustime();
+    scanPersistentStoreMeta(db->persistent_store, NULL, 0,
+                            _mergeRowGroupMeta, db);
+    dictEmpty(db->MetadictChecked, NULL);
+    db->metadict_lazy = 0;
+    serverLog(LL_NOTICE, "DB %d: Metadict loaded from RocksDB in %.3f seconds",
+              db->id, (float) (ustime() - start) / 1000000);
+}
+
+/* Delete the rowgroup metadata of 'db' from the META column family, when
+ * the DB is flushed. Returns C_ERR if RocksDB failed. */
+int flushRowGroupMeta(redisDb *db) {
+    sds err = NULL;
+
+    db->metadict_lazy = 0;
+    dictEmpty(db->MetadictChecked, NULL);
+    if (deletePersistentStoreMeta(db->persistent_store, RELMODEL_META_PREFIX,
+                                  strlen(RELMODEL_META_PREFIX), &err) == -1) {
+        serverLog(LL_WARNING, "DB %d: deleting the rowgroup metadata failed: %s",
+                  db->id, err);
+        sdsfree(err);
+        return C_ERR;
+    }
+    return C_OK;
+}
+
+
 /*addb key generation func*/
 
 robj * generateRgIdKeyForRowgroup(NewDataKeyInfo *dataKeyInfo){
@@ -471,16 +621,41 @@ robj *generateDataRocksKey(NewDataKeyInfo *dataKeyInfo, int rowId,
     return dataFieldKeyObj;
 }
 
+/* Returns the partition string of 'dataKeyInfo', "1:2" in D:{100:1:2}. */
+static size_t _getPartitionString(NewDataKeyInfo *dataKeyInfo, char *buf,
+                                  size_t size) {
+    if (dataKeyInfo->isPartitionString) {
+        return snprintf(buf, size, "%s",
+                        dataKeyInfo->partitionInfo.partitionString);
+    }
+    size_t len = 0;
+    for (int i = 0; i < dataKeyInfo->partitionCnt && len < size; i++) {
+        len += snprintf(buf + len, size - len, i ? ":%llu" : "%llu",
+                        dataKeyInfo->partitionInfo.partitionInt[i]);
+    }
+    return len;
+}
+
+/* RocksDB key of a column vector, see PERSISTENT_STORE_KEY_TAG. */
 sds generateDataRocksKeySds(NewDataKeyInfo *dataKeyInfo, int rowId,
                             int columnId) {
-    sds dataKey = generateDataKeySds(dataKeyInfo);
-    sds fieldKey = getDataFieldSds(rowId, columnId);
+    char partition[DATA_KEY_MAX_SIZE];
+    size_t partitionLen = _getPartitionString(dataKeyInfo, partition,
+                                              sizeof(partition));
+    return persistentStoreKey(dataKeyInfo->tableId, partition, partitionLen,
+                              dataKeyInfo->rowGroupId, rowId, columnId);
+}
 
-    char strBuf[DATA_KEY_MAX_SIZE];
-    sprintf(strBuf, "%s:%s%s", dataKey, REL_MODEL_FIELD_PREFIX, fieldKey);
-    sdsfree(dataKey);
-    sdsfree(fieldKey);
-    return sdsnew(strBuf);
+/* RocksDB key of the column vector 'field' of the rowgroup 'dataKey'. */
+sds dataKeyToRocksKeySds(sds dataKey, sds field) {
+    sds rocksKey = persistentStoreKeyFromDataKey(dataKey, sdslen(dataKey),
+                                                 field, sdslen(field));
+    if (rocksKey == NULL) {
+        serverLog(LL_WARNING, "Invalid data key [%s] or field [%s]",
+                  dataKey, field);
+        serverAssert(0);
+    }
+    return rocksKey;
 }
 
 robj * generateDataKeyForFirstEntry(NewDataKeyInfo *dataKeyInfo){
@@ -609,6 +784,8 @@ int insertKVpairToRelational(client *c, robj *dataKeyString, robj *dataField, ro
 
         vectorAdd(v, sdsdup(valueObj->ptr));
         robj *columnVectorObj = createObject(OBJ_VECTOR, v);
+        /* Column vectors always carry a LFU counter, see touchColumnVector() */
+        columnVectorObj->lru = (LFUGetTimeInMinutes()<<8) | LFU_INIT_VAL;
 
         int ret = dictAdd(hashDict,sdsdup(dataField->ptr),  columnVectorObj);
 
@@ -636,7 +813,6 @@ void prepareWriteToRocksDB(redisDb *db, robj *keyobj, robj *targetVal) {
 	serverLog(LL_DEBUG, "PREPARING WRITE FOR ROCKSDB");
 	dictIterator *di;
 	dictEntry *de;
-	char keystr[SDS_DATA_KEY_MAX];
 	char *err = NULL;
 
 	rocksdb_writebatch_t *writeBatch = rocksdb_writebatch_create();
@@ -652,9 +828,7 @@ void prepareWriteToRocksDB(redisDb *db, robj *keyobj, robj *targetVal) {
 		sds field_key = dictGetKey(de);
 		robj *vectorObj = dictGetVal(de);
 
-		sprintf(keystr, "%s:%s%s", keyobj->ptr, REL_MODEL_FIELD_PREFIX,
-				field_key);
-		sds rocksKey = sdsnew(keystr);
+		sds rocksKey = dataKeyToRocksKeySds(keyobj->ptr, field_key);
 		//robj *value = createStringObject(val, sdslen(val));
 		char *SerializeString = vectorSerialize(vectorObj);
 
@@ -679,16 +853,205 @@ void prepareWriteToRocksDB(redisDb *db, robj *keyobj, robj *targetVal) {
 	dictReleaseIterator(di);
 }
 
+/*
+ * SST ingestion of tiered rowgroups
+ *
+ * Tiered rowgroups are immutable, so instead of going through the WAL, the
+ * memtables and the compactions of the lower levels, a batch of rowgroups
+ * can be written as one sorted SST file and added to the LSM with external
+ * file ingestion (tiering_sst_ingest). RocksDB assigns a global sequence
+ * number to a file overlapping existing keys. If the file overlaps the
+ * memtable the ingestion is refused instead of blocking the worker on a
+ * flush, and the batch falls back to the WriteBatch path.
+ */
+typedef struct tieringSstEntry {
+    sds key;
+    char *value;
+    size_t valueLen;
+} tieringSstEntry;
+
+static unsigned long long tieringSstSeq = 0;
+
+static int _compareSstEntries(const void *a, const void *b) {
+    const tieringSstEntry *ea = a, *eb = b;
+    size_t la = sdslen(ea->key), lb = sdslen(eb->key);
+    int cmp = memcmp(ea->key, eb->key, la < lb ? la : lb);
+    if (cmp != 0) return cmp;
+    return (la > lb) - (la < lb);
+}
+
+/* Write the sorted entries of one table as an SST file and ingest it in the
+ * column family of the table. Returns NULL on success, otherwise an error
+ * which must be freed with rocksdb_free(). */
+static char *_ingestRunToRocksDB(persistent_store_t *ps, int tableId,
+                                 tieringSstEntry *entries, size_t numEntries) {
+    char path[PATH_MAX];
+    char *err = NULL;
+    size_t i;
+
+    snprintf(path, sizeof(path), "%s/tiering-%ld-%llu.sst", ps->dbname,
+             (long) getpid(),
+             __atomic_add_fetch(&tieringSstSeq, 1, __ATOMIC_RELAXED));
+
+    /* The CF is created first, the file is written with its options. */
+    rocksdb_column_family_handle_t *cf =
+        getPersistentStoreTableCF(ps, tableId, 1);
+    rocksdb_envoptions_t *envOptions = rocksdb_envoptions_create();
+    rocksdb_sstfilewriter_t *writer = rocksdb_sstfilewriter_create(
+        envOptions, getPersistentStoreTableCFOptions(ps, tableId));
+    rocksdb_sstfilewriter_open(writer, path, &err);
+    for (i = 0; i < numEntries && err == NULL; ++i) {
+        rocksdb_sstfilewriter_put(writer, entries[i].key,
+                                  sdslen(entries[i].key), entries[i].value,
+                                  entries[i].valueLen, &err);
+    }
+    if (err == NULL) rocksdb_sstfilewriter_finish(writer, &err);
+    rocksdb_sstfilewriter_destroy(writer);
+    rocksdb_envoptions_destroy(envOptions);
+
+    if (err == NULL) {
+        const char *files[1] = {path};
+        rocksdb_ingestexternalfileoptions_t *ingestOptions =
+            rocksdb_ingestexternalfileoptions_create();
+        rocksdb_ingestexternalfileoptions_set_move_files(ingestOptions, 1);
+        rocksdb_ingestexternalfileoptions_set_allow_global_seqno(ingestOptions, 1);
+        rocksdb_ingestexternalfileoptions_set_allow_blocking_flush(ingestOptions, 0);
+        rocksdb_ingest_external_file_cf(ps->ps, cf, files, 1, ingestOptions,
+                                        &err);
+        rocksdb_ingestexternalfileoptions_destroy(ingestOptions);
+    }
+    if (err == NULL) {
+        __atomic_add_fetch(&server.stat_tiering_ingested_files, 1,
+                           __ATOMIC_RELAXED);
+    }
+    /* With move_files the ingested file was linked in the DB, the name we
+     * used is ours to remove. */
+    unlink(path);
+    return err;
+}
+
+/* Record the rowgroups of a tiering batch and their 'rowCounts' in the
+ * META column family, see loadPartitionMetaIfNeeded(). */
+static void _addRowGroupMetaToBatch(redisDb *db, Vector *evict_keys,
+                                    const uint32_t *rowCounts,
+                                    rocksdb_writebatch_t *writeBatch) {
+    size_t numEvictKeys = vectorCount(evict_keys), i;
+
+    for (i = 0; i < numEvictKeys; ++i) {
+        sds metaKey;
+        int rowGroupId;
+        if (toMetaKey((sds) vectorGet(evict_keys, i), &metaKey,
+                      &rowGroupId) == C_ERR) continue;
+        setPersistentStoreRowGroupMetaWithBatch(db->persistent_store,
+                                                metaKey, sdslen(metaKey),
+                                                rowGroupId, rowCounts[i],
+                                                writeBatch);
+        sdsfree(metaKey);
+    }
+}
+
+/* Write the batch as SST files, one per table, and ingest them. Returns
+ * C_OK on success, C_ERR if the caller has to fall back to a WriteBatch.
+ * Rewriting files which were already ingested is harmless, the WriteBatch
+ * just shadows them with the same values. */
+static int _ingestBatchToRocksDB(redisDb *db, Vector *evict_keys,
+                                 Vector *evict_relations) {
+    persistent_store_t *ps = db->persistent_store;
+    size_t numEvictRelations = vectorCount(evict_relations);
+    size_t numEntries = 0, capacity = 0, i, run;
+    long long bytes = 0;
+    tieringSstEntry *entries = NULL;
+    char *err = NULL;
+    int ret = C_ERR, duplicated = 0;
+
+    for (i = 0; i < numEvictRelations; ++i) {
+        robj *relation_val = (robj *) vectorGet(evict_relations, i);
+        capacity += dictSize((dict *) relation_val->ptr);
+    }
+    if (capacity == 0) return C_OK;
+    entries = zmalloc(sizeof(tieringSstEntry) * capacity);
+
+    for (i = 0; i < numEvictRelations; ++i) {
+        sds key = (sds) vectorGet(evict_keys, i);
+        robj *relation_val = (robj *) vectorGet(evict_relations, i);
+        dictIterator *di = dictGetSafeIterator((dict *) relation_val->ptr);
+        dictEntry *de = NULL;
+        while ((de = dictNext(di)) != NULL) {
+            tieringSstEntry *e = &entries[numEntries++];
+            e->key = dataKeyToRocksKeySds(key, dictGetKey(de));
+            e->value = vectorSerialize(dictGetVal(de));
+            e->valueLen = strlen(e->value) + 1;
+            bytes += sdslen(e->key) + e->valueLen;
+        }
+        dictReleaseIterator(di);
+    }
+    qsort(entries, numEntries, sizeof(tieringSstEntry), _compareSstEntries);
+
+    /* Keys are unique, but a duplicate must not end up in a file. */
+    for (i = 1; i < numEntries && !duplicated; ++i)
+        duplicated = _compareSstEntries(&entries[i-1], &entries[i]) == 0;
+
+    /* The keys of a table share the "D:{<tableId>:" prefix, so every table
+     * is a run of the sorted entries. */
+    for (run = 0; run < numEntries && err == NULL && !duplicated; run = i) {
+        int tableId = getPersistentStoreKeyTableId(entries[run].key,
+                                                   sdslen(entries[run].key));
+        for (i = run + 1; i < numEntries; ++i) {
+            if (getPersistentStoreKeyTableId(entries[i].key,
+                                             sdslen(entries[i].key)) != tableId)
+                break;
+        }
+        err = _ingestRunToRocksDB(ps, tableId, entries + run, i - run);
+    }
+
+    if (err == NULL && !duplicated) {
+        ret = C_OK;
+        __atomic_add_fetch(&server.stat_tiered_bytes, bytes, __ATOMIC_RELAXED);
+    } else {
+        serverLog(LL_VERBOSE, "[SST INGEST] %s, falling back to WriteBatch",
+                  err ? err : "duplicated key in tiering batch");
+        __atomic_add_fetch(&server.stat_tiering_ingest_fallbacks, 1,
+                           __ATOMIC_RELAXED);
+        if (err) rocksdb_free(err);
+    }
+
+    for (i = 0; i < numEntries; ++i) {
+        sdsfree(entries[i].key);
+        zfree(entries[i].value);
+    }
+    zfree(entries);
+    return ret;
+}
+
+/* Write a batch of rowgroups to RocksDB, with their metadata. The column
+ * vectors and the metadata are written in one WriteBatch. Ingested SST
+ * files are followed by a WriteBatch of the metadata, so the metadata of
+ * a rowgroup never refers to column vectors which are not in RocksDB. */
 void prepareBatchWriteToRocksDB(redisDb *db, Vector *evict_keys,
-                                Vector *evict_relations) {
+                                Vector *evict_relations,
+                                const uint32_t *rowCounts) {
     serverLog(LL_DEBUG, "PREPARING BATCH WRITE FOR ROCKSDB");
-	char keystr[SDS_DATA_KEY_MAX];
 	char *err = NULL;
+	rocksdb_writebatch_t *writeBatch = rocksdb_writebatch_create();
 
     serverAssert(vectorCount(evict_keys) == vectorCount(evict_relations));
 
-	rocksdb_writebatch_t *writeBatch = rocksdb_writebatch_create();
+    _addRowGroupMetaToBatch(db, evict_keys, rowCounts, writeBatch);
+    if (server.tiering_sst_ingest &&
+        _ingestBatchToRocksDB(db, evict_keys, evict_relations) == C_OK) {
+        rocksdb_write(db->persistent_store->ps,
+                      db->persistent_store->ps_options->woptions, writeBatch,
+                      &err);
+        if (err) {
+            serverLog(LL_VERBOSE, "RocksDB err");
+            serverPanic("[PERSISTENT_STORE] putting a key failed");
+        }
+        rocksdb_writebatch_destroy(writeBatch);
+        return;
+    }
+
     size_t num_evict_relations = vectorCount(evict_relations);
+    long long bytes = 0;
 
     // Insert evict relations to RocksDB WriteBatch.
     for (size_t i = 0; i < num_evict_relations; ++i) {
@@ -704,8 +1067,7 @@ void prepareBatchWriteToRocksDB(redisDb *db, Vector *evict_keys,
             sds field_key = dictGetKey(de);
             robj *vector_obj = dictGetVal(de);
 
-            sprintf(keystr, "%s:%s%s", key, REL_MODEL_FIELD_PREFIX, field_key);
-            sds rockskey = sdsnew(keystr);
+            sds rockskey = dataKeyToRocksKeySds(key, field_key);
             char *serialized_vector_obj = vectorSerialize(vector_obj);
 
             serverLog(LL_DEBUG, "SERIALIZE Serial_val RESULT : %s",
@@ -714,6 +1076,7 @@ void prepareBatchWriteToRocksDB(redisDb *db, Vector *evict_keys,
                                       sdslen(rockskey), serialized_vector_obj,
                                       strlen(serialized_vector_obj) + 1,
                                       writeBatch);
+            bytes += sdslen(rockskey) + strlen(serialized_vector_obj) + 1;
             sdsfree(rockskey);
             zfree(serialized_vector_obj);
         }
@@ -724,21 +1087,66 @@ void prepareBatchWriteToRocksDB(redisDb *db, Vector *evict_keys,
     rocksdb_write(db->persistent_store->ps,
                   db->persistent_store->ps_options->woptions, writeBatch, &err);
 
-    // Set 'LOCATION_PERSISTED' on Relation robj.
-    for (size_t i = 0; i < num_evict_relations; ++i) {
-        robj *relation_val = (robj *) vectorGet(evict_relations, i);
-        __sync_synchronize();
-        relation_val->location = LOCATION_PERSISTED;
-    }
+    /* The tiering pool sets 'LOCATION_PERSISTED' on the relations from the
+     * event loop once the job completion is delivered. */
 
 	if (err) {
 		serverLog(LL_VERBOSE, "RocksDB err");
 		serverPanic("[PERSISTENT_STORE] putting a key failed");
 	}
+    __atomic_add_fetch(&server.stat_tiered_bytes, bytes, __ATOMIC_RELAXED);
 
 	rocksdb_writebatch_destroy(writeBatch);
 }
 
+/* Write column vectors of a table moved from another node, 'argv' holding
+ * 'count' binary keys and serialized vectors in turn. As the source reads
+ * them with an iterator, they are sorted and ingested as one SST file with
+ * tiering_sst_ingest, otherwise or if the ingestion is refused they are
+ * written in a WriteBatch. Returns C_ERR with 'err' set if RocksDB
+ * failed. */
+int restoreTieredColumnVectors(redisDb *db, int tableId, robj **argv,
+                               int count, sds *err) {
+    persistent_store_t *ps = db->persistent_store;
+    rocksdb_writebatch_t *writeBatch;
+    tieringSstEntry *entries;
+    char *ingestErr = NULL;
+    int i, sorted = 1, ret;
+
+    if (count == 0) return C_OK;
+    entries = zmalloc(sizeof(tieringSstEntry) * count);
+    for (i = 0; i < count; ++i) {
+        entries[i].key = argv[i*2]->ptr;
+        entries[i].value = argv[i*2+1]->ptr;
+        entries[i].valueLen = sdslen(argv[i*2+1]->ptr);
+        if (i > 0 && _compareSstEntries(&entries[i-1], &entries[i]) >= 0)
+            sorted = 0;
+    }
+    if (server.tiering_sst_ingest && sorted) {
+        ingestErr = _ingestRunToRocksDB(ps, tableId, entries, count);
+        if (ingestErr == NULL) {
+            zfree(entries);
+            return C_OK;
+        }
+        serverLog(LL_VERBOSE, "[SST INGEST] %s, falling back to WriteBatch",
+                  ingestErr);
+        __atomic_add_fetch(&server.stat_tiering_ingest_fallbacks, 1,
+                           __ATOMIC_RELAXED);
+        rocksdb_free(ingestErr);
+    }
+
+    writeBatch = rocksdb_writebatch_create();
+    for (i = 0; i < count; ++i) {
+        setPersistentKeyWithBatch(ps, entries[i].key, sdslen(entries[i].key),
+                                  entries[i].value, entries[i].valueLen,
+                                  writeBatch);
+    }
+    ret = writePersistentStoreBatch(ps, writeBatch, err) == 0 ? C_OK : C_ERR;
+    rocksdb_writebatch_destroy(writeBatch);
+    zfree(entries);
+    return ret;
+}
+
 
 /* ADDB Create Scan parameter*/
 ColumnParameter *parseColumnParameter(const sds rawColumnIdsString) {
@@ -770,14 +1178,22 @@ ColumnParameter *parseColumnParameter(const sds rawColumnIdsString) {
 }
 
 ScanParameter *createScanParameter(const client *c) {
+    return createScanParameterForKey(c->db, (sds) c->argv[1]->ptr,
+                                     (sds) c->argv[2]->ptr);
+}
+
+ScanParameter *createScanParameterForKey(redisDb *db, sds dataKey,
+                                         sds rawColumnIdsString) {
     ScanParameter *param = (ScanParameter *) zmalloc(sizeof(ScanParameter));
     param->startRowGroupId = 0;
-    param->dataKeyInfo = parsingDataKeyInfo((sds) c->argv[1]->ptr);
+    param->dataKeyInfo = parsingDataKeyInfo(dataKey);
     param->totalRowGroupCount = getRowGroupInfoAndSetRowGroupInfo(
-            c->db, param->dataKeyInfo);
+            db, param->dataKeyInfo);
     param->rowGroupParams = (RowGroupParameter *) zmalloc(
             sizeof(RowGroupParameter) * param->totalRowGroupCount);
-    param->columnParam = parseColumnParameter((sds) c->argv[2]->ptr);
+    param->columnParam = parseColumnParameter(rawColumnIdsString);
+    param->valueProc = NULL;
+    param->privdata = NULL;
     return param;
 }
 
@@ -824,10 +1240,19 @@ RowGroupParameter createRowGroupParameter(redisDb *db, robj *dataKey) {
     RowGroupParameter param;
     expireIfNeeded(db, dataKey);
     param.dictObj = lookupKey(db, dataKey, LOOKUP_NONE);
+    if (param.dictObj != NULL) {
+        touchRowGroup(param.dictObj);
+        server.stat_rowgroup_memory_hits++;
+    } else {
+        server.stat_rowgroup_tiered_reads++;
+        /* The rowgroup only lives in RocksDB, it may be hot enough to be
+         * loaded back in memory. */
+        param.dictObj = tieringPromoteRowGroup(db, dataKey);
+    }
 
     if (
             param.dictObj == NULL ||
-            param.dictObj->location == LOCATION_PERSISTED
+            objGetLocation(param.dictObj) == LOCATION_PERSISTED
        ) {
         param.isInRocksDb = true;
     } else {
@@ -837,6 +1262,132 @@ RowGroupParameter createRowGroupParameter(redisDb *db, robj *dataKey) {
     return param;
 }
 
+static inline void _addScanValue(client *c, ScanParameter *scanParam,
+                                 const char *value, size_t len) {
+    if (scanParam->valueProc != NULL)
+        scanParam->valueProc(scanParam->privdata, value, len);
+    else if (value == NULL)
+        addReply(c, shared.nullbulk);
+    else
+        addReplyBulkCBuffer(c, value, len);
+}
+
+/* Column vector cached by a scan while it reads its rows. It is in the
+ * RowGroup dict ('vector'), or read raw from RocksDB ('iter.col_v'), or
+ * missing when both are NULL. */
+typedef struct _ScanColumnVector {
+    int columnVectorId;     // -1 until a column vector is loaded
+    Vector *vector;
+    ColumnVectorIter iter;
+} ScanColumnVector;
+
+/* Load the column vector 'columnVectorId' of 'columnId' in 'cv'. It is
+ * taken from 'hashDict', the dict of the RowGroup when it is in memory,
+ * or from RocksDB when it is not there and the RowGroup is persisted. */
+static void _loadScanColumnVector(redisDb *db, ScanParameter *scanParam,
+                                  size_t rowGroupId, dict *hashDict,
+                                  ScanColumnVector *cv, int columnVectorId,
+                                  size_t columnId) {
+    RowGroupParameter *rowGroupParam =
+        &scanParam->rowGroupParams[rowGroupId - 1];
+
+    if (cv->iter.col_v != NULL) sdsfree(cv->iter.col_v);
+    cv->iter.col_v = NULL;
+    cv->vector = NULL;
+    cv->columnVectorId = columnVectorId;
+
+    if (hashDict != NULL) {
+        sds dataField = getDataFieldSds(columnVectorId, columnId);
+        dictEntry *entry = dictFind(hashDict, dataField);
+        sdsfree(dataField);
+        if (entry != NULL) {
+            robj *vectorObj = (robj *) dictGetVal(entry);
+            touchColumnVector(vectorObj);
+            cv->vector = (Vector *) vectorObj->ptr;
+            return;
+        }
+    }
+
+    if (rowGroupParam->isInRocksDb) {
+        sds dataKey = generateDataRocksKeySds(
+            scanParam->dataKeyInfo, columnVectorId, columnId);
+        sds colVector = getRawColumnVectorFromRocksDB(db, dataKey);
+        ColumnVectorIter end;
+        sdsfree(dataKey);
+        if (colVector != NULL &&
+            makeColumnVectorIter(colVector, &cv->iter, &end) == C_OK)
+            return;
+        sdsfree(colVector);
+        cv->iter.col_v = NULL;
+    }
+    serverLog(LL_WARNING,
+              "[SCAN] RowGroup[%zu] has no column vector %d of column %zu",
+              rowGroupId, columnVectorId, columnId);
+}
+
+/* Reply the value of 'rowId' from 'cv', a null value if the column vector
+ * is missing. The rows of a column vector read from RocksDB are taken in
+ * order. */
+static void _addScanColumnValue(client *c, ScanParameter *scanParam,
+                                ScanColumnVector *cv, size_t rowId) {
+    if (cv->vector != NULL) {
+        sds value = vectorGet(cv->vector, getColumnVectorIndex(rowId));
+        _addScanValue(c, scanParam, value, value ? sdslen(value) : 0);
+    } else if (cv->iter.col_v != NULL) {
+        char *value = NULL;
+        size_t value_size = 0;
+        int eoi = 0;
+        if (columnVectorIterGetNoCopy(cv->iter, &value, &value_size) == C_ERR)
+            value = NULL;
+        columnVectorIterNext(&cv->iter, &eoi);
+        _addScanValue(c, scanParam, value, value_size);
+    } else {
+        _addScanValue(c, scanParam, NULL, 0);
+    }
+}
+
+/* Scan the rows of a RowGroup, every column vector is taken from
+ * 'hashDict' or RocksDB, see _loadScanColumnVector(). */
+static size_t _scanRowGroup(client *c, redisDb *db, size_t rowGroupId,
+                            ScanParameter *scanParam, dict *hashDict) {
+    RowGroupParameter *rowGroupParam =
+        &scanParam->rowGroupParams[rowGroupId - 1];
+    ColumnParameter *columnParam = scanParam->columnParam;
+    ScanColumnVector *cached = zmalloc(
+        sizeof(ScanColumnVector) * columnParam->columnCount);
+    size_t numReplies = 0;
+    int k;
+
+    for (k = 0; k < columnParam->columnCount; ++k) {
+        cached[k].columnVectorId = -1;
+        cached[k].vector = NULL;
+        cached[k].iter.col_v = NULL;
+    }
+    serverLog(LL_DEBUG, "RowGroupId[%zu], RowGroup->rowCount[%llu]",
+              rowGroupId, (unsigned long long) rowGroupParam->rowCount);
+
+    for (size_t j = 0; j < rowGroupParam->rowCount; ++j) {
+        size_t rowId = j + 1;
+        int columnVectorId = getColumnVectorId(rowId);
+
+        for (k = 0; k < columnParam->columnCount; ++k) {
+            if (cached[k].columnVectorId != columnVectorId) {
+                size_t columnId =
+                    (long) vectorGet(&columnParam->columnIdList, k);
+                _loadScanColumnVector(db, scanParam, rowGroupId, hashDict,
+                                      &cached[k], columnVectorId, columnId);
+            }
+            _addScanColumnValue(c, scanParam, &cached[k], rowId);
+            numReplies++;
+        }
+    }
+
+    for (k = 0; k < columnParam->columnCount; ++k)
+        sdsfree(cached[k].iter.col_v);
+    zfree(cached);
+    return numReplies;
+}
+
 size_t scanDataFromADDB(client *c, redisDb *db, ScanParameter *scanParam) {
     size_t startRowGroupIdx = scanParam->startRowGroupId;
     ColumnParameter *columnParam = scanParam->columnParam;
@@ -848,7 +1399,12 @@ size_t scanDataFromADDB(client *c, redisDb *db, ScanParameter *scanParam) {
 
         // Performs ColumnVector cached scan.
         if (scanParam->rowGroupParams[rowGroupId - 1].isInRocksDb) {
-            numReplies += _cachedScanOnRocksDB_iterator(c, db, rowGroupId, scanParam);
+            if (scanParam->rowGroupParams[rowGroupId - 1].dictObj != NULL) {
+                // Persisted RowGroup which (partially) stays in memory.
+                numReplies += _cachedScanMixed(c, db, rowGroupId, scanParam);
+            } else {
+                numReplies += _cachedScanOnRocksDB_iterator(c, db, rowGroupId, scanParam);
+            }
             continue;
         }
 
@@ -862,98 +1418,11 @@ size_t _cachedScan(client *c, redisDb *db, size_t rowGroupId,
     // RowGroup index(i) = rowGroupId - 1
     RowGroupParameter *rowGroupParam =
         &scanParam->rowGroupParams[rowGroupId - 1];
-    ColumnParameter *columnParam = scanParam->columnParam;
-
-    robj **cachedColumnVectorObjs = (robj **) zmalloc(
-        sizeof(robj *) * columnParam->columnCount);
-    int *cachedColumnVectorIds = (int *) zmalloc(
-        sizeof(int) * columnParam->columnCount);
-    for (int i = 0; i < columnParam->columnCount; ++i) {
-        cachedColumnVectorObjs[i] = NULL;
-        cachedColumnVectorIds[i] = -1;
-    }
 
     serverLog(LL_DEBUG, "     ");
     serverLog(LL_DEBUG, "[SCAN] Scan On Redis");
-    serverLog(
-        LL_DEBUG,
-        "RowGroupId[%d], RowGroup->rowCount[%d]",
-        rowGroupId, rowGroupParam->rowCount);
-
-    size_t numReplies = 0;
-
-    for (size_t j = 0; j < rowGroupParam->rowCount; ++j) {
-        size_t rowId = j + 1;
-        for (size_t k = 0; k < columnParam->columnCount; ++k) {
-            size_t columnId = (long) vectorGet(&columnParam->columnIdList, k);
-            int columnVectorId = getColumnVectorId(rowId);
-
-            // Caching column vector.
-            if (columnVectorId != cachedColumnVectorIds[k]) {
-                serverLog(
-                    LL_DEBUG,
-                    "Miss! rowGroupId[%zu], rowId[%zu], columnId[%zu], columnVectorId[%zu], cachedColumnVectorIds[%d][%d]",
-                    rowGroupId, rowId, columnId, columnVectorId,
-                    k, cachedColumnVectorIds[k]);
-                // Redis Column Vector
-                // Redis Key, which is DataField key (Row & Column pair)
-                // Ex) "1:2"
-                sds dataKey = getDataFieldSds(columnVectorId, columnId);
-                robj *hashDictObj = rowGroupParam->dictObj;
-                dict *hashDict = (dict *) hashDictObj->ptr;
-                dictEntry *entry = dictFind(hashDict, dataKey);
-                if (entry == NULL) {
-                    serverLog(
-                        LL_WARNING,
-                        "[SCAN][FATAL] dataKey[%s] is not exist on hashDict.",
-                        dataKey);
-                    serverLog(
-                        LL_WARNING,
-                        "[SCAN][FATAL] RowGroup: %d, Row: %d, Column: %d, ColumnVector: %d",
-                        rowGroupId, rowId, columnId, columnVectorId);
-                }
-                cachedColumnVectorIds[k] = columnVectorId;
-                cachedColumnVectorObjs[k] = (robj *) dictGetVal(entry);
-                sdsfree(dataKey);
-            } else {
-                serverLog(
-                    LL_DEBUG,
-                    "Hit! rowGroupId[%zu], rowId[%zu], columnId[%zu], columnVectorId[%zu], cachedColumnVectorIds[%d][%d]",
-                    rowGroupId, rowId, columnId, columnVectorId,
-                    k, cachedColumnVectorIds[k]);
-            }
-
-            Vector *columnVector =
-                (Vector *) cachedColumnVectorObjs[k]->ptr;
-            if (columnVector == NULL) {
-                serverLog(
-                    LL_WARNING,
-                    "rowGroupId[%zu], rowId[%zu], columnId[%zu], columnVectorId[%zu], ColumnVectorIndex[%zu], ColumnVectorPtr[%p]",
-                    rowGroupId, rowId, columnId, columnVectorId,
-                    getColumnVectorIndex(rowId), columnVector);
-                serverLog(LL_WARNING, "ColumnVector Pointer: %p", columnVector);
-            }
-            sds value = vectorGet(columnVector, getColumnVectorIndex(rowId));
-            if (value == NULL) {
-                serverLog(
-                    LL_WARNING,
-                    "rowGroupId[%zu], rowId[%zu], columnId[%zu], columnVectorId[%zu], ColumnVectorIndex[%zu], value[%s]",
-                    rowGroupId, rowId, columnId, columnVectorId,
-                    getColumnVectorIndex(rowId), value);
-                for (size_t l = 0; l < vectorCount(columnVector); ++l) {
-                    serverLog(
-                        LL_WARNING, "ColumnVector[%zu]: [%s]", l,
-                        vectorGet(columnVector, l));
-                }
-            }
-            addReplyBulkCBuffer(c, value, sdslen(value));
-            numReplies++;
-        }
-    }
-
-    zfree(cachedColumnVectorObjs);
-    zfree(cachedColumnVectorIds);
-    return numReplies;
+    return _scanRowGroup(c, db, rowGroupId, scanParam,
+                         (dict *) rowGroupParam->dictObj->ptr);
 }
 
 size_t _cachedScanOnRocksDB(client *c, redisDb *db, size_t rowGroupId,
@@ -1021,7 +1490,7 @@ size_t _cachedScanOnRocksDB(client *c, redisDb *db, size_t rowGroupId,
                         vectorGet(columnVector, l));
                 }
             }
-            addReplyBulkCBuffer(c, value, sdslen(value));
+            _addScanValue(c, scanParam, value, sdslen(value));
             numReplies++;
         }
     }
@@ -1049,16 +1518,19 @@ Vector *getColumnVectorFromRocksDB(redisDb *db, sds dataRocksKey) {
     value = rocksdb_get_cf(
             db->persistent_store->ps,
             db->persistent_store->ps_options->roptions,
-            db->persistent_store->ps_cf_handles[PERSISTENT_STORE_CF_RW],
+            getPersistentStoreKeyCF(db->persistent_store, dataRocksKey,
+                                    sdslen(dataRocksKey), 0),
             dataRocksKey, sdslen(dataRocksKey), &valueLen, &err);
 
     serverLog(LL_DEBUG, "[getColumnVectorFromRocksDB] value: %s", value);
 
     if (value == NULL) {
+        sds repr = persistentStoreKeyRepr(dataRocksKey, sdslen(dataRocksKey));
         serverLog(
                 LL_WARNING,
                 "[getColumnVectorFromRocksDB] Key: %s, value is not exist.",
-                dataRocksKey);
+                repr);
+        sdsfree(repr);
         return NULL;
     }
 
@@ -1076,93 +1548,83 @@ Vector *getColumnVectorFromRocksDB(redisDb *db, sds dataRocksKey) {
     return vector;
 }
 
-size_t _cachedScanOnRocksDB_iterator(client *c, redisDb *db, size_t rowGroupId,
-                                     ScanParameter *scanParam) {
-    // RowGroup index(i) = rowGroupId - 1
-    RowGroupParameter *rowGroupParam =
-        &scanParam->rowGroupParams[rowGroupId - 1];
-    ColumnParameter *columnParam = scanParam->columnParam;
+/*
+ * loadRowGroupFromRocksDB
+ * Rebuilds the REL encoded rowgroup 'dataKey' from the column vectors
+ * stored in RocksDB. Returns NULL if RocksDB has no column vector of the
+ * rowgroup.
+ */
+robj *loadRowGroupFromRocksDB(redisDb *db, sds dataKey) {
+    persistent_store_t *ps = db->persistent_store;
+    sds prefix = persistentStoreKeyFromDataKey(dataKey, sdslen(dataKey),
+                                               NULL, 0);
+    robj *relation = createDataHashdictFordict();
+    dict *hashDict = (dict *) relation->ptr;
+
+    rocksdb_iterator_t *iter = rocksdb_create_iterator_cf(
+        ps->ps, ps->ps_options->roptions,
+        getPersistentStoreKeyCF(ps, dataKey, sdslen(dataKey), 0));
+    for (rocksdb_iter_seek(iter, prefix, sdslen(prefix));
+         rocksdb_iter_valid(iter); rocksdb_iter_next(iter)) {
+        size_t keyLen, valueLen;
+        const char *key = rocksdb_iter_key(iter, &keyLen);
+        const char *value = rocksdb_iter_value(iter, &valueLen);
+
+        if (keyLen < sdslen(prefix) ||
+            memcmp(key, prefix, sdslen(prefix)) != 0) break;
+
+        sds rawVector = sdsnewlen(value, valueLen);
+        Vector *vector;
+        if (vectorDeserialize(rawVector, &vector) == C_ERR) {
+            serverLog(
+                LL_WARNING,
+                "[FATAL][loadRowGroupFromRocksDB] Failed to deserialize vector.");
+            serverAssert(0);
+        }
+        sdsfree(rawVector);
+
+        robj *columnVectorObj = createObject(OBJ_VECTOR, vector);
+        columnVectorObj->lru = (LFUGetTimeInMinutes()<<8) | LFU_INIT_VAL;
+        sds field = persistentStoreKeyField(key, keyLen);
+        if (dictAdd(hashDict, field, columnVectorObj) != DICT_OK) {
+            sdsfree(field);
+            decrRefCount(columnVectorObj);
+        }
+    }
+    rocksdb_iter_destroy(iter);
+    sdsfree(prefix);
 
-    ColumnVectorIter *cachedColumnVectorIters = (ColumnVectorIter *) zmalloc(
-        sizeof(ColumnVectorIter) * columnParam->columnCount);
-    int *cachedColumnVectorIds = (int *) zmalloc(
-        sizeof(int) * columnParam->columnCount);
-    for (size_t i = 0; i < columnParam->columnCount; ++i) {
-        cachedColumnVectorIters[i].col_v = NULL;
-        cachedColumnVectorIds[i] = -1;
+    if (dictSize(hashDict) == 0) {
+        decrRefCount(relation);
+        return NULL;
     }
+    return relation;
+}
 
+size_t _cachedScanOnRocksDB_iterator(client *c, redisDb *db, size_t rowGroupId,
+                                     ScanParameter *scanParam) {
     serverLog(LL_DEBUG, "     ");
     serverLog(LL_DEBUG, "[SCAN] Scan On RocksDB");
-    serverLog(LL_DEBUG, "RowGroup->rowCount: %d", rowGroupParam->rowCount);
-
-    size_t numReplies = 0;
-
-    for (size_t j = 0; j < rowGroupParam->rowCount; ++j) {
-        size_t rowId = j + 1;
-        for (size_t k = 0; k < columnParam->columnCount; ++k) {
-            size_t columnId = (long) vectorGet(&columnParam->columnIdList, k);
-            size_t columnVectorId = getColumnVectorId(rowId);
-
-            // Caching column vector.
-            if (columnVectorId != cachedColumnVectorIds[k]) {
-                serverLog(
-                    LL_DEBUG,
-                    "Miss! rowGroupId[%zu], rowId[%zu], columnId[%zu], columnVectorId[%zu], cachedColumnVectorIds[%d][%d]",
-                    rowGroupId, rowId, columnId, columnVectorId,
-                    k, cachedColumnVectorIds[k]);
-                // RocksDB Column Vector
-                // RocksDB Key, which is Rocks key
-                // Ex) ""
-                sds dataKey = generateDataRocksKeySds(
-                    scanParam->dataKeyInfo, columnVectorId, columnId);
-                sds colVector = getRawColumnVectorFromRocksDB(db, dataKey);
-                cachedColumnVectorIds[k] = columnVectorId;
-
-                if (cachedColumnVectorIters[k].col_v != NULL) {
-                    sdsfree(cachedColumnVectorIters[k].col_v);
-                }
-
-                ColumnVectorIter begin, end;
-                makeColumnVectorIter(colVector, &begin, &end);
-                cachedColumnVectorIters[k] = begin;
-                sdsfree(dataKey);
-            } else {
-                serverLog(
-                    LL_DEBUG,
-                    "Hit! rowGroupId[%zu], rowId[%zu], columnId[%zu], columnVectorId[%zu], cachedColumnVectorIds[%d][%d]",
-                    rowGroupId, rowId, columnId, columnVectorId,
-                    k, cachedColumnVectorIds[k]);
-            }
-
-            char *value = NULL;
-            size_t value_size = 0;
-            if (columnVectorIterGetNoCopy(cachedColumnVectorIters[k], &value, &value_size) == C_ERR) {
-                serverLog(
-                    LL_WARNING,
-                    "rowGroupId[%zu], rowId[%zu], columnId[%zu], columnVectorId[%zu], ColumnVectorIndex[%zu], value[%s]",
-                    rowGroupId, rowId, columnId, columnVectorId, getColumnVectorIndex(rowId), value);
-            }
-            int eoi = 0;
-            columnVectorIterNext(&cachedColumnVectorIters[k], &eoi);
-
-            addReplyBulkCBuffer(c, value, value_size);
-            numReplies++;
-        }
-    }
-
-    // Removes created ColumnVector robjs.
-    for (size_t k = 0; k < columnParam->columnCount; ++k) {
-        sds colVector = cachedColumnVectorIters[k].col_v;
-        if (colVector != NULL) {
-            sdsfree(colVector);
-        }
-    }
+    return _scanRowGroup(c, db, rowGroupId, scanParam, NULL);
+}
 
-    zfree(cachedColumnVectorIters);
-    zfree(cachedColumnVectorIds);
+/*
+ * _cachedScanMixed
+ * Scans a persisted RowGroup which is still in memory. With the column
+ * granular tiering only the hot column vectors stay in the RowGroup dict,
+ * so every column vector is taken from memory when it is there and from
+ * RocksDB otherwise.
+ */
+size_t _cachedScanMixed(client *c, redisDb *db, size_t rowGroupId,
+                        ScanParameter *scanParam) {
+    // RowGroup index(i) = rowGroupId - 1
+    RowGroupParameter *rowGroupParam =
+        &scanParam->rowGroupParams[rowGroupId - 1];
 
-    return numReplies;
+    serverLog(LL_DEBUG, "     ");
+    serverLog(LL_DEBUG, "[SCAN] Scan On Redis & RocksDB");
+    return _scanRowGroup(c, db, rowGroupId, scanParam,
+                         (dict *) rowGroupParam->dictObj->ptr);
 }
 
 sds getRawColumnVectorFromRocksDB(redisDb *db, sds dataRocksKey) {
@@ -1176,16 +1638,19 @@ sds getRawColumnVectorFromRocksDB(redisDb *db, sds dataRocksKey) {
     value = rocksdb_get_cf(
             db->persistent_store->ps,
             db->persistent_store->ps_options->roptions,
-            db->persistent_store->ps_cf_handles[PERSISTENT_STORE_CF_RW],
+            getPersistentStoreKeyCF(db->persistent_store, dataRocksKey,
+                                    sdslen(dataRocksKey), 0),
             dataRocksKey, sdslen(dataRocksKey), &valueLen, &err);
 
     serverLog(LL_DEBUG, "[getColumnVectorFromRocksDB] value: %s", value);
 
     if (value == NULL) {
+        sds repr = persistentStoreKeyRepr(dataRocksKey, sdslen(dataRocksKey));
         serverLog(
                 LL_WARNING,
                 "[getColumnVectorFromRocksDB] Key: %s, value is not exist.",
-                dataRocksKey);
+                repr);
+        sdsfree(repr);
         return NULL;
     }
 
@@ -1376,6 +1841,8 @@ int parsePartitions(const char *partitionInfo, Vector *v) {
 
     token = strtok_r(copyStr, RELMODEL_DELIMITER, &savePtr);
     while (savePtr[0] != '\0') {
+        /* The shard of a sharded partition isn't a partition value. */
+        if (token[0] == RELMODEL_SHARD_PREFIX[0]) break;
         PartitionParameter *param = (PartitionParameter *) zmalloc(
                 sizeof(PartitionParameter));
         param->columnId = atoi(token);
@@ -1404,6 +1871,30 @@ int parsePartitions(const char *partitionInfo, Vector *v) {
     return C_OK;
 }
 
+/*
+ * partitionShardId
+ *  Returns the shard of a partition of a sharded table, given by the
+ *  ":#<shard>" ending its partition info, or -1 if it has none. The shard
+ *  takes the place of a column id, a value starting with '#' isn't taken
+ *  for it.
+ * --- Usage Examples ---
+ *  partitionShardId("1:2:#3") = 3
+ *  partitionShardId("1:#3") = -1
+ */
+int partitionShardId(const char *partitionInfo) {
+    const char *shard = strrchr(partitionInfo, RELMODEL_DELIMITER[0]);
+    int delimiters = 0;
+    long long id;
+
+    if (shard == NULL || shard[1] != RELMODEL_SHARD_PREFIX[0] ||
+        !string2ll(shard + 2, strlen(shard + 2), &id) || id < 0 ||
+        id > INT_MAX)
+        return -1;
+    for (const char *p = partitionInfo; p < shard; p++)
+        delimiters += *p == RELMODEL_DELIMITER[0];
+    return delimiters % 2 ? (int) id : -1;
+}
+
 void _freePartitionParameters(Vector *partitions) {
     for (size_t i = 0; i < vectorCount(partitions); ++i) {
         PartitionParameter *param = (PartitionParameter *) vectorGet(
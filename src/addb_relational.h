@@ -153,12 +153,17 @@ typedef struct _ColumnParameter {
     Vector columnIdStrList;     // string vector
 } ColumnParameter;
 
+/* Consumes the values of a scan instead of the client reply. */
+typedef void scanValueProc(void *privdata, const char *value, size_t len);
+
 typedef struct _ScanParameter {
     int startRowGroupId;
     int totalRowGroupCount;
     NewDataKeyInfo *dataKeyInfo;
     RowGroupParameter *rowGroupParams;
     ColumnParameter *columnParam;
+    scanValueProc *valueProc;   // NULL to reply the values
+    void *privdata;
 } ScanParameter;
 
 /*Partition Filter Parameters*/
@@ -207,6 +212,7 @@ dictEntry *getPrevCandidatedictEntry(client *c, NewDataKeyInfo *dataKeyInfo);
 int getRowNumberInfoAndSetRowNumberInfo(redisDb *db, NewDataKeyInfo *dataKeyInfo);
 int getRowGroupInfoAndSetRowGroupInfo(redisDb *db, NewDataKeyInfo *keyInfo);
 int getRowgroupInfo(redisDb *db, NewDataKeyInfo *dataKeyInfo);
+int getRowNumberOfDataKey(redisDb *db, sds dataKey);
 
 /*lookup Metadict function*/
 int lookupCompInfoForMeta(robj *metaHashdictObj,robj* metaField);
@@ -226,6 +232,7 @@ robj * generateDataKey(NewDataKeyInfo *dataKeyInfo);
 sds generateDataKeySds(NewDataKeyInfo *dataKeyInfo);
 robj *generateDataRocksKey(NewDataKeyInfo *dataKeyInfo, int rowId,
                            int columnId);
+sds dataKeyToRocksKeySds(sds dataKey, sds field);
 sds generateDataRocksKeySds(NewDataKeyInfo *dataKeyInfo, int rowId,
                             int columnId);
 
@@ -240,22 +247,33 @@ sds getDataFieldSds(int rowId, int columnId);
 int insertKVpairToRelational(client *c, robj *dataKeyString, robj *dataField, robj *valueObj);
 void prepareWriteToRocksDB(redisDb *db, robj *keyobj, robj *targetVal);
 void prepareBatchWriteToRocksDB(redisDb *db, Vector *evict_keys,
-                                Vector *evict_relations);
+                                Vector *evict_relations,
+                                const uint32_t *rowCounts);
+int restoreTieredColumnVectors(redisDb *db, int tableId, robj **argv,
+                               int count, sds *err);
+int dropPartition(redisDb *db, NewDataKeyInfo *dataKeyInfo, sds *err);
+int loadColumnVector(redisDb *db, robj *dataKey, int location, sds field,
+                     robj **values, int count);
 
 /*Scan*/
 ColumnParameter *parseColumnParameter(const sds rawColumnIdsString);
 ScanParameter *createScanParameter(const client *c);
+ScanParameter *createScanParameterForKey(redisDb *db, sds dataKey,
+                                         sds rawColumnIdsString);
 void freeColumnParameter(ColumnParameter *param);
 void freeScanParameter(ScanParameter *param);
 int populateScanParameter(redisDb *db, ScanParameter *scanParam);
 RowGroupParameter createRowGroupParameter(redisDb *db, robj *dataKey);
 Vector *getColumnVectorFromRocksDB(redisDb *db, sds dataRocksKey);
+robj *loadRowGroupFromRocksDB(redisDb *db, sds dataKey);
 // Non-vector scan functions
 size_t scanDataFromADDB(client *c, redisDb *db, ScanParameter *scanParam);
 size_t _cachedScan(client *c, redisDb *db, size_t rowGroupId,
                    ScanParameter *scanParam);
 size_t _cachedScanOnRocksDB(client *c, redisDb *db, size_t rowGroupId,
                             ScanParameter *scanParam);
+size_t _cachedScanMixed(client *c, redisDb *db, size_t rowGroupId,
+                        ScanParameter *scanParam);
 size_t _cachedScanOnRocksDB_iterator(client *c, redisDb *db, size_t rowGroupId,
                                      ScanParameter *scanParam);
 sds getRawColumnVectorFromRocksDB(redisDb *db, sds dataRocksKey);
@@ -265,6 +283,10 @@ int dateStrToInteger(const char *dateStr, long *result);
 bool validateStatements(const sds rawStatementsStr);
 bool validateStatement(const sds rawStatementStr);
 int parsePartitions(const char *partitionInfo, Vector *v);
+int partitionShardId(const char *partitionInfo);
+void _freePartitionParameters(Vector *partitions);
+sds convertLikeStatementToGlobPattern(const int optype,
+                                      const sds likeStatement);
 int parseStatement(const sds rawStatementStr, Condition **root);
 int createCondition(const char *rawConditionStr, Stack *s, Condition **cond);
 bool _evaluateLeafOperator(const int optype, const ConditionChild *first,
@@ -276,4 +298,19 @@ bool evaluateCondition(const Condition *cond, const sds metakey);
 void logCondition(const Condition *cond);
 void freeConditions(Condition *cond);
 
+/*Partition Index*/
+typedef struct partitionFilter partitionFilter;
+
+partitionFilter *getPartitionFilter(const char *statement);
+void releasePartitionFilter(partitionFilter *f);
+void partitionIndexFilter(redisDb *db, sds pattern, Vector *filters,
+                          Vector *metakeys);
+int getPartitionFiltersOrReply(client *c, sds rawStatementsStr,
+                               Vector *filters);
+void releasePartitionFilters(Vector *filters);
+int partitionIndexList(redisDb *db, sds pattern, Vector *metakeys);
+void partitionIndexTableIds(redisDb *db, Vector *ids);
+int partitionIndexTableStats(redisDb *db, int tableId, long long *partitions,
+                             long long *rowGroups, long long *rows);
+
 #endif
@@ -9,6 +9,7 @@
 #include "addb_relational.h"
 #include "stl.h"
 #include "circular_queue.h"
+#include "tiering.h"
 
 /*ADDB*/
 /*
@@ -33,7 +34,62 @@
  *  Results:
  *      redis-cli> OK
  */
-void fpWriteCommand(client *c){
+/* The rows appended by the last FPWRITE, see fpWriteBatchPropagate() */
+static struct {
+    sds dataKey;            /* Rowgroup the rows were appended to */
+    long long startRow;     /* Row number of the first row */
+    long long rows;
+} fpLastWrite;
+
+/* FPWRITEs appending to the same rowgroup are propagated as a single
+ * FPWRITEC carrying the values of all of them in one block. A batch is
+ * pending for every partition written since the last flush. */
+typedef struct fpWriteBatch {
+    int dbid;
+    int flags;              /* PROPAGATE_* */
+    robj *argv[5];          /* FPWRITE key partition ncols indexColumn */
+    sds dataKey;            /* Rowgroup of the batched rows */
+    long long nextRow;      /* Row number following the batched rows */
+    long long rows;
+    sds block;              /* Values, see blockCatElement() */
+    sds id;                 /* "<dbid>:<key>", owned by fpWriteBatches */
+    listNode *node;         /* Node in fpWriteBatchOrder */
+} fpWriteBatch;
+
+static dict *fpWriteBatches;        /* Pending batch of every partition */
+static list *fpWriteBatchOrder;     /* Pending batches, oldest first */
+static int fpWriteBatchFlushing;
+static long long fpWriteBatchOffset; /* Replication offset after the last
+                                        batch propagated */
+
+/* Reply an error and return C_ERR unless the partition written is a shard
+ * of a table sharded by FPTABLEOPT, or a plain partition of a table which
+ * is not. The writes of the master and of the AOF were accepted already. */
+static int checkPartitionShardOrReply(client *c, NewDataKeyInfo *dataKeyInfo){
+    int shards, shard;
+
+    if (server.loading || c->flags & CLIENT_MASTER) return C_OK;
+    shards = getPersistentStoreTableShards(c->db->persistent_store,
+                                           dataKeyInfo->tableId);
+    shard = partitionShardId(dataKeyInfo->partitionInfo.partitionString);
+    if (shards == 1 && shard == -1) return C_OK;
+    if (shards > 1 && shard >= 0 && shard < shards) return C_OK;
+
+    if (shards == 1)
+        addReplyErrorFormat(c, "[FPWRITE] table %d is not sharded",
+                            dataKeyInfo->tableId);
+    else
+        addReplyErrorFormat(c,
+                "[FPWRITE] table %d is sharded, append :%s<0..%d> to the "
+                "partition", dataKeyInfo->tableId, RELMODEL_SHARD_PREFIX,
+                shards - 1);
+    return C_ERR;
+}
+
+/* Append the 'value_num' values to the partition c->argv[1], c->argv[2]
+ * to c->argv[4] being the FPWRITE arguments. Shared by FPWRITE and
+ * FPWRITEC. */
+static void fpWriteGenericCommand(client *c, robj **values, int value_num){
 
     serverLog(LL_DEBUG,"FPWRITE COMMAND START");
 
@@ -53,10 +109,16 @@ void fpWriteCommand(client *c){
     assert(column_number <= MAX_COLUMN_NUMBER);
     serverLog(LL_DEBUG, "fpWrite Column Number : %d", column_number);
 
-    /*get value number*/
-    int value_num = c->argc - 5;
+    sdsfree(fpLastWrite.dataKey);
+    fpLastWrite.dataKey = NULL;
     serverLog(LL_DEBUG ,"VALUE NUM : %d", value_num);
 
+    /*check the shard of a sharded table*/
+    if (checkPartitionShardOrReply(c, dataKeyInfo) != C_OK) {
+        zfree(dataKeyInfo);
+        return;
+    }
+
     /*compare with column number and arguments*/
     if((value_num % column_number) != 0 ){
     	serverLog(LL_WARNING,"column number and args number do not match");
@@ -94,8 +156,7 @@ void fpWriteCommand(client *c){
 		if (entryDict != NULL) {
 			robj * val = dictGetVal(entryDict);
 
-			// __sync_synchronize();
-			if (val->location != LOCATION_REDIS_ONLY && !Enroll_queue) {
+			if (objGetLocation(val) != LOCATION_REDIS_ONLY && !Enroll_queue) {
 				rowGroupId = IncRowgroupIdAndModifyInfo(c->db, dataKeyInfo, 1);
 				// incRowNumber(c->db, dataKeyInfo, 0);
 				decrRefCount(dataKeyString);
@@ -118,9 +179,9 @@ void fpWriteCommand(client *c){
 
     int idx =0;
     int init =0;
-    for(i = 5; i < c->argc; i++){
+    for(i = 0; i < value_num; i++){
 
-    	robj *valueObj = getDecodedObject(c->argv[i]);
+    	robj *valueObj = getDecodedObject(values[i]);
 
     	//Create field Info
     	int row_idx = row_number + (idx / column_number) + 1;
@@ -157,6 +218,7 @@ void fpWriteCommand(client *c){
     /*addb update row number info*/
     insertedRow /= column_number;
     incRowNumber(c->db, dataKeyInfo, insertedRow);
+    server.stat_fpwrite_rows += insertedRow;
 
     serverLog(LL_DEBUG,"FPWRITE COMMAND END");
 
@@ -170,11 +232,307 @@ void fpWriteCommand(client *c){
     	}
     }
 
+    fpLastWrite.dataKey = sdsdup(dataKeyString->ptr);
+    fpLastWrite.startRow = row_number;
+    fpLastWrite.rows = insertedRow;
+
     decrRefCount(dataKeyString);
     zfree(dataKeyInfo);
     addReply(c, shared.ok);
 }
 
+void fpWriteCommand(client *c){
+    fpWriteGenericCommand(c, c->argv + 5, c->argc - 5);
+}
+
+/*
+ * fpWritecCommand
+ *  Write relation data to ADDB, the values packed in a single block.
+ *  FPWRITEs are propagated to the AOF and the slaves in this form, see
+ *  fpWriteBatchPropagate().
+ * --- Parameters ---
+ *  arg1~arg4:  Same as FPWRITE
+ *  arg5:       Number of rows
+ *  arg6:       Column Data, every value prefixed by its length
+ *              (see blockCatElement())
+ */
+void fpWritecCommand(client *c){
+    long long ncols, nrows, count, j;
+    const char *p, *end, *ele;
+    size_t len;
+    robj *block, **values;
+
+    if (getLongLongFromObjectOrReply(c, c->argv[3], &ncols, NULL) != C_OK ||
+        getLongLongFromObjectOrReply(c, c->argv[5], &nrows, NULL) != C_OK)
+        return;
+
+    block = getDecodedObject(c->argv[6]);
+    p = block->ptr;
+    end = p + sdslen(block->ptr);
+    /* Every value takes one byte at least. */
+    if (ncols <= 0 || ncols > MAX_COLUMN_NUMBER || nrows <= 0 ||
+        nrows > (long long) sdslen(block->ptr) / ncols) {
+        addReplyError(c, "Invalid FPWRITEC number of rows or columns");
+        decrRefCount(block);
+        return;
+    }
+
+    count = nrows * ncols;
+    values = zmalloc(sizeof(robj *) * count);
+    for (j = 0; j < count; j++) {
+        if (blockNextElement(&p, end, &ele, &len) == C_ERR) break;
+        values[j] = createStringObject(ele, len);
+    }
+    if (j == count && p == end)
+        fpWriteGenericCommand(c, values, count);
+    else
+        addReplyError(c, "Invalid FPWRITEC block");
+
+    while (j--) decrRefCount(values[j]);
+    zfree(values);
+    decrRefCount(block);
+}
+
+/* Propagate the batch 'b' as a FPWRITEC and free it. */
+static void fpWriteBatchEmit(fpWriteBatch *b){
+    robj *argv[7];
+    int j;
+
+    dictDelete(fpWriteBatches, b->id);
+    listDelNode(fpWriteBatchOrder, b->node);
+
+    argv[0] = createStringObject("FPWRITEC", 8);
+    for (j = 1; j < 5; j++) argv[j] = b->argv[j];
+    argv[5] = createStringObjectFromLongLong(b->rows);
+    argv[6] = createObject(OBJ_STRING, b->block);
+    /* propagate() flushes every batch otherwise. */
+    fpWriteBatchFlushing = 1;
+    propagate(server.fpwritecCommand, b->dbid, argv, 7, b->flags);
+    fpWriteBatchFlushing = 0;
+    for (j = 0; j < 7; j++) decrRefCount(argv[j]);
+
+    fpWriteBatchOffset = server.master_repl_offset;
+    sdsfree(b->dataKey);
+    zfree(b);
+}
+
+/* Called by call() instead of propagate() for every write command. The
+ * values of a FPWRITE continuing the rowgroup of the batch pending for
+ * its partition are added to it, otherwise that batch is propagated and
+ * a new one is started. Returns 1 if the command was batched, 0 if it
+ * must be propagated.
+ *
+ * Transactions, scripts and the stream of the master are propagated
+ * verbatim. */
+int fpWriteBatchPropagate(client *c, int flags){
+    sds dataKey = fpLastWrite.dataKey, id;
+    long long startRow = fpLastWrite.startRow, rows = fpLastWrite.rows;
+    fpWriteBatch *b = NULL;
+    dictEntry *de;
+    int j;
+
+    fpLastWrite.dataKey = NULL;
+    if (c->cmd->proc != fpWriteCommand || dataKey == NULL ||
+        server.fpwrite_batch_bytes == 0 ||
+        c->flags & (CLIENT_MULTI|CLIENT_LUA|CLIENT_MASTER)) {
+        sdsfree(dataKey);
+        return 0;
+    }
+
+    if (fpWriteBatches == NULL) {
+        fpWriteBatches = dictCreate(&setDictType, NULL);
+        fpWriteBatchOrder = listCreate();
+    }
+
+    id = sdscatprintf(sdsempty(), "%d:%s", c->db->id,
+                      (char *) c->argv[1]->ptr);
+    if ((de = dictFind(fpWriteBatches, id)) != NULL) {
+        int same;
+
+        b = dictGetVal(de);
+        same = b->flags == flags && b->nextRow == startRow &&
+               sdslen(b->block) < server.fpwrite_batch_bytes &&
+               sdscmp(b->dataKey, dataKey) == 0;
+        for (j = 2; same && j < 5; j++)
+            same = equalStringObjects(b->argv[j], c->argv[j]);
+        if (!same) {
+            fpWriteBatchEmit(b);
+            b = NULL;
+        }
+    }
+
+    if (b == NULL) {
+        b = zmalloc(sizeof(*b));
+        b->dbid = c->db->id;
+        b->flags = flags;
+        for (j = 1; j < 5; j++) {
+            b->argv[j] = c->argv[j];
+            incrRefCount(c->argv[j]);
+        }
+        b->dataKey = dataKey;
+        b->rows = 0;
+        b->block = sdsempty();
+        b->id = id;
+        listAddNodeTail(fpWriteBatchOrder, b);
+        b->node = listLast(fpWriteBatchOrder);
+        dictAdd(fpWriteBatches, b->id, b);
+    } else {
+        sdsfree(dataKey);
+        sdsfree(id);
+    }
+
+    for (j = 5; j < c->argc; j++) {
+        robj *value = getDecodedObject(c->argv[j]);
+        b->block = blockCatElement(b->block, value->ptr, sdslen(value->ptr));
+        decrRefCount(value);
+    }
+    b->rows += rows;
+    b->nextRow = startRow + rows;
+    return 1;
+}
+
+/* Propagate the pending batches as FPWRITEC, oldest first. Called before
+ * anything else is propagated, before the AOF is flushed and before a
+ * child is forked. Returns the replication offset following the last
+ * batch propagated. */
+long long fpWriteBatchFlush(void){
+    listNode *ln;
+
+    if (fpWriteBatchFlushing || fpWriteBatchOrder == NULL)
+        return fpWriteBatchOffset;
+    while ((ln = listFirst(fpWriteBatchOrder)) != NULL)
+        fpWriteBatchEmit(listNodeValue(ln));
+    return fpWriteBatchOffset;
+}
+
+/*
+ * fpCvLoadCommand
+ *  Replace a column vector of a rowgroup, the rowgroup is created if
+ *  needed. An AOF rewrite emits one FPCVLOAD per column vector.
+ * --- Parameters ---
+ *  arg1:  dataKey
+ *  arg2:  Location of the rowgroup (LOCATION_REDIS_ONLY, LOCATION_PERSISTED)
+ *  arg3:  Column vector field
+ *  arg4~: Values
+ * --- Usage Examples ---
+ *  Command:
+ *      redis-cli> FPCVLOAD D:{100:1:2}:G:1 0 1:2 a b c
+ *  Results:
+ *      redis-cli> OK
+ */
+void fpCvLoadCommand(client *c){
+    long long location;
+
+    if (getLongLongFromObjectOrReply(c, c->argv[2], &location, NULL) != C_OK)
+        return;
+    if (location != LOCATION_REDIS_ONLY && location != LOCATION_PERSISTED) {
+        addReplyError(c, "Invalid rowgroup location");
+        return;
+    }
+    if (loadColumnVector(c->db, c->argv[1], (int) location, c->argv[3]->ptr,
+                         c->argv + 4, c->argc - 4) == C_ERR) {
+        addReply(c, shared.wrongtypeerr);
+        return;
+    }
+    server.dirty++;
+    addReply(c, shared.ok);
+}
+
+/* Replace the column vector 'field' of the rowgroup 'dataKey' by the
+ * 'count' values of 'values'. The rowgroup is created if needed, at
+ * 'location'. Returns C_ERR if 'dataKey' holds something else. */
+int loadColumnVector(redisDb *db, robj *dataKey, int location, sds field,
+                     robj **values, int count) {
+    dictEntry *de;
+    Vector *v;
+    robj *o, *vo;
+    int j;
+
+    if ((de = dictFind(db->dict, dataKey->ptr)) == NULL) {
+        o = createDataHashdictFordict();
+        dbAdd(db, dataKey, o);
+        enqueue(db->EvictQueue, dictFind(db->dict, dataKey->ptr));
+    } else {
+        o = dictGetVal(de);
+        if (o->type != OBJ_HASH || o->encoding != OBJ_ENCODING_REL)
+            return C_ERR;
+        /* A tiering worker may still be reading the column vectors of a
+         * rowgroup being flushed: let it finish before replacing them. */
+        if (objGetLocation(o) == LOCATION_FLUSH) tieringWaitIdle();
+    }
+    objSetLocation(o, location);
+
+    v = zmalloc(sizeof(Vector));
+    vectorTypeInitWithSize(v, STL_TYPE_SDS,
+                           count > 0 ? count : INIT_VECTOR_SIZE);
+    for (j = 0; j < count; j++) {
+        robj *value = getDecodedObject(values[j]);
+        vectorAdd(v, sdsdup(value->ptr));
+        decrRefCount(value);
+    }
+    vo = createObject(OBJ_VECTOR, v);
+    vo->lru = (LFUGetTimeInMinutes()<<8) | LFU_INIT_VAL;
+
+    if ((de = dictFind(o->ptr, field)) != NULL) {
+        decrRefCount(dictGetVal(de));
+        dictSetVal((dict *) o->ptr, de, vo);
+    } else {
+        dictAdd(o->ptr, sdsdup(field), vo);
+    }
+
+    signalModifiedKey(db, dataKey);
+    return C_OK;
+}
+
+/*
+ * fpMetaLoadCommand
+ *  Set fields of a Metadict entry. An AOF rewrite emits one FPMETALOAD
+ *  per partition.
+ * --- Parameters ---
+ *  arg1:  metaKey
+ *  arg2~: field value pairs
+ * --- Usage Examples ---
+ *  Command:
+ *      redis-cli> FPMETALOAD M:{100:1:2} 0 2 1 500 2 20
+ *  Results:
+ *      redis-cli> OK
+ */
+void fpMetaLoadCommand(client *c){
+    robj *o;
+    int j;
+
+    if ((c->argc % 2) == 1) {
+        addReplyError(c, "wrong number of arguments for FPMETALOAD");
+        return;
+    }
+
+    if ((o = lookupKeyWriteForMetadict(c->db, c->argv[1])) == NULL) {
+        o = createMetaHashdictFordict();
+        dbAddForMetadict(c->db, c->argv[1], o);
+    } else if (o->type != OBJ_HASH) {
+        addReply(c, shared.wrongtypeerr);
+        return;
+    }
+
+    hashTypeTryConversion(o, c->argv, 2, c->argc - 1);
+    for (j = 2; j < c->argc; j += 2) {
+        long long field, value, old = 0;
+        robj *cur = hashTypeGetValueObject(o, c->argv[j]->ptr);
+
+        if (cur) {
+            if (getLongLongFromObject(cur, &old) != C_OK) old = 0;
+            decrRefCount(cur);
+        }
+        hashTypeSet(o, c->argv[j]->ptr, c->argv[j+1]->ptr, HASH_SET_COPY);
+        if (getLongLongFromObject(c->argv[j], &field) == C_OK &&
+            getLongLongFromObject(c->argv[j+1], &value) == C_OK)
+            partitionIndexCount(c->db, c->argv[1]->ptr, field, old, value);
+    }
+
+    server.dirty++;
+    addReply(c, shared.ok);
+}
+
 
 void fpReadCommand(client *c) {
     serverLog(LL_DEBUG,"FPREAD COMMAND START");
@@ -258,6 +616,55 @@ void _addReplyMetakeysResults(client *c, Vector *metakeys) {
     return;
 }
 
+/* Compile the '$' separated filter statements of 'rawStatementsStr' to
+ * 'filters', every one of them must hold. On error the client is replied
+ * and C_ERR is returned, 'filters' is left empty. */
+int getPartitionFiltersOrReply(client *c, sds rawStatementsStr,
+                               Vector *filters) {
+    vectorInit(filters);
+    if (!validateStatements(rawStatementsStr)) {
+        serverLog(LL_WARNING, "[FILTER] Stack structure is not valid form: [%s]",
+                  rawStatementsStr);
+        addReplyErrorFormat(c, "[FILTER] Stack structure is not valid form: [%s]",
+                            rawStatementsStr);
+        return C_ERR;
+    }
+
+    char copyStr[sdslen(rawStatementsStr) + 1];
+    char *savePtr = NULL;
+    char *token = NULL;
+    memcpy(copyStr, rawStatementsStr, sdslen(rawStatementsStr) + 1);
+
+    token = strtok_r(copyStr, PARTITION_FILTER_STATEMENT_SUFFIX, &savePtr);
+    while (token != NULL) {
+        partitionFilter *filter = getPartitionFilter(token);
+
+        if (filter == NULL) {
+            serverLog(
+                    LL_WARNING,
+                    "[FILTER][FATAL] Stack condition parser failed, server would have a memory leak...: [%s]",
+                    rawStatementsStr);
+            addReplyErrorFormat(
+                    c,
+                    "[FILTER][FATAL] Stack condition parser failed, server would have a memory leak...: [%s]",
+                    rawStatementsStr);
+            releasePartitionFilters(filters);
+            return C_ERR;
+        }
+
+        vectorAdd(filters, filter);
+        token = strtok_r(NULL, PARTITION_FILTER_STATEMENT_SUFFIX, &savePtr);
+    }
+    return C_OK;
+}
+
+void releasePartitionFilters(Vector *filters) {
+    for (size_t i = 0; i < vectorCount(filters); ++i) {
+        releasePartitionFilter(vectorGet(filters, i));
+    }
+    vectorFree(filters);
+}
+
 /*
  * metakeysCommand
  *  Lookup key in metadict
@@ -304,25 +711,35 @@ void metakeysCommand(client *c){
     Vector metakeys;
     vectorTypeInit(&metakeys, STL_TYPE_SDS);
 
-    /*Pattern match searching for metakeys*/
-    dictIterator *di = dictGetSafeIterator(c->db->Metadict);
-    dictEntry *de = NULL;
-    while ((de = dictNext(di)) != NULL) {
-        sds metakey = (sds) dictGetKey(de);
-        if (
-                allkeys ||
-                stringmatchlen(pattern, sdslen(pattern), metakey,
-                               sdslen(metakey), 0)
-        ) {
-            vectorAdd(&metakeys, metakey);
-        }
-    }
-    dictReleaseIterator(di);
+    loadMetadictIfNeeded(c->db);
 
     /* If rawStatements is null or empty, prints pattern matching
      * results only...
      */
     if (c->argc < 3) {
+        /* A pattern with a literal table only lists that table */
+        if (!allkeys &&
+                partitionIndexList(c->db, pattern, &metakeys) == C_OK) {
+            _addReplyMetakeysResults(c, &metakeys);
+            vectorFree(&metakeys);
+            return;
+        }
+
+        /*Pattern match searching for metakeys*/
+        dictIterator *di = dictGetSafeIterator(c->db->Metadict);
+        dictEntry *de = NULL;
+        while ((de = dictNext(di)) != NULL) {
+            sds metakey = (sds) dictGetKey(de);
+            if (
+                    allkeys ||
+                    stringmatchlen(pattern, sdslen(pattern), metakey,
+                                   sdslen(metakey), 0)
+            ) {
+                vectorAdd(&metakeys, metakey);
+            }
+        }
+        dictReleaseIterator(di);
+
         /*Prints out target partitions*/
         /*Scan data to client*/
         _addReplyMetakeysResults(c, &metakeys);
@@ -330,66 +747,88 @@ void metakeysCommand(client *c){
         return;
     }
 
-    sds rawStatementsStr = (sds) c->argv[2]->ptr;
-
-    if (!validateStatements(rawStatementsStr)) {
-        serverLog(LL_WARNING, "[FILTER] Stack structure is not valid form: [%s]",
-                  rawStatementsStr);
-        addReplyErrorFormat(c, "[FILTER] Stack structure is not valid form: [%s]",
-                            rawStatementsStr);
+    Vector filters;
+    if (getPartitionFiltersOrReply(c, c->argv[2]->ptr, &filters) != C_OK) {
+        vectorFree(&metakeys);
         return;
     }
 
-    char copyStr[sdslen(rawStatementsStr) + 1];
-    char *savePtr = NULL;
-    char *token = NULL;
-    memcpy(copyStr, rawStatementsStr, sdslen(rawStatementsStr) + 1);
+    partitionIndexFilter(c->db, pattern, &filters, &metakeys);
+    releasePartitionFilters(&filters);
 
-    token = strtok_r(copyStr, PARTITION_FILTER_STATEMENT_SUFFIX, &savePtr);
-    while (token != NULL) {
-        Condition *root;
-        sds rawStatementStr = sdsnew(token);
-
-        if (parseStatement(rawStatementStr, &root) == C_ERR) {
-            serverLog(
-                    LL_WARNING,
-                    "[FILTER][FATAL] Stack condition parser failed, server would have a memory leak...: [%s]",
-                    rawStatementsStr);
-            addReplyErrorFormat(
-                    c,
-                    "[FILTER][FATAL] Stack condition parser failed, server would have a memory leak...: [%s]",
-                    rawStatementsStr);
-            return;
-        }
+    /*Prints out target partitions*/
+    /*Scan data to client*/
+    _addReplyMetakeysResults(c, &metakeys);
+    vectorFree(&metakeys);
+}
 
-        // serverLog(LL_DEBUG, "   ");
-        // serverLog(LL_DEBUG, "[FILTER][PARSE] Condition Tree");
-        // logCondition(root);
 
-        Vector filteredMetakeys;
-        vectorInit(&filteredMetakeys);
-        for (size_t i = 0; i < vectorCount(&metakeys); ++i) {
-            sds metakey = (sds) vectorGet(&metakeys, i);
-            if (evaluateCondition(root, metakey)) {
-                vectorAdd(&filteredMetakeys, metakey);
+/*
+ * fpTableStatsCommand
+ *  Counts of the partitions of tables, kept up to date by the Metadict.
+ *  Every shard of a sharded table counts as a partition.
+ * --- Parameters ---
+ *  arg1~: tableIds (optional, every table if none is given)
+ *
+ * --- Usage Examples ---
+ *  Command:
+ *      redis-cli> FPTABLESTATS 100
+ *  Results:
+ *      redis-cli> 1) 1) "table"
+ *                    2) (integer) 100
+ *                    3) "partitions"
+ *                    4) (integer) 4
+ *                    5) "rowgroups"
+ *                    6) (integer) 9
+ *                    7) "rows"
+ *                    8) (integer) 2048
+ *                    9) "shards"
+ *                   10) (integer) 1
+ */
+void fpTableStatsCommand(client *c) {
+    Vector ids;
+    long long partitions, rowGroups, rows;
+
+    loadMetadictIfNeeded(c->db);
+
+    vectorTypeInit(&ids, STL_TYPE_LONG);
+    if (c->argc == 1) {
+        partitionIndexTableIds(c->db, &ids);
+    } else {
+        for (int i = 1; i < c->argc; ++i) {
+            long long tableId;
+            if (getLongLongFromObjectOrReply(c, c->argv[i], &tableId,
+                                             NULL) != C_OK) {
+                vectorFree(&ids);
+                return;
             }
+            vectorAdd(&ids, (void *) (long) (int) tableId);
         }
-        vectorFree(&metakeys);
-        metakeys = filteredMetakeys;
-
-        sdsfree(rawStatementStr);
-        freeConditions(root);
-
-        token = strtok_r(NULL, PARTITION_FILTER_STATEMENT_SUFFIX, &savePtr);
     }
 
-    /*Prints out target partitions*/
-    /*Scan data to client*/
-    _addReplyMetakeysResults(c, &metakeys);
-    vectorFree(&metakeys);
+    addReplyMultiBulkLen(c, vectorCount(&ids));
+    for (size_t i = 0; i < vectorCount(&ids); ++i) {
+        int tableId = (int) (long) vectorGet(&ids, i);
+        if (partitionIndexTableStats(c->db, tableId, &partitions, &rowGroups,
+                                     &rows) != C_OK) {
+            partitions = rowGroups = rows = 0;
+        }
+        addReplyMultiBulkLen(c, 10);
+        addReplyBulkCString(c, "table");
+        addReplyLongLong(c, tableId);
+        addReplyBulkCString(c, "partitions");
+        addReplyLongLong(c, partitions);
+        addReplyBulkCString(c, "rowgroups");
+        addReplyLongLong(c, rowGroups);
+        addReplyBulkCString(c, "rows");
+        addReplyLongLong(c, rows);
+        addReplyBulkCString(c, "shards");
+        addReplyLongLong(c, getPersistentStoreTableShards(
+                c->db->persistent_store, tableId));
+    }
+    vectorFree(&ids);
 }
 
-
 /*Lookup the value list of field and field in dict*/
 /*
  * fieldsAndValueCommand
@@ -823,13 +1262,15 @@ void serializeCommand(client *c){
  */
 void deserializeCommand(client *c){
 
-	sds pattern = sdsnew(c->argv[1]->ptr);
+	sds pattern = persistentStoreKeyFromText(c->argv[1]->ptr,
+	                                         sdslen(c->argv[1]->ptr));
+	if (pattern == NULL) pattern = sdsnew(c->argv[1]->ptr);
 
 	  char* err = NULL;
 	  size_t val_len;
 	  char* val;
 	  val = rocksdb_get_cf(c->db->persistent_store->ps, c->db->persistent_store->ps_options->roptions,
-			  c->db->persistent_store->ps_cf_handles[PERSISTENT_STORE_CF_RW], pattern, sdslen(pattern), &val_len, &err);
+			  getPersistentStoreKeyCF(c->db->persistent_store, pattern, sdslen(pattern), 0), pattern, sdslen(pattern), &val_len, &err);
 
 	  if(val == NULL){
 		  rocksdb_free(val);
@@ -864,8 +1305,276 @@ void deserializeCommand(client *c){
 
 }
 
+/*
+ * fpTableOptCommand
+ *  Set the RocksDB options of the column family of a table, and the
+ *  number of shards of its partitions. The options are kept by every
+ *  node, a cluster needs them on every master.
+ *  The column family of a table is created when its first rowgroup is
+ *  tiered, the options of a table which already has one are used when
+ *  it is opened again.
+ *
+ *  Every rowgroup of a partition shares its hash tag "{table:partition}",
+ *  so a hot partition pins its writes and scans to a single node. The
+ *  partitions of a table with shards=K are written as K shards, the
+ *  partitions "<partition>:#0" to "<partition>:#<K-1>" hashed to K slots,
+ *  and FPWRITE refuses the partitions without a shard. Writers spread the
+ *  rowgroups of a partition, the n-th rowgroup_size rows going to the
+ *  shard n mod K. The shard is not a partition value: METAKEYS filters,
+ *  FPTABLESCAN and FPTABLEAGG find every shard of a partition, on every
+ *  node.
+ * --- Parameters ---
+ *  arg1: tableId
+ *  arg2~: name=value pairs, see createTableOptions() in persistent_store.c
+ *      compression:    none|snappy|zlib|bz2|lz4|lz4hc|zstd
+ *      block_size:     bytes
+ *      bloom_bits:     bits per key, 0 disables the bloom filter
+ *      compaction:     level|universal|fifo
+ *      shards:         1~1024, the partitions are not sharded with 1
+ *
+ * --- Usage Examples ---
+ *  Command:
+ *      redis-cli> FPTABLEOPT 100 compression=zstd bloom_bits=10
+ *  Results:
+ *      redis-cli> OK
+ *  Command:
+ *      redis-cli> FPTABLEOPT 100
+ *  Results:
+ *      redis-cli> "compression=zstd bloom_bits=10"
+ *  Command:
+ *      redis-cli> FPTABLEOPT 200 shards=4
+ *      redis-cli> FPWRITE D:{200:1:2:#3} 1:2:#3 4 0 1 1 1 1
+ *  Results:
+ *      redis-cli> OK
+ */
+void fpTableOptCommand(client *c) {
+    long long tableId;
+    sds spec, err = NULL;
+
+    if (getLongLongFromObjectOrReply(c, c->argv[1], &tableId, NULL) != C_OK)
+        return;
+    if (tableId < 0 || tableId > INT_MAX) {
+        addReplyError(c, "invalid table id");
+        return;
+    }
+
+    if (c->argc == 2) {
+        spec = getPersistentStoreTableOptions(c->db->persistent_store,
+                                              (int) tableId);
+        if (spec == NULL) {
+            addReply(c, shared.nullbulk);
+        } else {
+            addReplyBulkSds(c, spec);
+        }
+        return;
+    }
+
+    spec = sdsempty();
+    for (int i = 2; i < c->argc; i++) {
+        if (i > 2) spec = sdscatlen(spec, " ", 1);
+        spec = sdscatsds(spec, c->argv[i]->ptr);
+    }
+    if (setPersistentStoreTableOptions(c->db->persistent_store, (int) tableId,
+                                       spec, &err) == -1) {
+        addReplyErrorFormat(c, "[FPTABLEOPT] %s", err);
+        sdsfree(err);
+    } else {
+        addReply(c, shared.ok);
+        server.dirty++;
+    }
+    sdsfree(spec);
+}
+
+static int _matchKeyPrefix(dictEntry *entry, void *privdata) {
+    sds key = dictGetKey(entry), prefix = privdata;
+    return sdslen(key) >= sdslen(prefix) &&
+           memcmp(key, prefix, sdslen(prefix)) == 0;
+}
+
+/* Delete the keys of 'd' starting with 'prefix', returns how many. */
+static unsigned long _deleteKeysWithPrefix(redisDb *db, dict *d, sds prefix) {
+    dictIterator *di = dictGetSafeIterator(d);
+    dictEntry *de;
+    unsigned long deleted = 0;
 
-void deleteEntryCommand(client *c){
+    while ((de = dictNext(di)) != NULL) {
+        sds key = dictGetKey(de);
+        if (!_matchKeyPrefix(de, prefix)) continue;
+        if (d == db->dict) {
+            robj *keyobj = createStringObject(key, sdslen(key));
+            deleted += dbAsyncDelete(db, keyobj);
+            decrRefCount(keyobj);
+        } else if (d == db->Metadict && server.cluster_enabled) {
+            robj *keyobj = createStringObject(key, sdslen(key));
+            slotToKeyDel(keyobj);
+            decrRefCount(keyobj);
+            deleted += dictDelete(d, key) == DICT_OK;
+        } else {
+            deleted += dictDelete(d, key) == DICT_OK;
+        }
+    }
+    dictReleaseIterator(di);
+    return deleted;
+}
 
+/*
+ * fpDropTableCommand
+ *  Drop every partition of a table, in memory and tiered.
+ *  A table with its own column family is dropped with its column family.
+ * --- Parameters ---
+ *  arg1: tableId
+ *
+ * --- Usage Examples ---
+ *  Command:
+ *      redis-cli> FPDROPTABLE 100
+ *  Results:
+ *      redis-cli> (integer) 12    // in-memory rowgroups dropped
+ */
+void fpDropTableCommand(client *c) {
+    long long tableId;
+    unsigned long deleted;
+    sds dataPrefix, metaPrefix, err = NULL;
+
+    if (getLongLongFromObjectOrReply(c, c->argv[1], &tableId, NULL) != C_OK)
+        return;
+    if (tableId < 0 || tableId > INT_MAX) {
+        addReplyError(c, "invalid table id");
+        return;
+    }
+
+    /* The rowgroups in flight must not be written after the drop. */
+    tieringWaitIdle();
+    abortPartitionMigration((int) tableId, "the table was dropped");
+
+    dataPrefix = sdscatfmt(sdsempty(), "D:{%I:", tableId);
+    metaPrefix = sdscatfmt(sdsempty(), "M:{%I:", tableId);
+    removeFromQueueIf(c->db->EvictQueue, _matchKeyPrefix, dataPrefix);
+    removeFromQueueIf(c->db->FreeQueue, _matchKeyPrefix, dataPrefix);
+    deleted = _deleteKeysWithPrefix(c->db, c->db->dict, dataPrefix);
+    _deleteKeysWithPrefix(c->db, c->db->TieredHeat, dataPrefix);
+    _deleteKeysWithPrefix(c->db, c->db->Metadict, metaPrefix);
+    partitionIndexDropTable(c->db, (int) tableId);
+
+    if (dropPersistentStoreTable(c->db->persistent_store, (int) tableId,
+                                 &err) == -1 ||
+        deletePersistentStoreMeta(c->db->persistent_store, metaPrefix,
+                                  sdslen(metaPrefix), &err) == -1) {
+        addReplyErrorFormat(c, "[FPDROPTABLE] %s", err);
+        sdsfree(err);
+    } else {
+        addReplyLongLong(c, deleted);
+    }
+    server.dirty++;
+    sdsfree(dataPrefix);
+    sdsfree(metaPrefix);
+}
+/* Return 1 if a rowgroup starting with 'prefix' is being tiered. */
+static int _isPrefixBeingTiered(Queue *queue, sds prefix) {
+    for (int32_t i = queue->rear; i != queue->front; i = (i + 1) % queue->max) {
+        dictEntry *entry = queue->buf[i];
+        if (entry != NULL && _matchKeyPrefix(entry, prefix) &&
+            objGetLocation((robj *) dictGetVal(entry)) == LOCATION_FLUSH)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * fpDropCommand
+ *  Drop a partition, in memory and tiered.
+ *  The in-memory rowgroups are freed by the lazyfree thread and the tiered
+ *  ones, like their metadata, are removed from RocksDB with a range
+ *  deletion.
+ * --- Parameters ---
+ *  arg1: dataKeyInfo
+ *
+ * --- Usage Examples ---
+ *  Parameters:
+ *      dataKeyInfo:        D:{100:1:2}
+ *  Command:
+ *      redis-cli> FPDROP D:{100:1:2}
+ *  Results:
+ *      redis-cli> (integer) 200    // rowgroups of the partition
+ */
+void fpDropCommand(client *c) {
+    NewDataKeyInfo *dataKeyInfo = parsingDataKeyInfo((sds) c->argv[1]->ptr);
+    sds err = NULL;
+    int rowGroupCount;
+
+    if (dataKeyInfo == NULL) {
+        addReplyErrorFormat(c, "[FPDROP] invalid data key: %s",
+                            (sds) c->argv[1]->ptr);
+        return;
+    }
+
+    if ((rowGroupCount = dropPartition(c->db, dataKeyInfo, &err)) == -1) {
+        addReplyErrorFormat(c, "[FPDROP] %s", err);
+        sdsfree(err);
+    } else {
+        addReplyLongLong(c, rowGroupCount);
+        server.dirty++;
+    }
+    zfree(dataKeyInfo);
+}
+
+/* Drop the partition of 'dataKeyInfo' from 'db', in memory and tiered.
+ * Returns the number of rowgroups of the partition, or -1 with 'err' set
+ * if RocksDB failed. */
+int dropPartition(redisDb *db, NewDataKeyInfo *dataKeyInfo, sds *err) {
+    sds partitionPrefix, rangeBegin, rangeEnd, metaKey;
+    int rowGroupCount, ret;
+
+    serverAssert(dataKeyInfo->isPartitionString);
+
+    partitionPrefix = sdscatfmt(sdsempty(), "%s:{%i:%s}:", RELMODEL_DATA_PREFIX,
+                                dataKeyInfo->tableId,
+                                dataKeyInfo->partitionInfo.partitionString);
+    rangeBegin = persistentStorePartitionPrefix(
+        dataKeyInfo->tableId, dataKeyInfo->partitionInfo.partitionString,
+        strlen(dataKeyInfo->partitionInfo.partitionString));
+    rangeEnd = sdsdup(rangeBegin);
+    persistentStorePrefixEnd(rangeEnd);
+
+    /* A rowgroup in flight must not be written after the range deletion. */
+    if (_isPrefixBeingTiered(db->FreeQueue, partitionPrefix))
+        tieringWaitIdle();
+
+    removeFromQueueIf(db->EvictQueue, _matchKeyPrefix, partitionPrefix);
+    removeFromQueueIf(db->FreeQueue, _matchKeyPrefix, partitionPrefix);
+
+    rowGroupCount = getRowGroupInfoAndSetRowGroupInfo(db, dataKeyInfo);
+    for (int i = 1; i <= rowGroupCount; i++) {
+        dataKeyInfo->rowGroupId = i;
+        robj *dataKey = generateDataKey(dataKeyInfo);
+        dbAsyncDelete(db, dataKey);
+        dictDelete(db->TieredHeat, dataKey->ptr);
+        decrRefCount(dataKey);
+    }
+
+    metaKey = sdscatfmt(sdsempty(), "%s:{%i:%s}", RELMODEL_META_PREFIX,
+                        dataKeyInfo->tableId,
+                        dataKeyInfo->partitionInfo.partitionString);
+    if (dictDelete(db->Metadict, metaKey) == DICT_OK &&
+        server.cluster_enabled) {
+        robj *keyobj = createStringObject(metaKey, sdslen(metaKey));
+        slotToKeyDel(keyobj);
+        decrRefCount(keyobj);
+    }
+    partitionIndexDelete(db, metaKey);
+
+    if (deletePersistentStoreKeyRange(db->persistent_store,
+                                      rangeBegin, sdslen(rangeBegin),
+                                      rangeEnd, sdslen(rangeEnd), err) == -1 ||
+        deletePersistentStoreMeta(db->persistent_store, metaKey,
+                                  sdslen(metaKey), err) == -1) {
+        ret = -1;
+    } else {
+        ret = rowGroupCount;
+    }
+    sdsfree(partitionPrefix);
+    sdsfree(rangeBegin);
+    sdsfree(rangeEnd);
+    sdsfree(metaKey);
+    return ret;
 }
 
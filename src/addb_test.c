@@ -20,6 +20,7 @@ void testDbAddForMeta(redisDb *db, robj *key, robj *val) {
     int retval = dictAdd(db->Metadict, copy, val);
 
     serverAssertWithInfo(NULL,key,retval == DICT_OK);
+    partitionIndexAdd(db, copy, val);
     if (server.cluster_enabled) slotToKeyAdd(key);
 }
 
@@ -634,6 +634,7 @@ int loadAppendOnlyFile(char *filename) {
     int old_aof_state = server.aof_state;
     long loops = 0;
     off_t valid_up_to = 0; /* Offset of latest well-formed command loaded. */
+    int j;
 
     if (fp == NULL) {
         serverLog(LL_WARNING,"Fatal error: can't open the append log file for reading: %s",strerror(errno));
@@ -657,6 +658,10 @@ int loadAppendOnlyFile(char *filename) {
     fakeClient = createFakeClient();
     startLoading(fp);
 
+    /* ADDB: FPWRITEs are replayed against the Metadict they were executed
+     * with, the META column family is merged once the AOF is loaded. */
+    for (j = 0; j < server.dbnum; j++) server.db[j].metadict_lazy = 0;
+
     /* Check if this AOF file has an RDB preamble. In that case we need to
      * load the RDB file and later continue loading the AOF tail. */
     char sig[5]; /* "REDIS" */
@@ -762,6 +767,7 @@ loaded_ok: /* DB loaded, cleanup and return C_OK to the caller. */
     fclose(fp);
     freeFakeClient(fakeClient);
     server.aof_state = old_aof_state;
+    for (j = 0; j < server.dbnum; j++) resetMetadictLazyLoad(server.db+j);
     stopLoading();
     aofUpdateCurrentSize();
     server.aof_rewrite_base_size = server.aof_current_size;
@@ -1003,9 +1009,10 @@ static int rioWriteHashIteratorCursor(rio *r, hashTypeIterator *hi, int what) {
     return 0;
 }
 
-/* Emit the commands needed to rebuild a hash object.
- * The function returns 0 on error, 1 on success. */
-int rewriteHashObject(rio *r, robj *key, robj *o) {
+/* Emit the 'cmd' (HMSET or FPMETALOAD) commands needed to rebuild a hash
+ * object. The function returns 0 on error, 1 on success. */
+static int rewriteHashObjectWithCommand(rio *r, char *cmd, robj *key,
+                                        robj *o) {
     hashTypeIterator *hi;
     long long count = 0, items = hashTypeLength(o);
 
@@ -1016,7 +1023,7 @@ int rewriteHashObject(rio *r, robj *key, robj *o) {
                 AOF_REWRITE_ITEMS_PER_CMD : items;
 
             if (rioWriteBulkCount(r,'*',2+cmd_items*2) == 0) return 0;
-            if (rioWriteBulkString(r,"HMSET",5) == 0) return 0;
+            if (rioWriteBulkString(r,cmd,strlen(cmd)) == 0) return 0;
             if (rioWriteBulkObject(r,key) == 0) return 0;
         }
 
@@ -1031,6 +1038,63 @@ int rewriteHashObject(rio *r, robj *key, robj *o) {
     return 1;
 }
 
+/* Emit the commands needed to rebuild a hash object.
+ * The function returns 0 on error, 1 on success. */
+int rewriteHashObject(rio *r, robj *key, robj *o) {
+    return rewriteHashObjectWithCommand(r,"HMSET",key,o);
+}
+
+/* ADDB: emit one FPCVLOAD per column vector of a rowgroup, instead of a
+ * HMSET of every value. The function returns 0 on error, 1 on success. */
+int rewriteRowGroupObject(rio *r, robj *key, robj *o) {
+    int location = objGetLocation(o) == LOCATION_PERSISTED ?
+                   LOCATION_PERSISTED : LOCATION_REDIS_ONLY;
+    dictIterator *di = dictGetIterator(o->ptr);
+    dictEntry *de;
+
+    while((de = dictNext(di)) != NULL) {
+        sds field = dictGetKey(de);
+        Vector *v = ((robj *) dictGetVal(de))->ptr;
+        size_t j;
+
+        if (rioWriteBulkCount(r,'*',4+v->count) == 0 ||
+            rioWriteBulkString(r,"FPCVLOAD",8) == 0 ||
+            rioWriteBulkObject(r,key) == 0 ||
+            rioWriteBulkLongLong(r,location) == 0 ||
+            rioWriteBulkString(r,field,sdslen(field)) == 0) goto werr;
+        for (j = 0; j < v->count; j++) {
+            sds value = v->data[j];
+            if (rioWriteBulkString(r,value,sdslen(value)) == 0) goto werr;
+        }
+    }
+    dictReleaseIterator(di);
+    return 1;
+
+werr:
+    dictReleaseIterator(di);
+    return 0;
+}
+
+/* ADDB: emit one FPMETALOAD per entry of the Metadict of 'db'. The
+ * function returns 0 on error, 1 on success. */
+int rewriteMetadict(rio *r, redisDb *db) {
+    dictIterator *di = dictGetIterator(db->Metadict);
+    dictEntry *de;
+
+    while((de = dictNext(di)) != NULL) {
+        robj key;
+
+        initStaticStringObject(key,dictGetKey(de));
+        if (rewriteHashObjectWithCommand(r,"FPMETALOAD",&key,
+                                         dictGetVal(de)) == 0) {
+            dictReleaseIterator(di);
+            return 0;
+        }
+    }
+    dictReleaseIterator(di);
+    return 1;
+}
+
 /* Call the module type callback in order to rewrite a data type
  * that is exported by a module and is not handled by Redis itself.
  * The function returns 0 on error, 1 on success. */
@@ -1073,7 +1137,7 @@ int rewriteAppendOnlyFileRio(rio *aof) {
         char selectcmd[] = "*2\r\n$6\r\nSELECT\r\n";
         redisDb *db = server.db+j;
         dict *d = db->dict;
-        if (dictSize(d) == 0) continue;
+        if (dictSize(d) == 0 && dictSize(db->Metadict) == 0) continue;
         di = dictGetSafeIterator(d);
 
         /* SELECT the new DB */
@@ -1109,6 +1173,9 @@ int rewriteAppendOnlyFileRio(rio *aof) {
                 if (rewriteSetObject(aof,&key,o) == 0) goto werr;
             } else if (o->type == OBJ_ZSET) {
                 if (rewriteSortedSetObject(aof,&key,o) == 0) goto werr;
+            } else if (o->type == OBJ_HASH &&
+                       o->encoding == OBJ_ENCODING_REL) {
+                if (rewriteRowGroupObject(aof,&key,o) == 0) goto werr;
             } else if (o->type == OBJ_HASH) {
                 if (rewriteHashObject(aof,&key,o) == 0) goto werr;
             } else if (o->type == OBJ_MODULE) {
@@ -1131,6 +1198,9 @@ int rewriteAppendOnlyFileRio(rio *aof) {
         }
         dictReleaseIterator(di);
         di = NULL;
+
+        /* ADDB: the row counts of the rowgroups. */
+        if (rewriteMetadict(aof,db) == 0) goto werr;
     }
     return C_OK;
 
@@ -1340,6 +1410,8 @@ int rewriteAppendOnlyFileBackground(void) {
 
     if (server.aof_child_pid != -1 || server.rdb_child_pid != -1) return C_ERR;
     if (aofCreatePipes() != C_OK) return C_ERR;
+    /* ADDB: FPWRITEs batched before the fork are part of the rewrite. */
+    fpWriteBatchFlush();
     openChildInfoPipe();
     start = ustime();
     if ((childpid = fork()) == 0) {
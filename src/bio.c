@@ -210,23 +210,9 @@ void *bioProcessBackgroundJobs(void *arg) {
             } else {
             	persistKey(db, keyobj, valobj);
             }
-            valobj->location = LOCATION_PERSISTED;
-            __sync_synchronize();
+            objSetLocation(valobj, LOCATION_PERSISTED);
             decrRefCount(keyobj);
             //decrRefCount(valobj);
-        } else if (type == BIO_BATCH_TIERING) {
-            /* ADDB
-             * Batch Tiering */
-            redisDb *db = (redisDb *) job->arg1;
-            Vector *evict_keys = (Vector *) job->arg2;
-            Vector *evict_relations = (Vector *) job->arg3;
-            prepareBatchWriteToRocksDB(db, evict_keys, evict_relations);
-            // TODO(totoro): If __sync_synchronize() is meaningless, remove this line.
-            __sync_synchronize();
-            vectorFree(evict_keys);
-            vectorFree(evict_relations);
-            zfree(evict_keys);
-            zfree(evict_relations);
         } else if (type == BIO_TIERED_FREE) {
             /* ADDB */
             dictEntry *de = (dictEntry *)job->arg1;
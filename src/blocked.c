@@ -122,6 +122,18 @@ void processUnblockedClients(void) {
          * client is not blocked before to proceed, but things may change and
          * the code is conceptually more correct this way. */
         if (!(c->flags & CLIENT_BLOCKED)) {
+            /* ADDB: a FPWRITE resumed after tiering backpressure, or a
+             * command read by an I/O thread while the clients were paused,
+             * is still in argv, run it before reading the next command. */
+            if (c->argc && !c->multibulklen) {
+                if (clientsArePaused()) continue;
+                server.current_client = c;
+                if (processCommand(c) == C_OK && !(c->flags & CLIENT_BLOCKED))
+                    resetClient(c);
+                /* The client may have been freed by processCommand(). */
+                if (server.current_client == NULL) continue;
+                server.current_client = NULL;
+            }
             if (c->querybuf && sdslen(c->querybuf) > 0) {
                 processInputBuffer(c);
             }
@@ -138,6 +150,12 @@ void unblockClient(client *c) {
         unblockClientWaitingReplicas(c);
     } else if (c->btype == BLOCKED_MODULE) {
         unblockClientFromModule(c);
+    } else if (c->btype == BLOCKED_TIERING) {
+        unblockClientWaitingTiering(c);
+    } else if (c->btype == BLOCKED_COORDINATOR) {
+        unblockClientFromCoordinator(c);
+    } else if (c->btype == BLOCKED_MIGRATION) {
+        unblockClientFromPartitionMigration(c);
     } else {
         serverPanic("Unknown btype in unblockClient().");
     }
@@ -164,6 +182,8 @@ void replyToBlockedClientTimedOut(client *c) {
         addReplyLongLong(c,replicationCountAcksByOffset(c->bpop.reploffset));
     } else if (c->btype == BLOCKED_MODULE) {
         moduleBlockedClientTimedOut(c);
+    } else if (c->btype == BLOCKED_COORDINATOR) {
+        coordinatorBlockedClientTimedOut(c);
     } else {
         serverPanic("Unknown btype in replyToBlockedClientTimedOut().");
     }
@@ -101,9 +101,8 @@ void *dequeueForClear(Queue *queue) {
 	robj *obj = dictGetVal(retVal);
 	serverAssert(obj != NULL);
 
-	__sync_synchronize();
-	serverAssert(obj->location != LOCATION_REDIS_ONLY);
-	if(obj->location != LOCATION_PERSISTED) return NULL;
+	serverAssert(objGetLocation(obj) != LOCATION_REDIS_ONLY);
+	if(objGetLocation(obj) != LOCATION_PERSISTED) return NULL;
 
 	queue->buf[queue->rear] = NULL;
 	queue->rear = (queue->rear + 1) % queue->max;
@@ -140,18 +139,39 @@ int isEmpty(Queue *queue) {
 
 //TODO - Implement later
 
+/* Drop every entry. The entries are not dereferenced, emptyDb() frees
+ * them before the queues are reset. */
 void initializeQueue(Queue *queue){
-	//int start = queue->rear;
-	int end = queue->front;
-
-	for(int start = queue->rear; start <= end; start++){
-		serverLog(LL_DEBUG, "Rear : %d(start : %d), Front : %d(end : %d)", queue->rear, start, queue->front, end);
-		forceDequeue(queue);
-	}
-
 	queue->rear = 0;
 	queue->key_offset = 0;
 	queue->front = 0;
+	queue->size = 0;
+}
+
+/* Remove the entries for which 'match' returns non zero, the remaining
+ * entries keep their FIFO order. Returns the number of removed entries. */
+int32_t removeFromQueueIf(Queue *queue,
+		int (*match)(dictEntry *entry, void *privdata), void *privdata) {
+	int32_t read = queue->rear, write = queue->rear, removed = 0;
+
+	while (read != queue->front) {
+		dictEntry *entry = queue->buf[read];
+		if (entry != NULL && match(entry, privdata)) {
+			removed++;
+		} else {
+			queue->buf[write] = entry;
+			write = (write + 1) % queue->max;
+		}
+		read = (read + 1) % queue->max;
+	}
+	while (write != queue->front) {
+		queue->buf[write] = NULL;
+		write = (write + 1) % queue->max;
+	}
+	queue->front = (queue->front - removed + queue->max) % queue->max;
+	queue->size -= removed;
+	queue->key_offset = queue->rear;
+	return removed;
 }
 
 void *chooseBestKeyFromQueue(Queue *queue){
@@ -166,7 +186,7 @@ void *chooseBestKeyFromQueue(Queue *queue){
 		bestEntry = queue->buf[queue->key_offset];  //queue->rear
 		robj *obj = dictGetVal(bestEntry);
 
-		if(obj->location == LOCATION_PERSISTED){
+		if(objGetLocation(obj) == LOCATION_PERSISTED){
 			if(queue->key_offset != queue->front){
 
 				queue->key_offset = (queue->key_offset + 1) % queue->max;
@@ -175,12 +195,12 @@ void *chooseBestKeyFromQueue(Queue *queue){
 			}
 		}
 
-		if((obj->location != LOCATION_PERSISTED) & (obj->location != LOCATION_REDIS_ONLY)){
-			serverLog(LL_WARNING, "Unknown Object Location Information : %d", obj->location);
+		if((objGetLocation(obj) != LOCATION_PERSISTED) & (objGetLocation(obj) != LOCATION_REDIS_ONLY)){
+			serverLog(LL_WARNING, "Unknown Object Location Information : %d", objGetLocation(obj));
 			serverAssert(0);
 		}
 
-		assert(obj->location == LOCATION_REDIS_ONLY);
+		assert(objGetLocation(obj) == LOCATION_REDIS_ONLY);
 		return bestEntry;
 
 	}
@@ -200,12 +220,12 @@ int checkQueueFordeQueue(int dbnum, Queue *queue){
 		de = queue->buf[queue->key_offset];
 		robj *val = dictGetVal(de);
 
-		if(val->location == LOCATION_REDIS_ONLY){
+		if(objGetLocation(val) == LOCATION_REDIS_ONLY){
 			serverLog(LL_VERBOSE, "No Entry to dequeue");
 			return 2;
 		}
 
-		if(val->location == LOCATION_PERSISTED){
+		if(objGetLocation(val) == LOCATION_PERSISTED){
 			queue->key_offset = (queue->key_offset + 1) % queue->max;
 			de = dequeue(queue);
 
@@ -265,11 +285,11 @@ void *chooseBestKeyFromQueue_(Queue *queue, Queue *freequeue) {
 	bestEntryCandidate = dequeue(queue);
 
 	robj * obj = dictGetVal(bestEntryCandidate);
-	if (obj->location != LOCATION_REDIS_ONLY) {
+	if (objGetLocation(obj) != LOCATION_REDIS_ONLY) {
 		serverAssert(0);
 	}
 
-  obj->location = LOCATION_FLUSH;
+  objSetLocation(obj, LOCATION_FLUSH);
 	result = enqueue(freequeue, bestEntryCandidate);
 	return bestEntryCandidate;
 
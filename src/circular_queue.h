@@ -44,6 +44,8 @@ void *forceDequeue(Queue *queue);
 //dictEntry *dequeue(Queue *queue);
 int isEmpty(Queue *queue);
 void initializeQueue(Queue *queue);
+int32_t removeFromQueueIf(Queue *queue,
+		int (*match)(dictEntry *entry, void *privdata), void *privdata);
 
 
 #endif /* SRC_CIRCULAR_QUEUE_H_ */
@@ -3445,6 +3445,9 @@ void clusterCron(void) {
     /* Abourt a manual failover if the timeout is reached. */
     manualFailoverCheckTimeout();
 
+    /* Abort FPMIGRATE if the target stopped replying. */
+    partitionMigrationCron();
+
     if (nodeIsSlave(myself)) {
         clusterHandleManualFailover();
         clusterHandleSlaveFailover();
@@ -4633,8 +4636,8 @@ void createDumpPayload(rio *payload, robj *o) {
      */
 
     /* RDB version */
-    buf[0] = RDB_VERSION & 0xff;
-    buf[1] = (RDB_VERSION >> 8) & 0xff;
+    buf[0] = RDB_ADDB_VERSION & 0xff;
+    buf[1] = (RDB_ADDB_VERSION >> 8) & 0xff;
     payload->io.buffer.ptr = sdscatlen(payload->io.buffer.ptr,buf,2);
 
     /* CRC64 */
@@ -4659,7 +4662,7 @@ int verifyDumpPayload(unsigned char *p, size_t len) {
 
     /* Verify RDB version */
     rdbver = (footer[1] << 8) | footer[0];
-    if (rdbver > RDB_VERSION) return C_ERR;
+    if (!rdbIsLoadableVersion(rdbver)) return C_ERR;
 
     /* Verify CRC64 */
     crc = crc64(0,p,len-8);
@@ -4741,6 +4744,9 @@ void restoreCommand(client *c) {
 
     /* Create the key and set the TTL if any */
     dbAdd(c->db,c->argv[1],obj);
+    /* ADDB: like the loaded ones, restored rowgroups can be tiered. */
+    if (obj->type == OBJ_HASH && obj->encoding == OBJ_ENCODING_REL)
+        enqueue(c->db->EvictQueue,dictFind(c->db->dict,c->argv[1]->ptr));
     if (ttl) setExpire(c,c->db,c->argv[1],mstime()+ttl);
     signalModifiedKey(c->db,c->argv[1]);
     addReply(c,shared.ok);
@@ -5217,6 +5223,7 @@ clusterNode *getNodeByQuery(client *c, struct redisCommand *cmd, robj **argv, in
     multiState *ms, _ms;
     multiCmd mc;
     int i, slot = 0, migrating_slot = 0, importing_slot = 0, missing_keys = 0;
+    int migrating_partition = 0;
 
     /* Set error code optimistically for the base case. */
     if (error_code) *error_code = CLUSTER_REDIR_NONE;
@@ -5305,12 +5312,23 @@ clusterNode *getNodeByQuery(client *c, struct redisCommand *cmd, robj **argv, in
                 }
             }
 
-            /* Migarting / Improrting slot? Count keys we don't have. */
+            /* Migarting / Improrting slot? Count keys we don't have. The
+             * data keys of the relational partitions are not in the
+             * keyspace, they exist as long as their partition does. */
             if ((migrating_slot || importing_slot) &&
-                lookupKeyRead(&server.db[0],thiskey) == NULL)
+                lookupKeyRead(&server.db[0],thiskey) == NULL &&
+                !partitionKeyExists(&server.db[0],thiskey->ptr))
             {
                 missing_keys++;
             }
+
+            /* Writes to the partition FPMIGRATE is handing over would be
+             * lost, they have to wait for the target to serve it. */
+            if (migrating_slot && mcmd->flags & CMD_WRITE &&
+                isPartitionMigrating(thiskey->ptr))
+            {
+                migrating_partition = 1;
+            }
         }
         getKeysFreeResult(keyindex);
     }
@@ -5334,6 +5352,11 @@ clusterNode *getNodeByQuery(client *c, struct redisCommand *cmd, robj **argv, in
     if ((migrating_slot || importing_slot) && cmd->proc == migrateCommand)
         return myself;
 
+    if (migrating_partition) {
+        if (error_code) *error_code = CLUSTER_REDIR_MIGRATING_PARTITION;
+        return NULL;
+    }
+
     /* If we don't have all the keys and we are migrating the slot, send
      * an ASK redirection. */
     if (migrating_slot && missing_keys) {
@@ -5388,6 +5411,8 @@ void clusterRedirectClient(client *c, clusterNode *n, int hashslot, int error_co
          * but the slot is not "stable" currently as there is
          * a migration or import in progress. */
         addReplySds(c,sdsnew("-TRYAGAIN Multiple keys request during rehashing of slot\r\n"));
+    } else if (error_code == CLUSTER_REDIR_MIGRATING_PARTITION) {
+        addReplySds(c,sdsnew("-TRYAGAIN Partition being migrated, try again\r\n"));
     } else if (error_code == CLUSTER_REDIR_DOWN_STATE) {
         addReplySds(c,sdsnew("-CLUSTERDOWN The cluster is down\r\n"));
     } else if (error_code == CLUSTER_REDIR_DOWN_UNBOUND) {
@@ -30,6 +30,7 @@
 
 #include "server.h"
 #include "cluster.h"
+#include "tiering.h"
 
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -212,6 +213,17 @@ void loadServerConfigFromString(char *config) {
             if (server.tcpkeepalive < 0) {
                 err = "Invalid tcp-keepalive value"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"io-threads") && argc == 2) {
+            server.io_threads_num = atoi(argv[1]);
+            if (server.io_threads_num < 1 ||
+                server.io_threads_num > CONFIG_MAX_IO_THREADS) {
+                err = "Invalid number of I/O threads, must be between 1 and 128";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"io-threads-do-reads") && argc == 2) {
+            if ((server.io_threads_do_reads = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"protected-mode") && argc == 2) {
             if ((server.protected_mode = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -355,6 +367,46 @@ void loadServerConfigFromString(char *config) {
             if(server.batch_tiering_size == 0){
                 server.batch_tiering_size = 1;  // default
             }
+        } else if (!strcasecmp(argv[0], "tiering_threads") &&argc == 2) {
+            server.tiering_threads = atoi(argv[1]);
+            if (server.tiering_threads < 1 ||
+                server.tiering_threads > TIERING_MAX_THREADS) {
+                err = "Invalid tiering_threads, must be between 1 and 64";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0], "tiering_high_watermark") &&argc == 2) {
+            server.tiering_high_watermark = atoi(argv[1]);
+            if (server.tiering_high_watermark < 1 ||
+                server.tiering_high_watermark > 100) {
+                err = "Invalid tiering_high_watermark, must be between 1 and 100";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0], "tiering_victim_samples") &&argc == 2) {
+            server.tiering_victim_samples = atoi(argv[1]);
+            if (server.tiering_victim_samples < 1 ||
+                server.tiering_victim_samples >
+                    CONFIG_MAX_TIERING_VICTIM_SAMPLES) {
+                err = "Invalid tiering_victim_samples, must be between 1 and 1024";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0], "tiering_promote_threshold") &&argc == 2) {
+            server.tiering_promote_threshold = atoi(argv[1]);
+            if (server.tiering_promote_threshold < 0 ||
+                server.tiering_promote_threshold > 255) {
+                err = "Invalid tiering_promote_threshold, must be between 0 and 255";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0], "tiering_backlog_limit") &&argc == 2) {
+            server.tiering_backlog_limit = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0], "memory_budget") &&argc == 2) {
+            server.memory_budget = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0], "tiering_low_watermark") &&argc == 2) {
+            server.tiering_low_watermark = atoi(argv[1]);
+            if (server.tiering_low_watermark < 0 ||
+                server.tiering_low_watermark > 99) {
+                err = "Invalid tiering_low_watermark, must be between 0 and 99";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"lfu-log-factor") && argc == 2) {
             server.lfu_log_factor = atoi(argv[1]);
             if (server.maxmemory_samples < 0) {
@@ -450,6 +502,60 @@ void loadServerConfigFromString(char *config) {
             if ((server.repl_slave_lazy_flush = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
             }
+        } else if (!strcasecmp(argv[0],"tiering_column_granular") && argc == 2) {
+            if ((server.tiering_column_granular = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"tiering_sst_ingest") && argc == 2) {
+            if ((server.tiering_sst_ingest = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"rocksdb_statistics") && argc == 2) {
+            if ((server.rocksdb_statistics = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"rocksdb_checkpoint") && argc == 2) {
+            if ((server.rocksdb_checkpoint = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"rocksdb_checkpoint_dir") && argc == 2) {
+            zfree(server.rocksdb_checkpoint_dir);
+            server.rocksdb_checkpoint_dir = zstrdup(argv[1]);
+        } else if (!strcasecmp(argv[0],"rocksdb_checkpoint_restore") && argc == 2) {
+            if ((server.rocksdb_checkpoint_restore = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"repl_rocksdb_sync") && argc == 2) {
+            if ((server.repl_rocksdb_sync = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"rocksdb_max_open_files") && argc == 2) {
+            server.rocksdb_max_open_files = atoi(argv[1]);
+            if (server.rocksdb_max_open_files == 0 ||
+                server.rocksdb_max_open_files < -1) {
+                err = "rocksdb_max_open_files must be -1 or greater than 0";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"fpwrite_batch_bytes") && argc == 2) {
+            server.fpwrite_batch_bytes = memtoll(argv[1],NULL);
+        } else if (!strcasecmp(argv[0],"partition_filter_cache_size") &&
+                   argc == 2) {
+            server.partition_filter_cache_size = atoi(argv[1]);
+            if (server.partition_filter_cache_size < 0) {
+                err = "partition_filter_cache_size can't be negative";
+                goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"cluster_coordinator") && argc == 2) {
+            if ((server.cluster_coordinator = yesnotoi(argv[1])) == -1) {
+                err = "argument must be 'yes' or 'no'"; goto loaderr;
+            }
+        } else if (!strcasecmp(argv[0],"cluster_coordinator_timeout") &&
+                   argc == 2) {
+            server.cluster_coordinator_timeout = strtoll(argv[1],NULL,10);
+            if (server.cluster_coordinator_timeout <= 0) {
+                err = "cluster_coordinator_timeout must be greater than 0";
+                goto loaderr;
+            }
         } else if (!strcasecmp(argv[0],"tiering_enabled") && argc == 2) {
             if ((server.tiering_enabled = yesnotoi(argv[1])) == -1) {
                 err = "argument must be 'yes' or 'no'"; goto loaderr;
@@ -770,6 +876,12 @@ void loadServerConfigFromString(char *config) {
         err = "slaveof directive not allowed in cluster mode";
         goto loaderr;
     }
+    if (server.tiering_low_watermark >= server.tiering_high_watermark) {
+        serverLog(LL_WARNING,
+            "tiering_low_watermark must be lower than tiering_high_watermark, "
+            "using %d", server.tiering_high_watermark - 1);
+        server.tiering_low_watermark = server.tiering_high_watermark - 1;
+    }
 
     sdsfreesplitres(lines,totlines);
     return;
@@ -871,6 +983,9 @@ void configSetCommand(client *c) {
         }
         zfree(server.rdb_filename);
         server.rdb_filename = zstrdup(o->ptr);
+    } config_set_special_field("rocksdb_checkpoint_dir") {
+        zfree(server.rocksdb_checkpoint_dir);
+        server.rocksdb_checkpoint_dir = zstrdup(o->ptr);
     } config_set_special_field("requirepass") {
         if (sdslen(o->ptr) > CONFIG_AUTHPASS_MAX_LEN) goto badfmt;
         zfree(server.requirepass);
@@ -1013,6 +1128,31 @@ void configSetCommand(client *c) {
     } config_set_special_field("slave-announce-ip") {
         zfree(server.slave_announce_ip);
         server.slave_announce_ip = ((char*)o->ptr)[0] ? zstrdup(o->ptr) : NULL;
+    } config_set_special_field("maxmemory") {
+        /* With a memory budget the governor owns maxmemory. */
+        if (server.memory_budget) {
+            addReplyError(c,"maxmemory is set by the memory governor, set memory_budget to 0 first");
+            return;
+        }
+        ll = memtoll(o->ptr,&err);
+        if (err || ll < 0) goto badfmt;
+        server.maxmemory = ll;
+        if (server.maxmemory) {
+            if (server.maxmemory < zmalloc_used_memory()) {
+                serverLog(LL_WARNING,"WARNING: the new maxmemory value set via CONFIG SET is smaller than the current memory usage. This will result in keys eviction and/or inability to accept new write commands depending on the maxmemory-policy.");
+            }
+            freeMemoryIfNeeded();
+        }
+    } config_set_special_field("memory_budget") {
+        const char *errmsg = NULL;
+
+        ll = memtoll(o->ptr,&err);
+        if (err || ll < 0) goto badfmt;
+        if (memoryGovernorSetBudget(ll,&errmsg) == C_ERR) {
+            addReplyError(c,errmsg);
+            return;
+        }
+        if (server.maxmemory) freeMemoryIfNeeded();
 
     /* Boolean fields.
      * config_set_bool_field(name,var). */
@@ -1058,6 +1198,16 @@ void configSetCommand(client *c) {
       "lazyfree-lazy-expire",server.lazyfree_lazy_expire) {
     } config_set_bool_field(
       "lazyfree-lazy-server-del",server.lazyfree_lazy_server_del) {
+    } config_set_bool_field(
+      "tiering_column_granular",server.tiering_column_granular) {
+    } config_set_bool_field(
+      "tiering_sst_ingest",server.tiering_sst_ingest) {
+    } config_set_bool_field(
+      "cluster_coordinator",server.cluster_coordinator) {
+    } config_set_bool_field(
+      "rocksdb_checkpoint",server.rocksdb_checkpoint) {
+    } config_set_bool_field(
+      "repl_rocksdb_sync",server.repl_rocksdb_sync) {
     } config_set_bool_field(
       "slave-lazy-flush",server.repl_slave_lazy_flush) {
     } config_set_bool_field(
@@ -1147,6 +1297,26 @@ void configSetCommand(client *c) {
          * but cap them to reasonable values. */
         if (server.hz < CONFIG_MIN_HZ) server.hz = CONFIG_MIN_HZ;
         if (server.hz > CONFIG_MAX_HZ) server.hz = CONFIG_MAX_HZ;
+    } config_set_numerical_field(
+      "batch_tiering_size",server.batch_tiering_size,1,INT_MAX) {
+    } config_set_numerical_field(
+      "tiering_high_watermark",ll,1,100) {
+        if (ll <= server.tiering_low_watermark) goto badfmt;
+        server.tiering_high_watermark = ll;
+    } config_set_numerical_field(
+      "tiering_low_watermark",ll,0,99) {
+        if (ll >= server.tiering_high_watermark) goto badfmt;
+        server.tiering_low_watermark = ll;
+    } config_set_numerical_field(
+      "tiering_victim_samples",server.tiering_victim_samples,1,
+      CONFIG_MAX_TIERING_VICTIM_SAMPLES) {
+    } config_set_numerical_field(
+      "tiering_promote_threshold",server.tiering_promote_threshold,0,255) {
+    } config_set_numerical_field(
+      "partition_filter_cache_size",server.partition_filter_cache_size,0,INT_MAX) {
+        trimPartitionFilterCache();
+    } config_set_numerical_field(
+      "cluster_coordinator_timeout",server.cluster_coordinator_timeout,1,LLONG_MAX) {
     } config_set_numerical_field(
       "watchdog-period",ll,0,LLONG_MAX) {
         if (ll)
@@ -1156,13 +1326,10 @@ void configSetCommand(client *c) {
 
     /* Memory fields.
      * config_set_memory_field(name,var) */
-    } config_set_memory_field("maxmemory",server.maxmemory) {
-        if (server.maxmemory) {
-            if (server.maxmemory < zmalloc_used_memory()) {
-                serverLog(LL_WARNING,"WARNING: the new maxmemory value set via CONFIG SET is smaller than the current memory usage. This will result in keys eviction and/or inability to accept new write commands depending on the maxmemory-policy.");
-            }
-            freeMemoryIfNeeded();
-        }
+    } config_set_memory_field(
+      "tiering_backlog_limit",server.tiering_backlog_limit) {
+    } config_set_memory_field(
+      "fpwrite_batch_bytes",server.fpwrite_batch_bytes) {
     } config_set_memory_field("repl-backlog-size",ll) {
         resizeReplicationBacklog(ll);
     } config_set_memory_field("auto-aof-rewrite-min-size",ll) {
@@ -1241,6 +1408,7 @@ void configGetCommand(client *c) {
 
     /* String values */
     config_get_string_field("dbfilename",server.rdb_filename);
+    config_get_string_field("rocksdb_checkpoint_dir",server.rocksdb_checkpoint_dir);
     config_get_string_field("requirepass",server.requirepass);
     config_get_string_field("masterauth",server.masterauth);
     config_get_string_field("cluster-announce-ip",server.cluster_announce_ip);
@@ -1306,6 +1474,19 @@ void configGetCommand(client *c) {
     config_get_numerical_field("cluster-slave-validity-factor",server.cluster_slave_validity_factor);
     config_get_numerical_field("repl-diskless-sync-delay",server.repl_diskless_sync_delay);
     config_get_numerical_field("tcp-keepalive",server.tcpkeepalive);
+    config_get_numerical_field("io-threads",server.io_threads_num);
+    config_get_numerical_field("batch_tiering_size",server.batch_tiering_size);
+    config_get_numerical_field("tiering_threads",server.tiering_threads);
+    config_get_numerical_field("tiering_high_watermark",server.tiering_high_watermark);
+    config_get_numerical_field("tiering_low_watermark",server.tiering_low_watermark);
+    config_get_numerical_field("tiering_backlog_limit",server.tiering_backlog_limit);
+    config_get_numerical_field("memory_budget",server.memory_budget);
+    config_get_numerical_field("tiering_victim_samples",server.tiering_victim_samples);
+    config_get_numerical_field("rocksdb_max_open_files",server.rocksdb_max_open_files);
+    config_get_numerical_field("fpwrite_batch_bytes",server.fpwrite_batch_bytes);
+    config_get_numerical_field("partition_filter_cache_size",server.partition_filter_cache_size);
+    config_get_numerical_field("cluster_coordinator_timeout",server.cluster_coordinator_timeout);
+    config_get_numerical_field("tiering_promote_threshold",server.tiering_promote_threshold);
 
     /* Bool (yes/no) values */
     config_get_bool_field("cluster-require-full-coverage",
@@ -1324,6 +1505,7 @@ void configGetCommand(client *c) {
     config_get_bool_field("activerehashing", server.activerehashing);
     config_get_bool_field("activedefrag", server.active_defrag_enabled);
     config_get_bool_field("protected-mode", server.protected_mode);
+    config_get_bool_field("io-threads-do-reads", server.io_threads_do_reads);
     config_get_bool_field("repl-disable-tcp-nodelay",
             server.repl_disable_tcp_nodelay);
     config_get_bool_field("repl-diskless-sync",
@@ -1340,6 +1522,20 @@ void configGetCommand(client *c) {
             server.lazyfree_lazy_expire);
     config_get_bool_field("lazyfree-lazy-server-del",
             server.lazyfree_lazy_server_del);
+    config_get_bool_field("tiering_column_granular",
+            server.tiering_column_granular);
+    config_get_bool_field("tiering_sst_ingest",
+            server.tiering_sst_ingest);
+    config_get_bool_field("cluster_coordinator",
+            server.cluster_coordinator);
+    config_get_bool_field("rocksdb_statistics",
+            server.rocksdb_statistics);
+    config_get_bool_field("rocksdb_checkpoint",
+            server.rocksdb_checkpoint);
+    config_get_bool_field("rocksdb_checkpoint_restore",
+            server.rocksdb_checkpoint_restore);
+    config_get_bool_field("repl_rocksdb_sync",
+            server.repl_rocksdb_sync);
     config_get_bool_field("slave-lazy-flush",
             server.repl_slave_lazy_flush);
 
@@ -1989,6 +2185,8 @@ int rewriteConfig(char *path) {
     rewriteConfigOctalOption(state,"unixsocketperm",server.unixsocketperm,CONFIG_DEFAULT_UNIX_SOCKET_PERM);
     rewriteConfigNumericalOption(state,"timeout",server.maxidletime,CONFIG_DEFAULT_CLIENT_TIMEOUT);
     rewriteConfigNumericalOption(state,"tcp-keepalive",server.tcpkeepalive,CONFIG_DEFAULT_TCP_KEEPALIVE);
+    rewriteConfigNumericalOption(state,"io-threads",server.io_threads_num,CONFIG_DEFAULT_IO_THREADS_NUM);
+    rewriteConfigYesNoOption(state,"io-threads-do-reads",server.io_threads_do_reads,CONFIG_DEFAULT_IO_THREADS_DO_READS);
     rewriteConfigNumericalOption(state,"slave-announce-port",server.slave_announce_port,CONFIG_DEFAULT_SLAVE_ANNOUNCE_PORT);
     rewriteConfigEnumOption(state,"loglevel",server.verbosity,loglevel_enum,CONFIG_DEFAULT_VERBOSITY);
     rewriteConfigStringOption(state,"logfile",server.logfile,CONFIG_DEFAULT_LOGFILE);
@@ -2020,7 +2218,7 @@ int rewriteConfig(char *path) {
     rewriteConfigNumericalOption(state,"min-slaves-max-lag",server.repl_min_slaves_max_lag,CONFIG_DEFAULT_MIN_SLAVES_MAX_LAG);
     rewriteConfigStringOption(state,"requirepass",server.requirepass,NULL);
     rewriteConfigNumericalOption(state,"maxclients",server.maxclients,CONFIG_DEFAULT_MAX_CLIENTS);
-    rewriteConfigBytesOption(state,"maxmemory",server.maxmemory,CONFIG_DEFAULT_MAXMEMORY);
+    rewriteConfigBytesOption(state,"maxmemory",memoryGovernorUserMaxmemory(),CONFIG_DEFAULT_MAXMEMORY);
     rewriteConfigEnumOption(state,"maxmemory-policy",server.maxmemory_policy,maxmemory_policy_enum,CONFIG_DEFAULT_MAXMEMORY_POLICY);
     rewriteConfigNumericalOption(state,"maxmemory-samples",server.maxmemory_samples,CONFIG_DEFAULT_MAXMEMORY_SAMPLES);
     rewriteConfigNumericalOption(state,"active-defrag-threshold-lower",server.active_defrag_threshold_lower,CONFIG_DEFAULT_DEFRAG_THRESHOLD_LOWER);
@@ -2065,6 +2263,26 @@ int rewriteConfig(char *path) {
     rewriteConfigYesNoOption(state,"lazyfree-lazy-eviction",server.lazyfree_lazy_eviction,CONFIG_DEFAULT_LAZYFREE_LAZY_EVICTION);
     rewriteConfigYesNoOption(state,"lazyfree-lazy-expire",server.lazyfree_lazy_expire,CONFIG_DEFAULT_LAZYFREE_LAZY_EXPIRE);
     rewriteConfigYesNoOption(state,"lazyfree-lazy-server-del",server.lazyfree_lazy_server_del,CONFIG_DEFAULT_LAZYFREE_LAZY_SERVER_DEL);
+    rewriteConfigNumericalOption(state,"batch_tiering_size",server.batch_tiering_size,CONFIG_DEFAULT_BATCH_TIERING_SIZE);
+    rewriteConfigNumericalOption(state,"tiering_threads",server.tiering_threads,CONFIG_DEFAULT_TIERING_THREADS);
+    rewriteConfigNumericalOption(state,"tiering_high_watermark",server.tiering_high_watermark,CONFIG_DEFAULT_TIERING_HIGH_WATERMARK);
+    rewriteConfigNumericalOption(state,"tiering_low_watermark",server.tiering_low_watermark,CONFIG_DEFAULT_TIERING_LOW_WATERMARK);
+    rewriteConfigBytesOption(state,"tiering_backlog_limit",server.tiering_backlog_limit,CONFIG_DEFAULT_TIERING_BACKLOG_LIMIT);
+    rewriteConfigBytesOption(state,"memory_budget",server.memory_budget,CONFIG_DEFAULT_MEMORY_BUDGET);
+    rewriteConfigNumericalOption(state,"tiering_victim_samples",server.tiering_victim_samples,CONFIG_DEFAULT_TIERING_VICTIM_SAMPLES);
+    rewriteConfigYesNoOption(state,"tiering_column_granular",server.tiering_column_granular,CONFIG_DEFAULT_TIERING_COLUMN_GRANULAR);
+    rewriteConfigNumericalOption(state,"tiering_promote_threshold",server.tiering_promote_threshold,CONFIG_DEFAULT_TIERING_PROMOTE_THRESHOLD);
+    rewriteConfigYesNoOption(state,"tiering_sst_ingest",server.tiering_sst_ingest,CONFIG_DEFAULT_TIERING_SST_INGEST);
+    rewriteConfigYesNoOption(state,"rocksdb_statistics",server.rocksdb_statistics,CONFIG_DEFAULT_ROCKSDB_STATISTICS);
+    rewriteConfigYesNoOption(state,"rocksdb_checkpoint",server.rocksdb_checkpoint,CONFIG_DEFAULT_ROCKSDB_CHECKPOINT);
+    rewriteConfigStringOption(state,"rocksdb_checkpoint_dir",server.rocksdb_checkpoint_dir,CONFIG_DEFAULT_ROCKSDB_CHECKPOINT_DIR);
+    rewriteConfigYesNoOption(state,"rocksdb_checkpoint_restore",server.rocksdb_checkpoint_restore,CONFIG_DEFAULT_ROCKSDB_CHECKPOINT_RESTORE);
+    rewriteConfigYesNoOption(state,"repl_rocksdb_sync",server.repl_rocksdb_sync,CONFIG_DEFAULT_REPL_ROCKSDB_SYNC);
+    rewriteConfigNumericalOption(state,"rocksdb_max_open_files",server.rocksdb_max_open_files,CONFIG_DEFAULT_ROCKSDB_MAX_OPEN_FILES);
+    rewriteConfigBytesOption(state,"fpwrite_batch_bytes",server.fpwrite_batch_bytes,CONFIG_DEFAULT_FPWRITE_BATCH_BYTES);
+    rewriteConfigNumericalOption(state,"partition_filter_cache_size",server.partition_filter_cache_size,CONFIG_DEFAULT_PARTITION_FILTER_CACHE_SIZE);
+    rewriteConfigYesNoOption(state,"cluster_coordinator",server.cluster_coordinator,CONFIG_DEFAULT_CLUSTER_COORDINATOR);
+    rewriteConfigNumericalOption(state,"cluster_coordinator_timeout",server.cluster_coordinator_timeout,CONFIG_DEFAULT_CLUSTER_COORDINATOR_TIMEOUT);
     rewriteConfigYesNoOption(state,"slave-lazy-flush",server.repl_slave_lazy_flush,CONFIG_DEFAULT_SLAVE_LAZY_FLUSH);
 
     /* Rewrite Sentinel config if in Sentinel mode. */
@@ -76,6 +76,11 @@
 #define HAVE_EPOLL 1
 #endif
 
+/* Test for eventfd(2), used to notify the event loop from threads */
+#ifdef __linux__
+#define HAVE_EVENTFD 1
+#endif
+
 #if (defined(__APPLE__) && defined(MAC_OS_X_VERSION_10_6)) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined (__NetBSD__)
 #define HAVE_KQUEUE 1
 #endif
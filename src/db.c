@@ -31,6 +31,7 @@
 #include "cluster.h"
 #include "atomicvar.h"
 #include "persistent_store.h"
+#include "tiering.h"
 
 #include <signal.h>
 #include <ctype.h>
@@ -53,7 +54,7 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
             /* ADDB */
             size_t val_len;
             char* err = NULL;
-            char* retVal = rocksdb_get_cf(db->persistent_store->ps, db->persistent_store->ps_options->roptions, db->persistent_store->ps_cf_handles[PERSISTENT_STORE_CF_RW], key->ptr, sdslen(key->ptr), &val_len, &err);
+            char* retVal = rocksdb_get_cf(db->persistent_store->ps, db->persistent_store->ps_options->roptions, getPersistentStoreKeyCF(db->persistent_store, key->ptr, sdslen(key->ptr), 0), key->ptr, sdslen(key->ptr), &val_len, &err);
             if(err) {
                 serverPanic("[RocksDB] Getting the key from RocksDB is failed.");
             } else {
@@ -75,7 +76,10 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
         server.aof_child_pid == -1 &&
         !(flags & LOOKUP_NOTOUCH))
     {
-        if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
+        if (val->encoding == OBJ_ENCODING_REL) {
+            /* ADDB: the heat of rowgroups is only updated by scans,
+             * see touchRowGroup(). */
+        } else if (server.maxmemory_policy & MAXMEMORY_FLAG_LFU) {
             unsigned long ldt = val->lru >> 8;
             unsigned long counter = LFULogIncr(val->lru & 255);
             val->lru = (ldt << 8) | counter;
@@ -89,6 +93,7 @@ robj *lookupKey(redisDb *db, robj *key, int flags) {
 /*addb lookup Metadict key. ref lookupKey func*/
 
 robj *lookupKeyForMetadict(redisDb *db, robj *key, int flags){
+    loadPartitionMetaIfNeeded(db,key->ptr);
     dictEntry *de = dictFind(db->Metadict,key->ptr);
     robj *val = NULL;
 
@@ -184,6 +189,7 @@ robj *lookupAllKeyRead(redisDb *db, robj *key) {
 
 robj *lookupSDSKeyForMetadict(redisDb *db, sds key){
 
+    loadPartitionMetaIfNeeded(db,key);
     dictEntry *de = dictFind(db->Metadict,key);
     if (de) {
         robj *val = dictGetVal(de);
@@ -267,6 +273,7 @@ void dbAddForMetadict(redisDb *db, robj *key, robj *val){
     }
 
     serverAssertWithInfo(NULL,key,retval == DICT_OK);
+    partitionIndexAdd(db, copy, val);
     if (val->type == OBJ_LIST) signalListAsReady(db, key);
     if (server.cluster_enabled) slotToKeyAdd(key);
 
@@ -375,7 +382,7 @@ void persistKey(redisDb *db, robj *keyobj, robj *targetVal) {
     char *persistValStr = targetVal->ptr;
     int persistValStrLen = sdslen(persistValStr);
     setPersistentKey(db->persistent_store,persistKeyStr,persistKeyStrLen,persistValStr,persistValStrLen);
-    targetVal->location = LOCATION_PERSISTED;
+    objSetLocation(targetVal, LOCATION_PERSISTED);
 }
 
 //TODO hs implement later
@@ -466,6 +473,11 @@ long long emptyDb(int dbnum, int flags, void(callback)(void*)) {
         return -1;
     }
 
+    /* ADDB: the tiering pool may still be serializing rowgroups we are
+     * about to free, and FPMIGRATE may still be sending them. */
+    tieringWaitIdle();
+    abortPartitionMigration(-1, "the database was emptied");
+
     for (j = 0; j < server.dbnum; j++) {
         if (dbnum != -1 && dbnum != j) continue;
         removed += dictSize(server.db[j].dict);
@@ -476,7 +488,11 @@ long long emptyDb(int dbnum, int flags, void(callback)(void*)) {
             dictEmpty(server.db[j].dict,callback);
             dictEmpty(server.db[j].expires,callback);
             dictEmpty(server.db[j].Metadict, callback);
+            partitionIndexEmpty(&server.db[j]);
         }
+        /* The tiered rowgroups are merged back on the next lookups, unless
+         * the caller flushes their metadata too. */
+        resetMetadictLazyLoad(&server.db[j]);
     }
     if (server.cluster_enabled) {
         if (async) {
@@ -491,6 +507,7 @@ long long emptyDb(int dbnum, int flags, void(callback)(void*)) {
     	redisDb *db = server.db + j;
     	initializeQueue(db->EvictQueue);
     	initializeQueue(db->FreeQueue);
+    	dictEmpty(db->TieredHeat,NULL);
    }
     if (dbnum == -1) flushSlaveKeysWithExpireList();
     return removed;
@@ -555,6 +572,7 @@ void flushdbCommand(client *c) {
     if (getFlushCommandFlags(c,&flags) == C_ERR) return;
     signalFlushedDb(c->db->id);
     server.dirty += emptyDb(c->db->id,flags,NULL);
+    flushRowGroupMeta(c->db);
     addReply(c,shared.ok);
 }
 
@@ -562,11 +580,12 @@ void flushdbCommand(client *c) {
  *
  * Flushes the whole server data set. */
 void flushallCommand(client *c) {
-    int flags;
+    int flags, j;
 
     if (getFlushCommandFlags(c,&flags) == C_ERR) return;
     signalFlushedDb(-1);
     server.dirty += emptyDb(-1,flags,NULL);
+    for (j = 0; j < server.dbnum; j++) flushRowGroupMeta(&server.db[j]);
     addReply(c,shared.ok);
 
     /*
@@ -1268,6 +1287,7 @@ void propagateExpire(redisDb *db, robj *key, int lazy) {
     incrRefCount(argv[0]);
     incrRefCount(argv[1]);
 
+    fpWriteBatchFlush();
     if (server.aof_state != AOF_OFF)
         feedAppendOnlyFile(server.delCommand,db->id,argv,2);
     replicationFeedSlaves(server.slaves,db->id,argv,2);
@@ -30,6 +30,7 @@
 #include "server.h"
 #include "sha1.h"   /* SHA1 is used for DEBUG DIGEST */
 #include "crc64.h"
+#include "tiering.h"
 
 #include <arpa/inet.h>
 #include <signal.h>
@@ -1055,6 +1056,7 @@ void sigsegvHandler(int sig, siginfo_t *info, void *secret) {
     /* Test memory */
     serverLogRaw(LL_WARNING|LL_RAW, "\n------ FAST MEMORY TEST ------\n");
     bioKillThreads();
+    tieringKillThreads();
     if (memtest_test_linux_anonymous_maps()) {
         serverLogRaw(LL_WARNING|LL_RAW,
             "!!! MEMORY ERROR DETECTED! Check your memory ASAP !!!\n");
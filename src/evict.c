@@ -33,8 +33,11 @@
 #include "server.h"
 #include "bio.h"
 #include "atomicvar.h"
+#include "latency.h"
 #include "circular_queue.h"
 #include "stl.h"
+#include "tiering.h"
+#include "addb_relational.h"
 
 /* ----------------------------------------------------------------------------
  * Data structures
@@ -333,9 +336,9 @@ uint8_t LFULogIncr(uint8_t counter) {
  * to fit: as we check for the candidate, we incrementally decrement the
  * counter of the scanned objects if needed. */
 #define LFU_DECR_INTERVAL 1
-unsigned long LFUDecrAndReturn(robj *o) {
-    unsigned long ldt = o->lru >> 8;
-    unsigned long counter = o->lru & 255;
+static unsigned long LFUDecrValueAndReturn(unsigned long *lfu) {
+    unsigned long ldt = *lfu >> 8;
+    unsigned long counter = *lfu & 255;
     if (LFUTimeElapsed(ldt) >= server.lfu_decay_time && counter) {
         if (counter > LFU_INIT_VAL*2) {
             counter /= 2;
@@ -343,11 +346,41 @@ unsigned long LFUDecrAndReturn(robj *o) {
         } else {
             counter--;
         }
-        o->lru = (LFUGetTimeInMinutes()<<8) | counter;
+        *lfu = (LFUGetTimeInMinutes()<<8) | counter;
     }
     return counter;
 }
 
+unsigned long LFUDecrAndReturn(robj *o) {
+    unsigned long lfu = o->lru;
+    unsigned long counter = LFUDecrValueAndReturn(&lfu);
+    if (lfu != o->lru) o->lru = lfu;
+    return counter;
+}
+
+/* ADDB
+ * Rowgroups always use the LFU format of robj.lru whatever the maxmemory
+ * policy is, and the counter is only incremented by scans, so that the
+ * tiering victim picker can keep the partitions which are read often in
+ * memory. */
+void touchRowGroup(robj *o) {
+    if (o->encoding != OBJ_ENCODING_REL) return;
+    if (server.rdb_child_pid != -1 || server.aof_child_pid != -1) return;
+
+    unsigned long counter = LFULogIncr(LFUDecrAndReturn(o));
+    o->lru = (LFUGetTimeInMinutes()<<8) | counter;
+}
+
+/* Same as touchRowGroup() for the column vectors of a rowgroup, used by
+ * the column granular tiering to keep the columns which are scanned. */
+void touchColumnVector(robj *o) {
+    if (o->type != OBJ_VECTOR) return;
+    if (server.rdb_child_pid != -1 || server.aof_child_pid != -1) return;
+
+    unsigned long counter = LFULogIncr(LFUDecrAndReturn(o));
+    o->lru = (LFUGetTimeInMinutes()<<8) | counter;
+}
+
 /* ----------------------------------------------------------------------------
  * The external API for eviction: freeMemroyIfNeeded() is called by the
  * server when there is data to add in order to make space if needed.
@@ -590,31 +623,100 @@ size_t freeMemoryGetNotCountedMemory(void) {
 //    return C_ERR;
 //}
 
-int _getRowCount(redisDb *db, sds dataKey) {
-    sds metaKey;
-    int rowGroupId;
-    if (toMetaKey(dataKey, &metaKey, &rowGroupId) == C_ERR) {
-        serverLog(
-            LL_WARNING,
-            "[_batchTiering][_getRowCount] FATAL: datakey has invalid format! %s",
-            dataKey);
-        serverAssert(0);
-    }
-    serverLog(LL_DEBUG, "[_batchTiering][%s] metakey: %s, rowGroupId: %d", dataKey, metaKey, rowGroupId);
-    robj *metaObj = lookupSDSKeyForMetadict(db, metaKey);
-    robj *rowGroupField = createStringObjectFromLongLong(
-        (long long) rowGroupId);
-    int rowCount = lookupCompInfoForRowNumberInMeta(metaObj, rowGroupField);
-
-    sdsfree(metaKey);
-    decrRefCount(rowGroupField);
-    return rowCount;
-}
-
-void _batchTiering(redisDb *db, Vector *evict_keys, Vector *evict_relations) {
-    int count = server.batch_tiering_size;
-    serverLog(LL_DEBUG, "[_batchTiering] Initial batch tiering size: %d", count);
+/* Heat of the rowgroup 'de' for the victim picker. The rowgroup still
+ * filled by FPWRITE is the hottest, as tiering it would close it early. */
+static unsigned long _rowGroupHeat(redisDb *db, dictEntry *de) {
+    if (getRowNumberOfDataKey(db, dictGetKey(de)) < server.rowgroup_size)
+        return 256;
+    return LFUDecrAndReturn(dictGetVal(de));
+}
+
+/* Sample the 'tiering_victim_samples' oldest rowgroups of the EvictQueue,
+ * like evictionPoolPopulate() does for keys, and move the coldest one to
+ * the rear of the queue so that chooseBestKeyFromQueue_() takes it. On a
+ * tie the oldest rowgroup wins, so with cold data this is still FIFO. */
+static void _moveColdestRowGroupToRear(redisDb *db) {
+    Queue *queue = db->EvictQueue;
+    int samples = server.tiering_victim_samples;
+    int32_t best = queue->rear;
+    unsigned long best_heat = ULONG_MAX;
+    int i;
+
+    if (samples > queue->size) samples = queue->size;
+    if (samples <= 1) return;
+
+    for (i = 0; i < samples; i++) {
+        int32_t idx = (queue->rear + i) % queue->max;
+        unsigned long heat = _rowGroupHeat(db, queue->buf[idx]);
+        if (heat < best_heat) {
+            best = idx;
+            best_heat = heat;
+            if (heat == 0) break;
+        }
+    }
+    if (best != queue->rear) {
+        dictEntry *tmp = queue->buf[queue->rear];
+        queue->buf[queue->rear] = queue->buf[best];
+        queue->buf[best] = tmp;
+    }
+}
+
+/* Replicate the rowgroups chosen by _batchTiering(), so that the slaves
+ * and the AOF tier the same rowgroups, see fptierCommand(). */
+static void _propagateTiering(redisDb *db, Vector *evict_keys) {
+    size_t count = vectorCount(evict_keys), i;
+    robj **argv;
+
+    if (count == 0) return;
+    argv = zmalloc(sizeof(robj*)*(count+1));
+    argv[0] = createStringObject("FPTIER",6);
+    for (i = 0; i < count; i++) {
+        sds key = vectorGet(evict_keys, i);
+        argv[i+1] = createStringObject(key, sdslen(key));
+    }
+    propagate(server.fptierCommand, db->id, argv, count+1,
+              PROPAGATE_AOF|PROPAGATE_REPL);
+    for (i = 0; i <= count; i++) decrRefCount(argv[i]);
+    zfree(argv);
+}
+
+static int _moveIfPersisted(dictEntry *de, void *privdata) {
+    redisDb *db = privdata;
+
+    if (objGetLocation((robj *) dictGetVal(de)) != LOCATION_PERSISTED) return 0;
+    enqueue(db->FreeQueue, de);
+    return 1;
+}
+
+/* Move rowgroups from the EvictQueue to the tiering pool until at least
+ * 'rows' rows were collected. Returns the number of rows submitted.
+ *
+ * A slave tiers the rowgroups chosen by its master, so it only moves the
+ * rowgroups already persisted (promoted, partially cleared or loaded as
+ * persisted from the RDB) to the FreeQueue, to be cleared. */
+long long _batchTiering(redisDb *db, long long rows) {
+    long long count = rows;
+    Vector *evict_keys, *evict_relations;
+
+    if (isEmpty(db->EvictQueue)) return 0;
+    if (server.masterhost)
+        return removeFromQueueIf(db->EvictQueue, _moveIfPersisted, db) *
+               server.rowgroup_size;
+
+    evict_keys = vectorCreate(STL_TYPE_SDS, INIT_VECTOR_SIZE);
+    evict_relations = vectorCreate(STL_TYPE_ROBJ, INIT_VECTOR_SIZE);
+    serverLog(LL_DEBUG, "[_batchTiering] Initial batch tiering size: %lld", count);
     while (!isEmpty(db->EvictQueue) && count > 0) {
+        _moveColdestRowGroupToRear(db);
+
+        /* Rowgroups partially cleared by the column granular tiering are
+         * already in RocksDB, they only need to be cleared. */
+        robj *rear = dictGetVal(db->EvictQueue->buf[db->EvictQueue->rear]);
+        if (objGetLocation(rear) == LOCATION_PERSISTED) {
+            enqueue(db->FreeQueue, dequeue(db->EvictQueue));
+            continue;
+        }
+
         dictEntry *de = chooseBestKeyFromQueue_(db->EvictQueue, db->FreeQueue);
         if (de == NULL) {
             continue;
@@ -624,24 +726,652 @@ void _batchTiering(redisDb *db, Vector *evict_keys, Vector *evict_relations) {
         vectorAdd(evict_keys, (void *) key);
         vectorAdd(evict_relations, (void *) relation);
         serverLog(LL_DEBUG, "[_batchTiering][%s] Get row count", key);
-        int rowCount = _getRowCount(db, key);
+        int rowCount = getRowNumberOfDataKey(db, key);
         count -= rowCount;
-        serverLog(LL_DEBUG, "[_batchTiering][%s] Remain batch tiering size: %d", key, count);
+        serverLog(LL_DEBUG, "[_batchTiering][%s] Remain batch tiering size: %lld", key, count);
     }
-    dbPersistBatch_(db, evict_keys, evict_relations);
     server.stat_evictedkeys += vectorCount(evict_relations);
+    _propagateTiering(db, evict_keys);
+    dbPersistBatch_(db, evict_keys, evict_relations);
+    return rows - count;
+}
+
+static int _matchFlush(dictEntry *de, void *privdata) {
+    UNUSED(privdata);
+    return objGetLocation((robj *) dictGetVal(de)) == LOCATION_FLUSH;
+}
+
+/* FPTIER <dataKey> [<dataKey> ...]
+ *
+ * Tier the given rowgroups now. It is propagated by _batchTiering() so
+ * that the slaves follow the tiering decisions of their master, and the
+ * rowgroups of the AOF are tiered again when it is loaded. Rowgroups which
+ * are missing or already tiered are skipped. */
+void fptierCommand(client *c) {
+    Vector *evict_keys = vectorCreate(STL_TYPE_SDS, INIT_VECTOR_SIZE);
+    Vector *evict_relations = vectorCreate(STL_TYPE_ROBJ, INIT_VECTOR_SIZE);
+    redisDb *db = c->db;
+    size_t count, i;
+    int j;
+
+    for (j = 1; j < c->argc; j++) {
+        dictEntry *de = dictFind(db->dict, c->argv[j]->ptr);
+        robj *relation = de ? dictGetVal(de) : NULL;
+
+        if (relation == NULL || relation->type != OBJ_HASH ||
+            relation->encoding != OBJ_ENCODING_REL ||
+            objGetLocation(relation) != LOCATION_REDIS_ONLY) continue;
+        objSetLocation(relation, LOCATION_FLUSH);
+        vectorAdd(evict_keys, dictGetKey(de));
+        vectorAdd(evict_relations, relation);
+    }
+
+    count = vectorCount(evict_keys);
+    if (count) {
+        removeFromQueueIf(db->EvictQueue, _matchFlush, NULL);
+        for (i = 0; i < count; i++)
+            enqueue(db->FreeQueue, dictFind(db->dict, vectorGet(evict_keys, i)));
+        server.stat_evictedkeys += count;
+        server.dirty += count;
+    }
+    dbPersistBatch_(db, evict_keys, evict_relations);
+    addReply(c, shared.ok);
 }
 
+/* ADDB
+ * Tiering controller
+ *
+ * Rowgroups are moved to RocksDB from serverCron() so that client commands
+ * almost never have to tier or clear memory by themselves:
+ *
+ * 1) Rowgroups already committed by the tiering pool are cleared from the
+ *    FreeQueue as long as memory is over the low watermark.
+ * 2) Once memory crosses the high watermark the controller gets active and
+ *    keeps submitting batches until the memory that will be left after the
+ *    in-flight rowgroups are cleared is under the low watermark.
+ * 3) The size of every batch is the number of rows needed to go back to the
+ *    low watermark, plus the rows expected to be ingested before the next
+ *    cycle. While the pool has a backlog the batch is capped to what the
+ *    pool committed during the last cycle, so that we don't queue more
+ *    work than the workers can take. 'batch_tiering_size' is the minimum
+ *    batch, as tiny WriteBatches waste the WAL sync.
+ *
+ * freeMemoryIfNeeded() is only the last resort when memory is over
+ * maxmemory, and it never waits for the tiering pool. */
+static struct {
+    int active;                 /* Between high and low watermark crossing. */
+    size_t rowgroup_bytes;      /* Moving average of bytes per rowgroup. */
+} tieringCtl = {0, 0};
+
+/* Column granular tiering: free the column vectors of a persisted
+ * rowgroup which were not scanned recently. Returns the number of column
+ * vectors freed, or 0 if the rowgroup has to be cleared as a whole because
+ * either every column or no column is cold. */
+static unsigned long _clearColdColumnVectors(robj *relation) {
+    dict *d = relation->ptr;
+    unsigned long cold = 0, j;
+    dictIterator *di;
+    dictEntry *de;
+    void **keys;
+
+    /* The counters decay with time, so the cold columns are collected
+     * once and exactly those are deleted. */
+    keys = zmalloc(sizeof(void *) * (dictSize(d) ? dictSize(d) : 1));
+    di = dictGetIterator(d);
+    while ((de = dictNext(di)) != NULL) {
+        if (LFUDecrAndReturn(dictGetVal(de)) <= LFU_INIT_VAL)
+            keys[cold++] = dictGetKey(de);
+    }
+    dictReleaseIterator(di);
+    if (cold != 0 && cold != dictSize(d)) {
+        for (j = 0; j < cold; j++) dictDelete(d, keys[j]);
+    } else {
+        cold = 0;
+    }
+    zfree(keys);
+    return cold;
+}
+
+/* Clear the rowgroups of the FreeQueue of 'db' already committed to
+ * RocksDB, until the memory used is at or under 'target'. The FreeQueue is
+ * FIFO, so we stop at the first rowgroup which is still in flight.
+ * Returns the memory used after clearing.
+ *
+ * With 'tiering_column_granular' only the cold column vectors of a
+ * rowgroup are freed the first time. The rowgroup stays in memory as
+ * persisted with its hot columns and goes back to the EvictQueue, so that
+ * it is cleared once it is chosen as victim again and its columns cooled
+ * down. */
+static size_t _tieringClearPersisted(redisDb *db, size_t mem_used,
+                                     size_t target) {
+    while (mem_used > target && !isEmpty(db->FreeQueue)) {
+        dictEntry *victim = chooseClearKeyFromQueue_(db->FreeQueue);
+        size_t before, after;
+        int partial = 0;
+
+        if (victim == NULL) break;
+
+        sds victimKey = dictGetKey(victim);
+        robj *victVal = dictGetVal(victim);
+        serverAssert(objGetLocation(victVal) == LOCATION_PERSISTED);
+
+        before = zmalloc_used_memory();
+        if (server.tiering_column_granular &&
+            _clearColdColumnVectors(victVal))
+        {
+            enqueue(db->EvictQueue, victim);
+            server.stat_tiering_partial_clears++;
+            partial = 1;
+        } else {
+            robj *victimKeyobj = createStringObject(victimKey,
+                                                    sdslen(victimKey));
+            if (dbClear_(db, victimKeyobj)) {
+                serverLog(LL_VERBOSE,"CLEAR FAIL : FreeQueue->size : %d", db->FreeQueue->size);
+                serverAssert(0);
+            }
+            decrRefCount(victimKeyobj);
+        }
+        after = zmalloc_used_memory();
+
+        if (before > after) {
+            size_t freed = before - after;
+            if (!partial) {
+                tieringCtl.rowgroup_bytes = tieringCtl.rowgroup_bytes ?
+                    (tieringCtl.rowgroup_bytes * 7 + freed) / 8 : freed;
+            }
+            mem_used = (mem_used > freed) ? mem_used - freed : 0;
+        }
+        serverLog(LL_DEBUG, "CLEAR VICTIM SUCCESS [rear: %d]",
+                  db->FreeQueue->rear);
+    }
+    return mem_used;
+}
+
+/* Memory used by the dataset, not counting replication and AOF buffers. */
+static size_t _tieringMemoryUsed(void) {
+    size_t mem_used = zmalloc_used_memory();
+    size_t overhead = freeMemoryGetNotCountedMemory();
+    return (mem_used > overhead) ? mem_used - overhead : 0;
+}
+
+/* Number of rows to tier in this cycle, see the comment above. */
+static long long _tieringBatchRows(size_t projected, size_t low) {
+    long long need, ingest, committed, rows;
+    int hz = server.hz ? server.hz : CONFIG_DEFAULT_HZ;
+
+    if (projected > low && tieringCtl.rowgroup_bytes) {
+        need = (long long) ((projected - low) / tieringCtl.rowgroup_bytes + 1) *
+               server.rowgroup_size;
+    } else {
+        need = 0;
+    }
+    ingest = getInstantaneousMetric(STATS_METRIC_FPWRITE_ROWS) / hz;
+    rows = need + ingest;
+
+    if (tieringPendingJobs() > (unsigned long long) tieringNumWorkers()) {
+        committed = getInstantaneousMetric(STATS_METRIC_TIERED_ROWGROUPS) *
+                    server.rowgroup_size / hz;
+        if (rows > committed) rows = committed;
+    }
+    if (rows < server.batch_tiering_size) rows = server.batch_tiering_size;
+    return rows;
+}
+
+/* ADDB
+ * Ingest backpressure
+ *
+ * The tiering backlog is the memory waiting to leave Redis: rowgroups in
+ * flight or committed but not cleared yet, plus the memory over the high
+ * watermark not submitted yet. The admission state of FPWRITE follows the
+ * backlog against 'tiering_backlog_limit' (by default the room between the
+ * high watermark and maxmemory):
+ *
+ * OPEN      backlog under half the limit, every write is admitted.
+ * THROTTLE  backlog between half the limit and the limit. Every cycle a
+ *           budget of rows is admitted, going linearly from the demand of
+ *           the last cycle down to the rows the pool committed in the last
+ *           cycle as the backlog approaches the limit. Writes over the
+ *           budget are blocked until the next cycle.
+ * BLOCK     backlog over the limit, writes are blocked until the backlog
+ *           goes back under 3/4 of the limit.
+ *
+ * Blocked clients keep their FPWRITE in argv and are resumed in FIFO order,
+ * so ingestion slows down smoothly instead of stalling on a full memory. */
+static const char *tieringAdmissionNames[] = {"open","throttle","block"};
+
+const char *tieringAdmissionName(void) {
+    return tieringAdmissionNames[server.tiering_admission];
+}
+
+size_t tieringBacklogLimit(void) {
+    size_t high;
+
+    if (server.tiering_backlog_limit) return server.tiering_backlog_limit;
+    high = server.maxmemory / 100 * server.tiering_high_watermark;
+    return (server.maxmemory > high) ? server.maxmemory - high : 0;
+}
+
+/* Number of rows carried by the FPWRITE in the client argv. */
+static long long _fpwriteRows(client *c) {
+    long long columns;
+
+    if (c->argc < 5) return 0;
+    columns = strtoll(c->argv[3]->ptr, NULL, 10);
+    return (columns > 0) ? (c->argc - 5) / columns : 0;
+}
+
+/* Return 1 if the FPWRITE of 'c' can run now, 0 if it has to wait. */
+int tieringAdmitWrite(client *c) {
+    long long rows;
+
+    if (c->flags & CLIENT_TIERING_ADMITTED) {
+        c->flags &= ~CLIENT_TIERING_ADMITTED;
+        return 1;
+    }
+    /* Never delay the replication stream, transactions, scripts or the
+     * AOF loading. */
+    if (c->flags & (CLIENT_MASTER|CLIENT_MULTI) || c->fd == -1 ||
+        server.loading) return 1;
+
+    rows = _fpwriteRows(c);
+    server.tiering_demand_rows += rows;
+    if (server.tiering_admission == TIERING_ADMIT_OPEN) return 1;
+
+    /* Nobody passes the clients already waiting. */
+    if (listLength(server.tiering_blocked_clients)) return 0;
+    if (server.tiering_admission == TIERING_ADMIT_THROTTLE &&
+        server.tiering_admit_rows > 0)
+    {
+        server.tiering_admit_rows -= rows;
+        return 1;
+    }
+    return 0;
+}
+
+void blockForTiering(client *c) {
+    listAddNodeTail(server.tiering_blocked_clients,c);
+    c->bpop.timeout = 0;
+    blockClient(c,BLOCKED_TIERING);
+    server.stat_tiering_delayed_writes++;
+}
+
+/* This is called by unblockClient() to remove the client from the list
+ * of clients waiting for the tiering backlog. */
+void unblockClientWaitingTiering(client *c) {
+    listNode *ln = listSearchKey(server.tiering_blocked_clients,c);
+    serverAssert(ln != NULL);
+    listDelNode(server.tiering_blocked_clients,ln);
+}
+
+/* Resume the blocked clients allowed by the admission state. The FPWRITE
+ * is executed again by processUnblockedClients(). */
+static void _tieringResumeClients(void) {
+    while (listLength(server.tiering_blocked_clients)) {
+        client *c = listNodeValue(listFirst(server.tiering_blocked_clients));
+
+        if (server.tiering_admission == TIERING_ADMIT_BLOCK) break;
+        if (server.tiering_admission == TIERING_ADMIT_THROTTLE) {
+            if (server.tiering_admit_rows <= 0) break;
+            server.tiering_admit_rows -= _fpwriteRows(c);
+        }
+        c->flags |= CLIENT_TIERING_ADMITTED;
+        unblockClient(c);
+    }
+}
+
+static void _tieringUpdateAdmission(size_t backlog) {
+    size_t limit = server.maxmemory ? tieringBacklogLimit() : 0;
+    int hz = server.hz ? server.hz : CONFIG_DEFAULT_HZ;
+    int state;
+
+    server.tiering_backlog_bytes = backlog;
+    if (limit == 0) {
+        state = TIERING_ADMIT_OPEN;
+    } else if (backlog >= limit) {
+        state = TIERING_ADMIT_BLOCK;
+    } else if (server.tiering_admission == TIERING_ADMIT_BLOCK &&
+               backlog >= limit / 4 * 3) {
+        state = TIERING_ADMIT_BLOCK;
+    } else if (backlog >= limit / 2) {
+        state = TIERING_ADMIT_THROTTLE;
+    } else {
+        state = TIERING_ADMIT_OPEN;
+    }
+
+    if (state != server.tiering_admission) {
+        serverLog(LL_VERBOSE, "Tiering admission %s -> %s (backlog %zu, limit %zu)",
+                  tieringAdmissionNames[server.tiering_admission],
+                  tieringAdmissionNames[state], backlog, limit);
+        /* A blocked ingestion is reported to the latency monitor as one
+         * event lasting until writes are admitted again. */
+        if (state == TIERING_ADMIT_BLOCK) {
+            server.tiering_block_start = mstime();
+        } else if (server.tiering_admission == TIERING_ADMIT_BLOCK) {
+            latencyAddSampleIfNeeded("tiering-stall",
+                                     mstime() - server.tiering_block_start);
+        }
+        server.tiering_admission = state;
+    }
+
+    if (state == TIERING_ADMIT_THROTTLE) {
+        long long committed, demand, budget;
+        double room = (double) (limit - backlog) / (limit / 2);
+
+        committed = getInstantaneousMetric(STATS_METRIC_TIERED_ROWGROUPS) *
+                    server.rowgroup_size / hz;
+        demand = server.tiering_demand_rows;
+        budget = committed;
+        if (demand > committed) budget += (long long) ((demand - committed) * room);
+        server.tiering_admit_rows = (budget > 0) ? budget : 1;
+    }
+    server.tiering_demand_rows = 0;
+    _tieringResumeClients();
+}
+
+/* A scan adds an entry to 'TieredHeat' for every tiered rowgroup it reads,
+ * and only promotion or a drop removes it. Sample the dict and forget the
+ * rowgroups whose decayed counter is back to LFU_INIT_VAL, as a new entry
+ * would start from it anyway. Like activeExpireCycle() the sampling goes on
+ * while more than a quarter of the samples are removed. */
+#define TIERING_HEAT_SAMPLES 20
+#define TIERING_HEAT_MAX_ROUNDS 16
+static void _tieringExpireHeat(redisDb *db) {
+    int rounds = 0, j, removed;
+
+    do {
+        removed = 0;
+        for (j = 0; j < TIERING_HEAT_SAMPLES; j++) {
+            dictEntry *de;
+            unsigned long lfu;
+
+            if (dictSize(db->TieredHeat) == 0) return;
+            de = dictGetRandomKey(db->TieredHeat);
+            lfu = dictGetUnsignedIntegerVal(de);
+            if (LFUDecrValueAndReturn(&lfu) <= LFU_INIT_VAL) {
+                dictDelete(db->TieredHeat, dictGetKey(de));
+                removed++;
+            } else {
+                dictSetUnsignedIntegerVal(de, lfu);
+            }
+        }
+    } while (removed > TIERING_HEAT_SAMPLES/4 &&
+             ++rounds < TIERING_HEAT_MAX_ROUNDS);
+}
+
+/* Memory used by the query buffers of the clients blocked for tiering. */
+static size_t _tieringWaitingInput(void) {
+    listIter li;
+    listNode *ln;
+    size_t waiting = 0;
+
+    listRewind(server.tiering_blocked_clients,&li);
+    while ((ln = listNext(&li)) != NULL) {
+        client *c = listNodeValue(ln);
+        if (c->querybuf) waiting += sdsAllocSize(c->querybuf);
+    }
+    return waiting;
+}
+
+void tieringCron(void) {
+    size_t mem_used, high, low, projected, inflight, waiting, excess, queued;
+    long long rows;
+    int j;
+
+    for (j = 0; j < server.dbnum; j++) _tieringExpireHeat(server.db+j);
+    if (!server.maxmemory || server.maxmemory_policy == MAXMEMORY_NO_EVICTION) {
+        _tieringUpdateAdmission(0);
+        return;
+    }
+    if (clientsArePaused()) return;
+
+    high = server.maxmemory / 100 * server.tiering_high_watermark;
+    low = server.maxmemory / 100 * server.tiering_low_watermark;
+
+    mem_used = _tieringMemoryUsed();
+    for (j = 0; j < server.dbnum && mem_used > low; j++)
+        mem_used = _tieringClearPersisted(server.db+j, mem_used, low);
+
+    /* Rowgroups left in the FreeQueue are in flight or committed, their
+     * memory will be released by the next cycles. */
+    inflight = 0;
+    for (j = 0; j < server.dbnum; j++)
+        inflight += server.db[j].FreeQueue->size;
+    inflight *= tieringCtl.rowgroup_bytes;
+    projected = (mem_used > inflight) ? mem_used - inflight : 0;
+
+    if (!tieringCtl.active && mem_used > high) tieringCtl.active = 1;
+    if (tieringCtl.active && projected <= low) tieringCtl.active = 0;
+    if (tieringCtl.active) {
+        rows = _tieringBatchRows(projected, low);
+        server.tiering_batch_rows = rows;
+        for (j = 0; j < server.dbnum && rows > 0; j++)
+            rows -= _batchTiering(server.db+j, rows);
+    }
+
+    /* The input of the clients waiting for the backlog is only released by
+     * resuming them, tiering can't make room for it. Neither can it for
+     * more than the rowgroups still queued, the rest is not backlog. The
+     * committed rowgroups of the FreeQueues are only cleared over the low
+     * watermark, under it they are not backlog either. */
+    waiting = _tieringWaitingInput();
+    excess = (projected > high + waiting) ? projected - high - waiting : 0;
+    queued = 0;
+    for (j = 0; j < server.dbnum; j++)
+        queued += server.db[j].EvictQueue->size;
+    queued *= tieringCtl.rowgroup_bytes;
+    if (mem_used <= low) inflight = 0;
+    _tieringUpdateAdmission(inflight + (excess < queued ? excess : queued));
+}
+
+/* ADDB
+ * Promote-on-read
+ *
+ * Once cleared, a tiered rowgroup has no robj to carry its LFU counter, so
+ * the scans of rowgroups living only in RocksDB are counted in the
+ * 'TieredHeat' dict of the db, with the same LFU format of robj.lru. When
+ * the counter reaches 'tiering_promote_threshold' and memory is under the
+ * low watermark with room for one more rowgroup, the rowgroup is loaded
+ * back in memory as LOCATION_PERSISTED and pushed to the EvictQueue. As it
+ * is already in RocksDB, tiering it again is just clearing it. */
+static int _tieringHasPromoteRoom(void) {
+    size_t low;
+
+    if (!server.maxmemory) return 1;
+    if (tieringCtl.active || server.tiering_admission != TIERING_ADMIT_OPEN)
+        return 0;
+    low = server.maxmemory / 100 * server.tiering_low_watermark;
+    return _tieringMemoryUsed() + tieringCtl.rowgroup_bytes <= low;
+}
+
+/* Called when a scan reads the rowgroup 'dataKey' which is not in memory.
+ * Returns the rowgroup loaded from RocksDB if it was promoted, otherwise
+ * NULL. */
+robj *tieringPromoteRowGroup(redisDb *db, robj *dataKey) {
+    dictEntry *de;
+    unsigned long lfu, counter;
+    robj *relation;
+
+    if (server.tiering_promote_threshold == 0) return NULL;
+    if (server.rdb_child_pid != -1 || server.aof_child_pid != -1) return NULL;
+
+    de = dictFind(db->TieredHeat, dataKey->ptr);
+    if (de == NULL) {
+        de = dictAddRaw(db->TieredHeat, sdsdup(dataKey->ptr), NULL);
+        dictSetUnsignedIntegerVal(de,
+            (LFUGetTimeInMinutes()<<8) | LFU_INIT_VAL);
+    }
+    lfu = dictGetUnsignedIntegerVal(de);
+    counter = LFULogIncr(LFUDecrValueAndReturn(&lfu));
+    dictSetUnsignedIntegerVal(de, (LFUGetTimeInMinutes()<<8) | counter);
+
+    if (counter < (unsigned long) server.tiering_promote_threshold ||
+        !_tieringHasPromoteRoom()) return NULL;
+
+    relation = loadRowGroupFromRocksDB(db, dataKey->ptr);
+    dictDelete(db->TieredHeat, dataKey->ptr);
+    if (relation == NULL) return NULL;
+
+    /* Keep the heat of the rowgroup, so that it is not the next victim. */
+    relation->lru = (LFUGetTimeInMinutes()<<8) | counter;
+    objSetLocation(relation, LOCATION_PERSISTED);
+    dbAdd(db, dataKey, relation);
+    enqueue(db->EvictQueue, dictFind(db->dict, dataKey->ptr));
+    server.stat_tiering_promotions++;
+    serverLog(LL_DEBUG, "[PROMOTE] %s", (char *) dataKey->ptr);
+    return relation;
+}
+
+/* ADDB
+ * Memory governor
+ *
+ * With 'memory_budget' set, one budget covers the Redis heap and the
+ * RocksDB block cache, memtables and table readers of every store. The
+ * memtables get a fixed 10% of the budget at startup, split between the
+ * stores, and the table readers are charged as measured. The rest is
+ * split between the block cache and the Redis DRAM tier, whose limit is
+ * maxmemory, so the tiering watermarks follow the split.
+ *
+ * Every second the hit ratio of the rowgroup lookups in Redis is compared
+ * with the hit ratio of the block cache on the reads of tiered rowgroups.
+ * The tier with the clearly lower ratio gets GOVERNOR_STEP of the budget
+ * from the other one, within the GOVERNOR_MIN/MAX_CACHE bounds for the
+ * block cache. Redis never gets less than GOVERNOR_MIN_REDIS. */
+#define GOVERNOR_MIN_CACHE 5     /* % of memory_budget */
+#define GOVERNOR_MAX_CACHE 60
+#define GOVERNOR_INIT_CACHE 20
+#define GOVERNOR_STEP 2
+#define GOVERNOR_MIN_REDIS 20
+#define GOVERNOR_MEMTABLES 10
+#define GOVERNOR_HYSTERESIS 0.05
+
+static struct {
+    int cache_share;                    /* % of the budget for block cache */
+    long long memory_hits, tiered_reads;    /* Counters at the last cycle */
+    unsigned long long cache_hits, cache_misses;
+    int statistics;                     /* RocksDB statistics are collected */
+    unsigned long long user_maxmemory;  /* Limits set by the user, restored */
+    size_t user_cache;                  /* when the budget is turned off */
+} governorCtl = {GOVERNOR_INIT_CACHE, 0, 0, 0, 0, 0, 0, 0};
+
+/* Called before the stores are created, the memtable budget and the
+ * statistics can't be changed once RocksDB is open. */
+void memoryGovernorInit(void) {
+    size_t budget = server.memory_budget;
+
+    governorCtl.statistics = budget || server.rocksdb_statistics;
+    governorCtl.user_maxmemory = server.maxmemory;
+    governorCtl.user_cache = getPersistentStoreBlockCacheCapacity();
+    configurePersistentStoreMemory(budget / 100 * GOVERNOR_MEMTABLES / server.dbnum,
+                                   governorCtl.statistics);
+    if (budget)
+        setPersistentStoreBlockCacheCapacity(budget / 100 * governorCtl.cache_share);
+}
+
+/* CONFIG SET memory_budget. The governor needs the block cache statistics,
+ * which can only be enabled at startup. The limits set by the user are
+ * saved when the budget is turned on and restored when it is turned off.
+ * Returns C_ERR with 'err' set if the budget can't be enabled. */
+int memoryGovernorSetBudget(unsigned long long budget, const char **err) {
+    if (budget && !governorCtl.statistics) {
+        *err = "memory_budget needs rocksdb_statistics enabled at startup";
+        return C_ERR;
+    }
+    if (budget && !server.memory_budget) {
+        governorCtl.user_maxmemory = server.maxmemory;
+        governorCtl.user_cache = getPersistentStoreBlockCacheCapacity();
+    } else if (!budget && server.memory_budget) {
+        server.maxmemory = governorCtl.user_maxmemory;
+        setPersistentStoreBlockCacheCapacity(governorCtl.user_cache);
+        serverLog(LL_VERBOSE, "[GOVERNOR] off, maxmemory %llu block cache %zu",
+                  server.maxmemory, governorCtl.user_cache);
+    }
+    server.memory_budget = budget;
+    memoryGovernorCron();
+    return C_OK;
+}
+
+/* The maxmemory set by the user, which CONFIG REWRITE persists instead of
+ * the value the governor is currently using. */
+unsigned long long memoryGovernorUserMaxmemory(void) {
+    return server.memory_budget ? governorCtl.user_maxmemory : server.maxmemory;
+}
+
+void getMemoryGovernorUsage(persistent_store_memory_t *usage) {
+    int j;
+
+    memset(usage, 0, sizeof(*usage));
+    for (j = 0; j < server.dbnum; j++)
+        getPersistentStoreMemoryUsage(server.db[j].persistent_store, usage);
+}
+
+static double _ratio(long long hits, long long misses, double none) {
+    return (hits + misses) ? (double) hits / (hits + misses) : none;
+}
+
+double memoryGovernorRedisHitRatio(void) {
+    return _ratio(server.stat_rowgroup_memory_hits,
+                  server.stat_rowgroup_tiered_reads, 0);
+}
+
+void memoryGovernorCron(void) {
+    persistent_store_memory_t usage;
+    long long hits, reads, cache_hits, cache_misses;
+    double redis_ratio, cache_ratio;
+    size_t budget = server.memory_budget, cache, memtables, rocksdb;
+    size_t redis, floor;
+
+    if (!budget) return;
+    getMemoryGovernorUsage(&usage);
+
+    hits = server.stat_rowgroup_memory_hits - governorCtl.memory_hits;
+    reads = server.stat_rowgroup_tiered_reads - governorCtl.tiered_reads;
+    cache_hits = usage.block_cache_hits - governorCtl.cache_hits;
+    cache_misses = usage.block_cache_misses - governorCtl.cache_misses;
+    governorCtl.memory_hits = server.stat_rowgroup_memory_hits;
+    governorCtl.tiered_reads = server.stat_rowgroup_tiered_reads;
+    governorCtl.cache_hits = usage.block_cache_hits;
+    governorCtl.cache_misses = usage.block_cache_misses;
+
+    /* Without block cache misses the reads of RocksDB are already served
+     * from memory, growing the cache would not save any I/O. */
+    if (reads > 0 && cache_misses > 0) {
+        redis_ratio = _ratio(hits, reads, 1);
+        cache_ratio = _ratio(cache_hits, cache_misses, 1);
+        if (cache_ratio < redis_ratio - GOVERNOR_HYSTERESIS)
+            governorCtl.cache_share += GOVERNOR_STEP;
+        else if (redis_ratio < cache_ratio - GOVERNOR_HYSTERESIS)
+            governorCtl.cache_share -= GOVERNOR_STEP;
+    }
+    if (governorCtl.cache_share < GOVERNOR_MIN_CACHE)
+        governorCtl.cache_share = GOVERNOR_MIN_CACHE;
+    if (governorCtl.cache_share > GOVERNOR_MAX_CACHE)
+        governorCtl.cache_share = GOVERNOR_MAX_CACHE;
+
+    cache = budget / 100 * governorCtl.cache_share;
+    memtables = budget / 100 * GOVERNOR_MEMTABLES;
+    if (usage.memtables > memtables) memtables = usage.memtables;
+    rocksdb = cache + memtables + usage.table_readers;
+    floor = budget / 100 * GOVERNOR_MIN_REDIS;
+    redis = (budget > rocksdb + floor) ? budget - rocksdb : floor;
+
+    if (cache != getPersistentStoreBlockCacheCapacity())
+        setPersistentStoreBlockCacheCapacity(cache);
+    if (redis != server.maxmemory) {
+        serverLog(LL_VERBOSE, "[GOVERNOR] maxmemory %zu block cache %zu",
+                  redis, cache);
+        server.maxmemory = redis;
+    }
+}
+
+/* This function is called by processCommand() for FPWRITE. The tiering
+ * controller in serverCron() normally keeps memory under the watermarks,
+ * so here we only act when memory is over maxmemory because ingestion was
+ * faster than the controller. We clear what was already committed and
+ * submit one more batch, but we never wait for the tiering pool. */
 int freeMemoryIfNeeded(void) {
-    size_t mem_reported, mem_used, mem_tofree, mem_freed;
-    mstime_t latency, eviction_latency;
-    long long delta;
-    int slaves = listLength(server.slaves);
-    int isClear = 0;
-    int isPersisted = 0;
-    int isFlushed = 0;
-    int isEnd = 0;
-    int victim_free = 0;
+    size_t mem_reported, mem_used;
+    mstime_t latency;
+    int j;
 
     /* When clients are paused the dataset should be static not just from the
      * POV of clients not being able to write, but also from the POV of
@@ -651,116 +1381,30 @@ int freeMemoryIfNeeded(void) {
     /* Check if we are over the memory usage limit. If we are not, no need
      * to subtract the slaves output buffers. We can just return ASAP. */
     mem_reported = zmalloc_used_memory();
-    if (mem_reported <= server.maxmemory * 8/10) return C_OK;
+    if (mem_reported <= server.maxmemory) return C_OK;
 
-    /* Remove the size of slaves output buffers and AOF buffer from the
-     * count of used memory. */
-    mem_used = mem_reported;
-    size_t overhead = freeMemoryGetNotCountedMemory();
-    mem_used = (mem_used > overhead) ? mem_used-overhead : 0;
-
-    /* Check if we are still over the memory limit. */
-    if (mem_used <= server.maxmemory * 8/10) return C_OK;
-
-    /* Compute how much memory we need to free. */
-    mem_tofree = mem_used - server.maxmemory;
-    mem_freed = 0;
+    /* Check if we are still over the memory limit once the slaves output
+     * buffers and AOF buffer are removed from the count. */
+    mem_used = _tieringMemoryUsed();
+    if (mem_used <= server.maxmemory) return C_OK;
 
     if (server.maxmemory_policy == MAXMEMORY_NO_EVICTION)
-        goto cant_free; /* We need to free memory, but policy forbids. */
-
-	redisDb *db = server.db;
-
-    if (db->FreeQueue->size < DEFAULT_FREE_QUEUE_SIZE-1) {
-        Vector *evict_keys = vectorCreate(STL_TYPE_SDS, INIT_VECTOR_SIZE);
-        Vector *evict_relations = vectorCreate(STL_TYPE_ROBJ, INIT_VECTOR_SIZE);
-        _batchTiering(db, evict_keys, evict_relations);
-    }
-    
-    //		if (db->EvictQueue->size == 0 && db->FreeQueue->size > 1000000) {
-    //			dictEntry * de;
-    //			serverLog(LL_VERBOSE, "if constraint");
-    //			while ((de = dequeue(db->FreeQueue)) != NULL) {
-    //				robj * debug = dictGetVal(de);
-    //				serverLog(LL_VERBOSE,"FreeQueue member location = %d", debug->location);
-    //			}
-    //			serverAssert(0);
-    //		}
-
-    if(mem_used > server.maxmemory) {
-        serverLog(LL_VERBOSE, "[INFO] : MetaDict size : %d" ,
-                zmalloc_size(db->Metadict) + (dictSize(db->Metadict) * sizeof(dictEntry)));
-        serverLog(LL_VERBOSE, "[QUEUE] : EvictQueue : %d , FreeQueue : %d",
-                db->EvictQueue->size, db->FreeQueue->size);
-    }
-
-    int index = 0;
-    while (mem_used > server.maxmemory) {
-		serverLog(LL_DEBUG,
-				"[FREE_MEMORY CALLED]- [%d] : maxmemory * 0.9 :%ld, maxmemory : %ld, used memory : %d, mem_tofree : %d, mem_freed : %d",
-				index++, server.maxmemory * 9 / 10, server.maxmemory, mem_used,
-				mem_tofree, mem_freed);
-
-		sds victimKey = NULL;
-		robj *victVal = NULL;
-		dictEntry *victim = NULL;
-
-		if (!isEmpty(db->FreeQueue)) {
-			victim = chooseClearKeyFromQueue_(db->FreeQueue);
-			/* Finally remove the selected key. */
-			if (victim != NULL) {
-				victimKey = dictGetKey(victim);
-				victVal = dictGetVal(victim);
-				serverAssert(victVal->location == LOCATION_PERSISTED);
-				robj *victimKeyobj = createStringObject(victimKey,
-						sdslen(victimKey));
-				//serverLog(LL_VERBOSE, "freed = %s" , victimKey);
-				isFlushed = dbClear_(db, victimKeyobj);
-				if (isFlushed) {
-					serverLog(LL_VERBOSE,"CLEAR FAIL : FreeQueue->size : %d", db->FreeQueue->size);
-					serverAssert(0);
-				}
-				decrRefCount(victimKeyobj);
-				serverLog(LL_DEBUG, "CLEAR VICTIM SUCCESS [rear: %d]",
-						db->FreeQueue->rear);
-				victim_free++;
-			} else {
-				serverLog(LL_DEBUG, "MayBe flush error victim is NULL");
-			}
-		} else {
-			serverLog(LL_DEBUG, "[FREE QUEUE is Empty] : size = %d, rear = %d, front = %d, max =%d ",
-					db->FreeQueue->size, db->FreeQueue->rear, db->FreeQueue->front, db->FreeQueue->max);
-			serverLog(LL_DEBUG, "[EVICT QUEUE] : size = %d, rear = %d, front = %d, max =%d ",
-					db->EvictQueue->size, db->EvictQueue->rear, db->EvictQueue->front, db->EvictQueue->max);
-			serverLog(LL_VERBOSE, "[Memory status] : maxmemory= %ld, used memory = %d", server.maxmemory, mem_used);
-			/* TODO(wgchoi): Need to check why freequeue is empty.
-			 *      Maybe, Insert speed is much faster than tiering speed.
-             *      We handle this issue by some workaround that force-evicts
-             *      more relations to RocksDB. */
-            Vector *force_evict_keys = vectorCreate(STL_TYPE_SDS,
-                                                    INIT_VECTOR_SIZE);
-            Vector *force_evict_relations = vectorCreate(STL_TYPE_ROBJ,
-                                                         INIT_VECTOR_SIZE);
-			_batchTiering(db, force_evict_keys, force_evict_relations);
-		}
-
-		mem_used = zmalloc_used_memory();
-		if (server.aof_state != AOF_OFF) {
-			mem_used -= sdslen(server.aof_buf);
-			mem_used -= aofRewriteBufferSize();
-		}
-	}
+        return C_ERR; /* We need to free memory, but policy forbids. */
 
-    return C_OK;
+    latencyStartMonitor(latency);
+    server.stat_tiering_sync_cycles++;
+    for (j = 0; j < server.dbnum && mem_used > server.maxmemory; j++)
+        mem_used = _tieringClearPersisted(server.db+j, mem_used,
+                                          server.maxmemory);
 
-cant_free:
-    /* We are here if we are not able to reclaim memory. There is only one
-     * last thing we can try: check if the lazyfree thread has jobs in queue
-     * and wait... */
-    while(bioPendingJobsOfType(BIO_LAZY_FREE)) {
-        if (((mem_reported - zmalloc_used_memory()) + mem_freed) >= mem_tofree)
-            break;
-        usleep(1000);
+    if (mem_used > server.maxmemory && tieringPendingJobs() == 0) {
+        serverLog(LL_VERBOSE, "[Memory status] : maxmemory= %llu, used memory = %zu",
+                  server.maxmemory, mem_used);
+        for (j = 0; j < server.dbnum; j++) {
+            if (_batchTiering(server.db+j, server.batch_tiering_size)) break;
+        }
     }
-    return C_ERR;
+    latencyEndMonitor(latency);
+    latencyAddSampleIfNeeded("eviction-cycle",latency);
+    return C_OK;
 }
@@ -16,6 +16,7 @@
 #define RELMODEL_BRACE_PREFIX "{"
 #define RELMODEL_BRACE_SUFFIX "}"
 #define RELMODEL_ROWGROUPID_PREFIX "G:"
+#define RELMODEL_SHARD_PREFIX "#"
 #define RELMODEL_COLUMN_DELIMITER ","
 #define REL_MODEL_FIELD_PREFIX "F:"
 #define RELMODEL_VECTOR_PREFIX "V:"
@@ -1,5 +1,6 @@
 #include "server.h"
 #include "bio.h"
+#include "tiering.h"
 #include "atomicvar.h"
 #include "cluster.h"
 #include "stl.h"
@@ -46,6 +47,11 @@ size_t lazyfreeGetFreeEffort(robj *obj) {
     } else if (obj->type == OBJ_HASH && obj->encoding == OBJ_ENCODING_HT) {
         dict *ht = obj->ptr;
         return dictSize(ht);
+    } else if (obj->type == OBJ_HASH && obj->encoding == OBJ_ENCODING_REL) {
+        /* ADDB: every field is a column vector of up to columnvector_size
+         * values. */
+        dict *ht = obj->ptr;
+        return dictSize(ht) * server.columnvector_size;
     } else {
         return 1; /* Everything else is a single allocation. */
     }
@@ -97,14 +103,14 @@ int dbPersistOrClear(redisDb *db, robj *key) {
     if (de) {
         robj *val = dictGetVal(de);
         //TODO - MODIFY LATER
-        if(val->location == LOCATION_PERSISTED) {
+        if(objGetLocation(val) == LOCATION_PERSISTED) {
             /* Deleting an entry from the expires dict will not free the sds of
              * the key, because it is shared with the main dictionary. */
             if (dictSize(db->expires) > 0) dictDelete(db->expires,key->ptr);
             serverLog(LL_DEBUG, "DELETE PERSISTED ENTRY KEY : %s", (char *)key->ptr);
             dictEntry *entry = dictUnlink(db->dict,key->ptr);
             bioCreateBackgroundJob(BIO_TIERED_FREE,entry,NULL,NULL);
-        } else if(val->location == LOCATION_REDIS_ONLY){
+        } else if(objGetLocation(val) == LOCATION_REDIS_ONLY){
             /*
              * TODO ADDB
              * In this case, value is just a string.
@@ -135,7 +141,7 @@ int dbPersist_(redisDb *db, robj *key) {
 	dictEntry *de = dictFind(db->dict, key->ptr);
 	if (de) {
 		robj *val = dictGetVal(de);
-		if (val->location != LOCATION_FLUSH) serverAssert(0);
+		if (objGetLocation(val) != LOCATION_FLUSH) serverAssert(0);
 		if (val->encoding == OBJ_ENCODING_REL) {
 			serverLog(LL_DEBUG, "TIERING PERSISTED ENTRY KEY : %s",
 					(char *) key->ptr);
@@ -162,9 +168,10 @@ int dbClear_(redisDb *db, robj *key) {
 }
 
 /* ADDB
- * Batch Tiering */
+ * Batch Tiering
+ * The batch is handed to the tiering worker pool, see tiering.c */
 void dbPersistBatch_(redisDb *db, Vector *evict_keys, Vector *evict_relations) {
-    bioCreateBackgroundJob(BIO_BATCH_TIERING, db, evict_keys, evict_relations);
+    tieringSubmitBatch(db, evict_keys, evict_relations);
 }
 
 /* Empty a Redis DB asynchronously. What the function does actually is to
@@ -35,6 +35,19 @@
 
 static void setProtocolError(const char *errstr, client *c, int pos);
 
+/* Operation run by the I/O threads, see the threaded I/O section at the
+ * end of this file. While it is not IO_THREADS_OP_IDLE the clients handed
+ * to the threads are served concurrently: they are neither freed nor
+ * queued for writes, and their commands are only parsed. */
+#define IO_THREADS_OP_IDLE 0
+#define IO_THREADS_OP_READ 1
+#define IO_THREADS_OP_WRITE 2
+static int io_threads_op = IO_THREADS_OP_IDLE;
+
+/* Set by processEventsWhileBlocked(), the reads can't be postponed while
+ * beforeSleep() is not called. */
+static int processing_events_while_blocked = 0;
+
 /* Return the size consumed from the allocator, for the specified SDS string,
  * including internal fragmentation. This function is used in order to compute
  * the client output buffer size. */
@@ -140,6 +153,27 @@ client *createClient(int fd) {
     return c;
 }
 
+/* Queue the client for the write of its output buffers in beforeSleep(). */
+static void clientInstallWriteHandler(client *c) {
+    /* Schedule the client to write the output buffers to the socket only
+     * if not already done (there were no pending writes already and the client
+     * was yet not flagged), and, for slaves, if the slave can actually
+     * receive writes at this stage. */
+    if (!(c->flags & CLIENT_PENDING_WRITE) &&
+        (c->replstate == REPL_STATE_NONE ||
+         (c->replstate == SLAVE_STATE_ONLINE && !c->repl_put_online_on_ack)))
+    {
+        /* Here instead of installing the write handler, we just flag the
+         * client and put it into a list of clients that have something
+         * to write to the socket. This way before re-entering the event
+         * loop, we can try to directly write to the client sockets avoiding
+         * a system call. We'll only really install the write handler if
+         * we'll not be able to write the whole reply at once. */
+        c->flags |= CLIENT_PENDING_WRITE;
+        listAddNodeHead(server.clients_pending_write,c);
+    }
+}
+
 /* This function is called every time we are going to transmit new data
  * to the client. The behavior is the following:
  *
@@ -178,23 +212,10 @@ int prepareClientToWrite(client *c) {
     if (c->fd <= 0) return C_ERR; /* Fake client for AOF loading. */
 
     /* Schedule the client to write the output buffers to the socket only
-     * if not already done (there were no pending writes already and the client
-     * was yet not flagged), and, for slaves, if the slave can actually
-     * receive writes at this stage. */
-    if (!clientHasPendingReplies(c) &&
-        !(c->flags & CLIENT_PENDING_WRITE) &&
-        (c->replstate == REPL_STATE_NONE ||
-         (c->replstate == SLAVE_STATE_ONLINE && !c->repl_put_online_on_ack)))
-    {
-        /* Here instead of installing the write handler, we just flag the
-         * client and put it into a list of clients that have something
-         * to write to the socket. This way before re-entering the event
-         * loop, we can try to directly write to the client sockets avoiding
-         * a system call. We'll only really install the write handler if
-         * we'll not be able to write the whole reply at once. */
-        c->flags |= CLIENT_PENDING_WRITE;
-        listAddNodeHead(server.clients_pending_write,c);
-    }
+     * if not already done. A client served by the I/O threads is queued by
+     * the main thread once they are done. */
+    if (!clientHasPendingReplies(c) && io_threads_op == IO_THREADS_OP_IDLE)
+        clientInstallWriteHandler(c);
 
     /* Authorize the caller to queue in the output buffer of this client. */
     return C_OK;
@@ -762,6 +783,14 @@ void unlinkClient(client *c) {
         c->flags &= ~CLIENT_PENDING_WRITE;
     }
 
+    /* Remove from the list of clients to read by the I/O threads. */
+    if (c->flags & CLIENT_PENDING_READ) {
+        ln = listSearchKey(server.clients_pending_read,c);
+        serverAssert(ln != NULL);
+        listDelNode(server.clients_pending_read,ln);
+        c->flags &= ~(CLIENT_PENDING_READ|CLIENT_PENDING_COMMAND);
+    }
+
     /* When client was just unblocked because of a blocking operation,
      * remove it from the list of unblocked clients. */
     if (c->flags & CLIENT_UNBLOCKED) {
@@ -871,9 +900,19 @@ void freeClient(client *c) {
  * a context where calling freeClient() is not possible, because the client
  * should be valid for the continuation of the flow of the program. */
 void freeClientAsync(client *c) {
+    /* The I/O threads may schedule their clients for closing at the same
+     * time, see writeToClient() and readQueryFromClient(). */
+    static pthread_mutex_t async_free_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+
     if (c->flags & CLIENT_CLOSE_ASAP || c->flags & CLIENT_LUA) return;
     c->flags |= CLIENT_CLOSE_ASAP;
+    if (server.io_threads_num == 1) {
+        listAddNodeTail(server.clients_to_close,c);
+        return;
+    }
+    pthread_mutex_lock(&async_free_queue_mutex);
     listAddNodeTail(server.clients_to_close,c);
+    pthread_mutex_unlock(&async_free_queue_mutex);
 }
 
 void freeClientsInAsyncFreeQueue(void) {
@@ -889,6 +928,15 @@ void freeClientsInAsyncFreeQueue(void) {
 
 /* Write data in output buffers to client. Return C_OK if the client
  * is still valid after the call, C_ERR if it was freed. */
+/* Free the client, or only schedule it for closing if it is served by the
+ * I/O threads right now. */
+static void freeClientFromIO(client *c) {
+    if (io_threads_op == IO_THREADS_OP_IDLE)
+        freeClient(c);
+    else
+        freeClientAsync(c);
+}
+
 int writeToClient(int fd, client *c, int handler_installed) {
     ssize_t nwritten = 0, totwritten = 0;
     size_t objlen;
@@ -944,14 +992,15 @@ int writeToClient(int fd, client *c, int handler_installed) {
             (server.maxmemory == 0 ||
              zmalloc_used_memory() < server.maxmemory)) break;
     }
-    server.stat_net_output_bytes += totwritten;
+    __atomic_add_fetch(&server.stat_net_output_bytes,totwritten,
+                       __ATOMIC_RELAXED);
     if (nwritten == -1) {
         if (errno == EAGAIN) {
             nwritten = 0;
         } else {
             serverLog(LL_VERBOSE,
                 "Error writing to client: %s", strerror(errno));
-            freeClient(c);
+            freeClientFromIO(c);
             return C_ERR;
         }
     }
@@ -968,7 +1017,7 @@ int writeToClient(int fd, client *c, int handler_installed) {
 
         /* Close connection after entire reply has been sent. */
         if (c->flags & CLIENT_CLOSE_AFTER_REPLY) {
-            freeClient(c);
+            freeClientFromIO(c);
             return C_ERR;
         }
     }
@@ -1288,15 +1337,51 @@ int processMultibulkBuffer(client *c) {
  * more query buffer to process, because we read more data from the socket
  * or because a client was blocked and later reactivated, so there could be
  * pending query buffer, already representing a full command, to process. */
+/* Run the command parsed in the client argv. The client is reset for the
+ * next command unless it is blocked. Returns C_ERR if the client was freed
+ * meanwhile, it must be the server.current_client when called. */
+static int processCommandAndResetClient(client *c) {
+    /* Only reset the client when the command was executed. */
+    if (processCommand(c) == C_OK) {
+        if (c->flags & CLIENT_MASTER && !(c->flags & CLIENT_MULTI)) {
+            /* Update the applied replication offset of our master. */
+            c->reploff = c->read_reploff - sdslen(c->querybuf);
+        }
+
+        /* Don't reset the client structure for clients blocked in a
+         * module blocking command, so that the reply callback will
+         * still be able to access the client argv and argc field.
+         * The client will be reset in unblockClientFromModule().
+         * The same applies to FPWRITE delayed by tiering, that is
+         * executed again once the client is resumed. */
+        if (!(c->flags & CLIENT_BLOCKED) ||
+            (c->btype != BLOCKED_MODULE && c->btype != BLOCKED_TIERING))
+            resetClient(c);
+    }
+    /* freeMemoryIfNeeded may flush slave output buffers. This may
+     * result into a slave, that may be the active client, to be
+     * freed. */
+    return server.current_client == NULL ? C_ERR : C_OK;
+}
+
 void processInputBuffer(client *c) {
-    server.current_client = c;
+    /* The I/O threads only parse the query buffer, the command is run by
+     * the main thread in handleClientsWithPendingReadsUsingThreads(). */
+    int parse_only = io_threads_op == IO_THREADS_OP_READ;
+
+    if (!parse_only) server.current_client = c;
     /* Keep processing while there is something in the input buffer */
     while(sdslen(c->querybuf)) {
-        /* Return if clients are paused. */
-        if (!(c->flags & CLIENT_SLAVE) && clientsArePaused()) break;
+        /* Return if clients are paused. The I/O threads can't unpause the
+         * clients, the main thread checks again before running a command. */
+        if (!(c->flags & CLIENT_SLAVE) &&
+            (parse_only ? server.clients_paused : clientsArePaused())) break;
 
-        /* Immediately abort if the client is in the middle of something. */
-        if (c->flags & CLIENT_BLOCKED) break;
+        /* Immediately abort if the client is in the middle of something.
+         * ADDB: a parsed command still in argv, as a FPWRITE resumed after
+         * tiering backpressure, is run first by processUnblockedClients(). */
+        if (c->flags & (CLIENT_BLOCKED|CLIENT_UNBLOCKED) ||
+            (c->argc && !c->multibulklen)) break;
 
         /* CLIENT_CLOSE_AFTER_REPLY closes the connection once the reply is
          * written to the client. Make sure to not let the reply grow after
@@ -1325,28 +1410,30 @@ void processInputBuffer(client *c) {
         /* Multibulk processing could see a <= 0 length. */
         if (c->argc == 0) {
             resetClient(c);
+        } else if (parse_only) {
+            c->flags |= CLIENT_PENDING_COMMAND;
+            break;
         } else {
-            /* Only reset the client when the command was executed. */
-            if (processCommand(c) == C_OK) {
-                if (c->flags & CLIENT_MASTER && !(c->flags & CLIENT_MULTI)) {
-                    /* Update the applied replication offset of our master. */
-                    c->reploff = c->read_reploff - sdslen(c->querybuf);
-                }
-
-                /* Don't reset the client structure for clients blocked in a
-                 * module blocking command, so that the reply callback will
-                 * still be able to access the client argv and argc field.
-                 * The client will be reset in unblockClientFromModule(). */
-                if (!(c->flags & CLIENT_BLOCKED) || c->btype != BLOCKED_MODULE)
-                    resetClient(c);
-            }
-            /* freeMemoryIfNeeded may flush slave output buffers. This may
-             * result into a slave, that may be the active client, to be
-             * freed. */
-            if (server.current_client == NULL) break;
+            if (processCommandAndResetClient(c) == C_ERR) break;
         }
     }
-    server.current_client = NULL;
+    if (!parse_only) server.current_client = NULL;
+}
+
+/* Queue the client for handleClientsWithPendingReadsUsingThreads() when the
+ * I/O threads are active. The masters and the slaves are always read by the
+ * main thread, as the replication offsets are updated while reading. */
+static int postponeClientRead(client *c) {
+    if (server.io_threads_active &&
+        server.io_threads_do_reads &&
+        !processing_events_while_blocked &&
+        !(c->flags & (CLIENT_MASTER|CLIENT_SLAVE|CLIENT_PENDING_READ)))
+    {
+        c->flags |= CLIENT_PENDING_READ;
+        listAddNodeHead(server.clients_pending_read,c);
+        return 1;
+    }
+    return 0;
 }
 
 void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
@@ -1356,6 +1443,9 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     UNUSED(el);
     UNUSED(mask);
 
+    /* Leave the read to the I/O threads if they are active. */
+    if (postponeClientRead(c)) return;
+
     readlen = PROTO_IOBUF_LEN;
     /* If this is a multi bulk request, and we are processing a bulk reply
      * that is large enough, try to maximize the probability that the query
@@ -1380,12 +1470,12 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
             return;
         } else {
             serverLog(LL_VERBOSE, "Reading from client: %s",strerror(errno));
-            freeClient(c);
+            freeClientFromIO(c);
             return;
         }
     } else if (nread == 0) {
         serverLog(LL_VERBOSE, "Client closed connection");
-        freeClient(c);
+        freeClientFromIO(c);
         return;
     } else if (c->flags & CLIENT_MASTER) {
         /* Append the query buffer to the pending (not applied) buffer
@@ -1398,7 +1488,7 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
     sdsIncrLen(c->querybuf,nread);
     c->lastinteraction = server.unixtime;
     if (c->flags & CLIENT_MASTER) c->read_reploff += nread;
-    server.stat_net_input_bytes += nread;
+    __atomic_add_fetch(&server.stat_net_input_bytes,nread,__ATOMIC_RELAXED);
     if (sdslen(c->querybuf) > server.client_max_querybuf_len) {
         sds ci = catClientInfoString(sdsempty(),c), bytes = sdsempty();
 
@@ -1406,7 +1496,7 @@ void readQueryFromClient(aeEventLoop *el, int fd, void *privdata, int mask) {
         serverLog(LL_WARNING,"Closing client that reached max query buffer length: %s (qbuf initial bytes: %s)", ci, bytes);
         sdsfree(ci);
         sdsfree(bytes);
-        freeClient(c);
+        freeClientFromIO(c);
         return;
     }
 
@@ -2011,6 +2101,7 @@ int clientsArePaused(void) {
 int processEventsWhileBlocked(void) {
     int iterations = 4; /* See the function top-comment. */
     int count = 0;
+    processing_events_while_blocked = 1;
     while (iterations--) {
         int events = 0;
         events += aeProcessEvents(server.el, AE_FILE_EVENTS|AE_DONT_WAIT);
@@ -2018,5 +2109,237 @@ int processEventsWhileBlocked(void) {
         if (!events) break;
         count += events;
     }
+    processing_events_while_blocked = 0;
     return count;
 }
+
+/* ==========================================================================
+ * Threaded I/O
+ *
+ * With io-threads greater than 1, the clients with pending writes are split
+ * among the I/O threads in beforeSleep(), that write the replies to the
+ * sockets in parallel. With io-threads-do-reads the readable clients are
+ * queued as well, the threads read and parse their query buffers and the
+ * main thread runs the commands in order: commands are never executed by
+ * the I/O threads. The main thread serves its own share of clients and
+ * waits for the threads, that spin for the next job and are parked on a
+ * mutex when there are too few clients to write.
+ * ======================================================================== */
+
+static pthread_t io_threads[CONFIG_MAX_IO_THREADS];
+static pthread_mutex_t io_threads_mutex[CONFIG_MAX_IO_THREADS];
+static unsigned long io_threads_pending[CONFIG_MAX_IO_THREADS];
+static list *io_threads_list[CONFIG_MAX_IO_THREADS];
+
+static unsigned long getIOPendingCount(int id) {
+    return __atomic_load_n(&io_threads_pending[id],__ATOMIC_SEQ_CST);
+}
+
+static void setIOPendingCount(int id, unsigned long count) {
+    __atomic_store_n(&io_threads_pending[id],count,__ATOMIC_SEQ_CST);
+}
+
+/* Serve the clients of 'list' with the current io_threads_op. */
+static void processIOThreadList(list *list) {
+    listIter li;
+    listNode *ln;
+
+    listRewind(list,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+        if (io_threads_op == IO_THREADS_OP_WRITE) {
+            writeToClient(c->fd,c,0);
+        } else if (io_threads_op == IO_THREADS_OP_READ) {
+            readQueryFromClient(NULL,c->fd,c,0);
+        } else {
+            serverPanic("io_threads_op value is unknown");
+        }
+    }
+    listEmpty(list);
+}
+
+static void *IOThreadMain(void *arg) {
+    int id = (unsigned long) arg;
+
+    while(1) {
+        int j;
+
+        /* Wait for a job, spinning a little before checking if the main
+         * thread parked us. */
+        for (j = 0; j < 1000000; j++) {
+            if (getIOPendingCount(id) != 0) break;
+        }
+        if (getIOPendingCount(id) == 0) {
+            pthread_mutex_lock(&io_threads_mutex[id]);
+            pthread_mutex_unlock(&io_threads_mutex[id]);
+            continue;
+        }
+
+        processIOThreadList(io_threads_list[id]);
+        setIOPendingCount(id,0);
+    }
+    return NULL;
+}
+
+/* Start the I/O threads at startup. They are parked until the first time
+ * there are enough clients to write, see startThreadedIO(). */
+void initThreadedIO(void) {
+    int j;
+
+    server.io_threads_active = 0;
+    if (server.io_threads_num == 1) return;
+
+    for (j = 0; j < server.io_threads_num; j++) {
+        io_threads_list[j] = listCreate();
+        if (j == 0) continue; /* Thread 0 is the main thread. */
+
+        pthread_mutex_init(&io_threads_mutex[j],NULL);
+        setIOPendingCount(j,0);
+        pthread_mutex_lock(&io_threads_mutex[j]);
+        if (pthread_create(&io_threads[j],NULL,IOThreadMain,
+                           (void*)(unsigned long) j) != 0)
+        {
+            serverLog(LL_WARNING,"Fatal: Can't initialize I/O threads.");
+            exit(1);
+        }
+    }
+    serverLog(LL_NOTICE,"I/O threads started with %d threads%s.",
+              server.io_threads_num,
+              server.io_threads_do_reads ? " (reads and writes)" : "");
+}
+
+static void startThreadedIO(void) {
+    int j;
+
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_unlock(&io_threads_mutex[j]);
+    server.io_threads_active = 1;
+}
+
+static void stopThreadedIO(void) {
+    int j;
+
+    /* Serve the clients queued for reads before parking the threads. */
+    handleClientsWithPendingReadsUsingThreads();
+    for (j = 1; j < server.io_threads_num; j++)
+        pthread_mutex_lock(&io_threads_mutex[j]);
+    server.io_threads_active = 0;
+}
+
+/* Park the I/O threads if there are too few clients to write for them to
+ * pay off, spinning threads would waste the CPU. Returns 1 if the writes
+ * are done by the main thread alone. */
+static int stopThreadedIOIfNeeded(void) {
+    unsigned long pending = listLength(server.clients_pending_write);
+
+    if (server.io_threads_num == 1) return 1;
+    if (pending < (unsigned long) server.io_threads_num*2) {
+        if (server.io_threads_active) stopThreadedIO();
+        return 1;
+    }
+    return 0;
+}
+
+/* Hand the clients in 'clients' to the I/O threads for io_threads_op, serve
+ * the share of the main thread and wait for the others. */
+static void runIOThreads(list *clients, int op) {
+    listIter li;
+    listNode *ln;
+    int j, item_id = 0;
+
+    listRewind(clients,&li);
+    while((ln = listNext(&li))) {
+        client *c = listNodeValue(ln);
+
+        /* Skip the clients that are going to be closed. */
+        if (c->flags & CLIENT_CLOSE_ASAP) continue;
+        listAddNodeTail(io_threads_list[item_id % server.io_threads_num],c);
+        item_id++;
+    }
+
+    io_threads_op = op;
+    for (j = 1; j < server.io_threads_num; j++)
+        setIOPendingCount(j,listLength(io_threads_list[j]));
+    processIOThreadList(io_threads_list[0]);
+
+    while(1) {
+        unsigned long pending = 0;
+        for (j = 1; j < server.io_threads_num; j++)
+            pending += getIOPendingCount(j);
+        if (pending == 0) break;
+    }
+    io_threads_op = IO_THREADS_OP_IDLE;
+}
+
+/* Like handleClientsWithPendingWrites(), but the replies are written by the
+ * I/O threads when there are enough clients to write. */
+int handleClientsWithPendingWritesUsingThreads(void) {
+    int processed = listLength(server.clients_pending_write);
+
+    if (processed == 0) return 0;
+    if (stopThreadedIOIfNeeded()) return handleClientsWithPendingWrites();
+    if (!server.io_threads_active) startThreadedIO();
+
+    runIOThreads(server.clients_pending_write,IO_THREADS_OP_WRITE);
+
+    /* Install the write handler for the replies that were not sent at
+     * once. */
+    while(listLength(server.clients_pending_write)) {
+        listNode *ln = listFirst(server.clients_pending_write);
+        client *c = listNodeValue(ln);
+
+        c->flags &= ~CLIENT_PENDING_WRITE;
+        listDelNode(server.clients_pending_write,ln);
+        if (c->flags & CLIENT_CLOSE_ASAP) continue;
+        if (clientHasPendingReplies(c) &&
+            aeCreateFileEvent(server.el, c->fd, AE_WRITABLE,
+                sendReplyToClient, c) == AE_ERR)
+        {
+            freeClientAsync(c);
+        }
+    }
+    server.stat_io_writes_processed += processed;
+    return processed;
+}
+
+/* Read and parse the query buffers of the clients queued by
+ * postponeClientRead() with the I/O threads, then run the parsed commands
+ * in the order the clients were read. Called by beforeSleep(). */
+int handleClientsWithPendingReadsUsingThreads(void) {
+    int processed = listLength(server.clients_pending_read);
+
+    if (processed == 0) return 0;
+
+    runIOThreads(server.clients_pending_read,IO_THREADS_OP_READ);
+
+    /* A command run here may free any client of the list, so the list is
+     * consumed from its head. */
+    while(listLength(server.clients_pending_read)) {
+        listNode *ln = listFirst(server.clients_pending_read);
+        client *c = listNodeValue(ln);
+        int pending_command = c->flags & CLIENT_PENDING_COMMAND;
+
+        c->flags &= ~(CLIENT_PENDING_READ|CLIENT_PENDING_COMMAND);
+        listDelNode(server.clients_pending_read,ln);
+        if (c->flags & CLIENT_CLOSE_ASAP) continue;
+
+        if (pending_command) {
+            /* The clients may have been paused since the read, the command
+             * is then run by processUnblockedClients() once they are
+             * unpaused. */
+            if (!(c->flags & CLIENT_SLAVE) && clientsArePaused()) continue;
+            server.current_client = c;
+            if (processCommandAndResetClient(c) == C_ERR) continue;
+        }
+        /* Run the other commands already in the query buffer. */
+        processInputBuffer(c);
+
+        /* The protocol errors were added while the client was read by an
+         * I/O thread, without queueing the client for the write. */
+        if (!(c->flags & CLIENT_CLOSE_ASAP) && clientHasPendingReplies(c))
+            clientInstallWriteHandler(c);
+    }
+    server.current_client = NULL;
+    server.stat_io_reads_processed += processed;
+    return processed;
+}
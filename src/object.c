@@ -43,7 +43,7 @@
 robj *createObject(int type, void *ptr) {
     robj *o = zmalloc(sizeof(*o));
     o->type = type;
-    o->location = LOCATION_REDIS_ONLY;
+    objSetLocation(o, LOCATION_REDIS_ONLY);
     o->encoding = OBJ_ENCODING_RAW;
     o->ptr = ptr;
     o->refcount = 1;
@@ -89,7 +89,7 @@ robj *createEmbeddedStringObject(const char *ptr, size_t len) {
     struct sdshdr8 *sh = (void*)(o+1);
 
     o->type = OBJ_STRING;
-    o->location = LOCATION_REDIS_ONLY;
+    objSetLocation(o, LOCATION_REDIS_ONLY);
     o->encoding = OBJ_ENCODING_EMBSTR;
     o->ptr = sh+1;
     o->refcount = 1;
@@ -190,6 +190,8 @@ robj *createDataHashdictFordict(void){
 	  assert(dict != NULL);
 	  robj *o = createObject(OBJ_HASH, dict);
 	  o->encoding = OBJ_ENCODING_REL;
+	  /* Rowgroups always carry a LFU counter, see touchRowGroup() */
+	  o->lru = (LFUGetTimeInMinutes()<<8) | LFU_INIT_VAL;
 	  //o->encoding = OBJ_ENCODING_HT;
     return o;
 
@@ -4,21 +4,115 @@
  *  Created on: 2017. 9. 5.
  *      Author: Jaehyung Kim
  */
+#include "fmacros.h"
 #include "redisassert.h"
 #include "persistent_store.h"
 #include "zmalloc.h"
 #include "util.h"
+#include "crc64.h"
 
 #include <stdio.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <strings.h>
+
+/* Prefix extractor and bloom filters for the binary keys. The bloom
+ * filters hold the whole keys for point lookups and the prefixes, the
+ * table and partition ids, for the iterators of a partition. Keys shorter
+ * than the prefix, like the table options, are out of the domain of the
+ * prefix extractor and only use the whole key filter. */
+static void setDataKeyOptions(rocksdb_options_t *options,
+                              rocksdb_block_based_table_options_t *table_options,
+                              int bloomBits) {
+    rocksdb_options_set_prefix_extractor(options,
+        rocksdb_slicetransform_create_fixed_prefix(
+            PERSISTENT_STORE_KEY_PARTITION_LEN));
+    rocksdb_options_set_memtable_prefix_bloom_size_ratio(options, 0.1);
+    if (bloomBits) {
+        rocksdb_block_based_options_set_filter_policy(table_options,
+            rocksdb_filterpolicy_create_bloom(bloomBits));
+    }
+    rocksdb_block_based_options_set_whole_key_filtering(table_options, 1);
+}
+
+/* Memory of the stores, see configurePersistentStoreMemory(). The block
+ * cache is shared by every store and every column family, so that one
+ * capacity bounds the blocks cached by RocksDB. */
+static rocksdb_cache_t *blockCache = NULL;
+static size_t blockCacheCapacity = PERSISTENT_STORE_DEFAULT_BLOCK_CACHE;
+static int blockCacheRefs = 0;
+static size_t memtableBudget = 0;
+static int statisticsEnabled = 0;
+static int maxOpenFiles = PERSISTENT_STORE_DEFAULT_MAX_OPEN_FILES;
+
+/* Must be called before the stores are created. 'memtables' bounds the
+ * memtables of each store, 0 keeps the default of RocksDB. With
+ * 'statistics' the block cache hits and misses are counted. */
+void configurePersistentStoreMemory(size_t memtables, int statistics) {
+    memtableBudget = memtables;
+    statisticsEnabled = statistics;
+}
+
+/* Must be called before the stores are created. With -1 RocksDB opens
+ * every SST file, and loads its index and filter, when the store is
+ * opened, so the time to open a store grows with its data. Otherwise the
+ * files are opened on demand and at most 'maxOpen' stay open. */
+void configurePersistentStoreOpenFiles(int maxOpen) {
+    maxOpenFiles = maxOpen;
+}
+
+/* With a memtable budget a memtable is a quarter of the budget of the store,
+ * the prefix bloom of every memtable is sized after it. */
+static void setMemtableOptions(rocksdb_options_t *options) {
+    if (!memtableBudget) return;
+    rocksdb_options_set_db_write_buffer_size(options, memtableBudget);
+    rocksdb_options_set_write_buffer_size(options, memtableBudget / 4);
+}
+
+void setPersistentStoreBlockCacheCapacity(size_t capacity) {
+    blockCacheCapacity = capacity;
+    if (blockCache) rocksdb_cache_set_capacity(blockCache, capacity);
+}
+
+size_t getPersistentStoreBlockCacheCapacity(void) {
+    return blockCacheCapacity;
+}
+
+size_t getPersistentStoreBlockCacheUsage(void) {
+    return blockCache ? rocksdb_cache_get_usage(blockCache) : 0;
+}
+
+size_t getPersistentStoreBlockCachePinnedUsage(void) {
+    return blockCache ? rocksdb_cache_get_pinned_usage(blockCache) : 0;
+}
+
+/* Index and filter blocks go through the block cache too, so they are
+ * bounded by its capacity. The ones of L0 are pinned, as every read
+ * checks them. */
+static void setBlockCacheOptions(rocksdb_block_based_table_options_t *table_options) {
+    rocksdb_block_based_options_set_block_cache(table_options, blockCache);
+    rocksdb_block_based_options_set_cache_index_and_filter_blocks(table_options, 1);
+    rocksdb_block_based_options_set_pin_l0_filter_and_index_blocks_in_cache(table_options, 1);
+}
 
 void createPersistentStoreOptions(persistent_store_t *ps) {
     persistent_store_options_t* ps_options = (persistent_store_options_t*)zmalloc(sizeof(persistent_store_options_t));
     ps_options->options = rocksdb_options_create();
     ps_options->roptions = rocksdb_readoptions_create();
+    ps_options->total_order_roptions = rocksdb_readoptions_create();
     ps_options->woptions = rocksdb_writeoptions_create();
     ps_options->coptions = rocksdb_compactoptions_create();
-    ps_options->cache = rocksdb_cache_create_lru(100000);
-    rocksdb_options_set_info_log_level(ps_options, 2);
+    if (blockCacheRefs++ == 0)
+        blockCache = rocksdb_cache_create_lru(blockCacheCapacity);
+    ps_options->cache = blockCache;
+    rocksdb_options_set_info_log_level(ps_options->options, 2);
 
     rocksdb_options_set_create_if_missing(ps_options->options, 1);
     rocksdb_options_set_create_missing_column_families(ps_options->options, 1);
@@ -26,14 +120,18 @@ void createPersistentStoreOptions(persistent_store_t *ps) {
     rocksdb_options_optimize_level_style_compaction(ps_options->options, 64*4*1024*1024);
     //rocksdb_options_set_write_buffer_size(ps_options->options, 100000);
     rocksdb_options_set_paranoid_checks(ps_options->options, 1);
-    rocksdb_options_set_max_open_files(ps_options->options, -1);
+    rocksdb_options_set_max_open_files(ps_options->options, maxOpenFiles);
     rocksdb_options_increase_parallelism(ps_options->options, 4);	//2 for flush thread, max 2 for compaction threads
     rocksdb_options_set_max_background_compactions(ps_options->options, 2);
     rocksdb_options_set_max_background_flushes(ps_options->options,2);
     rocksdb_options_set_min_write_buffer_number_to_merge(ps_options->options, 1);
     //rocksdb_options_set_base_background_compactions(ps_options->options, 3);
+    setMemtableOptions(ps_options->options);
+    if (statisticsEnabled) rocksdb_options_enable_statistics(ps_options->options);
     ps_options->table_options = rocksdb_block_based_options_create();
-    rocksdb_block_based_options_set_block_cache(ps_options->table_options, ps_options->cache);
+    setBlockCacheOptions(ps_options->table_options);
+    setDataKeyOptions(ps_options->options, ps_options->table_options,
+                      PERSISTENT_STORE_DEFAULT_BLOOM_BITS);
     rocksdb_options_set_block_based_table_factory(ps_options->options, ps_options->table_options);
 
     rocksdb_options_set_compression(ps_options->options, rocksdb_no_compression);
@@ -46,6 +144,9 @@ void createPersistentStoreOptions(persistent_store_t *ps) {
 
     rocksdb_readoptions_set_verify_checksums(ps_options->roptions, 1);
     rocksdb_readoptions_set_fill_cache(ps_options->roptions, 1);
+    rocksdb_readoptions_set_verify_checksums(ps_options->total_order_roptions, 1);
+    rocksdb_readoptions_set_fill_cache(ps_options->total_order_roptions, 0);
+    rocksdb_readoptions_set_total_order_seek(ps_options->total_order_roptions, 1);
 
     rocksdb_writeoptions_set_sync(ps_options->woptions, 1);
 
@@ -53,60 +154,374 @@ void createPersistentStoreOptions(persistent_store_t *ps) {
     ps->ps_options = ps_options;
 }
 
+/* Column family options of a table: the options of the RW column family,
+ * overridden by the FPTABLEOPT 'spec' of the table ("name=value" pairs):
+ *
+ *   compression  none|snappy|zlib|bz2|lz4|lz4hc|zstd
+ *   block_size   block size in bytes
+ *   bloom_bits   bits per key of the bloom filter, 0 for no filter
+ *   compaction   level|universal|fifo
+ *   shards       hash tags the partitions are sharded over, see
+ *                fpTableOptCommand(), not a column family option
+ *
+ * Returns 0 on success, -1 with '*err' set to a static string if 'spec'
+ * is invalid. */
+static int createTableOptions(const char *spec,
+                              rocksdb_options_t **options,
+                              rocksdb_block_based_table_options_t **table_options,
+                              const char **err) {
+    rocksdb_options_t *o = rocksdb_options_create();
+    rocksdb_block_based_table_options_t *t = rocksdb_block_based_options_create();
+    int compression = rocksdb_no_compression, j, argc = 0;
+    int bloomBits = PERSISTENT_STORE_DEFAULT_BLOOM_BITS;
+    sds *argv = NULL;
+
+    rocksdb_options_optimize_level_style_compaction(o, 64*4*1024*1024);
+    rocksdb_options_set_min_write_buffer_number_to_merge(o, 1);
+    setMemtableOptions(o);
+    rocksdb_options_set_compression_options(o, -14, -1, 0, 0);
+    setBlockCacheOptions(t);
+
+    if (spec) argv = sdssplitargs(spec, &argc);
+    if (spec && argv == NULL) {
+        *err = "Invalid table options";
+        goto error;
+    }
+    for (j = 0; j < argc; j++) {
+        char *value = strchr(argv[j], '=');
+        long long ll;
+
+        if (value == NULL) {
+            *err = "Table options must be given as name=value";
+            goto error;
+        }
+        *value++ = '\0';
+        if (!strcasecmp(argv[j], "compression")) {
+            if (!strcasecmp(value, "none")) compression = rocksdb_no_compression;
+            else if (!strcasecmp(value, "snappy")) compression = rocksdb_snappy_compression;
+            else if (!strcasecmp(value, "zlib")) compression = rocksdb_zlib_compression;
+            else if (!strcasecmp(value, "bz2")) compression = rocksdb_bz2_compression;
+            else if (!strcasecmp(value, "lz4")) compression = rocksdb_lz4_compression;
+            else if (!strcasecmp(value, "lz4hc")) compression = rocksdb_lz4hc_compression;
+            else if (!strcasecmp(value, "zstd")) compression = rocksdb_zstd_compression;
+            else {
+                *err = "Unknown compression, use none, snappy, zlib, bz2, lz4, lz4hc or zstd";
+                goto error;
+            }
+        } else if (!strcasecmp(argv[j], "block_size")) {
+            if (!string2ll(value, strlen(value), &ll) || ll < 1024) {
+                *err = "block_size must be 1024 or greater";
+                goto error;
+            }
+            rocksdb_block_based_options_set_block_size(t, ll);
+        } else if (!strcasecmp(argv[j], "bloom_bits")) {
+            if (!string2ll(value, strlen(value), &ll) || ll < 0 || ll > 64) {
+                *err = "bloom_bits must be between 0 and 64";
+                goto error;
+            }
+            bloomBits = ll;
+        } else if (!strcasecmp(argv[j], "compaction")) {
+            if (!strcasecmp(value, "level"))
+                rocksdb_options_set_compaction_style(o, rocksdb_level_compaction);
+            else if (!strcasecmp(value, "universal"))
+                rocksdb_options_set_compaction_style(o, rocksdb_universal_compaction);
+            else if (!strcasecmp(value, "fifo"))
+                rocksdb_options_set_compaction_style(o, rocksdb_fifo_compaction);
+            else {
+                *err = "Unknown compaction, use level, universal or fifo";
+                goto error;
+            }
+        } else if (!strcasecmp(argv[j], "shards")) {
+            if (!string2ll(value, strlen(value), &ll) || ll < 1 ||
+                ll > PERSISTENT_STORE_MAX_TABLE_SHARDS) {
+                *err = "shards must be between 1 and 1024";
+                goto error;
+            }
+        } else {
+            *err = "Unknown table option, use compression, block_size, bloom_bits, compaction or shards";
+            goto error;
+        }
+    }
+    if (argv) sdsfreesplitres(argv, argc);
+
+    int compression_levels[] = {compression, compression,
+                                compression, compression};
+    rocksdb_options_set_compression(o, compression);
+    rocksdb_options_set_compression_per_level(o, compression_levels, 4);
+    setDataKeyOptions(o, t, bloomBits);
+    /* The factory copies the table options, so it is set last. */
+    rocksdb_options_set_block_based_table_factory(o, t);
+    *options = o;
+    *table_options = t;
+    return 0;
+
+error:
+    if (argv) sdsfreesplitres(argv, argc);
+    rocksdb_block_based_options_destroy(t);
+    rocksdb_options_destroy(o);
+    return -1;
+}
+
+static uint64_t tableIdHash(const void *key) {
+    return dictGenHashFunction(&key, sizeof(key));
+}
+
+static dictType persistentStoreTablesDictType = {
+    tableIdHash,                /* hash function */
+    NULL,                       /* key dup */
+    NULL,                       /* val dup */
+    NULL,                       /* key compare */
+    NULL,                       /* key destructor */
+    NULL                        /* val destructor */
+};
+
+#define TABLE_KEY(id) ((void *)(long)(id))
+
+static persistent_store_table_t *getTableEntry(persistent_store_t *ps,
+                                               int tableId, int create) {
+    dictEntry *de = dictFind(ps->tables, TABLE_KEY(tableId));
+    persistent_store_table_t *t;
+
+    if (de) return dictGetVal(de);
+    if (!create) return NULL;
+    t = zcalloc(sizeof(*t));
+    t->table_id = tableId;
+    dictAdd(ps->tables, TABLE_KEY(tableId), t);
+    return t;
+}
+
+static void freeTableEntry(persistent_store_table_t *t) {
+    if (t->cf) rocksdb_column_family_handle_destroy(t->cf);
+    if (t->table_options) rocksdb_block_based_options_destroy(t->table_options);
+    if (t->options) rocksdb_options_destroy(t->options);
+    sdsfree(t->spec);
+    zfree(t);
+}
+
+/* Return the shards option of 'spec', validated by createTableOptions(),
+ * or 0 if it has none. */
+static int tableSpecShards(const char *spec) {
+    int argc, j, shards = 0;
+    sds *argv = sdssplitargs(spec, &argc);
+
+    for (j = 0; argv && j < argc; j++) {
+        if (!strncasecmp(argv[j], "shards=", 7)) shards = atoi(argv[j] + 7);
+    }
+    if (argv) sdsfreesplitres(argv, argc);
+    return shards;
+}
+
+/* Load the FPTABLEOPT specs stored in the default column family. The DB
+ * can't be opened without the options of every column family, so the
+ * default column family is first opened alone in read only mode. */
+static void loadTableOptionSpecs(persistent_store_t *ps) {
+    const char *names[1] = {"default"};
+    const rocksdb_options_t *cfs_options[1] = {ps->ps_options->options};
+    rocksdb_column_family_handle_t *handle;
+    char *err = NULL;
+    size_t prefixlen = strlen(PERSISTENT_STORE_TABLE_OPTIONS_PREFIX);
+
+    rocksdb_t *db = rocksdb_open_for_read_only_column_families(
+        ps->ps_options->options, ps->dbname, 1, names, cfs_options, &handle,
+        0, &err);
+    if (err) {
+        panic("[PERSISTENT_STORE] loading table options failed due to %s", err);
+    }
+
+    rocksdb_iterator_t *iter = rocksdb_create_iterator_cf(db,
+        ps->ps_options->roptions, handle);
+    for (rocksdb_iter_seek(iter, PERSISTENT_STORE_TABLE_OPTIONS_PREFIX, prefixlen);
+         rocksdb_iter_valid(iter); rocksdb_iter_next(iter)) {
+        size_t keylen, vallen;
+        const char *key = rocksdb_iter_key(iter, &keylen);
+        const char *val = rocksdb_iter_value(iter, &vallen);
+        long long tableId;
+
+        if (keylen <= prefixlen ||
+            memcmp(key, PERSISTENT_STORE_TABLE_OPTIONS_PREFIX, prefixlen)) break;
+        if (!string2ll(key + prefixlen, keylen - prefixlen, &tableId)) continue;
+        persistent_store_table_t *t = getTableEntry(ps, tableId, 1);
+        t->spec = sdsnewlen(val, vallen);
+        t->shards = tableSpecShards(t->spec);
+    }
+    rocksdb_iter_destroy(iter);
+    rocksdb_column_family_handle_destroy(handle);
+    rocksdb_close(db);
+}
+
+/* Convert the text keys "D:{...}:G:<rowGroupId>:F:<field>" of a column
+ * family written by older versions to binary keys. Every batch moves its
+ * keys atomically, an interrupted conversion continues at the next start. */
+#define MIGRATE_BATCH_KEYS 1024
+static void migrateTextKeys(persistent_store_t *ps,
+                            rocksdb_column_family_handle_t *cf,
+                            const char *name) {
+    const char *begin = "D:{", *end = "D:|";   /* '|' follows '{' */
+    rocksdb_writebatch_t *wb = rocksdb_writebatch_create();
+    unsigned long long migrated = 0, skipped = 0;
+    size_t keylen, vallen;
+    char *err = NULL;
+
+    rocksdb_iterator_t *iter = rocksdb_create_iterator_cf(ps->ps,
+        ps->ps_options->total_order_roptions, cf);
+    for (rocksdb_iter_seek(iter, begin, strlen(begin));
+         rocksdb_iter_valid(iter); rocksdb_iter_next(iter)) {
+        const char *key = rocksdb_iter_key(iter, &keylen);
+        const char *val = rocksdb_iter_value(iter, &vallen);
+        if (memcmp(key, end, keylen < 3 ? keylen : 3) >= 0) break;
+
+        sds binKey = persistentStoreKeyFromText(key, keylen);
+        if (binKey == NULL) {
+            skipped++;
+            continue;
+        }
+        rocksdb_writebatch_put_cf(wb, cf, binKey, sdslen(binKey), val, vallen);
+        rocksdb_writebatch_delete_cf(wb, cf, key, keylen);
+        sdsfree(binKey);
+        if (++migrated % MIGRATE_BATCH_KEYS == 0) {
+            rocksdb_write(ps->ps, ps->ps_options->woptions, wb, &err);
+            if (err) break;
+            rocksdb_writebatch_clear(wb);
+        }
+    }
+    if (err == NULL) rocksdb_iter_get_error(iter, &err);
+    if (err == NULL) rocksdb_write(ps->ps, ps->ps_options->woptions, wb, &err);
+    rocksdb_iter_destroy(iter);
+    rocksdb_writebatch_destroy(wb);
+    if (err) {
+        panic("[PERSISTENT_STORE] converting the keys of %s failed due to %s",
+              name, err);
+    }
+
+    if (migrated) {
+        /* Drop the tombstones of the text keys right away. */
+        rocksdb_compact_range_cf(ps->ps, cf, begin, strlen(begin), end,
+                                 strlen(end));
+        serverLog(PERSISTENT_STORE_NOTICE,
+                  "[PERSISTENT_STORE] converted %llu text keys of %s to binary keys",
+                  migrated, name);
+    }
+    if (skipped) {
+        serverLog(PERSISTENT_STORE_WARNING,
+                  "[PERSISTENT_STORE] %llu keys of %s aren't column vector keys, left as is",
+                  skipped, name);
+    }
+}
+
 void createPersistentStoreDb(persistent_store_t *ps) {
     char *err = NULL;
-    size_t i=0;
-
-    /* First, DB creation by opening */
-//    ps->ps = rocksdb_open(ps->ps_options->options, ps->dbname, &err);
-//
-//    if(err != NULL)
-//    {
-//        panic("[PERSISTENT_STORE] Persistent DB open failed due to : %s", err);
-//    }
-//
-//    rocksdb_column_family_handle_t* cfh;
-//    cfh = rocksdb_create_column_family(ps->ps, ps->ps_options->options, "RW", &err);
-//    rocksdb_column_family_handle_destroy(cfh);
-//
-//    rocksdb_close(ps->ps);
-
-    /* Get list of CFs */
-    size_t cflen = 2;
-    char* cf_names[2] = {"default", "RW"};
-//    ps->cf_names = cf_names;
-//    ps->cf_names = rocksdb_list_column_families(ps->ps_options->options, (const char*)ps->dbname, &cflen, &err);
-//    if(err) {
-//        rocksdb_free(err);
-//        panic("[PERSISTENT_STORE] list column families failed due to %s", err);
-//    }
-    ps->cflen = cflen;
+    size_t i = 0, j, listed = 0, cflen, tablecflen;
+    char **listed_names;
+    size_t prefixlen = strlen(PERSISTENT_STORE_TABLE_CF_PREFIX);
+
+    ps->tables = dictCreate(&persistentStoreTablesDictType, NULL);
+    pthread_mutex_init(&ps->tables_mutex, NULL);
+
+    /* Get list of CFs. A missing DB only has the default, RW and META CFs,
+     * the ones missing in an existing DB are created. */
+    listed_names = rocksdb_list_column_families(ps->ps_options->options,
+        (const char*)ps->dbname, &listed, &err);
+    if (err) {
+        rocksdb_free(err);
+        err = NULL;
+        listed_names = NULL;
+        listed = 0;
+    }
+
+    /* "default", "RW" and "META" come first, as PERSISTENT_STORE_CF_DEFAULT,
+     * PERSISTENT_STORE_CF_RW and PERSISTENT_STORE_CF_META, then the column
+     * families of the tables, then the probes left by
+     * setPersistentStoreTableOptions(), which are dropped once the DB is
+     * open. */
+    cflen = PERSISTENT_STORE_CF_NUM;
+    const char **cf_names = zmalloc(sizeof(char *) * (listed + PERSISTENT_STORE_CF_NUM));
+    cf_names[PERSISTENT_STORE_CF_DEFAULT] = "default";
+    cf_names[PERSISTENT_STORE_CF_RW] = "RW";
+    cf_names[PERSISTENT_STORE_CF_META] = "META";
+    for (j = 0; j < listed; j++) {
+        if (!strncmp(listed_names[j], PERSISTENT_STORE_TABLE_CF_PREFIX, prefixlen))
+            cf_names[cflen++] = listed_names[j];
+    }
+    tablecflen = cflen;
+    for (j = 0; j < listed; j++) {
+        if (!strncmp(listed_names[j], PERSISTENT_STORE_TABLE_OPTIONS_PREFIX,
+                     strlen(PERSISTENT_STORE_TABLE_OPTIONS_PREFIX)))
+            cf_names[cflen++] = listed_names[j];
+    }
+    /* A table can have options before its column family is created. */
+    if (listed > 0) loadTableOptionSpecs(ps);
 
     /* Open CFs */
-    ps->ps_cf_handles = zmalloc(sizeof(rocksdb_column_family_handle_t *) * cflen);
+    rocksdb_column_family_handle_t **handles =
+        zmalloc(sizeof(rocksdb_column_family_handle_t *) * cflen);
     rocksdb_options_t **cfs_options = zmalloc(sizeof(rocksdb_options_t *) * cflen);
-    for(i = 0; i < cflen; i++) {
+    for (i = 0; i < cflen; i++) {
         cfs_options[i] = ps->ps_options->options;
+        if (i < PERSISTENT_STORE_CF_NUM || i >= tablecflen) continue;
+
+        const char *cferr = NULL;
+        int tableId = atoi(cf_names[i] + prefixlen);
+        persistent_store_table_t *t = getTableEntry(ps, tableId, 1);
+        if (createTableOptions(t->spec, &t->options, &t->table_options,
+                               &cferr) == -1) {
+            panic("[PERSISTENT_STORE] invalid options of table %d: %s",
+                  tableId, cferr);
+        }
+        cfs_options[i] = t->options;
     }
 
     /* Open RocksDB */
-    ps->ps = rocksdb_open_column_families((const rocksdb_options_t*)ps->ps_options->options, (const char*)ps->dbname, cflen, (const char**)cf_names, (const struct rocksdb_options_t **)cfs_options, ps->ps_cf_handles, &err);
+    ps->ps = rocksdb_open_column_families((const rocksdb_options_t*)ps->ps_options->options, (const char*)ps->dbname, cflen, cf_names, (const struct rocksdb_options_t **)cfs_options, handles, &err);
     if(err) {
         panic("[PERSISTENT_STORE] open column families failed due to %s", err);
     }
 
+    ps->cflen = PERSISTENT_STORE_CF_NUM;
+    ps->ps_cf_handles = zmalloc(sizeof(rocksdb_column_family_handle_t *) * PERSISTENT_STORE_CF_NUM);
+    for (i = 0; i < cflen; i++) {
+        if (i < PERSISTENT_STORE_CF_NUM) {
+            ps->ps_cf_handles[i] = handles[i];
+        } else if (i < tablecflen) {
+            getTableEntry(ps, atoi(cf_names[i] + prefixlen), 0)->cf = handles[i];
+        } else {
+            rocksdb_drop_column_family(ps->ps, handles[i], &err);
+            if (err) {
+                panic("[PERSISTENT_STORE] dropping column family %s failed due to %s",
+                      cf_names[i], err);
+            }
+            rocksdb_column_family_handle_destroy(handles[i]);
+        }
+    }
+
+    migrateTextKeys(ps, ps->ps_cf_handles[PERSISTENT_STORE_CF_RW], "RW");
+    for (i = PERSISTENT_STORE_CF_NUM; i < tablecflen; i++) {
+        persistent_store_table_t *t =
+            getTableEntry(ps, atoi(cf_names[i] + prefixlen), 0);
+        migrateTextKeys(ps, t->cf, cf_names[i]);
+    }
+
+    if (listed_names) rocksdb_list_column_families_destroy(listed_names, listed);
+    ps->cf_names = NULL;
+    zfree(cf_names);
+    zfree(handles);
     zfree(cfs_options);
 }
 
-persistent_store_t* createPersistentStore(int dbnum) {
-    persistent_store_t *ps = (persistent_store_t *)zmalloc(sizeof(persistent_store_t));
-
-    /* Assign the database name */
+/* Directory of the store of the db 'dbnum', relative to the working
+ * directory of the server. */
+static char *persistentStoreDirName(int dbnum) {
     /* TODO temporarily used name */
     char *ps_db_name = "default";
     char *ps_name = zmalloc(digits10(dbnum)+9);
     sprintf(ps_name, "%d:%s", dbnum, ps_db_name);
-    ps->dbname = ps_name;
+    return ps_name;
+}
+
+persistent_store_t* createPersistentStore(int dbnum) {
+    persistent_store_t *ps = (persistent_store_t *)zmalloc(sizeof(persistent_store_t));
+
+    /* Assign the database name */
+    ps->dbname = persistentStoreDirName(dbnum);
 
     createPersistentStoreOptions(ps);
     createPersistentStoreDb(ps);
@@ -116,7 +531,8 @@ persistent_store_t* createPersistentStore(int dbnum) {
 void setPersistentKey(persistent_store_t* ps, const void *key, const int keylen, const void *val, const int vallen) {
     char *err = NULL;
     serverLog(0, "Write to RocksDB[ KEY : %s, VAL : %s ]", (char *)key, (char *)val);
-    rocksdb_put_cf(ps->ps, ps->ps_options->woptions, ps->ps_cf_handles[PERSISTENT_STORE_CF_RW],
+    rocksdb_put_cf(ps->ps, ps->ps_options->woptions,
+    		getPersistentStoreKeyCF(ps, key, keylen, 1),
     		(const char*)key, keylen, (const char*)val, vallen, &err);
     if(err) {
         panic("[PERSISTENT_STORE] putting a key failed due to %s", err);
@@ -126,7 +542,821 @@ void setPersistentKey(persistent_store_t* ps, const void *key, const int keylen,
 void setPersistentKeyWithBatch(persistent_store_t* ps, const void *key, const int keylen, const void *val,
 		const int vallen, rocksdb_writebatch_t * writeBatch) {
     serverLog(0, "WriteBatch to RocksDB[ KEY : %s, VAL : %s ]", (char *)key, (char *)val);
-	 rocksdb_writebatch_put_cf(writeBatch, ps->ps_cf_handles[PERSISTENT_STORE_CF_RW], (const char*)key, keylen, (const char*)val, vallen);
+	 rocksdb_writebatch_put_cf(writeBatch, getPersistentStoreKeyCF(ps, key, keylen, 1), (const char*)key, keylen, (const char*)val, vallen);
+}
+
+/* Integer property of the column family 'cf', of the db if 'cf' is NULL. */
+static unsigned long long getIntProperty(persistent_store_t *ps,
+                                         rocksdb_column_family_handle_t *cf,
+                                         const char *name) {
+    char *value = cf ? rocksdb_property_value_cf(ps->ps, cf, name) :
+                       rocksdb_property_value(ps->ps, name);
+    unsigned long long v = value ? strtoull(value, NULL, 10) : 0;
+    free(value);
+    return v;
+}
+
+/* Tickers and histograms of the statistics string of RocksDB:
+ *   <name> COUNT : <n>
+ *   <name> statistics Percentiles :=> 50 : <p> 95 : <p> 99 : <p> 100 : <p> */
+static unsigned long long getTickerCount(const char *stats, const char *name) {
+    const char *p = stats;
+    size_t len = strlen(name);
+    unsigned long long v;
+
+    while (p && (p = strstr(p, name)) != NULL) {
+        p += len;
+        if (sscanf(p, " COUNT : %llu", &v) == 1) return v;
+    }
+    return 0;
+}
+
+static void getHistogram(const char *stats, const char *name,
+                         persistent_store_histogram_t *h) {
+    const char *p = stats;
+    size_t len = strlen(name);
+    persistent_store_histogram_t v;
+
+    while (p && (p = strstr(p, name)) != NULL) {
+        p += len;
+        if (sscanf(p, " statistics Percentiles :=> 50 : %lf 95 : %lf 99 : %lf 100 : %lf",
+                   &v.p50, &v.p95, &v.p99, &v.max) != 4) continue;
+        if (v.p50 > h->p50) h->p50 = v.p50;
+        if (v.p95 > h->p95) h->p95 = v.p95;
+        if (v.p99 > h->p99) h->p99 = v.p99;
+        if (v.max > h->max) h->max = v.max;
+        return;
+    }
+}
+
+/* Return the column families of 'ps' in a zmalloc'ed array. The table
+ * column families are only dropped by the main thread. */
+static rocksdb_column_family_handle_t **getColumnFamilies(persistent_store_t *ps,
+                                                          size_t *count) {
+    rocksdb_column_family_handle_t **cfs;
+    dictIterator *di;
+    dictEntry *de;
+    size_t i, n = 0;
+
+    pthread_mutex_lock(&ps->tables_mutex);
+    cfs = zmalloc(sizeof(*cfs) * (ps->cflen + dictSize(ps->tables)));
+    for (i = 0; i < ps->cflen; i++) cfs[n++] = ps->ps_cf_handles[i];
+    di = dictGetIterator(ps->tables);
+    while ((de = dictNext(di)) != NULL) {
+        persistent_store_table_t *t = dictGetVal(de);
+        if (t->cf) cfs[n++] = t->cf;
+    }
+    dictReleaseIterator(di);
+    pthread_mutex_unlock(&ps->tables_mutex);
+    *count = n;
+    return cfs;
+}
+
+int persistentStoreStatisticsEnabled(void) {
+    return statisticsEnabled;
+}
+
+/* Add the memory used by the memtables and the table readers of every
+ * column family of 'ps', and the block cache tickers, to 'usage'. */
+void getPersistentStoreMemoryUsage(persistent_store_t *ps, persistent_store_memory_t *usage) {
+    rocksdb_column_family_handle_t **cfs;
+    size_t i, n;
+
+    cfs = getColumnFamilies(ps, &n);
+    for (i = 0; i < n; i++) {
+        usage->memtables += getIntProperty(ps, cfs[i],
+                                           "rocksdb.cur-size-all-mem-tables");
+        usage->table_readers += getIntProperty(ps, cfs[i],
+                                               "rocksdb.estimate-table-readers-mem");
+    }
+    zfree(cfs);
+
+    if (statisticsEnabled) {
+        char *stats = rocksdb_options_statistics_get_string(ps->ps_options->options);
+        usage->block_cache_hits += getTickerCount(stats, "rocksdb.block.cache.hit");
+        usage->block_cache_misses += getTickerCount(stats, "rocksdb.block.cache.miss");
+        free(stats);
+    }
+}
+
+/* Add the compaction, stall and read statistics of 'ps' to 'stats'. The
+ * read amplification of a column family is the number of sorted runs a
+ * point lookup may probe: every L0 file plus one per non empty level. The
+ * histograms and the read amplification keep the worst store. */
+void getPersistentStoreStats(persistent_store_t *ps, persistent_store_stats_t *stats) {
+    rocksdb_column_family_handle_t **cfs;
+    size_t i, n;
+    int level;
+
+    cfs = getColumnFamilies(ps, &n);
+    for (i = 0; i < n; i++) {
+        unsigned long long amp = 0;
+        char name[64];
+
+        stats->pending_compaction_bytes += getIntProperty(ps, cfs[i],
+            "rocksdb.estimate-pending-compaction-bytes");
+        stats->immutable_memtables += getIntProperty(ps, cfs[i],
+            "rocksdb.num-immutable-mem-table");
+        for (level = 0; ; level++) {
+            char *value;
+            unsigned long long files;
+
+            snprintf(name, sizeof(name), "rocksdb.num-files-at-level%d", level);
+            value = rocksdb_property_value_cf(ps->ps, cfs[i], name);
+            if (value == NULL) break;
+            files = strtoull(value, NULL, 10);
+            free(value);
+            amp += (level == 0) ? files : (files != 0);
+        }
+        if (amp > stats->read_amplification) stats->read_amplification = amp;
+    }
+    zfree(cfs);
+
+    stats->running_compactions += getIntProperty(ps, NULL, "rocksdb.num-running-compactions");
+    stats->write_stopped += getIntProperty(ps, NULL, "rocksdb.is-write-stopped");
+    stats->delayed_write_rate += getIntProperty(ps, NULL, "rocksdb.actual-delayed-write-rate");
+
+    if (statisticsEnabled) {
+        char *s = rocksdb_options_statistics_get_string(ps->ps_options->options);
+        stats->stall_micros += getTickerCount(s, "rocksdb.stall.micros");
+        stats->memtable_hits += getTickerCount(s, "rocksdb.memtable.hit");
+        stats->l0_hits += getTickerCount(s, "rocksdb.l0.hit");
+        stats->l1_hits += getTickerCount(s, "rocksdb.l1.hit");
+        stats->l2andup_hits += getTickerCount(s, "rocksdb.l2andup.hit");
+        getHistogram(s, "rocksdb.db.get.micros", &stats->get);
+        getHistogram(s, "rocksdb.db.write.micros", &stats->write);
+        getHistogram(s, "rocksdb.db.seek.micros", &stats->seek);
+        free(s);
+    }
+}
+
+/* Binary keys, see PERSISTENT_STORE_KEY_TAG in persistent_store.h. */
+static void putUint32(sds key, size_t offset, uint32_t value) {
+    key[offset] = (char) (value >> 24);
+    key[offset+1] = (char) (value >> 16);
+    key[offset+2] = (char) (value >> 8);
+    key[offset+3] = (char) value;
+}
+
+static uint32_t getUint32(const char *key, size_t offset) {
+    const unsigned char *p = (const unsigned char *) key + offset;
+    return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) |
+           ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+sds persistentStoreTablePrefix(int tableId) {
+    sds key = sdsnewlen(NULL, PERSISTENT_STORE_KEY_TABLE_LEN);
+    key[0] = PERSISTENT_STORE_KEY_TAG;
+    putUint32(key, 1, (uint32_t) tableId);
+    return key;
+}
+
+sds persistentStorePartitionPrefix(int tableId, const char *partition, size_t partitionlen) {
+    uint64_t partitionId = crc64(0, (const unsigned char *) partition, partitionlen);
+    sds key = persistentStoreTablePrefix(tableId);
+    key = sdsMakeRoomFor(key, PERSISTENT_STORE_KEY_LEN - PERSISTENT_STORE_KEY_TABLE_LEN);
+    putUint32(key, 5, (uint32_t) (partitionId >> 32));
+    putUint32(key, 9, (uint32_t) partitionId);
+    sdsIncrLen(key, PERSISTENT_STORE_KEY_PARTITION_LEN - PERSISTENT_STORE_KEY_TABLE_LEN);
+    return key;
+}
+
+sds persistentStoreRowGroupPrefix(int tableId, const char *partition, size_t partitionlen, uint32_t rowGroupId) {
+    sds key = persistentStorePartitionPrefix(tableId, partition, partitionlen);
+    putUint32(key, 13, rowGroupId);
+    sdsIncrLen(key, 4);
+    return key;
+}
+
+/* The column comes before the column vector, the column vectors of a
+ * column are contiguous. */
+sds persistentStoreKey(int tableId, const char *partition, size_t partitionlen, uint32_t rowGroupId, uint32_t columnVectorId, uint32_t columnId) {
+    sds key = persistentStoreRowGroupPrefix(tableId, partition, partitionlen, rowGroupId);
+    putUint32(key, 17, columnId);
+    putUint32(key, 21, columnVectorId);
+    sdsIncrLen(key, 8);
+    return key;
+}
+
+/* Parse the unsigned decimal number at '*p' and skip it. */
+static int parseUint32(const char **p, const char *end, uint32_t *value) {
+    const char *start = *p;
+    unsigned long long v = 0;
+
+    while (*p < end && **p >= '0' && **p <= '9') {
+        v = v * 10 + (**p - '0');
+        if (v > UINT32_MAX) return -1;
+        (*p)++;
+    }
+    if (*p == start) return -1;
+    *value = (uint32_t) v;
+    return 0;
+}
+
+/* Skip 'sep' at '*p'. */
+static int skipSeparator(const char **p, const char *end, const char *sep) {
+    size_t len = strlen(sep);
+
+    if ((size_t) (end - *p) < len || memcmp(*p, sep, len) != 0) return -1;
+    *p += len;
+    return 0;
+}
+
+/* Parse the data key "D:{<tableId>:<partition>}:G:<rowGroupId>". On
+ * success '*p' points after the rowgroup id. */
+static int parseDataKey(const char **p, const char *end, int *tableId,
+                        const char **partition, size_t *partitionlen,
+                        uint32_t *rowGroupId) {
+    const char *close;
+    uint32_t table;
+
+    if (skipSeparator(p, end, "D:{") == -1 ||
+        parseUint32(p, end, &table) == -1 || table > INT_MAX ||
+        skipSeparator(p, end, ":") == -1)
+        return -1;
+    close = memchr(*p, '}', end - *p);
+    if (close == NULL || close == *p) return -1;
+    *partition = *p;
+    *partitionlen = close - *p;
+    *p = close + 1;
+    if (skipSeparator(p, end, ":G:") == -1 ||
+        parseUint32(p, end, rowGroupId) == -1)
+        return -1;
+    *tableId = (int) table;
+    return 0;
+}
+
+/* Return the key of the column vector 'field' ("<colVector>:<column>") of
+ * the rowgroup 'dataKey', or the prefix of the rowgroup if 'field' is
+ * NULL. Returns NULL if 'dataKey' or 'field' can't be parsed. */
+sds persistentStoreKeyFromDataKey(const char *dataKey, size_t dataKeylen, const char *field, size_t fieldlen) {
+    const char *p = dataKey, *partition;
+    size_t partitionlen;
+    uint32_t rowGroupId, columnVectorId, columnId;
+    int tableId;
+
+    if (parseDataKey(&p, dataKey + dataKeylen, &tableId, &partition,
+                     &partitionlen, &rowGroupId) == -1 || p != dataKey + dataKeylen)
+        return NULL;
+    if (field == NULL)
+        return persistentStoreRowGroupPrefix(tableId, partition, partitionlen,
+                                             rowGroupId);
+    p = field;
+    if (parseUint32(&p, field + fieldlen, &columnVectorId) == -1 ||
+        skipSeparator(&p, field + fieldlen, ":") == -1 ||
+        parseUint32(&p, field + fieldlen, &columnId) == -1 ||
+        p != field + fieldlen)
+        return NULL;
+    return persistentStoreKey(tableId, partition, partitionlen, rowGroupId,
+                              columnVectorId, columnId);
+}
+
+/* Convert the text key "D:{100:1:2}:G:10:F:3:2" to its binary key, or
+ * return NULL if 'key' isn't a text key of a column vector. */
+sds persistentStoreKeyFromText(const char *key, size_t keylen) {
+    const char *p = key, *end = key + keylen, *partition;
+    size_t partitionlen;
+    uint32_t rowGroupId;
+    int tableId;
+
+    if (parseDataKey(&p, end, &tableId, &partition, &partitionlen,
+                     &rowGroupId) == -1)
+        return NULL;
+    if (skipSeparator(&p, end, ":F:") == -1) return NULL;
+    return persistentStoreKeyFromDataKey(key, p - 3 - key, p, end - p);
+}
+
+/* Return the field "<colVector>:<column>" of a binary key. */
+sds persistentStoreKeyField(const char *key, size_t keylen) {
+    assert(keylen == PERSISTENT_STORE_KEY_LEN);
+    return sdscatprintf(sdsempty(), "%u:%u", getUint32(key, 21),
+                        getUint32(key, 17));
+}
+
+/* Return the rowgroup id of a binary key. */
+uint32_t persistentStoreKeyRowGroupId(const char *key, size_t keylen) {
+    assert(keylen >= PERSISTENT_STORE_KEY_ROWGROUP_LEN);
+    return getUint32(key, 13);
+}
+
+/* Return a printable form of a key, for logging. */
+sds persistentStoreKeyRepr(const char *key, size_t keylen) {
+    if (keylen == PERSISTENT_STORE_KEY_LEN && key[0] == PERSISTENT_STORE_KEY_TAG) {
+        return sdscatprintf(sdsempty(), "[table %u, partition %08x%08x, "
+                            "rowgroup %u, column %u, col vector %u]",
+                            getUint32(key, 1), getUint32(key, 5),
+                            getUint32(key, 9), getUint32(key, 13),
+                            getUint32(key, 17), getUint32(key, 21));
+    }
+    return sdscatrepr(sdsempty(), key, keylen);
+}
+
+/* Turn a prefix into the first key after every key with that prefix, the
+ * end of a range deletion. */
+void persistentStorePrefixEnd(sds prefix) {
+    ssize_t i;
+
+    for (i = sdslen(prefix) - 1; i >= 0; i--) {
+        if ((unsigned char) prefix[i] != 0xff) {
+            prefix[i]++;
+            return;
+        }
+        prefix[i] = 0;
+    }
+    assert(0);
+}
+
+/* Return the table id of a binary key or of a data key "D:{<tableId>:...}",
+ * or -1 if 'key' is neither. */
+int getPersistentStoreKeyTableId(const char *key, size_t keylen) {
+    const char *p = key + 3, *end = key + keylen;
+    long long tableId = 0;
+
+    if (keylen >= PERSISTENT_STORE_KEY_TABLE_LEN &&
+        key[0] == PERSISTENT_STORE_KEY_TAG)
+        return (int) getUint32(key, 1);
+    if (keylen < 4 || memcmp(key, "D:{", 3) != 0) return -1;
+    while (p < end && *p >= '0' && *p <= '9') {
+        tableId = tableId * 10 + (*p - '0');
+        if (tableId > INT_MAX) return -1;
+        p++;
+    }
+    if (p == key + 3 || p == end || (*p != ':' && *p != '}')) return -1;
+    return (int) tableId;
+}
+
+/* Return 1 if the RW column family holds data keys of 'tableId'. */
+static int tableHasSharedKeys(persistent_store_t *ps, int tableId) {
+    sds prefix = persistentStoreTablePrefix(tableId);
+    size_t keylen;
+    int found = 0;
+
+    rocksdb_iterator_t *iter = rocksdb_create_iterator_cf(ps->ps,
+        ps->ps_options->total_order_roptions,
+        ps->ps_cf_handles[PERSISTENT_STORE_CF_RW]);
+    rocksdb_iter_seek(iter, prefix, sdslen(prefix));
+    if (rocksdb_iter_valid(iter)) {
+        const char *key = rocksdb_iter_key(iter, &keylen);
+        found = keylen >= sdslen(prefix) && !memcmp(key, prefix, sdslen(prefix));
+    }
+    rocksdb_iter_destroy(iter);
+    sdsfree(prefix);
+    return found;
+}
+
+/* Return the column family of 'tableId'. With 'create' the column family
+ * is created if the table doesn't have one yet, unless the table already
+ * has data in the RW column family. Without 'create', or for keys which
+ * don't belong to a table, the RW column family is returned. This is
+ * called by the tiering workers, so the tables are protected by a mutex. */
+rocksdb_column_family_handle_t *getPersistentStoreTableCF(persistent_store_t *ps, int tableId, int create) {
+    rocksdb_column_family_handle_t *cf = ps->ps_cf_handles[PERSISTENT_STORE_CF_RW];
+    persistent_store_table_t *t;
+    char name[32];
+    const char *cferr = NULL;
+    char *err = NULL;
+
+    if (tableId < 0) return cf;
+    pthread_mutex_lock(&ps->tables_mutex);
+    t = getTableEntry(ps, tableId, create);
+    if (t == NULL || t->cf || !create || t->shared) {
+        if (t && t->cf) cf = t->cf;
+        pthread_mutex_unlock(&ps->tables_mutex);
+        return cf;
+    }
+
+    if (tableHasSharedKeys(ps, tableId)) {
+        t->shared = 1;
+    } else {
+        if (t->options == NULL &&
+            createTableOptions(t->spec, &t->options, &t->table_options,
+                               &cferr) == -1) {
+            panic("[PERSISTENT_STORE] invalid options of table %d: %s",
+                  tableId, cferr);
+        }
+        snprintf(name, sizeof(name), "%s%d", PERSISTENT_STORE_TABLE_CF_PREFIX,
+                 tableId);
+        t->cf = rocksdb_create_column_family(ps->ps, t->options, name, &err);
+        if (err) {
+            panic("[PERSISTENT_STORE] creating column family %s failed due to %s",
+                  name, err);
+        }
+        cf = t->cf;
+    }
+    pthread_mutex_unlock(&ps->tables_mutex);
+    return cf;
+}
+
+/* Return the options of the column family of 'tableId'. */
+rocksdb_options_t *getPersistentStoreTableCFOptions(persistent_store_t *ps, int tableId) {
+    rocksdb_options_t *options = ps->ps_options->options;
+    persistent_store_table_t *t;
+
+    pthread_mutex_lock(&ps->tables_mutex);
+    t = getTableEntry(ps, tableId, 0);
+    if (t && t->cf && t->options) options = t->options;
+    pthread_mutex_unlock(&ps->tables_mutex);
+    return options;
+}
+
+rocksdb_column_family_handle_t *getPersistentStoreKeyCF(persistent_store_t *ps, const char *key, size_t keylen, int create) {
+    return getPersistentStoreTableCF(ps,
+        getPersistentStoreKeyTableId(key, keylen), create);
+}
+
+/* Set the column family options of 'tableId', see createTableOptions().
+ * The options are used when the column family of the table is created, or
+ * when it is opened again for a table which already has one. */
+int setPersistentStoreTableOptions(persistent_store_t *ps, int tableId, sds spec, sds *err) {
+    rocksdb_options_t *options;
+    rocksdb_block_based_table_options_t *table_options;
+    const char *specerr = NULL;
+    char *rerr = NULL;
+    char key[32];
+    size_t keylen;
+    persistent_store_table_t *t;
+
+    if (createTableOptions(spec, &options, &table_options, &specerr) == -1) {
+        *err = sdsnew(specerr);
+        return -1;
+    }
+    /* Some options, like a compression the library was built without, are
+     * only rejected by RocksDB when a column family is created. Creating
+     * the column family of the table must not fail later, so the options
+     * are tried on a column family which is dropped right away. */
+    keylen = snprintf(key, sizeof(key), "%s%d",
+                      PERSISTENT_STORE_TABLE_OPTIONS_PREFIX, tableId);
+    rocksdb_column_family_handle_t *probe =
+        rocksdb_create_column_family(ps->ps, options, key, &rerr);
+    if (probe) {
+        if (rerr == NULL) rocksdb_drop_column_family(ps->ps, probe, &rerr);
+        rocksdb_column_family_handle_destroy(probe);
+    }
+    if (rerr == NULL) {
+        rocksdb_put_cf(ps->ps, ps->ps_options->woptions,
+                       ps->ps_cf_handles[PERSISTENT_STORE_CF_DEFAULT], key,
+                       keylen, spec, sdslen(spec), &rerr);
+    }
+    /* loadTableOptionSpecs() opens the DB read only, which does not see
+     * what is only in the WAL. */
+    if (rerr == NULL) {
+        rocksdb_flushoptions_t *fo = rocksdb_flushoptions_create();
+        rocksdb_flushoptions_set_wait(fo, 1);
+        rocksdb_flush(ps->ps, fo, &rerr);
+        rocksdb_flushoptions_destroy(fo);
+    }
+    if (rerr) {
+        *err = sdsnew(rerr);
+        rocksdb_free(rerr);
+        rocksdb_options_destroy(options);
+        rocksdb_block_based_options_destroy(table_options);
+        return -1;
+    }
+
+    pthread_mutex_lock(&ps->tables_mutex);
+    t = getTableEntry(ps, tableId, 1);
+    sdsfree(t->spec);
+    t->spec = sdsdup(spec);
+    t->shards = tableSpecShards(spec);
+    if (t->cf == NULL) {
+        if (t->options) rocksdb_options_destroy(t->options);
+        if (t->table_options) rocksdb_block_based_options_destroy(t->table_options);
+        t->options = options;
+        t->table_options = table_options;
+    } else {
+        rocksdb_options_destroy(options);
+        rocksdb_block_based_options_destroy(table_options);
+    }
+    pthread_mutex_unlock(&ps->tables_mutex);
+    return 0;
+}
+
+/* Return a copy of the options of 'tableId', or NULL if none were set. */
+sds getPersistentStoreTableOptions(persistent_store_t *ps, int tableId) {
+    persistent_store_table_t *t;
+    sds spec = NULL;
+
+    pthread_mutex_lock(&ps->tables_mutex);
+    t = getTableEntry(ps, tableId, 0);
+    if (t && t->spec) spec = sdsdup(t->spec);
+    pthread_mutex_unlock(&ps->tables_mutex);
+    return spec;
+}
+
+/* Return the number of hash tags the partitions of 'tableId' are sharded
+ * over, 1 if they are not sharded. */
+int getPersistentStoreTableShards(persistent_store_t *ps, int tableId) {
+    persistent_store_table_t *t;
+    int shards = 1;
+
+    pthread_mutex_lock(&ps->tables_mutex);
+    t = getTableEntry(ps, tableId, 0);
+    if (t && t->shards > 1) shards = t->shards;
+    pthread_mutex_unlock(&ps->tables_mutex);
+    return shards;
+}
+
+static void deleteRangeOfCF(persistent_store_t *ps,
+                            rocksdb_column_family_handle_t *cf,
+                            const char *begin, size_t beginlen,
+                            const char *end, size_t endlen, char **err) {
+    rocksdb_writebatch_t *wb = rocksdb_writebatch_create();
+    rocksdb_writebatch_delete_range_cf(wb, cf, begin, beginlen, end, endlen);
+    rocksdb_write(ps->ps, ps->ps_options->woptions, wb, err);
+    rocksdb_writebatch_destroy(wb);
+}
+
+/* Delete the keys in [begin, end) with a single range tombstone. Both keys
+ * must belong to the same table. */
+int deletePersistentStoreKeyRange(persistent_store_t *ps, const char *begin, size_t beginlen, const char *end, size_t endlen, sds *err) {
+    char *rerr = NULL;
+
+    deleteRangeOfCF(ps, getPersistentStoreKeyCF(ps, begin, beginlen, 0),
+                    begin, beginlen, end, endlen, &rerr);
+    if (rerr) {
+        *err = sdsnew(rerr);
+        rocksdb_free(rerr);
+        return -1;
+    }
+    return 0;
+}
+
+/* Write 'writeBatch' to 'ps'. Returns -1 with 'err' set if RocksDB failed. */
+int writePersistentStoreBatch(persistent_store_t *ps, rocksdb_writebatch_t *writeBatch, sds *err) {
+    char *rerr = NULL;
+
+    rocksdb_write(ps->ps, ps->ps_options->woptions, writeBatch, &rerr);
+    if (rerr) {
+        *err = sdsnew(rerr);
+        rocksdb_free(rerr);
+        return -1;
+    }
+    return 0;
+}
+
+/* Return an iterator over the column family of the keys starting with
+ * 'prefix', positioned on the first of them. The iterator reads the
+ * snapshot of the store at its creation, the caller stops it at the end of
+ * the prefix. */
+rocksdb_iterator_t *createPersistentStorePrefixIterator(persistent_store_t *ps, const char *prefix, size_t prefixlen) {
+    rocksdb_iterator_t *it = rocksdb_create_iterator_cf(ps->ps,
+        ps->ps_options->total_order_roptions,
+        getPersistentStoreKeyCF(ps, prefix, prefixlen, 0));
+
+    rocksdb_iter_seek(it, prefix, prefixlen);
+    return it;
+}
+
+/* Rowgroup metadata, see PERSISTENT_STORE_CF_META in persistent_store.h. */
+void setPersistentStoreRowGroupMetaWithBatch(persistent_store_t *ps, const char *metaKey, size_t metaKeylen, uint32_t rowGroupId, uint32_t rowCount, rocksdb_writebatch_t *writeBatch) {
+    sds key = sdsnewlen(metaKey, metaKeylen + PERSISTENT_STORE_META_ENTRY_LEN);
+    char val[PERSISTENT_STORE_META_ENTRY_LEN];
+
+    putUint32(key, metaKeylen, rowGroupId);
+    putUint32(val, 0, rowCount);
+    rocksdb_writebatch_put_cf(writeBatch,
+                              ps->ps_cf_handles[PERSISTENT_STORE_CF_META],
+                              key, sdslen(key), val, sizeof(val));
+    sdsfree(key);
+}
+
+/* Get the row count recorded for a rowgroup. Returns 0 if the rowgroup
+ * has no metadata. */
+int getPersistentStoreRowGroupMeta(persistent_store_t *ps, const char *metaKey, size_t metaKeylen, uint32_t rowGroupId, uint32_t *rowCount) {
+    sds key = sdsnewlen(metaKey, metaKeylen + PERSISTENT_STORE_META_ENTRY_LEN);
+    char *val, *err = NULL;
+    size_t vallen;
+    int found = 0;
+
+    putUint32(key, metaKeylen, rowGroupId);
+    val = rocksdb_get_cf(ps->ps, ps->ps_options->total_order_roptions,
+                         ps->ps_cf_handles[PERSISTENT_STORE_CF_META],
+                         key, sdslen(key), &vallen, &err);
+    if (err) {
+        serverLog(PERSISTENT_STORE_WARNING,
+                  "[PERSISTENT_STORE] reading rowgroup metadata failed: %s", err);
+        rocksdb_free(err);
+    } else if (val && vallen == PERSISTENT_STORE_META_ENTRY_LEN) {
+        *rowCount = getUint32(val, 0);
+        found = 1;
+    }
+    if (val) rocksdb_free(val);
+    sdsfree(key);
+    return found;
+}
+
+/* Return 1 if any rowgroup metadata was written to 'ps'. */
+int persistentStoreHasMeta(persistent_store_t *ps) {
+    rocksdb_iterator_t *it = rocksdb_create_iterator_cf(ps->ps,
+        ps->ps_options->total_order_roptions,
+        ps->ps_cf_handles[PERSISTENT_STORE_CF_META]);
+    int found;
+
+    rocksdb_iter_seek_to_first(it);
+    found = rocksdb_iter_valid(it);
+    rocksdb_iter_destroy(it);
+    return found;
+}
+
+/* Call 'proc' for every rowgroup metadata entry whose key starts with
+ * 'prefix', every entry if 'prefix' is NULL. Entries are visited in key
+ * order, so the rowgroups of a partition come one after the other. */
+void scanPersistentStoreMeta(persistent_store_t *ps, const char *prefix, size_t prefixlen, persistentStoreMetaProc *proc, void *privdata) {
+    rocksdb_iterator_t *it = rocksdb_create_iterator_cf(ps->ps,
+        ps->ps_options->total_order_roptions,
+        ps->ps_cf_handles[PERSISTENT_STORE_CF_META]);
+
+    if (prefix) rocksdb_iter_seek(it, prefix, prefixlen);
+    else rocksdb_iter_seek_to_first(it);
+    for (; rocksdb_iter_valid(it); rocksdb_iter_next(it)) {
+        size_t keylen, vallen;
+        const char *key = rocksdb_iter_key(it, &keylen);
+        const char *val = rocksdb_iter_value(it, &vallen);
+
+        if (prefix && (keylen < prefixlen || memcmp(key, prefix, prefixlen)))
+            break;
+        if (keylen <= PERSISTENT_STORE_META_ENTRY_LEN ||
+            vallen != PERSISTENT_STORE_META_ENTRY_LEN) continue;
+        keylen -= PERSISTENT_STORE_META_ENTRY_LEN;
+        proc(privdata, key, keylen, getUint32(key, keylen), getUint32(val, 0));
+    }
+    rocksdb_iter_destroy(it);
+}
+
+/* Delete the rowgroup metadata whose key starts with 'prefix'. */
+int deletePersistentStoreMeta(persistent_store_t *ps, const char *prefix, size_t prefixlen, sds *err) {
+    sds end = sdsnewlen(prefix, prefixlen);
+    char *rerr = NULL;
+
+    persistentStorePrefixEnd(end);
+    deleteRangeOfCF(ps, ps->ps_cf_handles[PERSISTENT_STORE_CF_META],
+                    prefix, prefixlen, end, sdslen(end), &rerr);
+    sdsfree(end);
+    if (rerr) {
+        *err = sdsnew(rerr);
+        rocksdb_free(rerr);
+        return -1;
+    }
+    return 0;
+}
+
+/* Checkpoints
+ *
+ * A checkpoint is an openable copy of a store made of hard links to its
+ * SST files, so it costs no data copy. The WAL is copied unless it is over
+ * PERSISTENT_STORE_CHECKPOINT_LOG_SIZE, then the memtables are flushed
+ * first. */
+int createPersistentStoreCheckpoint(persistent_store_t *ps, const char *dir,
+                                    sds *err) {
+    rocksdb_checkpoint_t *checkpoint;
+    char *rerr = NULL;
+
+    checkpoint = rocksdb_checkpoint_object_create(ps->ps, &rerr);
+    if (rerr == NULL) {
+        rocksdb_checkpoint_create(checkpoint, dir,
+                                  PERSISTENT_STORE_CHECKPOINT_LOG_SIZE, &rerr);
+        rocksdb_checkpoint_object_destroy(checkpoint);
+    }
+    if (rerr) {
+        *err = sdsnew(rerr);
+        free(rerr);
+        return -1;
+    }
+    return 0;
+}
+
+static int removeEntry(const char *path, const struct stat *sb, int flag,
+                       struct FTW *ftwbuf) {
+    (void) sb;
+    (void) flag;
+    (void) ftwbuf;
+    return remove(path);
+}
+
+/* Remove 'dir' and everything under it. */
+int removePersistentStoreDir(const char *dir) {
+    struct stat sb;
+
+    if (lstat(dir, &sb) == -1) return (errno == ENOENT) ? 0 : -1;
+    return nftw(dir, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+static int copyFile(const char *src, const char *dst) {
+    char buf[65536];
+    ssize_t n = 0;
+    int in, out;
+
+    if ((in = open(src, O_RDONLY)) == -1) return -1;
+    if ((out = open(dst, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+        close(in);
+        return -1;
+    }
+    while ((n = read(in, buf, sizeof(buf))) > 0) {
+        if (write(out, buf, n) != n) {
+            n = -1;
+            break;
+        }
+    }
+    if (n == 0 && fsync(out) == -1) n = -1;
+    close(in);
+    close(out);
+    return (n == 0) ? 0 : -1;
+}
+
+/* Replace the store of the db 'dbnum' by the one saved in the checkpoint
+ * 'dir'. It must be called while the store is closed. The SST files are
+ * hard linked, the other files are copied as RocksDB rewrites them in
+ * place, so the checkpoint stays usable. The replaced store is kept in the
+ * "<store>.old" directory until the next restore. */
+int restorePersistentStoreCheckpoint(int dbnum, const char *dir, sds *err) {
+    char *name = persistentStoreDirName(dbnum);
+    sds src = sdscatfmt(sdsempty(), "%s/%s", dir, name);
+    sds old = sdscatfmt(sdsempty(), "%s.old", name);
+    struct dirent *de;
+    DIR *d;
+    int ret = -1;
+
+    if ((d = opendir(src)) == NULL) {
+        *err = sdscatfmt(sdsempty(), "can't open %s: %s", src, strerror(errno));
+        goto cleanup;
+    }
+    if (removePersistentStoreDir(old) == -1 ||
+        (rename(name, old) == -1 && errno != ENOENT) ||
+        mkdir(name, 0755) == -1)
+    {
+        *err = sdscatfmt(sdsempty(), "can't replace %s: %s", name, strerror(errno));
+        goto cleanup;
+    }
+    while ((de = readdir(d)) != NULL) {
+        size_t len = strlen(de->d_name);
+        sds from, to;
+        int linked;
+
+        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+        from = sdscatfmt(sdsempty(), "%s/%s", src, de->d_name);
+        to = sdscatfmt(sdsempty(), "%s/%s", name, de->d_name);
+        linked = len > 4 && !strcmp(de->d_name + len - 4, ".sst");
+        if ((linked ? link(from, to) : copyFile(from, to)) == -1) {
+            *err = sdscatfmt(sdsempty(), "can't restore %s: %s", from,
+                             strerror(errno));
+            sdsfree(from);
+            sdsfree(to);
+            goto cleanup;
+        }
+        sdsfree(from);
+        sdsfree(to);
+    }
+    ret = 0;
+
+cleanup:
+    if (d) closedir(d);
+    zfree(name);
+    sdsfree(src);
+    sdsfree(old);
+    return ret;
+}
+
+/* Drop every key of 'tableId'. A table with its own column family is
+ * dropped with the column family, otherwise its key range is removed
+ * from the RW column family with a single range deletion. The caller
+ * makes sure that no tiering job of the table is in flight. */
+int dropPersistentStoreTable(persistent_store_t *ps, int tableId, sds *err) {
+    persistent_store_table_t *t;
+    char *rerr = NULL;
+    char key[32];
+    size_t keylen;
+
+    pthread_mutex_lock(&ps->tables_mutex);
+    t = getTableEntry(ps, tableId, 0);
+    if (t && t->cf) {
+        rocksdb_drop_column_family(ps->ps, t->cf, &rerr);
+    } else {
+        sds begin = persistentStoreTablePrefix(tableId);
+        sds end = sdsdup(begin);
+        persistentStorePrefixEnd(end);
+        deleteRangeOfCF(ps, ps->ps_cf_handles[PERSISTENT_STORE_CF_RW],
+                        begin, sdslen(begin), end, sdslen(end), &rerr);
+        sdsfree(begin);
+        sdsfree(end);
+    }
+    if (rerr == NULL) {
+        if (t) {
+            dictDelete(ps->tables, TABLE_KEY(tableId));
+            freeTableEntry(t);
+        }
+        keylen = snprintf(key, sizeof(key), "%s%d",
+                          PERSISTENT_STORE_TABLE_OPTIONS_PREFIX, tableId);
+        rocksdb_delete_cf(ps->ps, ps->ps_options->woptions,
+                          ps->ps_cf_handles[PERSISTENT_STORE_CF_DEFAULT],
+                          key, keylen, &rerr);
+    }
+    pthread_mutex_unlock(&ps->tables_mutex);
+    if (rerr) {
+        *err = sdsnew(rerr);
+        rocksdb_free(rerr);
+        return -1;
+    }
+    return 0;
 }
 
 
@@ -137,22 +1367,39 @@ void getPersistentKey(void){
 }
 
 void destroyPersistentStoreOptions(persistent_store_t* ps) {
-    rocksdb_cache_destroy(ps->ps_options->cache);
+    if (--blockCacheRefs == 0) {
+        rocksdb_cache_destroy(blockCache);
+        blockCache = NULL;
+    }
     rocksdb_block_based_options_destroy(ps->ps_options->table_options);
     rocksdb_compactoptions_destroy(ps->ps_options->coptions);
     rocksdb_ratelimiter_destroy(ps->ps_options->rate_limiter);
     rocksdb_readoptions_destroy(ps->ps_options->roptions);
+    rocksdb_readoptions_destroy(ps->ps_options->total_order_roptions);
     rocksdb_writeoptions_destroy(ps->ps_options->woptions);
     rocksdb_options_destroy(ps->ps_options->options);
+    zfree(ps->ps_options);
 }
 
+/* Close the store and free 'ps'. The caller makes sure that no tiering job
+ * is in flight. */
 void destroyPersistentStore(persistent_store_t* ps) {
     size_t i = 0;
-    rocksdb_list_column_families_destroy(ps->cf_names, ps->cflen);
+    dictIterator *di;
+    dictEntry *de;
+
+    if (ps->cf_names) rocksdb_list_column_families_destroy(ps->cf_names, ps->cflen);
     for (i = 0; i < ps->cflen; i++) {
       rocksdb_column_family_handle_destroy(ps->ps_cf_handles[i]);
     }
-    destroyPersistentStoreOptions(ps);
+    di = dictGetIterator(ps->tables);
+    while ((de = dictNext(di)) != NULL) freeTableEntry(dictGetVal(de));
+    dictReleaseIterator(di);
+    dictRelease(ps->tables);
+    pthread_mutex_destroy(&ps->tables_mutex);
     rocksdb_close(ps->ps);
+    destroyPersistentStoreOptions(ps);
+    zfree(ps->ps_cf_handles);
     zfree(ps->dbname);
+    zfree(ps);
 }
@@ -8,8 +8,10 @@
 #ifndef SRC_PERSISTENT_STORE_H_
 #define SRC_PERSISTENT_STORE_H_
 
+#include <pthread.h>
 #include "rocksdb/c.h"
 #include "sds.h"
+#include "dict.h"
 
 #define LOG_MAX_LEN    1024 /* Default maximum length of syslog messages */
 
@@ -22,11 +24,54 @@
 /* COLUMN FAMILIES */
 #define PERSISTENT_STORE_CF_DEFAULT 0
 #define PERSISTENT_STORE_CF_RW      1
-#define PERSISTENT_STORE_CF_NUM     2
+#define PERSISTENT_STORE_CF_META    2
+#define PERSISTENT_STORE_CF_NUM     3
+
+/* Every table gets its own column family "T:<tableId>", created the first
+ * time one of its rowgroups is tiered. Tables tiered before column families
+ * per table existed keep living in the RW column family. The options of a
+ * table are kept in the default column family under "O:<tableId>". */
+#define PERSISTENT_STORE_TABLE_CF_PREFIX "T:"
+#define PERSISTENT_STORE_TABLE_OPTIONS_PREFIX "O:"
+
+/* The META column family records the tiered rowgroups, so that the
+ * Metadict can be rebuilt from RocksDB after a restart:
+ *
+ *   "M:{100:1:2}" <rowgroup id, 4 bytes> -> <row count, 4 bytes>
+ *
+ * Integers are big endian. The entries of a rowgroup are written in the
+ * same WriteBatch as its column vectors. The metadata key of a partition
+ * ends with '}', so it is the prefix of the entries of that partition
+ * only. */
+#define PERSISTENT_STORE_META_ENTRY_LEN 4
+#define PERSISTENT_STORE_DEFAULT_MAX_OPEN_FILES 512
+
+/* Column vectors are stored under binary keys:
+ *
+ *   0     1          5               13         17       21          25
+ *   | tag | table id | partition id | rowgroup | column | col vector |
+ *
+ * Every integer is big endian, so the keys sort numerically and the keys
+ * of a table, a partition or a rowgroup are contiguous. The partition id
+ * is the CRC64 of the partition string ("1:2" in D:{100:1:2}). The table
+ * id and the partition id are the prefix of the prefix extractor, so the
+ * bloom filters also answer for a whole partition. Text keys
+ * "D:{100:1:2}:G:10:F:3:2" written by older versions are converted when
+ * the DB is opened. */
+#define PERSISTENT_STORE_KEY_TAG            0x01
+#define PERSISTENT_STORE_KEY_TABLE_LEN      5
+#define PERSISTENT_STORE_KEY_PARTITION_LEN  13
+#define PERSISTENT_STORE_KEY_ROWGROUP_LEN   17
+#define PERSISTENT_STORE_KEY_LEN            25
+#define PERSISTENT_STORE_DEFAULT_BLOOM_BITS 10
+#define PERSISTENT_STORE_MAX_TABLE_SHARDS   1024
+#define PERSISTENT_STORE_DEFAULT_BLOCK_CACHE 100000
+#define PERSISTENT_STORE_CHECKPOINT_LOG_SIZE (64*1024*1024)
 
 typedef struct _persistent_store_options {
     rocksdb_options_t* options;
     rocksdb_readoptions_t* roptions;
+    rocksdb_readoptions_t* total_order_roptions; /* Seeks across prefixes */
     rocksdb_writeoptions_t* woptions;
     rocksdb_compactoptions_t* coptions;
     rocksdb_block_based_table_options_t* table_options;
@@ -34,6 +79,16 @@ typedef struct _persistent_store_options {
     rocksdb_ratelimiter_t* rate_limiter;
 } persistent_store_options_t;
 
+typedef struct _persistent_store_table {
+    int table_id;
+    rocksdb_column_family_handle_t *cf;   /* NULL: not created yet */
+    int shared;                           /* Tiered to the RW CF before */
+    rocksdb_options_t *options;
+    rocksdb_block_based_table_options_t *table_options;
+    sds spec;                             /* Options set by FPTABLEOPT */
+    int shards;                           /* Option shards, 0 if not set */
+} persistent_store_table_t;
+
 typedef struct _persistent_store {
     rocksdb_t *ps;                                    /* RocksDB instance */
     persistent_store_options_t* ps_options;           /* DB options */
@@ -41,11 +96,85 @@ typedef struct _persistent_store {
     size_t cflen;
     char** cf_names;
     char* dbname;
+    dict *tables;                   /* Table id -> persistent_store_table_t */
+    pthread_mutex_t tables_mutex;   /* Tiering workers create table CFs */
 } persistent_store_t;
 
+/* Called for every META entry by scanPersistentStoreMeta(). */
+typedef void persistentStoreMetaProc(void *privdata, const char *metaKey,
+                                     size_t metaKeylen, uint32_t rowGroupId,
+                                     uint32_t rowCount);
+
+typedef struct _persistent_store_memory {
+    unsigned long long memtables;
+    unsigned long long table_readers;   /* Not charged to the block cache */
+    unsigned long long block_cache_hits;
+    unsigned long long block_cache_misses;
+} persistent_store_memory_t;
+
+typedef struct _persistent_store_histogram {
+    double p50, p95, p99, max;          /* Microseconds */
+} persistent_store_histogram_t;
+
+typedef struct _persistent_store_stats {
+    unsigned long long pending_compaction_bytes;
+    unsigned long long running_compactions;
+    unsigned long long immutable_memtables;
+    unsigned long long write_stopped;
+    unsigned long long delayed_write_rate;
+    unsigned long long read_amplification;
+    unsigned long long stall_micros;
+    unsigned long long memtable_hits;
+    unsigned long long l0_hits;
+    unsigned long long l1_hits;
+    unsigned long long l2andup_hits;
+    persistent_store_histogram_t get;
+    persistent_store_histogram_t write;
+    persistent_store_histogram_t seek;
+} persistent_store_stats_t;
+
+void configurePersistentStoreMemory(size_t memtables, int statistics);
+void configurePersistentStoreOpenFiles(int maxOpen);
+int persistentStoreStatisticsEnabled(void);
+void getPersistentStoreStats(persistent_store_t *ps, persistent_store_stats_t *stats);
+void setPersistentStoreBlockCacheCapacity(size_t capacity);
+size_t getPersistentStoreBlockCacheCapacity(void);
+size_t getPersistentStoreBlockCacheUsage(void);
+size_t getPersistentStoreBlockCachePinnedUsage(void);
+void getPersistentStoreMemoryUsage(persistent_store_t *ps, persistent_store_memory_t *usage);
 void createPersistentStoreOptions(persistent_store_t *ps);
 void createPersistentStoreDb(persistent_store_t *ps);
 persistent_store_t* createPersistentStore(int dbnum);
+void destroyPersistentStore(persistent_store_t* ps);
 void setPersistentKey(persistent_store_t* ps, const void *key, const int keylen, const void *val, const int vallen);
 void setPersistentKeyWithBatch(persistent_store_t* ps, const void *key, const int keylen, const void *val, const int vallen, rocksdb_writebatch_t * writeBatch);
+sds persistentStoreTablePrefix(int tableId);
+sds persistentStorePartitionPrefix(int tableId, const char *partition, size_t partitionlen);
+sds persistentStoreRowGroupPrefix(int tableId, const char *partition, size_t partitionlen, uint32_t rowGroupId);
+sds persistentStoreKey(int tableId, const char *partition, size_t partitionlen, uint32_t rowGroupId, uint32_t columnVectorId, uint32_t columnId);
+sds persistentStoreKeyFromDataKey(const char *dataKey, size_t dataKeylen, const char *field, size_t fieldlen);
+sds persistentStoreKeyFromText(const char *key, size_t keylen);
+sds persistentStoreKeyField(const char *key, size_t keylen);
+uint32_t persistentStoreKeyRowGroupId(const char *key, size_t keylen);
+sds persistentStoreKeyRepr(const char *key, size_t keylen);
+void persistentStorePrefixEnd(sds prefix);
+int getPersistentStoreKeyTableId(const char *key, size_t keylen);
+rocksdb_column_family_handle_t *getPersistentStoreTableCF(persistent_store_t *ps, int tableId, int create);
+rocksdb_options_t *getPersistentStoreTableCFOptions(persistent_store_t *ps, int tableId);
+rocksdb_column_family_handle_t *getPersistentStoreKeyCF(persistent_store_t *ps, const char *key, size_t keylen, int create);
+int setPersistentStoreTableOptions(persistent_store_t *ps, int tableId, sds spec, sds *err);
+sds getPersistentStoreTableOptions(persistent_store_t *ps, int tableId);
+int getPersistentStoreTableShards(persistent_store_t *ps, int tableId);
+int deletePersistentStoreKeyRange(persistent_store_t *ps, const char *begin, size_t beginlen, const char *end, size_t endlen, sds *err);
+int writePersistentStoreBatch(persistent_store_t *ps, rocksdb_writebatch_t *writeBatch, sds *err);
+rocksdb_iterator_t *createPersistentStorePrefixIterator(persistent_store_t *ps, const char *prefix, size_t prefixlen);
+void setPersistentStoreRowGroupMetaWithBatch(persistent_store_t *ps, const char *metaKey, size_t metaKeylen, uint32_t rowGroupId, uint32_t rowCount, rocksdb_writebatch_t *writeBatch);
+int getPersistentStoreRowGroupMeta(persistent_store_t *ps, const char *metaKey, size_t metaKeylen, uint32_t rowGroupId, uint32_t *rowCount);
+int persistentStoreHasMeta(persistent_store_t *ps);
+void scanPersistentStoreMeta(persistent_store_t *ps, const char *prefix, size_t prefixlen, persistentStoreMetaProc *proc, void *privdata);
+int deletePersistentStoreMeta(persistent_store_t *ps, const char *prefix, size_t prefixlen, sds *err);
+int dropPersistentStoreTable(persistent_store_t *ps, int tableId, sds *err);
+int createPersistentStoreCheckpoint(persistent_store_t *ps, const char *dir, sds *err);
+int restorePersistentStoreCheckpoint(int dbnum, const char *dir, sds *err);
+int removePersistentStoreDir(const char *dir);
 #endif /* SRC_PERSISTENT_STORE_H_ */
@@ -622,7 +622,7 @@ int rdbSaveObjectType(rio *rdb, robj *o) {
             return rdbSaveType(rdb,RDB_TYPE_HASH);
         /*addb*/
         else if (o->encoding == OBJ_ENCODING_REL)
-        	return rdbSaveType(rdb, RDB_TYPE_HASH);
+            return rdbSaveType(rdb,RDB_TYPE_REL_ROWGROUP);
         else
             serverPanic("Unknown hash encoding");
     case OBJ_MODULE:
@@ -643,6 +643,201 @@ int rdbLoadObjectType(rio *rdb) {
 }
 
 /* Save a Redis object. Returns -1 on error, number of bytes written on success. */
+/* ADDB
+ * A rowgroup is saved as its location (LOCATION_*), the number of column
+ * vectors, then for every column vector its field ("cv:col"), the type and
+ * the number of elements of the Vector and one string holding all the
+ * elements, each one prefixed by its length as a base 128 varint. The
+ * string is LZF compressed like any other string when rdbcompression is
+ * enabled, and it is loaded with a single read. */
+static sds rdbEncodeVectorBlock(Vector *v) {
+    size_t j, total = 0;
+    sds block;
+
+    for (j = 0; j < v->count; j++) total += sdslen(v->data[j]) + 10;
+    block = sdsMakeRoomFor(sdsempty(),total);
+    for (j = 0; j < v->count; j++)
+        block = blockCatElement(block,v->data[j],sdslen(v->data[j]));
+    return block;
+}
+
+static ssize_t rdbSaveRowGroup(rio *rdb, robj *o) {
+    dictIterator *di = dictGetIterator(o->ptr);
+    dictEntry *de;
+    ssize_t n, nwritten = 0;
+    int location = objGetLocation(o);
+
+    /* A rowgroup in flight to RocksDB is saved as not tiered, tiering it
+     * again after a restart just overwrites the same keys. */
+    if (location == LOCATION_FLUSH) location = LOCATION_REDIS_ONLY;
+    if ((n = rdbSaveType(rdb,location)) == -1) goto werr;
+    nwritten += n;
+    if ((n = rdbSaveLen(rdb,dictSize((dict*)o->ptr))) == -1) goto werr;
+    nwritten += n;
+
+    while((de = dictNext(di)) != NULL) {
+        sds field = dictGetKey(de);
+        robj *vo = dictGetVal(de);
+        Vector *v = vo->ptr;
+        sds block;
+
+        if ((n = rdbSaveRawString(rdb,(unsigned char*)field,
+                sdslen(field))) == -1) goto werr;
+        nwritten += n;
+        if ((n = rdbSaveType(rdb,v->type)) == -1) goto werr;
+        nwritten += n;
+        if ((n = rdbSaveLen(rdb,v->count)) == -1) goto werr;
+        nwritten += n;
+        block = rdbEncodeVectorBlock(v);
+        n = rdbSaveRawString(rdb,(unsigned char*)block,sdslen(block));
+        sdsfree(block);
+        if (n == -1) goto werr;
+        nwritten += n;
+    }
+    dictReleaseIterator(di);
+    return nwritten;
+
+werr:
+    dictReleaseIterator(di);
+    return -1;
+}
+
+static robj *rdbLoadColumnVector(rio *rdb) {
+    int type;
+    uint64_t count, j;
+    size_t blocklen;
+    char *block;
+    const char *p, *end, *ele;
+    size_t elelen;
+    Vector *v;
+    robj *o;
+
+    if ((type = rdbLoadType(rdb)) == -1) return NULL;
+    if ((count = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
+    if ((block = rdbGenericLoadStringObject(rdb,RDB_LOAD_PLAIN,&blocklen))
+        == NULL) return NULL;
+    if (type != STL_TYPE_SDS || count > blocklen)
+        rdbExitReportCorruptRDB("Bad column vector, type %d count %llu",
+            type, (unsigned long long) count);
+
+    v = zmalloc(sizeof(Vector));
+    vectorTypeInitWithSize(v,type,count ? count : INIT_VECTOR_SIZE);
+    p = block;
+    end = block+blocklen;
+    for (j = 0; j < count; j++) {
+        if (blockNextElement(&p,end,&ele,&elelen) == C_ERR)
+            rdbExitReportCorruptRDB("Truncated column vector");
+        vectorAdd(v,sdsnewlen(ele,elelen));
+    }
+    zfree(block);
+
+    o = createObject(OBJ_VECTOR,v);
+    o->lru = (LFUGetTimeInMinutes()<<8) | LFU_INIT_VAL;
+    return o;
+}
+
+static robj *rdbLoadRowGroup(rio *rdb) {
+    int location;
+    uint64_t len;
+    robj *o;
+    dict *d;
+
+    if ((location = rdbLoadType(rdb)) == -1) return NULL;
+    if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
+    o = createDataHashdictFordict();
+    d = o->ptr;
+    if (len) dictExpand(d,len);
+    objSetLocation(o,location == LOCATION_PERSISTED ?
+                     LOCATION_PERSISTED : LOCATION_REDIS_ONLY);
+
+    while (len--) {
+        sds field;
+        robj *vo;
+
+        if ((field = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL))
+            == NULL) {
+            decrRefCount(o);
+            return NULL;
+        }
+        if ((vo = rdbLoadColumnVector(rdb)) == NULL) {
+            sdsfree(field);
+            decrRefCount(o);
+            return NULL;
+        }
+        if (dictAdd(d,field,vo) == DICT_ERR)
+            rdbExitReportCorruptRDB("Duplicate column vector detected");
+    }
+    return o;
+}
+
+/* The Metadict of a DB is saved after RDB_OPCODE_RESIZEDB as the opcode
+ * RDB_OPCODE_METADICT, the number of entries and the entries as key, type
+ * and object. */
+static ssize_t rdbSaveMetadict(rio *rdb, dict *metadict) {
+    dictIterator *di;
+    dictEntry *de;
+    ssize_t n, nwritten = 0;
+
+    if (dictSize(metadict) == 0) return 0;
+    if ((n = rdbSaveType(rdb,RDB_OPCODE_METADICT)) == -1) return -1;
+    nwritten += n;
+    if ((n = rdbSaveLen(rdb,dictSize(metadict))) == -1) return -1;
+    nwritten += n;
+
+    di = dictGetIterator(metadict);
+    while((de = dictNext(di)) != NULL) {
+        sds key = dictGetKey(de);
+        robj *o = dictGetVal(de);
+
+        if ((n = rdbSaveRawString(rdb,(unsigned char*)key,sdslen(key))) == -1)
+            goto werr;
+        nwritten += n;
+        if ((n = rdbSaveObjectType(rdb,o)) == -1) goto werr;
+        nwritten += n;
+        if ((n = rdbSaveObject(rdb,o)) == -1) goto werr;
+        nwritten += n;
+    }
+    dictReleaseIterator(di);
+    return nwritten;
+
+werr:
+    dictReleaseIterator(di);
+    return -1;
+}
+
+/* Load the entries following RDB_OPCODE_METADICT into the Metadict of
+ * 'db', they are only checked if 'db' is NULL. Returns the number of
+ * entries or -1 on error. */
+ssize_t rdbLoadMetadict(rio *rdb, redisDb *db) {
+    uint64_t len, j;
+
+    if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return -1;
+    if (db) dictExpand(db->Metadict,dictSize(db->Metadict)+len);
+    for (j = 0; j < len; j++) {
+        sds key;
+        robj *o;
+        int type;
+
+        if ((key = rdbGenericLoadStringObject(rdb,RDB_LOAD_SDS,NULL)) == NULL)
+            return -1;
+        if ((type = rdbLoadObjectType(rdb)) == -1 ||
+            (o = rdbLoadObject(type,rdb)) == NULL)
+        {
+            sdsfree(key);
+            return -1;
+        }
+        if (db == NULL) {
+            sdsfree(key);
+            decrRefCount(o);
+        } else if (dictAdd(db->Metadict,key,o) == DICT_ERR) {
+            rdbExitReportCorruptRDB("Duplicate Metadict key detected");
+        } else {
+            partitionIndexAdd(db,key,o);
+        }
+    }
+    return len;
+}
+
 ssize_t rdbSaveObject(rio *rdb, robj *o) {
     ssize_t n = 0, nwritten = 0;
 
@@ -763,27 +958,9 @@ ssize_t rdbSaveObject(rio *rdb, robj *o) {
             dictReleaseIterator(di);
         } /*addb*/
         else if (o->encoding == OBJ_ENCODING_REL) {
-            dictIterator *di = dictGetIterator(o->ptr);
-            dictEntry *de;
-
-            if ((n = rdbSaveLen(rdb,dictSize((dict*)o->ptr))) == -1) return -1;
+            if ((n = rdbSaveRowGroup(rdb,o)) == -1) return -1;
             nwritten += n;
-
-            while((de = dictNext(di)) != NULL) {
-                sds field = dictGetKey(de);
-                sds value = dictGetVal(de);
-
-                if ((n = rdbSaveRawString(rdb,(unsigned char*)field,
-                        sdslen(field))) == -1) return -1;
-                nwritten += n;
-                if ((n = rdbSaveRawString(rdb,(unsigned char*)value,
-                        sdslen(value))) == -1) return -1;
-                nwritten += n;
-            }
-            dictReleaseIterator(di);
-        }
-
-        else {
+        } else {
             serverPanic("Unknown hash encoding");
         }
 
@@ -893,6 +1070,11 @@ int rdbSaveInfoAuxFields(rio *rdb, int flags, rdbSaveInfo *rsi) {
     if (rdbSaveAuxFieldStrInt(rdb,"aof-preamble",aof_preamble) == -1) return -1;
     if (rdbSaveAuxFieldStrStr(rdb,"repl-id",server.replid) == -1) return -1;
     if (rdbSaveAuxFieldStrInt(rdb,"repl-offset",server.master_repl_offset) == -1) return -1;
+    /* ADDB: the RocksDB checkpoint taken at the same point of the fork. */
+    if (!aof_preamble && server.rocksdb_checkpoint_pending &&
+        rdbSaveAuxFieldStrStr(rdb,"addb-checkpoint",
+                              server.rocksdb_checkpoint_pending) == -1)
+        return -1;
     return 1;
 }
 
@@ -915,14 +1097,14 @@ int rdbSaveRio(rio *rdb, int *error, int flags, rdbSaveInfo *rsi) {
 
     if (server.rdb_checksum)
         rdb->update_cksum = rioGenericUpdateChecksum;
-    snprintf(magic,sizeof(magic),"REDIS%04d",RDB_VERSION);
+    snprintf(magic,sizeof(magic),"REDIS%04d",RDB_ADDB_VERSION);
     if (rdbWriteRaw(rdb,magic,9) == -1) goto werr;
     if (rdbSaveInfoAuxFields(rdb,flags,rsi) == -1) goto werr;
 
     for (j = 0; j < server.dbnum; j++) {
         redisDb *db = server.db+j;
         dict *d = db->dict;
-        if (dictSize(d) == 0) continue;
+        if (dictSize(d) == 0 && dictSize(db->Metadict) == 0) continue;
         di = dictGetSafeIterator(d);
         if (!di) return C_ERR;
 
@@ -945,6 +1127,9 @@ int rdbSaveRio(rio *rdb, int *error, int flags, rdbSaveInfo *rsi) {
         if (rdbSaveLen(rdb,db_size) == -1) goto werr;
         if (rdbSaveLen(rdb,expires_size) == -1) goto werr;
 
+        /* ADDB: the partition metadata goes before the rowgroups. */
+        if (rdbSaveMetadict(rdb,db->Metadict) == -1) goto werr;
+
         /* Iterate this DB writing every entry */
         while((de = dictNext(di)) != NULL) {
             sds keystr = dictGetKey(de);
@@ -1011,8 +1196,209 @@ werr: /* Write error. */
     return C_ERR;
 }
 
+/* ADDB
+ * RocksDB checkpoints
+ *
+ * With 'rocksdb_checkpoint' enabled, every RDB saved on disk comes with a
+ * checkpoint of the stores of every DB, taken right before the fork (or
+ * the SAVE) in "<rocksdb_checkpoint_dir>/<unix time in ms>/<store>". No
+ * command runs and no tiering completion is handled between the checkpoint
+ * and the fork, so a rowgroup is in the checkpoint if it is not in the RDB.
+ * The path of the checkpoint is the "addb-checkpoint" aux field of the RDB.
+ * Once the RDB is saved the checkpoint of the previous RDB is removed.
+ *
+ * The BGSAVE of a full resync with 'repl_rocksdb_sync' is saved without
+ * one, the stores are checkpointed for the slaves already.
+ *
+ * With 'rocksdb_checkpoint_restore' the stores are replaced at startup by
+ * the checkpoint of the RDB, before they are opened and the RDB is loaded.
+ * A checkpoint which is missing or was created by another node, as the one
+ * of the RDB a slave got from its master, is not restored.
+ *
+ * rdbCheckpointStores() creates the checkpoint 'dir' of every store, it is
+ * also used for the checkpoints sent to the slaves, see replication.c. */
+int rdbCheckpointStores(sds dir) {
+    int j;
+
+    if ((mkdir(server.rocksdb_checkpoint_dir,0755) == -1 && errno != EEXIST) ||
+        mkdir(dir,0755) == -1)
+    {
+        serverLog(LL_WARNING,"Can't create the RocksDB checkpoint %s: %s",
+            dir, strerror(errno));
+        return C_ERR;
+    }
+    for (j = 0; j < server.dbnum; j++) {
+        persistent_store_t *ps = server.db[j].persistent_store;
+        sds path = sdscatprintf(sdsempty(),"%s/%s",dir,ps->dbname);
+        sds err = NULL;
+
+        if (createPersistentStoreCheckpoint(ps,path,&err) == -1) {
+            serverLog(LL_WARNING,"Can't create the RocksDB checkpoint %s: %s",
+                path, err);
+            sdsfree(err);
+            sdsfree(path);
+            removePersistentStoreDir(dir);
+            return C_ERR;
+        }
+        sdsfree(path);
+    }
+    serverLog(LL_NOTICE,"RocksDB checkpoint created in %s",dir);
+    return C_OK;
+}
+
+/* The node owning a checkpoint: a slave loads the RDB of its master, with
+ * the path of a checkpoint of the master, which may even exist on this
+ * host. Two nodes on the same host never share their working directory. */
+static sds rdbCheckpointOwner(void) {
+    char host[256], cwd[MAXPATHLEN];
+
+    if (gethostname(host,sizeof(host)) == -1) host[0] = '\0';
+    host[sizeof(host)-1] = '\0';
+    if (getcwd(cwd,sizeof(cwd)) == NULL) cwd[0] = '\0';
+    return sdscatfmt(sdsempty(),"%s:%s",host,cwd);
+}
+
+static int rdbCreateCheckpoint(void) {
+    sds dir, path, owner;
+    FILE *fp;
+
+    if (!server.rocksdb_checkpoint || server.rocksdb_checkpoint_skip)
+        return C_OK;
+    dir = sdscatprintf(sdsempty(),"%s/%lld",server.rocksdb_checkpoint_dir,
+                       mstime());
+    if (rdbCheckpointStores(dir) == C_ERR) {
+        sdsfree(dir);
+        return C_ERR;
+    }
+    path = sdscatfmt(sdsempty(),"%s/%s",dir,RDB_CHECKPOINT_OWNER);
+    owner = rdbCheckpointOwner();
+    if ((fp = fopen(path,"w")) == NULL ||
+        fwrite(owner,sdslen(owner),1,fp) != 1 || fclose(fp) == EOF)
+    {
+        serverLog(LL_WARNING,"Can't write %s: %s",path,strerror(errno));
+        removePersistentStoreDir(dir);
+        sdsfree(owner);
+        sdsfree(path);
+        sdsfree(dir);
+        return C_ERR;
+    }
+    sdsfree(owner);
+    sdsfree(path);
+    server.rocksdb_checkpoint_pending = dir;
+    return C_OK;
+}
+
+/* Return 1 if the checkpoint 'dir' was created by this node. */
+static int rdbIsOwnCheckpoint(sds dir) {
+    sds path = sdscatfmt(sdsempty(),"%s/%s",dir,RDB_CHECKPOINT_OWNER);
+    sds owner = rdbCheckpointOwner();
+    char buf[MAXPATHLEN+256+2];
+    size_t nread = 0;
+    FILE *fp;
+
+    if ((fp = fopen(path,"r")) != NULL) {
+        nread = fread(buf,1,sizeof(buf),fp);
+        fclose(fp);
+    }
+    sdsfree(path);
+    if (nread != sdslen(owner) || memcmp(buf,owner,nread)) {
+        sdsfree(owner);
+        return 0;
+    }
+    sdsfree(owner);
+    return 1;
+}
+
+/* Called once the RDB was saved on disk, or failed to. */
+static void rdbEndCheckpoint(int ok) {
+    sds pending = server.rocksdb_checkpoint_pending;
+
+    server.rocksdb_checkpoint_pending = NULL;
+    if (!ok) {
+        if (pending) {
+            removePersistentStoreDir(pending);
+            sdsfree(pending);
+        }
+        return;
+    }
+    if (server.rocksdb_checkpoint_saved) {
+        if (removePersistentStoreDir(server.rocksdb_checkpoint_saved) == -1)
+            serverLog(LL_WARNING,"Can't remove the RocksDB checkpoint %s: %s",
+                server.rocksdb_checkpoint_saved, strerror(errno));
+        sdsfree(server.rocksdb_checkpoint_saved);
+    }
+    server.rocksdb_checkpoint_saved = pending;
+}
+
+/* Return the "addb-checkpoint" aux field of the RDB 'filename', or NULL.
+ * The aux fields come right after the RDB version. */
+static sds rdbLoadCheckpointAux(char *filename) {
+    FILE *fp;
+    rio rdb;
+    char buf[9];
+    sds checkpoint = NULL;
+
+    if ((fp = fopen(filename,"r")) == NULL) return NULL;
+    rioInitWithFile(&rdb,fp);
+    if (rioRead(&rdb,buf,9) != 0 && memcmp(buf,"REDIS",5) == 0) {
+        while (rdbLoadType(&rdb) == RDB_OPCODE_AUX) {
+            robj *auxkey, *auxval;
+
+            if ((auxkey = rdbLoadStringObject(&rdb)) == NULL) break;
+            if ((auxval = rdbLoadStringObject(&rdb)) == NULL) {
+                decrRefCount(auxkey);
+                break;
+            }
+            if (!strcasecmp(auxkey->ptr,"addb-checkpoint"))
+                checkpoint = sdsdup(auxval->ptr);
+            decrRefCount(auxkey);
+            decrRefCount(auxval);
+        }
+    }
+    fclose(fp);
+    return checkpoint;
+}
+
+/* Called at startup before the stores are opened. */
+void rdbRestoreCheckpoint(void) {
+    struct stat sb;
+    sds checkpoint;
+    int j;
+
+    if (server.aof_state == AOF_ON) return;
+    if ((checkpoint = rdbLoadCheckpointAux(server.rdb_filename)) == NULL)
+        return;
+    /* Like for the RDB of a slave, the stores are then used as they are. */
+    if (stat(checkpoint,&sb) == -1) {
+        serverLog(LL_WARNING,"The RocksDB checkpoint %s of the RDB is missing, not restoring it",
+            checkpoint);
+        sdsfree(checkpoint);
+        return;
+    }
+    if (!rdbIsOwnCheckpoint(checkpoint)) {
+        serverLog(LL_WARNING,"The RocksDB checkpoint %s of the RDB belongs to another node, not restoring it",
+            checkpoint);
+        sdsfree(checkpoint);
+        return;
+    }
+    server.rocksdb_checkpoint_saved = checkpoint;
+    if (!server.rocksdb_checkpoint_restore) return;
+
+    for (j = 0; j < server.dbnum; j++) {
+        sds err = NULL;
+
+        if (restorePersistentStoreCheckpoint(j,checkpoint,&err) == -1) {
+            serverLog(LL_WARNING,"Can't restore the RocksDB checkpoint %s: %s",
+                checkpoint, err);
+            exit(1);
+        }
+    }
+    serverLog(LL_NOTICE,"RocksDB stores restored from the checkpoint %s",
+        checkpoint);
+}
+
 /* Save the DB on disk. Return C_ERR on error, C_OK on success. */
-int rdbSave(char *filename, rdbSaveInfo *rsi) {
+static int rdbSaveFile(char *filename, rdbSaveInfo *rsi) {
     char tmpfile[256];
     char cwd[MAXPATHLEN]; /* Current working dir path for error messages. */
     FILE *fp;
@@ -1071,6 +1457,16 @@ werr:
     return C_ERR;
 }
 
+/* Save the DB on disk with its RocksDB checkpoint if enabled. */
+int rdbSave(char *filename, rdbSaveInfo *rsi) {
+    int retval;
+
+    if (rdbCreateCheckpoint() == C_ERR) return C_ERR;
+    retval = rdbSaveFile(filename,rsi);
+    rdbEndCheckpoint(retval == C_OK);
+    return retval;
+}
+
 int rdbSaveBackground(char *filename, rdbSaveInfo *rsi) {
     pid_t childpid;
     long long start;
@@ -1079,6 +1475,12 @@ int rdbSaveBackground(char *filename, rdbSaveInfo *rsi) {
 
     server.dirty_before_bgsave = server.dirty;
     server.lastbgsave_try = time(NULL);
+    if (rdbCreateCheckpoint() == C_ERR) {
+        server.lastbgsave_status = C_ERR;
+        return C_ERR;
+    }
+    /* ADDB: FPWRITEs batched before the fork are part of the snapshot. */
+    fpWriteBatchFlush();
     openChildInfoPipe();
 
     start = ustime();
@@ -1088,7 +1490,7 @@ int rdbSaveBackground(char *filename, rdbSaveInfo *rsi) {
         /* Child */
         closeListeningSockets(0);
         redisSetProcTitle("redis-rdb-bgsave");
-        retval = rdbSave(filename,rsi);
+        retval = rdbSaveFile(filename,rsi);
         if (retval == C_OK) {
             size_t private_dirty = zmalloc_get_private_dirty(-1);
 
@@ -1112,6 +1514,7 @@ int rdbSaveBackground(char *filename, rdbSaveInfo *rsi) {
             server.lastbgsave_status = C_ERR;
             serverLog(LL_WARNING,"Can't save in background: fork: %s",
                 strerror(errno));
+            rdbEndCheckpoint(0);
             return C_ERR;
         }
         serverLog(LL_NOTICE,"Background saving started by pid %d",childpid);
@@ -1335,13 +1738,9 @@ robj *rdbLoadObject(int rdbtype, rio *rdb) {
 
         /* All pairs should be read by now */
         serverAssert(len == 0);
-    }
-    /*addb TODO implement later*/
-    else if (o->encoding == OBJ_ENCODING_REL && len > 0){
-
-
-    }
-    else if (rdbtype == RDB_TYPE_LIST_QUICKLIST) {
+    } else if (rdbtype == RDB_TYPE_REL_ROWGROUP) {
+        o = rdbLoadRowGroup(rdb);
+    } else if (rdbtype == RDB_TYPE_LIST_QUICKLIST) {
         if ((len = rdbLoadLen(rdb,NULL)) == RDB_LENERR) return NULL;
         o = createQuicklistObject();
         quicklistSetOptions(o->ptr, server.list_max_ziplist_size,
@@ -1538,7 +1937,7 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
         return C_ERR;
     }
     rdbver = atoi(buf+5);
-    if (rdbver < 1 || rdbver > RDB_VERSION) {
+    if (!rdbIsLoadableVersion(rdbver)) {
         serverLog(LL_WARNING,"Can't handle RDB format version %d",rdbver);
         errno = EINVAL;
         return C_ERR;
@@ -1595,6 +1994,9 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
             dictExpand(db->dict,db_size);
             dictExpand(db->expires,expires_size);
             continue; /* Read type again. */
+        } else if (type == RDB_OPCODE_METADICT) {
+            if (rdbLoadMetadict(rdb,db) == -1) goto eoferr;
+            continue; /* Read type again. */
         } else if (type == RDB_OPCODE_AUX) {
             /* AUX: generic string-string fields. Use to add state to RDB
              * which is backward compatible. Implementations of RDB loading
@@ -1621,6 +2023,10 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
                 }
             } else if (!strcasecmp(auxkey->ptr,"repl-offset")) {
                 if (rsi) rsi->repl_offset = strtoll(auxval->ptr,NULL,10);
+            } else if (!strcasecmp(auxkey->ptr,"addb-checkpoint")) {
+                /* Handled by rdbRestoreCheckpoint() before loading. */
+                serverLog(LL_NOTICE,"RDB RocksDB checkpoint: %s",
+                    (char*)auxval->ptr);
             } else {
                 /* We ignore fields we don't understand, as by AUX field
                  * contract. */
@@ -1647,9 +2053,22 @@ int rdbLoadRio(rio *rdb, rdbSaveInfo *rsi) {
             decrRefCount(val);
             continue;
         }
+        /* ADDB: a rowgroup tiered again since the RDB was saved is read
+         * from RocksDB. */
+        if (val->type == OBJ_HASH && val->encoding == OBJ_ENCODING_REL &&
+            isStaleRowGroup(db,key->ptr))
+        {
+            decrRefCount(key);
+            decrRefCount(val);
+            continue;
+        }
         /* Add the new object in the hash table */
         dbAdd(db,key,val);
 
+        /* ADDB: loaded rowgroups are candidates for tiering again. */
+        if (val->type == OBJ_HASH && val->encoding == OBJ_ENCODING_REL)
+            enqueue(db->EvictQueue,dictFind(db->dict,key->ptr));
+
         /* Set the expire time if needed */
         if (expiretime != -1) setExpire(NULL,db,key,expiretime);
 
@@ -1723,6 +2142,7 @@ void backgroundSaveDoneHandlerDisk(int exitcode, int bysignal) {
         if (bysignal != SIGUSR1)
             server.lastbgsave_status = C_ERR;
     }
+    rdbEndCheckpoint(!bysignal && exitcode == 0);
     server.rdb_child_pid = -1;
     server.rdb_child_type = RDB_CHILD_TYPE_NONE;
     server.rdb_save_time_last = time(NULL)-server.rdb_save_time_start;
@@ -1888,7 +2308,9 @@ int rdbSaveToSlavesSockets(rdbSaveInfo *rsi) {
         }
     }
 
-    /* Create the child process. */
+    /* Create the child process. ADDB: FPWRITEs batched before the fork
+     * are part of the snapshot. */
+    fpWriteBatchFlush();
     openChildInfoPipe();
     start = ustime();
     if ((childpid = fork()) == 0) {
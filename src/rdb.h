@@ -40,6 +40,19 @@
  * backward compatible this number gets incremented. */
 #define RDB_VERSION 8
 
+/* ADDB: the files and DUMP payloads written by ADDB use type 15 and opcode
+ * 249, which are RDB_TYPE_STREAM_LISTPACKS and RDB_OPCODE_MODULE_AUX in the
+ * RDB versions of Redis 5 and later. They carry this version instead of
+ * RDB_VERSION, so that Redis refuses them as a version it can't handle
+ * instead of misreading them. The format is RDB_VERSION with the ADDB types
+ * and opcodes. Files of versions up to RDB_VERSION are still loaded. */
+#define RDB_ADDB_VERSION 1008
+#define rdbIsLoadableVersion(v) \
+    (((v) >= 1 && (v) <= RDB_VERSION) || (v) == RDB_ADDB_VERSION)
+
+/* ADDB: file of an RDB checkpoint naming the node which created it. */
+#define RDB_CHECKPOINT_OWNER "OWNER"
+
 /* Defines related to the dump file format. To store 32 bits lengths for short
  * keys requires a lot of space, so we check the most significant 2 bits of
  * the first byte to interpreter the length:
@@ -89,12 +102,15 @@
 #define RDB_TYPE_ZSET_ZIPLIST  12
 #define RDB_TYPE_HASH_ZIPLIST  13
 #define RDB_TYPE_LIST_QUICKLIST 14
+/* ADDB: rowgroup of column vectors (OBJ_HASH with OBJ_ENCODING_REL). */
+#define RDB_TYPE_REL_ROWGROUP  15
 /* NOTE: WHEN ADDING NEW RDB TYPE, UPDATE rdbIsObjectType() BELOW */
 
 /* Test if a type is an object type. */
-#define rdbIsObjectType(t) ((t >= 0 && t <= 7) || (t >= 9 && t <= 14))
+#define rdbIsObjectType(t) ((t >= 0 && t <= 7) || (t >= 9 && t <= 15))
 
 /* Special RDB opcodes (saved/loaded with rdbSaveType/rdbLoadType). */
+#define RDB_OPCODE_METADICT   249   /* ADDB: partition metadata of a DB. */
 #define RDB_OPCODE_AUX        250
 #define RDB_OPCODE_RESIZEDB   251
 #define RDB_OPCODE_EXPIRETIME_MS 252
@@ -130,12 +146,15 @@ int rdbSaveObjectType(rio *rdb, robj *o);
 int rdbLoadObjectType(rio *rdb);
 int rdbLoad(char *filename, rdbSaveInfo *rsi);
 int rdbSaveBackground(char *filename, rdbSaveInfo *rsi);
+void rdbRestoreCheckpoint(void);
+int rdbCheckpointStores(sds dir);
 int rdbSaveToSlavesSockets(rdbSaveInfo *rsi);
 void rdbRemoveTempFile(pid_t childpid);
 int rdbSave(char *filename, rdbSaveInfo *rsi);
 ssize_t rdbSaveObject(rio *rdb, robj *o);
 size_t rdbSavedObjectLen(robj *o);
 robj *rdbLoadObject(int type, rio *rdb);
+ssize_t rdbLoadMetadict(rio *rdb, redisDb *db);
 void backgroundSaveDoneHandler(int exitcode, int bysignal);
 int rdbSaveKeyValuePair(rio *rdb, robj *key, robj *val, long long expiretime, long long now);
 robj *rdbLoadStringObject(rio *rdb);
@@ -85,7 +85,8 @@ char *rdb_type_string[] = {
     "set-intset",
     "zset-ziplist",
     "hash-ziplist",
-    "quicklist"
+    "quicklist",
+    "rel-rowgroup"
 };
 
 /* Show a few stats collected into 'rdbstate' */
@@ -196,7 +197,7 @@ int redis_check_rdb(char *rdbfilename, FILE *fp) {
         return 1;
     }
     rdbver = atoi(buf+5);
-    if (rdbver < 1 || rdbver > RDB_VERSION) {
+    if (!rdbIsLoadableVersion(rdbver)) {
         rdbCheckError("Can't handle RDB format version %d",rdbver);
         return 1;
     }
@@ -251,6 +252,13 @@ int redis_check_rdb(char *rdbfilename, FILE *fp) {
             if ((expires_size = rdbLoadLen(&rdb,NULL)) == RDB_LENERR)
                 goto eoferr;
             continue; /* Read type again. */
+        } else if (type == RDB_OPCODE_METADICT) {
+            ssize_t metakeys;
+
+            rdbstate.doing = RDB_CHECK_DOING_READ_OBJECT_VALUE;
+            if ((metakeys = rdbLoadMetadict(&rdb,NULL)) == -1) goto eoferr;
+            rdbCheckInfo("Metadict of %zd keys", metakeys);
+            continue; /* Read type again. */
         } else if (type == RDB_OPCODE_AUX) {
             /* AUX: generic string-string fields. Use to add state to RDB
              * which is backward compatible. Implementations of RDB loading
@@ -930,6 +930,15 @@ class RedisTrib
             target.r.cluster("setslot",slot,"importing",source.info[:name])
             source.r.cluster("setslot",slot,"migrating",target.info[:name])
         end
+        # Move the relational partitions of the slot, with their tiered
+        # rowgroups, before the keys MIGRATE knows about.
+        begin
+            source.r.client.call(["fpmigrate",target.info[:host],target.info[:port],slot,@timeout])
+        rescue => e
+            puts ""
+            xputs "[ERR] Calling FPMIGRATE: #{e}"
+            exit 1
+        end
         # Migrate all the keys from source to target using the MIGRATE command
         while true
             keys = source.r.cluster("getkeysinslot",slot,o[:pipeline])
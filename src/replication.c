@@ -30,18 +30,22 @@
 
 
 #include "server.h"
+#include "tiering.h"
 
 #include <sys/time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <dirent.h>
 
 void replicationDiscardCachedMaster(void);
 void replicationResurrectCachedMaster(int newfd);
 void replicationSendAck(void);
 void putSlaveOnline(client *slave);
 int cancelReplicationHandshake(void);
+static int slaveFetchStores(sds *checkpoint);
+static void slaveReplaceStores(sds dir);
 
 /* --------------------------- Utility functions ---------------------------- */
 
@@ -542,6 +546,297 @@ need_full_resync:
     return C_ERR;
 }
 
+/* ----------------------- ADDB: RocksDB stores sync -------------------------
+ *
+ * The RDB of a full resynchronization only carries the DRAM tier, so the
+ * rowgroups tiered to RocksDB are shipped as a checkpoint of the stores:
+ *
+ * 1) When the BGSAVE for replication starts, the tiering pool is drained
+ *    and every store is checkpointed in "repl-<replid>-<offset>" under
+ *    rocksdb_checkpoint_dir, with the replication ID and offset of the
+ *    FULLRESYNC reply. Nothing runs between the checkpoint and the fork,
+ *    so the checkpoint and the RDB are the same snapshot.
+ * 2) Once the RDB is received, the slave opens a second connection to the
+ *    master, authenticated with masterauth, lists the files of the
+ *    checkpoint with ROCKSDBSYNC LIST and fetches them in chunks with
+ *    ROCKSDBSYNC READ, see slaveFetchStores().
+ * 3) The slave replaces its stores by the fetched checkpoint and loads the
+ *    RDB, whose Metadict describes the rowgroups of the checkpoint.
+ *
+ * After the sync the tiering decisions of the master are replicated with
+ * FPTIER (see fptierCommand()), so the stores of the slave follow the ones
+ * of the master: the slave serves scans of cold data and keeps them when
+ * it is promoted.
+ *
+ * A checkpoint is removed once no slave waits for its RDB and no
+ * ROCKSDBSYNC used it for repl-timeout seconds. */
+
+#define REPL_ROCKSDB_CHECKPOINT_PREFIX "repl-"
+#define REPL_ROCKSDB_MAX_CHUNK (4*1024*1024)
+
+typedef struct replCheckpoint {
+    sds name;           /* repl-<replid>-<offset> */
+    sds dir;
+    long long offset;   /* psync_initial_offset of the slaves using it */
+    time_t last_use;
+} replCheckpoint;
+
+static list *replCheckpoints = NULL;
+
+static void freeReplCheckpoint(void *ptr) {
+    replCheckpoint *cp = ptr;
+
+    if (removePersistentStoreDir(cp->dir) == -1)
+        serverLog(LL_WARNING,"Can't remove the RocksDB checkpoint %s: %s",
+            cp->dir, strerror(errno));
+    sdsfree(cp->name);
+    sdsfree(cp->dir);
+    zfree(cp);
+}
+
+static replCheckpoint *replicationFindCheckpoint(const char *name) {
+    listIter li;
+    listNode *ln;
+
+    if (replCheckpoints == NULL) return NULL;
+    listRewind(replCheckpoints,&li);
+    while((ln = listNext(&li))) {
+        replCheckpoint *cp = ln->value;
+        if (!strcmp(cp->name,name)) return cp;
+    }
+    return NULL;
+}
+
+/* Remove the checkpoints left by a previous run, their replication ID
+ * can't be used anymore. */
+static void replicationRemoveStaleCheckpoints(void) {
+    struct dirent *de;
+    DIR *d;
+
+    if ((d = opendir(server.rocksdb_checkpoint_dir)) == NULL) return;
+    while ((de = readdir(d)) != NULL) {
+        if (strncmp(de->d_name,REPL_ROCKSDB_CHECKPOINT_PREFIX,
+                    strlen(REPL_ROCKSDB_CHECKPOINT_PREFIX))) continue;
+        sds dir = sdscatfmt(sdsempty(),"%s/%s",server.rocksdb_checkpoint_dir,
+                            de->d_name);
+        removePersistentStoreDir(dir);
+        sdsfree(dir);
+    }
+    closedir(d);
+}
+
+/* Checkpoint the stores for the full resync starting at 'offset'. The
+ * slaves attached to the same BGSAVE share the checkpoint. Returns C_ERR
+ * if the stores can't be checkpointed, the slaves can't be served by the
+ * RDB alone. */
+static int replicationCreateCheckpoint(long long offset) {
+    replCheckpoint *cp;
+    sds name;
+
+    if (!server.repl_rocksdb_sync) return C_OK;
+    if (replCheckpoints == NULL) {
+        replCheckpoints = listCreate();
+        listSetFreeMethod(replCheckpoints,freeReplCheckpoint);
+        replicationRemoveStaleCheckpoints();
+    }
+
+    name = sdscatprintf(sdsempty(),"%s%s-%lld",REPL_ROCKSDB_CHECKPOINT_PREFIX,
+                        server.replid,offset);
+    if ((cp = replicationFindCheckpoint(name)) != NULL) {
+        cp->last_use = server.unixtime;
+        sdsfree(name);
+        return C_OK;
+    }
+
+    /* The rowgroups in flight are saved in the RDB as not tiered, while
+     * the FPTIER moving them to RocksDB was already propagated. */
+    tieringWaitIdle();
+
+    cp = zmalloc(sizeof(*cp));
+    cp->name = name;
+    cp->dir = sdscatfmt(sdsempty(),"%s/%s",server.rocksdb_checkpoint_dir,name);
+    cp->offset = offset;
+    cp->last_use = server.unixtime;
+    if (rdbCheckpointStores(cp->dir) == C_ERR) {
+        sdsfree(cp->name);
+        sdsfree(cp->dir);
+        zfree(cp);
+        return C_ERR;
+    }
+    listAddNodeTail(replCheckpoints,cp);
+    return C_OK;
+}
+
+/* Called by replicationCron(). */
+static void replicationExpireCheckpoints(void) {
+    listIter li, sli;
+    listNode *ln, *sln;
+
+    if (replCheckpoints == NULL) return;
+    listRewind(replCheckpoints,&li);
+    while((ln = listNext(&li))) {
+        replCheckpoint *cp = ln->value;
+
+        listRewind(server.slaves,&sli);
+        while((sln = listNext(&sli))) {
+            client *slave = sln->value;
+
+            if ((slave->replstate == SLAVE_STATE_WAIT_BGSAVE_END ||
+                 slave->replstate == SLAVE_STATE_SEND_BULK) &&
+                slave->psync_initial_offset == cp->offset)
+            {
+                cp->last_use = server.unixtime;
+            }
+        }
+        if (server.unixtime - cp->last_use > server.repl_timeout) {
+            serverLog(LL_NOTICE,"Removing the RocksDB checkpoint %s",cp->dir);
+            listDelNode(replCheckpoints,ln);
+        }
+    }
+}
+
+/* Return 1 if 'path' is a "<store>/<file>" path of a checkpoint. */
+static int replicationIsCheckpointFile(const char *path) {
+    const char *file = strchr(path,'/');
+    int j;
+
+    if (file == NULL || file[1] == '\0' || file[1] == '.' ||
+        strchr(file+1,'/') != NULL) return 0;
+    for (j = 0; j < server.dbnum; j++) {
+        char *store = server.db[j].persistent_store->dbname;
+        if (strlen(store) == (size_t)(file-path) &&
+            !memcmp(store,path,file-path)) return 1;
+    }
+    return 0;
+}
+
+/* Return the fingerprint prefix of the files of 'store' in 'cp': the
+ * IDENTITY of the store, which is unique to the store and not part of its
+ * checkpoints. If it can't be read the checkpoint name is used, so the
+ * files are only reused within the same checkpoint. */
+static sds replicationStoreIdentity(replCheckpoint *cp, char *store) {
+    sds path = sdscatfmt(sdsempty(),"%s/IDENTITY",store);
+    sds identity = sdsempty();
+    char buf[128];
+    ssize_t len = -1;
+    int fd;
+
+    if ((fd = open(path,O_RDONLY)) != -1) {
+        len = read(fd,buf,sizeof(buf));
+        close(fd);
+    }
+    if (len > 0) identity = sdscatlen(identity,buf,len);
+    sdstrim(identity," \t\r\n");
+    if (sdslen(identity) == 0 || strchr(identity,' ') != NULL) {
+        sdsfree(identity);
+        identity = sdsdup(cp->name);
+    }
+    sdsfree(path);
+    return identity;
+}
+
+/* ROCKSDBSYNC LIST <checkpoint>
+ * ROCKSDBSYNC READ <checkpoint> <store>/<file> <offset> <count>
+ *
+ * Used by the slaves to fetch the checkpoint of their full resync. LIST
+ * replies with the path, the size and the fingerprint of every file, READ
+ * with at most <count> bytes of the file starting at <offset>.
+ *
+ * The fingerprint is "<store identity>:<file>". RocksDB never reuses a
+ * file number within a store and never rewrites an SST file, so two SST
+ * files with the same fingerprint have the same content. */
+void rocksdbsyncCommand(client *c) {
+    replCheckpoint *cp;
+
+    /* No checkpoint was taken for the RDB: tell the slave to load it
+     * alone rather than to retry the sync. */
+    if (!server.repl_rocksdb_sync) {
+        addReplySds(c,sdsnew("-NOROCKSDBSYNC RocksDB sync is disabled on this master\r\n"));
+        return;
+    }
+    if ((cp = replicationFindCheckpoint(c->argv[2]->ptr)) == NULL) {
+        addReplyError(c,"No such RocksDB checkpoint");
+        return;
+    }
+    cp->last_use = server.unixtime;
+
+    if (!strcasecmp(c->argv[1]->ptr,"list") && c->argc == 3) {
+        void *replylen = addDeferredMultiBulkLength(c);
+        long files = 0;
+        int j;
+
+        for (j = 0; j < server.dbnum; j++) {
+            char *store = server.db[j].persistent_store->dbname;
+            sds dir = sdscatfmt(sdsempty(),"%s/%s",cp->dir,store);
+            sds identity = replicationStoreIdentity(cp,store);
+            struct dirent *de;
+            struct stat sb;
+            DIR *d;
+
+            if ((d = opendir(dir)) != NULL) {
+                while ((de = readdir(d)) != NULL) {
+                    sds path = sdscatfmt(sdsempty(),"%s/%s",dir,de->d_name);
+
+                    if (de->d_name[0] != '.' && stat(path,&sb) == 0 &&
+                        S_ISREG(sb.st_mode))
+                    {
+                        sdsfree(path);
+                        path = sdscatfmt(sdsempty(),"%s/%s",store,de->d_name);
+                        addReplyBulkCBuffer(c,path,sdslen(path));
+                        addReplyLongLong(c,sb.st_size);
+                        sdsclear(path);
+                        path = sdscatfmt(path,"%s:%s",identity,de->d_name);
+                        addReplyBulkCBuffer(c,path,sdslen(path));
+                        files++;
+                    }
+                    sdsfree(path);
+                }
+                closedir(d);
+            }
+            sdsfree(identity);
+            sdsfree(dir);
+        }
+        setDeferredMultiBulkLength(c,replylen,files*3);
+    } else if (!strcasecmp(c->argv[1]->ptr,"read") && c->argc == 6) {
+        long long offset, count;
+        sds path, buf;
+        ssize_t nread;
+        int fd;
+
+        if (getLongLongFromObjectOrReply(c,c->argv[4],&offset,NULL) != C_OK ||
+            getLongLongFromObjectOrReply(c,c->argv[5],&count,NULL) != C_OK)
+            return;
+        if (!replicationIsCheckpointFile(c->argv[3]->ptr) || offset < 0 ||
+            count <= 0)
+        {
+            addReplyError(c,"Invalid RocksDB checkpoint file or range");
+            return;
+        }
+        if (count > REPL_ROCKSDB_MAX_CHUNK) count = REPL_ROCKSDB_MAX_CHUNK;
+
+        path = sdscatfmt(sdsempty(),"%s/%s",cp->dir,(char*)c->argv[3]->ptr);
+        fd = open(path,O_RDONLY);
+        sdsfree(path);
+        if (fd == -1) {
+            addReplyErrorFormat(c,"Can't open %s: %s",
+                (char*)c->argv[3]->ptr, strerror(errno));
+            return;
+        }
+        buf = sdsnewlen(NULL,count);
+        nread = pread(fd,buf,count,offset);
+        close(fd);
+        if (nread == -1) {
+            addReplyErrorFormat(c,"Can't read %s: %s",
+                (char*)c->argv[3]->ptr, strerror(errno));
+        } else {
+            addReplyBulkCBuffer(c,buf,nread);
+        }
+        sdsfree(buf);
+    } else {
+        addReply(c,shared.syntaxerr);
+    }
+}
+
 /* Start a BGSAVE for replication goals, which is, selecting the disk or
  * socket target depending on the configuration, and making sure that
  * the script cache is flushed before to start.
@@ -577,10 +872,18 @@ int startBgsaveForReplication(int mincapa) {
      * no way to send SELECT commands. */
     if (server.master) rsi.repl_stream_db = server.master->db->id;
 
-    if (socket_target)
+    /* ADDB: FPWRITEs batched before the checkpoint are part of it. */
+    fpWriteBatchFlush();
+    if (replicationCreateCheckpoint(getPsyncInitialOffset()) == C_ERR)
+        retval = C_ERR;
+    else if (socket_target)
         retval = rdbSaveToSlavesSockets(&rsi);
-    else
+    else {
+        /* The checkpoint of the slaves is the one of this RDB already. */
+        server.rocksdb_checkpoint_skip = server.repl_rocksdb_sync;
         retval = rdbSaveBackground(server.rdb_filename,&rsi);
+        server.rocksdb_checkpoint_skip = 0;
+    }
 
     /* If we failed to BGSAVE, remove the slaves waiting for a full
      * resynchorinization from the list of salves, inform them with
@@ -1106,6 +1409,7 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
     char buf[4096];
     ssize_t nread, readlen;
     off_t left;
+    int j;
     UNUSED(el);
     UNUSED(privdata);
     UNUSED(mask);
@@ -1242,12 +1546,23 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
 
     if (eof_reached) {
         int aof_is_enabled = server.aof_state != AOF_OFF;
+        sds checkpoint;
 
         if (rename(server.repl_transfer_tmpfile,server.rdb_filename) == -1) {
             serverLog(LL_WARNING,"Failed trying to rename the temp DB into dump.rdb in MASTER <-> SLAVE synchronization: %s", strerror(errno));
             cancelReplicationHandshake();
             return;
         }
+        /* Before fetching the RocksDB checkpoint and loading the DB into
+         * memory we need to delete the readable handler, otherwise it will
+         * get called recursively since both call the event loop to process
+         * events from time to time. */
+        aeDeleteFileEvent(server.el,server.repl_transfer_s,AE_READABLE);
+        if (slaveFetchStores(&checkpoint) == C_ERR) {
+            serverLog(LL_WARNING,"Failed trying to fetch the RocksDB stores of the MASTER, retrying the synchronization");
+            cancelReplicationHandshake();
+            return;
+        }
         serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Flushing old data");
         /* We need to stop any AOFRW fork before flusing and parsing
          * RDB, otherwise we'll create a copy-on-write disaster. */
@@ -1257,11 +1572,15 @@ void readSyncBulkPayload(aeEventLoop *el, int fd, void *privdata, int mask) {
             -1,
             server.repl_slave_lazy_flush ? EMPTYDB_ASYNC : EMPTYDB_NO_FLAGS,
             replicationEmptyDbCallback);
-        /* Before loading the DB into memory we need to delete the readable
-         * handler, otherwise it will get called recursively since
-         * rdbLoad() will call the event loop to process events from time to
-         * time for non blocking loading. */
-        aeDeleteFileEvent(server.el,server.repl_transfer_s,AE_READABLE);
+        if (checkpoint) {
+            slaveReplaceStores(checkpoint);
+            sdsfree(checkpoint);
+        } else {
+            /* The rowgroups tiered by this replica are not part of the new
+             * data set. */
+            for (j = 0; j < server.dbnum; j++)
+                flushRowGroupMeta(&server.db[j]);
+        }
         serverLog(LL_NOTICE, "MASTER <-> SLAVE sync: Loading DB in memory");
         rdbSaveInfo rsi = RDB_SAVE_INFO_INIT;
         if (rdbLoad(server.rdb_filename,&rsi) != C_OK) {
@@ -1358,6 +1677,403 @@ char *sendSynchronousCommand(int flags, int fd, ...) {
     return NULL;
 }
 
+/* ----------------------- ADDB: RocksDB stores sync -------------------------
+ * Slave side, see replicationCreateCheckpoint() for the master side.
+ *
+ * The checkpoint is fetched in "<rocksdb_checkpoint_dir>/slave-sync", which
+ * is kept after the sync: the stores are restored from it with hard links,
+ * so the SST files of the next sync which are already there don't cost a
+ * transfer. The fingerprints listed by the master for the staged files are
+ * kept in "slave-sync/FINGERPRINTS", and a staged file is only kept when
+ * its fingerprint didn't change, see rocksdbsyncCommand(). A kept SST file
+ * of the right size is reused and a shorter one is resumed. The other files
+ * are small and fetched again every time. */
+
+#define SLAVE_ROCKSDB_STAGING "slave-sync"
+#define SLAVE_ROCKSDB_FINGERPRINTS "FINGERPRINTS"
+
+/* Read a reply line starting with 'type' and return the number following
+ * it, or -1 on error. */
+static long long slaveReadReplyNumber(int fd, char type) {
+    char buf[256];
+
+    if (syncReadLine(fd,buf,sizeof(buf),server.repl_syncio_timeout*1000) == -1)
+    {
+        serverLog(LL_WARNING,"I/O error reading ROCKSDBSYNC reply: %s",
+            strerror(errno));
+        return -1;
+    }
+    if (buf[0] != type) {
+        serverLog(LL_WARNING,"Unexpected ROCKSDBSYNC reply from MASTER: %s",
+            buf);
+        return -1;
+    }
+    return strtoll(buf+1,NULL,10);
+}
+
+/* Called while the checkpoint is fetched. The clients are served with
+ * -LOADING and the master, which considers our RDB delivered, gets an ACK
+ * every second so that it doesn't time us out. */
+static void slaveFetchProgress(off_t fetched, time_t *lastack) {
+    updateCachedTime();
+    loadingProgress(fetched);
+    if (*lastack != server.unixtime) {
+        char ack[64];
+        int len = snprintf(ack,sizeof(ack),"REPLCONF ACK %lld\r\n",
+                           server.master_initial_offset);
+
+        syncWrite(server.repl_transfer_s,ack,len,
+                  server.repl_syncio_timeout*1000);
+        *lastack = server.unixtime;
+    }
+    processEventsWhileBlocked();
+}
+
+/* Remove from the staging directory the files which are not part of the
+ * checkpoint or whose fingerprint changed, then record the fingerprints of
+ * the checkpoint. 'files' maps the path of every file of the checkpoint to
+ * its fingerprint. */
+static int slavePrepareStaging(sds staging, dict *files) {
+    sds manifest = sdscatfmt(sdsempty(),"%s/%s",staging,
+                             SLAVE_ROCKSDB_FINGERPRINTS);
+    dict *kept = dictCreate(&setDictType,NULL);
+    dictIterator *di;
+    dictEntry *entry;
+    char buf[1024];
+    FILE *fp;
+    int j, retval = C_ERR;
+
+    if ((fp = fopen(manifest,"r")) != NULL) {
+        while (fgets(buf,sizeof(buf),fp) != NULL) {
+            char *fingerprint = strchr(buf,' ');
+            sds path;
+
+            if (fingerprint == NULL) continue;
+            *fingerprint++ = '\0';
+            fingerprint[strcspn(fingerprint,"\r\n")] = '\0';
+            path = sdsnew(buf);
+            entry = dictFind(files,path);
+            if (entry && !strcmp(dictGetVal(entry),fingerprint) &&
+                dictAdd(kept,path,NULL) == DICT_OK) continue;
+            sdsfree(path);
+        }
+        fclose(fp);
+    }
+    if ((mkdir(server.rocksdb_checkpoint_dir,0755) == -1 && errno != EEXIST) ||
+        (mkdir(staging,0755) == -1 && errno != EEXIST))
+        goto cleanup;
+
+    for (j = 0; j < server.dbnum; j++) {
+        char *store = server.db[j].persistent_store->dbname;
+        sds dir = sdscatfmt(sdsempty(),"%s/%s",staging,store);
+        struct dirent *de;
+        DIR *d;
+
+        if (mkdir(dir,0755) == -1 && errno != EEXIST) {
+            sdsfree(dir);
+            goto cleanup;
+        }
+        if ((d = opendir(dir)) != NULL) {
+            while ((de = readdir(d)) != NULL) {
+                sds path = sdscatfmt(sdsempty(),"%s/%s",store,de->d_name);
+
+                if (de->d_name[0] != '.' && dictFind(kept,path) == NULL) {
+                    sds file = sdscatfmt(sdsempty(),"%s/%s",dir,de->d_name);
+                    unlink(file);
+                    sdsfree(file);
+                }
+                sdsfree(path);
+            }
+            closedir(d);
+        }
+        sdsfree(dir);
+    }
+
+    /* Written before any file is fetched, so a file left by an interrupted
+     * sync is always described by the manifest. */
+    if ((fp = fopen(manifest,"w")) == NULL) goto cleanup;
+    di = dictGetIterator(files);
+    while((entry = dictNext(di)) != NULL)
+        fprintf(fp,"%s %s\n",(char*)dictGetKey(entry),(char*)dictGetVal(entry));
+    dictReleaseIterator(di);
+    if (fflush(fp) == EOF || fsync(fileno(fp)) == -1) {
+        fclose(fp);
+        goto cleanup;
+    }
+    if (fclose(fp) == EOF) goto cleanup;
+    retval = C_OK;
+
+cleanup:
+    if (retval == C_ERR)
+        serverLog(LL_WARNING,"Can't prepare %s for the RocksDB sync: %s",
+            staging, strerror(errno));
+    dictRelease(kept);
+    sdsfree(manifest);
+    return retval;
+}
+
+/* Fetch the file 'path' of 'size' bytes of the checkpoint 'name' in
+ * 'staging'. Returns the number of bytes which were already there, or -1
+ * on error. */
+static long long slaveFetchFile(int fd, char *name, char *path, long long size,
+                          sds staging, char *chunk, off_t *fetched,
+                          time_t *lastack)
+{
+    sds local = sdscatfmt(sdsempty(),"%s/%s",staging,path);
+    size_t pathlen = strlen(path);
+    long long offset = 0, reused, retval = -1;
+    struct stat sb;
+    int out = -1;
+
+    if (pathlen > 4 && !strcmp(path+pathlen-4,".sst") &&
+        stat(local,&sb) == 0 && sb.st_size <= size)
+    {
+        offset = sb.st_size;
+        *fetched += offset;
+    }
+    reused = offset;
+    if (offset == size) {
+        retval = reused;
+        goto cleanup;
+    }
+    if ((out = open(local,O_WRONLY|O_CREAT|(offset ? 0 : O_TRUNC),0644)) == -1) {
+        serverLog(LL_WARNING,"Can't open %s: %s",local,strerror(errno));
+        goto cleanup;
+    }
+
+    while (offset < size) {
+        char off[32], count[32];
+        long long len = size - offset;
+        char *err;
+
+        if (len > REPL_ROCKSDB_MAX_CHUNK) len = REPL_ROCKSDB_MAX_CHUNK;
+        ll2string(off,sizeof(off),offset);
+        ll2string(count,sizeof(count),len);
+        err = sendSynchronousCommand(SYNC_CMD_WRITE,fd,"ROCKSDBSYNC","READ",
+                                     name,path,off,count,NULL);
+        if (err) {
+            serverLog(LL_WARNING,"%s",err+1);
+            sdsfree(err);
+            goto cleanup;
+        }
+        if ((len = slaveReadReplyNumber(fd,'$')) <= 0) goto cleanup;
+        if (len > REPL_ROCKSDB_MAX_CHUNK ||
+            syncRead(fd,chunk,len+2,server.repl_syncio_timeout*1000) != len+2)
+        {
+            serverLog(LL_WARNING,"I/O error reading %s from MASTER",path);
+            goto cleanup;
+        }
+        if (pwrite(out,chunk,len,offset) != len) {
+            serverLog(LL_WARNING,"Can't write %s: %s",local,strerror(errno));
+            goto cleanup;
+        }
+        offset += len;
+        *fetched += len;
+        slaveFetchProgress(*fetched,lastack);
+    }
+    if (fsync(out) == -1) {
+        serverLog(LL_WARNING,"Can't fsync %s: %s",local,strerror(errno));
+        goto cleanup;
+    }
+    retval = reused;
+
+cleanup:
+    if (out != -1) close(out);
+    sdsfree(local);
+    return retval;
+}
+
+/* Read a bulk string reply of at most 'size'-1 bytes into 'buf'. Returns
+ * C_ERR on error. */
+static int slaveReadReplyBulk(int fd, char *buf, size_t size) {
+    long long len = slaveReadReplyNumber(fd,'$');
+
+    if (len < 0 || len >= (long long)size ||
+        syncReadLine(fd,buf,size,server.repl_syncio_timeout*1000) == -1 ||
+        strlen(buf) != (size_t)len)
+        return C_ERR;
+    return C_OK;
+}
+
+/* Fetch the checkpoint of the full resync in progress from the master.
+ * On success '*checkpoint' is set to the directory of the checkpoint, or
+ * to NULL if repl_rocksdb_sync is off here or on the master. Returns C_ERR if the checkpoint
+ * can't be fetched: the RDB alone doesn't describe the data set of the
+ * master, so the sync has to be started again. */
+static int slaveFetchStores(sds *checkpoint) {
+    sds name = NULL, staging = NULL, *paths = NULL, *fingerprints = NULL;
+    long long *sizes = NULL, total = 0, reused = 0, n = 0, i;
+    dict *files = dictCreate(&setDictType,NULL);
+    char *chunk = NULL;
+    off_t fetched = 0;
+    time_t lastack = 0;
+    int fd, j, ok = 0, disabled = 0;
+
+    *checkpoint = NULL;
+    if (!server.repl_rocksdb_sync) {
+        dictRelease(files);
+        return C_OK;
+    }
+    name = sdscatprintf(sdsempty(),"%s%s-%lld",REPL_ROCKSDB_CHECKPOINT_PREFIX,
+                        server.master_replid,server.master_initial_offset);
+    staging = sdscatfmt(sdsempty(),"%s/%s",server.rocksdb_checkpoint_dir,
+                        SLAVE_ROCKSDB_STAGING);
+
+    fd = anetTcpNonBlockConnect(NULL,server.masterhost,server.masterport);
+    if (fd == -1 || !(aeWait(fd,AE_WRITABLE,server.repl_syncio_timeout*1000) &
+                      AE_WRITABLE))
+    {
+        serverLog(LL_WARNING,"Unable to connect to MASTER for the RocksDB sync");
+        goto cleanup;
+    }
+    if (server.masterauth) {
+        char *err = sendSynchronousCommand(SYNC_CMD_FULL,fd,"AUTH",
+                                           server.masterauth,NULL);
+        if (err[0] == '-') {
+            serverLog(LL_WARNING,"Unable to AUTH to MASTER for the RocksDB sync: %s",
+                err);
+            sdsfree(err);
+            goto cleanup;
+        }
+        sdsfree(err);
+    }
+
+    /* List the files of the checkpoint. */
+    {
+        char *err = sendSynchronousCommand(SYNC_CMD_WRITE,fd,"ROCKSDBSYNC",
+                                           "LIST",name,NULL);
+        if (err) {
+            serverLog(LL_WARNING,"%s",err+1);
+            sdsfree(err);
+            goto cleanup;
+        }
+    }
+    {
+        char buf[256];
+
+        if (syncReadLine(fd,buf,sizeof(buf),
+                         server.repl_syncio_timeout*1000) == -1)
+        {
+            serverLog(LL_WARNING,"I/O error reading ROCKSDBSYNC reply: %s",
+                strerror(errno));
+            goto cleanup;
+        }
+        /* The master doesn't checkpoint its stores, its RDB is all we
+         * get: load it like with repl_rocksdb_sync off. */
+        if (!strncmp(buf,"-NOROCKSDBSYNC",14)) {
+            serverLog(LL_WARNING,
+                "MASTER has repl_rocksdb_sync disabled, loading its RDB without the RocksDB stores");
+            disabled = 1;
+            goto cleanup;
+        }
+        if (buf[0] != '*') {
+            serverLog(LL_WARNING,"Unexpected ROCKSDBSYNC reply from MASTER: %s",
+                buf);
+            goto cleanup;
+        }
+        if ((n = strtoll(buf+1,NULL,10)) < 0 || n % 3) goto cleanup;
+    }
+    n /= 3;
+    paths = zcalloc(sizeof(sds)*(n ? n : 1));
+    fingerprints = zcalloc(sizeof(sds)*(n ? n : 1));
+    sizes = zmalloc(sizeof(long long)*(n ? n : 1));
+    for (i = 0; i < n; i++) {
+        char buf[1024], fingerprint[256];
+
+        if (slaveReadReplyBulk(fd,buf,sizeof(buf)) == C_ERR ||
+            (sizes[i] = slaveReadReplyNumber(fd,':')) < 0 ||
+            slaveReadReplyBulk(fd,fingerprint,sizeof(fingerprint)) == C_ERR)
+            goto cleanup;
+        /* Never write out of the staging directory. */
+        if (!replicationIsCheckpointFile(buf) ||
+            strpbrk(fingerprint," \r\n") != NULL)
+        {
+            serverLog(LL_WARNING,"Invalid RocksDB checkpoint file from MASTER: %s",
+                buf);
+            goto cleanup;
+        }
+        paths[i] = sdsnew(buf);
+        fingerprints[i] = sdsnew(fingerprint);
+        dictAdd(files,sdsdup(paths[i]),fingerprints[i]);
+        total += sizes[i];
+    }
+    for (j = 0; j < server.dbnum; j++) {
+        sds current = sdscatfmt(sdsempty(),"%s/CURRENT",
+                                server.db[j].persistent_store->dbname);
+        int found = dictFind(files,current) != NULL;
+
+        sdsfree(current);
+        if (!found) {
+            serverLog(LL_WARNING,"The RocksDB checkpoint of MASTER misses DB %d",j);
+            goto cleanup;
+        }
+    }
+    if (slavePrepareStaging(staging,files) == C_ERR) goto cleanup;
+
+    serverLog(LL_NOTICE,
+        "MASTER <-> SLAVE sync: fetching %lld RocksDB files (%lld bytes)",
+        n, total);
+    server.loading = 1;
+    server.loading_start_time = time(NULL);
+    server.loading_loaded_bytes = 0;
+    server.loading_total_bytes = total;
+    chunk = zmalloc(REPL_ROCKSDB_MAX_CHUNK+2);
+    for (i = 0; i < n; i++) {
+        long long retval = slaveFetchFile(fd,name,paths[i],sizes[i],staging,
+                                          chunk,&fetched,&lastack);
+        if (retval == -1) {
+            stopLoading();
+            goto cleanup;
+        }
+        reused += retval;
+    }
+    stopLoading();
+    serverLog(LL_NOTICE,
+        "MASTER <-> SLAVE sync: RocksDB files fetched, %lld bytes reused",
+        reused);
+    ok = 1;
+
+cleanup:
+    if (fd != -1) close(fd);
+    for (i = 0; paths && i < n; i++) {
+        sdsfree(paths[i]);
+        sdsfree(fingerprints[i]);
+    }
+    zfree(paths);
+    zfree(fingerprints);
+    zfree(sizes);
+    zfree(chunk);
+    dictRelease(files);
+    sdsfree(name);
+    if (!ok) {
+        sdsfree(staging);
+        return disabled ? C_OK : C_ERR;
+    }
+    *checkpoint = staging;
+    return C_OK;
+}
+
+/* Replace the stores by the checkpoint in 'dir'. The slave can't go on
+ * with a store half replaced. */
+static void slaveReplaceStores(sds dir) {
+    int j;
+
+    tieringWaitIdle();
+    for (j = 0; j < server.dbnum; j++) {
+        sds err = NULL;
+
+        destroyPersistentStore(server.db[j].persistent_store);
+        if (restorePersistentStoreCheckpoint(j,dir,&err) == -1) {
+            serverLog(LL_WARNING,"Can't replace the RocksDB store of DB %d: %s",
+                j, err);
+            exit(1);
+        }
+        server.db[j].persistent_store = createPersistentStore(j);
+        resetMetadictLazyLoad(&server.db[j]);
+    }
+    serverLog(LL_NOTICE,"MASTER <-> SLAVE sync: RocksDB stores replaced");
+}
+
 /* Try a partial resynchronization with the master if we are about to reconnect.
  * If there is no cached master structure, at least try to issue a
  * "PSYNC ? -1" command in order to trigger a full resync using the PSYNC
@@ -2381,7 +3097,7 @@ int replicationCountAcksByOffset(long long offset) {
 void waitCommand(client *c) {
     mstime_t timeout;
     long numreplicas, ackreplicas;
-    long long offset = c->woff;
+    long long offset = c->woff, flushed;
 
     if (server.masterhost) {
         addReplyError(c,"WAIT cannot be used with slave instances. Please also note that since Redis 4.0 if a slave is configured to be writable (which is not the default) writes to slaves are just local and are not propagated.");
@@ -2394,6 +3110,11 @@ void waitCommand(client *c) {
     if (getTimeoutFromObjectOrReply(c,c->argv[2],&timeout,UNIT_MILLISECONDS)
         != C_OK) return;
 
+    /* ADDB: the last FPWRITEs of the client may be propagated in a
+     * FPWRITEC after its offset was recorded. */
+    flushed = fpWriteBatchFlush();
+    if (flushed > offset) offset = c->woff = flushed;
+
     /* First try without blocking at all. */
     ackreplicas = replicationCountAcksByOffset(c->woff);
     if (ackreplicas >= numreplicas || c->flags & CLIENT_MULTI) {
@@ -2663,5 +3384,6 @@ void replicationCron(void) {
 
     /* Refresh the number of slaves with lag <= min-slaves-max-lag. */
     refreshGoodSlavesCount();
+    replicationExpireCheckpoints();
     replication_cron_loops++; /* Incremented with frequency 1 HZ. */
 }
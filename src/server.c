@@ -31,6 +31,7 @@
 #include "cluster.h"
 #include "slowlog.h"
 #include "bio.h"
+#include "tiering.h"
 #include "latency.h"
 #include "atomicvar.h"
 
@@ -252,6 +253,7 @@ struct redisCommand redisCommandTable[] = {
     {"sync",syncCommand,1,"ars",0,NULL,0,0,0,0,0},
     {"psync",syncCommand,3,"ars",0,NULL,0,0,0,0,0},
     {"replconf",replconfCommand,-1,"aslt",0,NULL,0,0,0,0,0},
+    {"rocksdbsync",rocksdbsyncCommand,-3,"ast",0,NULL,0,0,0,0,0},
     {"flushdb",flushdbCommand,-1,"w",0,NULL,0,0,0,0,0},
     {"flushall",flushallCommand,-1,"w",0,NULL,0,0,0,0,0},
     {"sort",sortCommand,-2,"wm",0,sortGetKeys,1,1,1,0,0},
@@ -316,8 +318,20 @@ struct redisCommand redisCommandTable[] = {
 	 */
     {"fpread",fpReadCommand,2,"rF",0,NULL,1,1,1,0,0},
     {"fpwrite",fpWriteCommand,-3,"wm",0,NULL,1,1,1,0,0},
+    {"fpwritec",fpWritecCommand,7,"wm",0,NULL,1,1,1,0,0},
+    {"fpcvload",fpCvLoadCommand,-4,"wm",0,NULL,1,1,1,0,0},
+    {"fpmetaload",fpMetaLoadCommand,-4,"wm",0,NULL,0,0,0,0,0},
+    {"fptier",fptierCommand,-2,"w",0,NULL,1,-1,1,0,0},
     {"fpscan",fpScanCommand,-3,"rF",0,NULL,1,1,1,0,0},
-    {"metakeys",metakeysCommand,-1,"rS",0,NULL,0,0,0,0,0,0,0},
+    {"fptableopt",fpTableOptCommand,-2,"w",0,NULL,0,0,0,0,0},
+    {"fpdroptable",fpDropTableCommand,2,"w",0,NULL,0,0,0,0,0},
+    {"fpdrop",fpDropCommand,2,"w",0,NULL,1,1,1,0,0},
+    {"fpmigrate",fpMigrateCommand,5,"w",0,NULL,0,0,0,0,0},
+    {"fprestore",fpRestoreCommand,-3,"wmk",0,NULL,1,1,1,0,0},
+    {"metakeys",metakeysCommand,-2,"rS",0,NULL,0,0,0,0,0,0,0},
+    {"fptablestats",fpTableStatsCommand,-1,"rF",0,NULL,0,0,0,0,0},
+    {"fptablescan",fpTableScanCommand,-3,"r",0,NULL,0,0,0,0,0},
+    {"fptableagg",fpTableAggCommand,-3,"r",0,NULL,0,0,0,0,0},
 
     /*
      * 2018. 5. 11
@@ -1011,9 +1025,15 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     run_with_period(100) {
         trackInstantaneousMetric(STATS_METRIC_COMMAND,server.stat_numcommands);
         trackInstantaneousMetric(STATS_METRIC_NET_INPUT,
-                server.stat_net_input_bytes);
+                __atomic_load_n(&server.stat_net_input_bytes,__ATOMIC_RELAXED));
         trackInstantaneousMetric(STATS_METRIC_NET_OUTPUT,
-                server.stat_net_output_bytes);
+                __atomic_load_n(&server.stat_net_output_bytes,__ATOMIC_RELAXED));
+        trackInstantaneousMetric(STATS_METRIC_FPWRITE_ROWS,
+                server.stat_fpwrite_rows);
+        trackInstantaneousMetric(STATS_METRIC_TIERED_ROWGROUPS,
+                (long long) tieringCompletedRowgroups());
+        trackInstantaneousMetric(STATS_METRIC_TIERED_BYTES,
+                __atomic_load_n(&server.stat_tiered_bytes,__ATOMIC_RELAXED));
     }
 
     /* We have just LRU_BITS bits per object for LRU information.
@@ -1079,6 +1099,11 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
     /* Handle background operations on Redis databases. */
     databasesCron();
 
+    /* ADDB: split the memory budget between Redis and RocksDB, then move
+     * cold rowgroups to RocksDB before we hit maxmemory. */
+    run_with_period(1000) memoryGovernorCron();
+    tieringCron();
+
     /* Start a scheduled AOF rewrite if this was requested by the user while
      * a BGSAVE was in progress. */
     if (server.rdb_child_pid == -1 && server.aof_child_pid == -1 &&
@@ -1226,6 +1251,10 @@ int serverCron(struct aeEventLoop *eventLoop, long long id, void *clientData) {
 void beforeSleep(struct aeEventLoop *eventLoop) {
     UNUSED(eventLoop);
 
+    /* Run the commands read by the I/O threads first, everything below
+     * applies to them as well. */
+    handleClientsWithPendingReadsUsingThreads();
+
     /* Call the Redis Cluster before sleep function. Note that this function
      * may change the state of Redis Cluster (from ok to fail or vice versa),
      * so it's a good idea to call it before serving the unblocked clients
@@ -1265,11 +1294,16 @@ void beforeSleep(struct aeEventLoop *eventLoop) {
     if (listLength(server.unblocked_clients))
         processUnblockedClients();
 
+    /* ADDB: propagate the FPWRITEs batched in this iteration. Every path
+     * that can run a command is above, so nothing is left in the batch when
+     * the AOF is flushed and the replies are sent. */
+    fpWriteBatchFlush();
+
     /* Write the AOF buffer on disk */
     flushAppendOnlyFile(0);
 
     /* Handle writes with pending output buffers. */
-    handleClientsWithPendingWrites();
+    handleClientsWithPendingWritesUsingThreads();
 
     /* Before we are going to sleep, let the threads access the dataset by
      * releasing the GIL. Redis main thread will not touch anything at this
@@ -1411,6 +1445,8 @@ void initServerConfig(void) {
     server.verbosity = CONFIG_DEFAULT_VERBOSITY;
     server.maxidletime = CONFIG_DEFAULT_CLIENT_TIMEOUT;
     server.tcpkeepalive = CONFIG_DEFAULT_TCP_KEEPALIVE;
+    server.io_threads_num = CONFIG_DEFAULT_IO_THREADS_NUM;
+    server.io_threads_do_reads = CONFIG_DEFAULT_IO_THREADS_DO_READS;
     server.active_expire_enabled = 1;
     server.active_defrag_enabled = CONFIG_DEFAULT_ACTIVE_DEFRAG;
     server.active_defrag_ignore_bytes = CONFIG_DEFAULT_DEFRAG_IGNORE_BYTES;
@@ -1558,6 +1594,8 @@ void initServerConfig(void) {
     server.execCommand = lookupCommandByCString("exec");
     server.expireCommand = lookupCommandByCString("expire");
     server.pexpireCommand = lookupCommandByCString("pexpire");
+    server.fpwritecCommand = lookupCommandByCString("fpwritec");
+    server.fptierCommand = lookupCommandByCString("fptier");
 
     /* Slow log */
     server.slowlog_log_slower_than = CONFIG_DEFAULT_SLOWLOG_LOG_SLOWER_THAN;
@@ -1575,6 +1613,28 @@ void initServerConfig(void) {
 
     /* Batch tiering */
     server.batch_tiering_size = CONFIG_DEFAULT_BATCH_TIERING_SIZE;
+    server.tiering_threads = CONFIG_DEFAULT_TIERING_THREADS;
+    server.tiering_high_watermark = CONFIG_DEFAULT_TIERING_HIGH_WATERMARK;
+    server.tiering_low_watermark = CONFIG_DEFAULT_TIERING_LOW_WATERMARK;
+    server.tiering_batch_rows = 0;
+    server.tiering_backlog_limit = CONFIG_DEFAULT_TIERING_BACKLOG_LIMIT;
+    server.memory_budget = CONFIG_DEFAULT_MEMORY_BUDGET;
+    server.tiering_victim_samples = CONFIG_DEFAULT_TIERING_VICTIM_SAMPLES;
+    server.tiering_column_granular = CONFIG_DEFAULT_TIERING_COLUMN_GRANULAR;
+    server.tiering_promote_threshold = CONFIG_DEFAULT_TIERING_PROMOTE_THRESHOLD;
+    server.tiering_sst_ingest = CONFIG_DEFAULT_TIERING_SST_INGEST;
+    server.rocksdb_statistics = CONFIG_DEFAULT_ROCKSDB_STATISTICS;
+    server.rocksdb_checkpoint = CONFIG_DEFAULT_ROCKSDB_CHECKPOINT;
+    server.rocksdb_checkpoint_dir = zstrdup(CONFIG_DEFAULT_ROCKSDB_CHECKPOINT_DIR);
+    server.rocksdb_checkpoint_restore = CONFIG_DEFAULT_ROCKSDB_CHECKPOINT_RESTORE;
+    server.rocksdb_checkpoint_pending = NULL;
+    server.rocksdb_checkpoint_saved = NULL;
+    server.repl_rocksdb_sync = CONFIG_DEFAULT_REPL_ROCKSDB_SYNC;
+    server.rocksdb_max_open_files = CONFIG_DEFAULT_ROCKSDB_MAX_OPEN_FILES;
+    server.fpwrite_batch_bytes = CONFIG_DEFAULT_FPWRITE_BATCH_BYTES;
+    server.partition_filter_cache_size = CONFIG_DEFAULT_PARTITION_FILTER_CACHE_SIZE;
+    server.cluster_coordinator = CONFIG_DEFAULT_CLUSTER_COORDINATOR;
+    server.cluster_coordinator_timeout = CONFIG_DEFAULT_CLUSTER_COORDINATOR_TIMEOUT;
 }
 
 extern char **environ;
@@ -1815,6 +1875,19 @@ void resetServerStats(void) {
     server.stat_numconnections = 0;
     server.stat_expiredkeys = 0;
     server.stat_evictedkeys = 0;
+    server.stat_fpwrite_rows = 0;
+    server.stat_tiering_sync_cycles = 0;
+    server.stat_tiering_delayed_writes = 0;
+    server.stat_tiering_partial_clears = 0;
+    server.stat_tiering_promotions = 0;
+    /* Updated by the tiering workers. */
+    __atomic_store_n(&server.stat_tiering_ingested_files,0,__ATOMIC_RELAXED);
+    __atomic_store_n(&server.stat_tiering_ingest_fallbacks,0,__ATOMIC_RELAXED);
+    __atomic_store_n(&server.stat_tiered_bytes,0,__ATOMIC_RELAXED);
+    server.stat_rowgroup_memory_hits = 0;
+    server.stat_rowgroup_tiered_reads = 0;
+    server.stat_partition_filter_hits = 0;
+    server.stat_partition_filter_misses = 0;
     server.stat_time_meta_update = 0;
     server.stat_time_data_insert = 0;
     server.stat_keyspace_misses = 0;
@@ -1836,8 +1909,11 @@ void resetServerStats(void) {
         memset(server.inst_metric[j].samples,0,
             sizeof(server.inst_metric[j].samples));
     }
-    server.stat_net_input_bytes = 0;
-    server.stat_net_output_bytes = 0;
+    /* Updated by the I/O threads. */
+    __atomic_store_n(&server.stat_net_input_bytes,0,__ATOMIC_RELAXED);
+    __atomic_store_n(&server.stat_net_output_bytes,0,__ATOMIC_RELAXED);
+    server.stat_io_reads_processed = 0;
+    server.stat_io_writes_processed = 0;
     server.aof_delayed_fsync = 0;
 }
 
@@ -1860,8 +1936,14 @@ void initServer(void) {
     server.slaves = listCreate();
     server.monitors = listCreate();
     server.clients_pending_write = listCreate();
+    server.clients_pending_read = listCreate();
     server.slaveseldb = -1; /* Force to emit the first SELECT command. */
     server.unblocked_clients = listCreate();
+    server.tiering_blocked_clients = listCreate();
+    server.tiering_admission = TIERING_ADMIT_OPEN;
+    server.tiering_admit_rows = 0;
+    server.tiering_demand_rows = 0;
+    server.tiering_backlog_bytes = 0;
     server.ready_keys = listCreate();
     server.clients_waiting_acks = listCreate();
     server.get_ack_from_slaves = 0;
@@ -1902,15 +1984,23 @@ void initServer(void) {
         exit(1);
     }
 
+    /* ADDB: size the RocksDB memory and restore the checkpoint of the RDB
+     * before the stores are opened. */
+    memoryGovernorInit();
+    configurePersistentStoreOpenFiles(server.rocksdb_max_open_files);
+    rdbRestoreCheckpoint();
+
     /* Create the Redis databases, and initialize other internal state. */
     for (j = 0; j < server.dbnum; j++) {
         server.db[j].dict = dictCreate(&dbDictType,NULL);
         server.db[j].expires = dictCreate(&keyptrDictType,NULL);
         /*addb create Metadict*/
         server.db[j].Metadict = dictCreate(&dbDictType, NULL);
+        server.db[j].PartitionIndex = raxNew();
 
         server.db[j].EvictQueue = createArrayQueue(DEFAULT_ARRAY_QUEUE_SIZE);
         server.db[j].FreeQueue = createArrayQueue(DEFAULT_FREE_QUEUE_SIZE);
+        server.db[j].TieredHeat = dictCreate(&setDictType,NULL);
 
         server.db[j].blocking_keys = dictCreate(&keylistDictType,NULL);
         server.db[j].ready_keys = dictCreate(&objectKeyPointerValueDictType,NULL);
@@ -1921,6 +2011,8 @@ void initServer(void) {
         /* ADDB */
         /* currently, DB name is set to the number of Redis DB */
         server.db[j].persistent_store = createPersistentStore(j);
+        server.db[j].MetadictChecked = dictCreate(&setDictType,NULL);
+        resetMetadictLazyLoad(&server.db[j]);
     }
     evictionPoolAlloc(); /* Initialize the LRU keys pool. */
     server.pubsub_channels = dictCreate(&keylistDictType,NULL);
@@ -2013,6 +2105,8 @@ void initServer(void) {
     slowlogInit();
     latencyMonitorInit();
     bioInit();
+    tieringInit();
+    initThreadedIO();
     server.initial_memory_usage = zmalloc_used_memory();
 }
 
@@ -2147,6 +2241,8 @@ struct redisCommand *lookupCommandOrOriginal(sds name) {
 void propagate(struct redisCommand *cmd, int dbid, robj **argv, int argc,
                int flags)
 {
+    /* ADDB: FPWRITEs batched so far go first. */
+    fpWriteBatchFlush();
     if (server.aof_state != AOF_OFF && flags & PROPAGATE_AOF)
         feedAppendOnlyFile(cmd,dbid,argv,argc);
     if (flags & PROPAGATE_REPL)
@@ -2324,8 +2420,10 @@ void call(client *c, int flags) {
                 propagate_flags &= ~PROPAGATE_AOF;
 
         /* Call propagate() only if at least one of AOF / replication
-         * propagation is needed. */
-        if (propagate_flags != PROPAGATE_NONE)
+         * propagation is needed. ADDB: FPWRITE may be added to a FPWRITEC
+         * batch instead. */
+        if (propagate_flags != PROPAGATE_NONE &&
+            !fpWriteBatchPropagate(c,propagate_flags))
             propagate(c->cmd,c->db->id,c->argv,c->argc,propagate_flags);
     }
 
@@ -2434,6 +2532,12 @@ int processCommand(client *c) {
      * keys in the dataset). If there are not the only thing we can do
      * is returning an error. */
     if (server.maxmemory && (c->cmd->proc == fpWriteCommand)) {
+        /* ADDB: delay the write when tiering can't keep up with ingestion,
+         * the command stays in argv until the client is resumed. */
+        if (!tieringAdmitWrite(c)) {
+            blockForTiering(c);
+            return C_OK;
+        }
         int retval = freeMemoryIfNeeded();
         /* freeMemoryIfNeeded may flush slave output buffers. This may result
          * into a slave, that may be the active client, to be freed. */
@@ -2588,6 +2692,9 @@ int prepareForShutdown(int flags) {
         rdbRemoveTempFile(server.rdb_child_pid);
     }
 
+    /* ADDB: the FPWRITEs batched go to the AOF flushed below. */
+    fpWriteBatchFlush();
+
     if (server.aof_state != AOF_OFF) {
         /* Kill the AOF saving child as the AOF we already have may be longer
          * but contains the full dataset anyway. */
@@ -2857,6 +2964,14 @@ void bytesToHuman(char *s, unsigned long long n) {
     }
 }
 
+/* ADDB: latency percentiles of a RocksDB operation, in microseconds. */
+static sds sdscatRocksDBHistogram(sds info, const char *name,
+                                  persistent_store_histogram_t *h) {
+    return sdscatprintf(info,
+        "rocksdb_%s_usec:p50=%.2f,p95=%.2f,p99=%.2f,max=%.2f\r\n",
+        name, h->p50, h->p95, h->p99, h->max);
+}
+
 /* Create the string returned by the INFO command. This is decoupled
  * by the INFO command itself as we need to report the same information
  * on memory corruption problems. */
@@ -3034,6 +3149,27 @@ sds genRedisInfoString(char *section) {
             lazyfreeGetPendingObjectsCount()
         );
         freeMemoryOverheadData(mh);
+
+        /* ADDB: memory of the RocksDB tier, governed by memory_budget. */
+        persistent_store_memory_t psm;
+        getMemoryGovernorUsage(&psm);
+        info = sdscatprintf(info,
+            "memory_budget:%llu\r\n"
+            "rocksdb_block_cache_capacity:%zu\r\n"
+            "rocksdb_block_cache_usage:%zu\r\n"
+            "rocksdb_block_cache_pinned:%zu\r\n"
+            "rocksdb_memtables:%llu\r\n"
+            "rocksdb_table_readers:%llu\r\n"
+            "rocksdb_block_cache_hits:%llu\r\n"
+            "rocksdb_block_cache_misses:%llu\r\n",
+            server.memory_budget,
+            getPersistentStoreBlockCacheCapacity(),
+            getPersistentStoreBlockCacheUsage(),
+            getPersistentStoreBlockCachePinnedUsage(),
+            psm.memtables,
+            psm.table_readers,
+            psm.block_cache_hits,
+            psm.block_cache_misses);
     }
 
     /* Persistence */
@@ -3076,6 +3212,16 @@ sds genRedisInfoString(char *section) {
             (server.aof_last_write_status == C_OK) ? "ok" : "err",
             server.stat_aof_cow_bytes);
 
+        /* ADDB */
+        int metadict_lazy = 0;
+        for (j = 0; j < server.dbnum; j++)
+            metadict_lazy += server.db[j].metadict_lazy;
+        info = sdscatprintf(info,
+            "rocksdb_checkpoint:%s\r\n"
+            "metadict_lazy_dbs:%d\r\n",
+            server.rocksdb_checkpoint_saved ? server.rocksdb_checkpoint_saved : "",
+            metadict_lazy);
+
         if (server.aof_state != AOF_OFF) {
             info = sdscatprintf(info,
                 "aof_current_size:%lld\r\n"
@@ -3156,12 +3302,16 @@ sds genRedisInfoString(char *section) {
             "active_defrag_hits:%lld\r\n"
             "active_defrag_misses:%lld\r\n"
             "active_defrag_key_hits:%lld\r\n"
-            "active_defrag_key_misses:%lld\r\n",
+            "active_defrag_key_misses:%lld\r\n"
+            "partition_filter_cache_hits:%lld\r\n"
+            "partition_filter_cache_misses:%lld\r\n"
+            "io_threaded_reads_processed:%lld\r\n"
+            "io_threaded_writes_processed:%lld\r\n",
             server.stat_numconnections,
             server.stat_numcommands,
             getInstantaneousMetric(STATS_METRIC_COMMAND),
-            server.stat_net_input_bytes,
-            server.stat_net_output_bytes,
+            __atomic_load_n(&server.stat_net_input_bytes,__ATOMIC_RELAXED),
+            __atomic_load_n(&server.stat_net_output_bytes,__ATOMIC_RELAXED),
             (float)getInstantaneousMetric(STATS_METRIC_NET_INPUT)/1024,
             (float)getInstantaneousMetric(STATS_METRIC_NET_OUTPUT)/1024,
             server.stat_rejected_conn,
@@ -3182,7 +3332,11 @@ sds genRedisInfoString(char *section) {
             server.stat_active_defrag_hits,
             server.stat_active_defrag_misses,
             server.stat_active_defrag_key_hits,
-            server.stat_active_defrag_key_misses);
+            server.stat_active_defrag_key_misses,
+            server.stat_partition_filter_hits,
+            server.stat_partition_filter_misses,
+            server.stat_io_reads_processed,
+            server.stat_io_writes_processed);
     }
 
     /* Replication */
@@ -3313,6 +3467,108 @@ sds genRedisInfoString(char *section) {
             server.repl_backlog_histlen);
     }
 
+    /* Tiering */
+    if (allsections || defsections || !strcasecmp(section,"tiering")) {
+        long long evict_queued = 0, free_queued = 0;
+
+        for (j = 0; j < server.dbnum; j++) {
+            evict_queued += server.db[j].EvictQueue->size;
+            free_queued += server.db[j].FreeQueue->size;
+        }
+        if (sections++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info,
+            "# Tiering\r\n"
+            "tiering_threads:%d\r\n"
+            "tiering_pending_jobs:%llu\r\n"
+            "tiering_batch_rows:%lld\r\n"
+            "tiering_admission:%s\r\n"
+            "tiering_backlog_bytes:%zu\r\n"
+            "tiering_backlog_limit:%zu\r\n"
+            "tiering_blocked_clients:%lu\r\n"
+            "tiering_delayed_writes:%lld\r\n"
+            "tiering_sync_cycles:%lld\r\n"
+            "tiering_partial_clears:%lld\r\n"
+            "tiering_promotions:%lld\r\n"
+            "tiering_ingested_files:%lld\r\n"
+            "tiering_ingest_fallbacks:%lld\r\n"
+            "tiering_evict_queue_rowgroups:%lld\r\n"
+            "tiering_free_queue_rowgroups:%lld\r\n"
+            "tiering_tiered_bytes:%lld\r\n"
+            "bio_pending_close_file:%llu\r\n"
+            "bio_pending_aof_fsync:%llu\r\n"
+            "bio_pending_lazy_free:%llu\r\n"
+            "bio_pending_tiering:%llu\r\n"
+            "bio_pending_tiered_free:%llu\r\n"
+            "rowgroup_memory_hits:%lld\r\n"
+            "rowgroup_tiered_reads:%lld\r\n"
+            "rowgroup_hit_ratio:%.4f\r\n"
+            "instantaneous_fpwrite_rows_per_sec:%lld\r\n"
+            "instantaneous_tiered_rowgroups_per_sec:%lld\r\n"
+            "instantaneous_tiered_kbps:%.2f\r\n",
+            tieringNumWorkers(),
+            tieringPendingJobs(),
+            server.tiering_batch_rows,
+            tieringAdmissionName(),
+            server.tiering_backlog_bytes,
+            server.maxmemory ? tieringBacklogLimit() : 0,
+            listLength(server.tiering_blocked_clients),
+            server.stat_tiering_delayed_writes,
+            server.stat_tiering_sync_cycles,
+            server.stat_tiering_partial_clears,
+            server.stat_tiering_promotions,
+            __atomic_load_n(&server.stat_tiering_ingested_files,
+                            __ATOMIC_RELAXED),
+            __atomic_load_n(&server.stat_tiering_ingest_fallbacks,
+                            __ATOMIC_RELAXED),
+            evict_queued,
+            free_queued,
+            __atomic_load_n(&server.stat_tiered_bytes,__ATOMIC_RELAXED),
+            bioPendingJobsOfType(BIO_CLOSE_FILE),
+            bioPendingJobsOfType(BIO_AOF_FSYNC),
+            bioPendingJobsOfType(BIO_LAZY_FREE),
+            bioPendingJobsOfType(BIO_TIERING),
+            bioPendingJobsOfType(BIO_TIERED_FREE),
+            server.stat_rowgroup_memory_hits,
+            server.stat_rowgroup_tiered_reads,
+            memoryGovernorRedisHitRatio(),
+            getInstantaneousMetric(STATS_METRIC_FPWRITE_ROWS),
+            getInstantaneousMetric(STATS_METRIC_TIERED_ROWGROUPS),
+            (float)getInstantaneousMetric(STATS_METRIC_TIERED_BYTES)/1024);
+    }
+
+    /* RocksDB */
+    if (allsections || defsections || !strcasecmp(section,"rocksdb")) {
+        persistent_store_stats_t pss;
+
+        memset(&pss,0,sizeof(pss));
+        for (j = 0; j < server.dbnum; j++)
+            getPersistentStoreStats(server.db[j].persistent_store,&pss);
+        if (sections++) info = sdscat(info,"\r\n");
+        info = sdscatprintf(info,
+            "# RocksDB\r\n"
+            "rocksdb_statistics:%d\r\n"
+            "rocksdb_pending_compaction_bytes:%llu\r\n"
+            "rocksdb_running_compactions:%llu\r\n"
+            "rocksdb_immutable_memtables:%llu\r\n"
+            "rocksdb_write_stopped:%llu\r\n"
+            "rocksdb_delayed_write_rate:%llu\r\n"
+            "rocksdb_stall_micros:%llu\r\n"
+            "rocksdb_read_amplification:%llu\r\n"
+            "rocksdb_get_hits:memtable=%llu,l0=%llu,l1=%llu,l2andup=%llu\r\n",
+            persistentStoreStatisticsEnabled(),
+            pss.pending_compaction_bytes,
+            pss.running_compactions,
+            pss.immutable_memtables,
+            pss.write_stopped,
+            pss.delayed_write_rate,
+            pss.stall_micros,
+            pss.read_amplification,
+            pss.memtable_hits, pss.l0_hits, pss.l1_hits, pss.l2andup_hits);
+        info = sdscatRocksDBHistogram(info,"get",&pss.get);
+        info = sdscatRocksDBHistogram(info,"write",&pss.write);
+        info = sdscatRocksDBHistogram(info,"seek",&pss.seek);
+    }
+
     /* CPU */
     if (allsections || defsections || !strcasecmp(section,"cpu")) {
         if (sections++) info = sdscat(info,"\r\n");
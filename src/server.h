@@ -122,6 +122,9 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CONFIG_DEFAULT_DAEMONIZE 0
 #define CONFIG_DEFAULT_UNIX_SOCKET_PERM 0
 #define CONFIG_DEFAULT_TCP_KEEPALIVE 300
+#define CONFIG_DEFAULT_IO_THREADS_NUM 1 /* Single threaded by default */
+#define CONFIG_DEFAULT_IO_THREADS_DO_READS 0 /* Threaded writes only */
+#define CONFIG_MAX_IO_THREADS 128
 #define CONFIG_DEFAULT_PROTECTED_MODE 1
 #define CONFIG_DEFAULT_LOGFILE ""
 #define CONFIG_DEFAULT_SYSLOG_ENABLED 0
@@ -168,6 +171,31 @@ typedef long long mstime_t; /* millisecond time type. */
 
 /* ADDB Related */
 #define CONFIG_DEFAULT_BATCH_TIERING_SIZE 1 /* Single tiering */
+#define CONFIG_DEFAULT_TIERING_THREADS 4
+#define CONFIG_DEFAULT_TIERING_HIGH_WATERMARK 80 /* % of maxmemory */
+#define CONFIG_DEFAULT_TIERING_LOW_WATERMARK 70  /* % of maxmemory */
+#define CONFIG_DEFAULT_TIERING_BACKLOG_LIMIT 0 /* 0: maxmemory - high watermark */
+#define CONFIG_DEFAULT_MEMORY_BUDGET 0 /* 0: no governor, maxmemory is used */
+#define CONFIG_DEFAULT_TIERING_VICTIM_SAMPLES 16
+#define CONFIG_MAX_TIERING_VICTIM_SAMPLES 1024
+#define CONFIG_DEFAULT_TIERING_COLUMN_GRANULAR 0
+#define CONFIG_DEFAULT_TIERING_PROMOTE_THRESHOLD 10 /* LFU counter, 0: off */
+#define CONFIG_DEFAULT_TIERING_SST_INGEST 0
+#define CONFIG_DEFAULT_ROCKSDB_STATISTICS 0
+#define CONFIG_DEFAULT_ROCKSDB_CHECKPOINT 0
+#define CONFIG_DEFAULT_ROCKSDB_CHECKPOINT_DIR "checkpoints"
+#define CONFIG_DEFAULT_ROCKSDB_CHECKPOINT_RESTORE 0
+#define CONFIG_DEFAULT_REPL_ROCKSDB_SYNC 1
+#define CONFIG_DEFAULT_ROCKSDB_MAX_OPEN_FILES 512 /* -1: every SST open */
+#define CONFIG_DEFAULT_FPWRITE_BATCH_BYTES (64*1024) /* 0: FPWRITE verbatim */
+#define CONFIG_DEFAULT_PARTITION_FILTER_CACHE_SIZE 128 /* 0: no cache */
+#define CONFIG_DEFAULT_CLUSTER_COORDINATOR 0
+#define CONFIG_DEFAULT_CLUSTER_COORDINATOR_TIMEOUT 5000 /* milliseconds */
+
+/* ADDB FPWRITE admission states, see evict.c */
+#define TIERING_ADMIT_OPEN 0
+#define TIERING_ADMIT_THROTTLE 1
+#define TIERING_ADMIT_BLOCK 2
 
 #define ACTIVE_EXPIRE_CYCLE_LOOKUPS_PER_LOOP 20 /* Loopkups per loop. */
 #define ACTIVE_EXPIRE_CYCLE_FAST_DURATION 1000 /* Microseconds */
@@ -180,7 +208,10 @@ typedef long long mstime_t; /* millisecond time type. */
 #define STATS_METRIC_COMMAND 0      /* Number of commands executed. */
 #define STATS_METRIC_NET_INPUT 1    /* Bytes read to network .*/
 #define STATS_METRIC_NET_OUTPUT 2   /* Bytes written to network. */
-#define STATS_METRIC_COUNT 3
+#define STATS_METRIC_FPWRITE_ROWS 3 /* ADDB: rows inserted by FPWRITE. */
+#define STATS_METRIC_TIERED_ROWGROUPS 4 /* ADDB: rowgroups committed to RocksDB. */
+#define STATS_METRIC_TIERED_BYTES 5 /* ADDB: bytes committed to RocksDB. */
+#define STATS_METRIC_COUNT 6
 
 /* Protocol and I/O related defines */
 #define PROTO_MAX_QUERYBUF_LEN  (1024*1024*1024) /* 1GB max query buffer. */
@@ -256,6 +287,12 @@ typedef long long mstime_t; /* millisecond time type. */
 #define CLIENT_LUA_DEBUG (1<<25)  /* Run EVAL in debug mode. */
 #define CLIENT_LUA_DEBUG_SYNC (1<<26)  /* EVAL debugging without fork() */
 #define CLIENT_MODULE (1<<27) /* Non connected client used by some module. */
+#define CLIENT_TIERING_ADMITTED (1<<28) /* ADDB: resumed FPWRITE, skip the
+                                           tiering admission once. */
+#define CLIENT_PENDING_READ (1<<29) /* The query buffer is read and parsed
+                                       by an I/O thread. */
+#define CLIENT_PENDING_COMMAND (1<<30) /* An I/O thread parsed a command the
+                                          main thread did not run yet. */
 
 /* Client block type (btype field in client structure)
  * if CLIENT_BLOCKED flag is set. */
@@ -263,6 +300,9 @@ typedef long long mstime_t; /* millisecond time type. */
 #define BLOCKED_LIST 1    /* BLPOP & co. */
 #define BLOCKED_WAIT 2    /* WAIT for synchronous replication. */
 #define BLOCKED_MODULE 3  /* Blocked by a loadable module. */
+#define BLOCKED_TIERING 4 /* ADDB: FPWRITE delayed by tiering backpressure. */
+#define BLOCKED_COORDINATOR 5 /* ADDB: table command waiting for the nodes. */
+#define BLOCKED_MIGRATION 6 /* ADDB: FPMIGRATE moving the partitions. */
 
 /* Client request types */
 #define PROTO_REQ_INLINE 1
@@ -604,18 +644,26 @@ typedef struct RedisModuleDigest {
 
 #define OBJ_SHARED_REFCOUNT INT_MAX
 typedef struct redisObject {
-    unsigned type:3;
-    volatile unsigned location:2;   /* ADDB - Data location : Memory or Persistent store */
-                           /* 0 : REDIS_ONLY, 1 : FLUSH, 2 : PERSISTED */
-                           /* TODO Need to change as an atomic variable */
+    unsigned type:4;
     unsigned encoding:4;
     unsigned lru:LRU_BITS; /* LRU time (relative to global lru_clock) or
                             * LFU data (least significant 8 bits frequency
                             * and most significant 16 bits decreas time). */
+    uint8_t location;      /* ADDB - Data location : Memory or Persistent store
+                            * (LOCATION_*). It has its own byte so that it
+                            * can be accessed atomically, always use
+                            * objGetLocation() / objSetLocation(). */
     int refcount;
     void *ptr;
 } robj;
 
+/* ADDB - The location of a rowgroup is read by the tiering workers while
+ * the main thread updates it. These are the GCC builtins for the C11
+ * atomic_load_explicit(memory_order_acquire) / atomic_store_explicit(
+ * memory_order_release) pair, as the server is built with -std=c99. */
+#define objGetLocation(o) __atomic_load_n(&(o)->location,__ATOMIC_ACQUIRE)
+#define objSetLocation(o,l) __atomic_store_n(&(o)->location,(uint8_t)(l),__ATOMIC_RELEASE)
+
 /* Macro used to initialize a Redis object allocated on the stack.
  * Note that this macro is taken near the structure definition to make sure
  * we'll update it when the structure is changed, to avoid bugs like
@@ -643,9 +691,13 @@ typedef struct redisDb {
 
     /*addb add Metadict*/
     dict *Metadict;            /*using for relational metadata */
+    dict *MetadictChecked;     /* Partitions merged with the META CF */
+    int metadict_lazy;         /* The META CF isn't merged entirely yet */
+    rax *PartitionIndex;       /* tableId -> partition index of the table */
 
     Queue *EvictQueue;        /*used for best key management */
     Queue *FreeQueue;
+    dict *TieredHeat;           /* LFU counter of scanned tiered rowgroups */
     persistent_store_t *persistent_store;
 } redisDb;
 
@@ -684,6 +736,14 @@ typedef struct blockingState {
     void *module_blocked_handle; /* RedisModuleBlockedClient structure.
                                     which is opaque for the Redis core, only
                                     handled in module.c. */
+
+    /* BLOCKED_COORDINATOR */
+    void *coordinator_request; /* Fan-out in progress, see
+                                  addb_coordinator.c. */
+
+    /* BLOCKED_MIGRATION */
+    void *partition_migration; /* Migration in progress, see
+                                  addb_migrate.c. */
 } blockingState;
 
 /* The following structure represents a node in the server.ready_keys list,
@@ -948,6 +1008,7 @@ struct redisServer {
     list *clients;              /* List of active clients */
     list *clients_to_close;     /* Clients to close asynchronously */
     list *clients_pending_write; /* There is to write or install handler. */
+    list *clients_pending_read;  /* Clients to read by the I/O threads. */
     list *slaves, *monitors;    /* List of slaves and MONITORs */
     client *current_client; /* Current client, only used on crash report */
     int clients_paused;         /* True if clients are currently paused */
@@ -965,7 +1026,7 @@ struct redisServer {
     /* Fast pointers to often looked up command */
     struct redisCommand *delCommand, *multiCommand, *lpushCommand, *lpopCommand,
                         *rpopCommand, *sremCommand, *execCommand, *expireCommand,
-                        *pexpireCommand;
+                        *pexpireCommand, *fpwritecCommand, *fptierCommand;
     /* Fields used only for stats */
     time_t stat_starttime;          /* Server start time */
     long long stat_numcommands;     /* Number of processed commands */
@@ -973,6 +1034,18 @@ struct redisServer {
     long long stat_expiredkeys;     /* Number of expired keys */
     long long stat_evictedkeys;     /* Number of evicted keys (maxmemory) */
     /* addb */
+    long long stat_fpwrite_rows;    /* Number of rows inserted by FPWRITE */
+    long long stat_tiering_sync_cycles; /* Tiering done in the command path */
+    long long stat_tiering_delayed_writes; /* FPWRITE blocked by backpressure */
+    long long stat_tiering_partial_clears; /* Rowgroups kept with hot columns */
+    long long stat_tiering_promotions; /* Rowgroups loaded back from RocksDB */
+    long long stat_tiering_ingested_files; /* SST files ingested by tiering */
+    long long stat_tiering_ingest_fallbacks; /* Ingestions done by WriteBatch */
+    long long stat_tiered_bytes;    /* Keys and values written by tiering */
+    long long stat_rowgroup_memory_hits; /* Rowgroup lookups found in Redis */
+    long long stat_rowgroup_tiered_reads; /* Rowgroup lookups read from RocksDB */
+    long long stat_partition_filter_hits; /* METAKEYS statements found compiled */
+    long long stat_partition_filter_misses; /* METAKEYS statements compiled */
     long long stat_time_meta_update;
     long long stat_time_data_insert;
     long long stat_keyspace_hits;   /* Number of successful lookups of keys */
@@ -995,6 +1068,8 @@ struct redisServer {
     size_t resident_set_size;       /* RSS sampled in serverCron(). */
     long long stat_net_input_bytes; /* Bytes read from network. */
     long long stat_net_output_bytes; /* Bytes written to network. */
+    long long stat_io_reads_processed; /* Reads done by the I/O threads */
+    long long stat_io_writes_processed; /* Writes done by the I/O threads */
     size_t stat_rdb_cow_bytes;      /* Copy on write bytes during RDB saving. */
     size_t stat_aof_cow_bytes;      /* Copy on write bytes during AOF rewrite. */
     /* The following two are used to track instantaneous metrics, like
@@ -1009,6 +1084,9 @@ struct redisServer {
     int verbosity;                  /* Loglevel in redis.conf */
     int maxidletime;                /* Client timeout in seconds */
     int tcpkeepalive;               /* Set SO_KEEPALIVE if non-zero. */
+    int io_threads_num;             /* Threads reading and writing sockets */
+    int io_threads_do_reads;        /* Read and parse with the I/O threads */
+    int io_threads_active;          /* The I/O threads are not parked */
     int active_expire_enabled;      /* Can be disabled for testing purposes. */
     int active_defrag_enabled;
     size_t active_defrag_ignore_bytes; /* minimum amount of fragmentation waste to start active defrag */
@@ -1245,6 +1323,35 @@ struct redisServer {
 
     /* Batch tiering */
     int batch_tiering_size;
+    int tiering_threads;            /* Number of tiering pool workers. */
+    int tiering_high_watermark;     /* Start tiering above this % of maxmemory */
+    int tiering_low_watermark;      /* Stop tiering below this % of maxmemory */
+    long long tiering_batch_rows;   /* Batch size chosen by the last cycle */
+    unsigned long long tiering_backlog_limit; /* Backlog bytes blocking FPWRITE */
+    unsigned long long memory_budget; /* Redis + RocksDB memory, sets maxmemory */
+    size_t tiering_backlog_bytes;   /* Backlog measured by the last cycle */
+    int tiering_admission;          /* TIERING_ADMIT_* state of FPWRITE */
+    mstime_t tiering_block_start;   /* Time FPWRITE was last blocked */
+    long long tiering_admit_rows;   /* Rows left to admit in this cycle */
+    long long tiering_demand_rows;  /* Rows requested in this cycle */
+    list *tiering_blocked_clients;  /* FPWRITE clients waiting for tiering */
+    int tiering_victim_samples;     /* Rowgroups sampled to pick a victim */
+    int tiering_column_granular;    /* Keep the hot columns of tiered rowgroups */
+    int tiering_promote_threshold;  /* LFU counter promoting a tiered rowgroup */
+    int tiering_sst_ingest;         /* Tier batches as ingested SST files */
+    int rocksdb_statistics;         /* Collect RocksDB tickers and histograms */
+    int rocksdb_checkpoint;         /* Checkpoint the stores with every RDB */
+    char *rocksdb_checkpoint_dir;   /* Where the checkpoints are created */
+    int rocksdb_checkpoint_restore; /* Restore the checkpoint of the RDB */
+    sds rocksdb_checkpoint_pending; /* Checkpoint of the RDB being saved */
+    sds rocksdb_checkpoint_saved;   /* Checkpoint of the last saved RDB */
+    int rocksdb_checkpoint_skip;    /* Save the next RDB without checkpoint */
+    int repl_rocksdb_sync;          /* Ship the stores with full resyncs */
+    int rocksdb_max_open_files;     /* SST files kept open by every store */
+    size_t fpwrite_batch_bytes;     /* FPWRITEC block propagating FPWRITEs */
+    int partition_filter_cache_size; /* METAKEYS statements kept compiled */
+    int cluster_coordinator;        /* Fan table commands out to the nodes */
+    long long cluster_coordinator_timeout; /* Fan-out timeout (ms) */
 };
 
 typedef struct pubsubPattern {
@@ -1345,6 +1452,7 @@ extern dictType hashDictType;
 extern dictType replScriptCacheDictType;
 extern dictType keyptrDictType;
 extern dictType modulesDictType;
+extern dictType migrateCacheDictType;
 
 /*-----------------------------------------------------------------------------
  * Functions prototypes
@@ -1428,6 +1536,9 @@ void pauseClients(mstime_t duration);
 int clientsArePaused(void);
 int processEventsWhileBlocked(void);
 int handleClientsWithPendingWrites(void);
+int handleClientsWithPendingWritesUsingThreads(void);
+int handleClientsWithPendingReadsUsingThreads(void);
+void initThreadedIO(void);
 int clientHasPendingReplies(client *c);
 void unlinkClient(client *c);
 int writeToClient(int fd, client *c, int handler_installed);
@@ -1647,7 +1758,30 @@ int zslLexValueLteMax(sds value, zlexrangespec *spec);
 
 /* Core functions */
 int freeMemoryIfNeeded(void);
+void tieringCron(void);
+void memoryGovernorInit(void);
+void memoryGovernorCron(void);
+int memoryGovernorSetBudget(unsigned long long budget, const char **err);
+unsigned long long memoryGovernorUserMaxmemory(void);
+void getMemoryGovernorUsage(persistent_store_memory_t *usage);
+double memoryGovernorRedisHitRatio(void);
+int tieringAdmitWrite(client *c);
+void touchRowGroup(robj *o);
+void touchColumnVector(robj *o);
+robj *tieringPromoteRowGroup(redisDb *db, robj *dataKey);
+void blockForTiering(client *c);
+void unblockClientWaitingTiering(client *c);
+void unblockClientFromCoordinator(client *c);
+void coordinatorBlockedClientTimedOut(client *c);
+void unblockClientFromPartitionMigration(client *c);
+void partitionMigrationCron(void);
+void abortPartitionMigration(int tableId, const char *reason);
+int partitionKeyExists(redisDb *db, sds key);
+int isPartitionMigrating(sds key);
+size_t tieringBacklogLimit(void);
+const char *tieringAdmissionName(void);
 int processCommand(client *c);
+long long getInstantaneousMetric(int metric);
 void setupSignalHandlers(void);
 struct redisCommand *lookupCommand(sds name);
 struct redisCommand *lookupCommandByCString(char *s);
@@ -1795,6 +1929,18 @@ robj *objectCommandLookupOrReply(client *c, robj *key, robj *reply);
 #define LOOKUP_ALL (1<<1)
 /*addb dbadd function for metadict*/
 void dbAddForMetadict(redisDb *db, robj *key, robj *val);
+void resetMetadictLazyLoad(redisDb *db);
+void loadPartitionMetaIfNeeded(redisDb *db, sds metaKey);
+void loadMetadictIfNeeded(redisDb *db);
+int isStaleRowGroup(redisDb *db, sds dataKey);
+int flushRowGroupMeta(redisDb *db);
+void partitionIndexAdd(redisDb *db, sds metakey, robj *o);
+void partitionIndexCount(redisDb *db, sds metakey, long long field,
+                         long long oldValue, long long newValue);
+void partitionIndexDelete(redisDb *db, sds metakey);
+void partitionIndexDropTable(redisDb *db, int tableId);
+void partitionIndexEmpty(redisDb *db);
+void trimPartitionFilterCache(void);
 
 void dbAdd(redisDb *db, robj *key, robj *val);
 void dbAddForMeta(redisDb *db, robj *key, robj *val);
@@ -2066,6 +2212,7 @@ void bitcountCommand(client *c);
 void bitposCommand(client *c);
 void replconfCommand(client *c);
 void waitCommand(client *c);
+void rocksdbsyncCommand(client *c);
 void geoencodeCommand(client *c);
 void geodecodeCommand(client *c);
 void georadiusbymemberCommand(client *c);
@@ -2090,9 +2237,23 @@ void securityWarningCommand(client *c);
  * hssung@yonsei.ac.kr
  */
 void fpWriteCommand(client *c);
+void fpWritecCommand(client *c);
+void fpCvLoadCommand(client *c);
+void fpMetaLoadCommand(client *c);
+void fptierCommand(client *c);
+int fpWriteBatchPropagate(client *c, int flags);
+long long fpWriteBatchFlush(void);
 void fpReadCommand(client *c);
 void fpScanCommand(client *c);
 void fpPartitionFilterCommand(client *c);
+void fpTableOptCommand(client *c);
+void fpDropTableCommand(client *c);
+void fpTableStatsCommand(client *c);
+void fpTableScanCommand(client *c);
+void fpTableAggCommand(client *c);
+void fpDropCommand(client *c);
+void fpMigrateCommand(client *c);
+void fpRestoreCommand(client *c);
 void setGenericCommand(client *c, int flags, robj *key, robj *val, robj *expire, int unit, robj *ok_reply, robj *abort_reply);
 int getGenericCommand(client *c);
 void metakeysCommand(client *c);
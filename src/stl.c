@@ -787,6 +787,44 @@ int columnVectorIterGetNoCopy(const ColumnVectorIter it, char **start,
     return C_OK;
 }
 
+/* Element blocks: every element prefixed by its length as a base 128
+ * varint. Column vectors are saved in RDB files and propagated by FPWRITEC
+ * as a single string in this format. */
+sds blockCatElement(sds block, const char *ele, size_t len) {
+    char prefix[10];
+    size_t n = 0;
+    uint64_t l = len;
+
+    while (l >= 0x80) {
+        prefix[n++] = (char) ((l & 0x7f) | 0x80);
+        l >>= 7;
+    }
+    prefix[n++] = (char) l;
+    block = sdscatlen(block, prefix, n);
+    return sdscatlen(block, ele, len);
+}
+
+/* Read the element at '*p' and move '*p' past it. Returns C_ERR if the
+ * block is truncated. */
+int blockNextElement(const char **p, const char *end, const char **ele,
+                     size_t *len) {
+    const char *q = *p;
+    uint64_t l = 0;
+    int shift = 0;
+
+    while (q < end && (*q & 0x80) && shift < 63) {
+        l |= (uint64_t) (*q++ & 0x7f) << shift;
+        shift += 7;
+    }
+    if (q == end) return C_ERR;
+    l |= (uint64_t) (*q++ & 0x7f) << shift;
+    if (l > (uint64_t) (end - q)) return C_ERR;
+    *ele = q;
+    *len = l;
+    *p = q + l;
+    return C_OK;
+}
+
 void stackInit(Stack *s) {
     s->type = STL_TYPE_DEFAULT;
     vectorInit(&s->data);
@@ -50,6 +50,10 @@ int vectorDeserialize(sds rawVector, Vector **result);
 // Deprecated
 Vector *VectordeSerialize(char *VectorString);
 
+sds blockCatElement(sds block, const char *ele, size_t len);
+int blockNextElement(const char **p, const char *end, const char **ele,
+                     size_t *len);
+
 // Implement like C++ style
 typedef struct _ColumnVectorIter {
     sds col_v;
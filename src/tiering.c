@@ -0,0 +1,495 @@
+/*
+ * tiering.c
+ *
+ * ADDB tiering worker pool.
+ *
+ * DESIGN
+ * ------
+ *
+ * Previously every batch of evicted rowgroups was processed by the single
+ * BIO_BATCH_TIERING thread, so serialization of column vectors and the
+ * RocksDB write were bound to one core.
+ *
+ * The pool owns 'tiering_threads' workers. The main thread splits a batch
+ * into at most one job per worker and pushes the jobs round-robin to the
+ * request rings of the workers. A worker pops jobs from its own ring and,
+ * when it runs dry, steals from the rings of the other workers, so a long
+ * rowgroup never leaves the other cores idle.
+ *
+ * Every job serializes its rowgroups into its own WriteBatch. Workers
+ * commit concurrently, and RocksDB's write thread merges concurrent
+ * writers into a single WAL append (group commit), which amortizes the
+ * synchronous WAL fsync over all the workers.
+ *
+ * HANDOFF
+ * -------
+ *
+ * Requests and completions travel through bounded lock-free rings (the
+ * array based MPMC queue by Dmitry Vyukov): a request ring has the main
+ * thread as its only producer and every worker as consumer because of work
+ * stealing, the completion ring has every worker as producer and the main
+ * thread as its only consumer. No lock is taken on the fast path.
+ *
+ * A committed job is pushed to the completion ring and the event loop is
+ * woken up through an eventfd (a pipe where eventfd is not available). The
+ * event handler marks the rowgroups LOCATION_PERSISTED, so the location of
+ * a rowgroup is only ever written by the main thread.
+ *
+ * Workers with nothing to do sleep on 'tiering_newjob_cond'. The mutex is
+ * only taken to sleep and, by the main thread, to wake up sleeping workers.
+ */
+
+#include "server.h"
+#include "tiering.h"
+#include "addb_relational.h"
+
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
+/* Capacity of the request ring of every worker, it must be a power of 2. */
+#define TIERING_RING_SIZE 1024
+#define TIERING_CACHELINE 64
+
+typedef struct tieringJob {
+    redisDb *db;
+    Vector *evict_keys;
+    Vector *evict_relations;
+    uint32_t *row_counts;       /* Recorded with the rowgroups. */
+    int owner;                  /* Worker the job was pushed to. */
+} tieringJob;
+
+typedef struct tieringRingCell {
+    size_t seq;
+    void *data;
+} tieringRingCell;
+
+/* The producer and consumer positions live in different cache lines, so
+ * the main thread and the workers don't bounce the same line. */
+typedef struct tieringRing {
+    tieringRingCell *cells;
+    size_t mask;
+    char pad0[TIERING_CACHELINE];
+    size_t enqueue_pos;
+    char pad1[TIERING_CACHELINE];
+    size_t dequeue_pos;
+    char pad2[TIERING_CACHELINE];
+} tieringRing;
+
+typedef struct tieringWorker {
+    pthread_t thread;
+    tieringRing requests;
+    unsigned long long pending; /* Queued and running jobs (main thread). */
+} tieringWorker;
+
+static tieringWorker tiering_workers[TIERING_MAX_THREADS];
+static int tiering_num_workers = 0;
+static int tiering_next_worker = 0;
+
+static tieringRing tiering_completions;
+static int tiering_notify_fds[2] = {-1,-1}; /* The same fd twice for eventfd. */
+static int tiering_notified = 0;    /* Set if the event loop was woken up. */
+
+static pthread_mutex_t tiering_mutex;
+static pthread_cond_t tiering_newjob_cond;
+static unsigned long tiering_queued = 0;    /* Jobs not picked yet. */
+static int tiering_sleeping = 0;            /* Workers waiting for a job. */
+
+/* The following are only accessed by the main thread. */
+static unsigned long long tiering_pending = 0;  /* Jobs not completed yet. */
+static unsigned long long tiering_done_rowgroups = 0; /* Rowgroups committed. */
+
+void *tieringProcessJobs(void *arg);
+void tieringHandleCompletions(aeEventLoop *el, int fd, void *privdata, int mask);
+
+/* ------------------------------ Rings ------------------------------------ */
+
+static void tieringRingInit(tieringRing *r, size_t size) {
+    size_t j;
+
+    r->cells = zmalloc(sizeof(tieringRingCell)*size);
+    r->mask = size-1;
+    for (j = 0; j < size; j++) r->cells[j].seq = j;
+    r->enqueue_pos = 0;
+    r->dequeue_pos = 0;
+}
+
+/* Push 'data' into the ring. Returns 0 if the ring is full. */
+static int tieringRingPush(tieringRing *r, void *data) {
+    tieringRingCell *cell;
+    size_t pos = __atomic_load_n(&r->enqueue_pos,__ATOMIC_RELAXED);
+
+    while(1) {
+        size_t seq;
+        intptr_t diff;
+
+        cell = &r->cells[pos & r->mask];
+        seq = __atomic_load_n(&cell->seq,__ATOMIC_ACQUIRE);
+        diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->enqueue_pos,&pos,pos+1,1,
+                    __ATOMIC_RELAXED,__ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            return 0;
+        } else {
+            pos = __atomic_load_n(&r->enqueue_pos,__ATOMIC_RELAXED);
+        }
+    }
+    cell->data = data;
+    __atomic_store_n(&cell->seq,pos+1,__ATOMIC_RELEASE);
+    return 1;
+}
+
+/* Pop an element from the ring. Returns NULL if the ring is empty. */
+static void *tieringRingPop(tieringRing *r) {
+    tieringRingCell *cell;
+    void *data;
+    size_t pos = __atomic_load_n(&r->dequeue_pos,__ATOMIC_RELAXED);
+
+    while(1) {
+        size_t seq;
+        intptr_t diff;
+
+        cell = &r->cells[pos & r->mask];
+        seq = __atomic_load_n(&cell->seq,__ATOMIC_ACQUIRE);
+        diff = (intptr_t)seq - (intptr_t)(pos+1);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&r->dequeue_pos,&pos,pos+1,1,
+                    __ATOMIC_RELAXED,__ATOMIC_RELAXED)) break;
+        } else if (diff < 0) {
+            return NULL;
+        } else {
+            pos = __atomic_load_n(&r->dequeue_pos,__ATOMIC_RELAXED);
+        }
+    }
+    data = cell->data;
+    __atomic_store_n(&cell->seq,pos+r->mask+1,__ATOMIC_RELEASE);
+    return data;
+}
+
+/* ------------------------------ Pool ------------------------------------- */
+
+/* Make sure we have enough stack to perform all the things we do in the
+ * main thread. */
+#define TIERING_THREAD_STACK_SIZE (1024*1024*4)
+
+static int tieringCreateNotifyChannel(void) {
+#ifdef HAVE_EVENTFD
+    int fd = eventfd(0,EFD_NONBLOCK|EFD_CLOEXEC);
+    if (fd == -1) return -1;
+    tiering_notify_fds[0] = tiering_notify_fds[1] = fd;
+#else
+    if (pipe(tiering_notify_fds) == -1) return -1;
+    if (anetNonBlock(NULL,tiering_notify_fds[0]) != ANET_OK ||
+        anetNonBlock(NULL,tiering_notify_fds[1]) != ANET_OK) return -1;
+#endif
+    return 0;
+}
+
+/* Initialize the tiering pool, spawning 'server.tiering_threads' workers.
+ * Must be called after the event loop was created. */
+void tieringInit(void) {
+    pthread_attr_t attr;
+    size_t stacksize, completions;
+    int j;
+
+    tiering_num_workers = server.tiering_threads;
+    if (tiering_num_workers < 1) tiering_num_workers = 1;
+    if (tiering_num_workers > TIERING_MAX_THREADS)
+        tiering_num_workers = TIERING_MAX_THREADS;
+
+    pthread_mutex_init(&tiering_mutex,NULL);
+    pthread_cond_init(&tiering_newjob_cond,NULL);
+    for (j = 0; j < tiering_num_workers; j++) {
+        tieringRingInit(&tiering_workers[j].requests,TIERING_RING_SIZE);
+        tiering_workers[j].pending = 0;
+    }
+
+    /* The completion ring can hold every job in flight, so that workers
+     * never have to wait for the main thread. */
+    completions = 1;
+    while (completions < (size_t)tiering_num_workers*(TIERING_RING_SIZE+1))
+        completions *= 2;
+    tieringRingInit(&tiering_completions,completions);
+
+    if (tieringCreateNotifyChannel() == -1 ||
+        aeCreateFileEvent(server.el,tiering_notify_fds[0],AE_READABLE,
+            tieringHandleCompletions,NULL) == AE_ERR)
+    {
+        serverLog(LL_WARNING,"Fatal: Can't create the tiering notification "
+                             "channel: %s", strerror(errno));
+        exit(1);
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_getstacksize(&attr,&stacksize);
+    if (!stacksize) stacksize = 1;
+    while (stacksize < TIERING_THREAD_STACK_SIZE) stacksize *= 2;
+    pthread_attr_setstacksize(&attr, stacksize);
+
+    for (j = 0; j < tiering_num_workers; j++) {
+        void *arg = (void*)(unsigned long) j;
+        if (pthread_create(&tiering_workers[j].thread,&attr,
+                           tieringProcessJobs,arg) != 0) {
+            serverLog(LL_WARNING,"Fatal: Can't initialize tiering workers.");
+            exit(1);
+        }
+    }
+    serverLog(LL_NOTICE,"Tiering pool started with %d workers.",
+              tiering_num_workers);
+}
+
+/* Hand 'job' to the worker 'id', or to the next worker with room in its
+ * ring. If every ring is full we process completions until a worker takes
+ * a job. */
+static void tieringPushJob(int id, tieringJob *job) {
+    int j, pushed = 0;
+
+    while (!pushed) {
+        for (j = 0; j < tiering_num_workers && !pushed; j++) {
+            int target = (id + j) % tiering_num_workers;
+            if (tieringRingPush(&tiering_workers[target].requests,job)) {
+                job->owner = target;
+                tiering_workers[target].pending++;
+                tiering_pending++;
+                pushed = 1;
+            }
+        }
+        if (!pushed) {
+            tieringHandleCompletions(NULL,-1,NULL,0);
+            sched_yield();
+        }
+    }
+
+    /* Publish the job before looking for sleeping workers, see
+     * tieringProcessJobs(). */
+    __atomic_add_fetch(&tiering_queued,1,__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&tiering_sleeping,__ATOMIC_SEQ_CST)) {
+        pthread_mutex_lock(&tiering_mutex);
+        pthread_cond_signal(&tiering_newjob_cond);
+        pthread_mutex_unlock(&tiering_mutex);
+    }
+}
+
+static tieringJob *tieringCreateJob(redisDb *db, Vector *evict_keys,
+                                    Vector *evict_relations) {
+    tieringJob *job = zmalloc(sizeof(*job));
+    size_t count = vectorCount(evict_keys), i;
+
+    job->db = db;
+    job->evict_keys = evict_keys;
+    job->evict_relations = evict_relations;
+    job->owner = -1;
+
+    /* The row counts are recorded with the rowgroups, and the Metadict is
+     * only read by the main thread. */
+    job->row_counts = zmalloc(sizeof(uint32_t)*count);
+    for (i = 0; i < count; i++)
+        job->row_counts[i] = getRowNumberOfDataKey(db,vectorGet(evict_keys,i));
+    return job;
+}
+
+/* Submit a batch of rowgroups for tiering. The batch is split in at most
+ * one slice per worker so that serialization runs in parallel. Ownership
+ * of the vectors passes to the pool. */
+void tieringSubmitBatch(redisDb *db, Vector *evict_keys,
+                        Vector *evict_relations) {
+    size_t count = vectorCount(evict_relations);
+    size_t slices, per_slice, i, j;
+
+    serverAssert(vectorCount(evict_keys) == count);
+    if (count == 0) {
+        vectorFree(evict_keys);
+        vectorFree(evict_relations);
+        zfree(evict_keys);
+        zfree(evict_relations);
+        return;
+    }
+
+    slices = (count < (size_t) tiering_num_workers) ?
+             count : (size_t) tiering_num_workers;
+    if (slices <= 1) {
+        tieringPushJob(tiering_next_worker,
+                       tieringCreateJob(db,evict_keys,evict_relations));
+        tiering_next_worker = (tiering_next_worker + 1) % tiering_num_workers;
+        return;
+    }
+
+    per_slice = (count + slices - 1) / slices;
+    for (i = 0; i < count; i += per_slice) {
+        Vector *keys = vectorCreate(STL_TYPE_SDS, per_slice);
+        Vector *relations = vectorCreate(STL_TYPE_ROBJ, per_slice);
+        for (j = i; j < count && j < i + per_slice; j++) {
+            vectorAdd(keys, vectorGet(evict_keys, j));
+            vectorAdd(relations, vectorGet(evict_relations, j));
+        }
+        tieringPushJob(tiering_next_worker,
+                       tieringCreateJob(db,keys,relations));
+        tiering_next_worker = (tiering_next_worker + 1) % tiering_num_workers;
+    }
+    vectorFree(evict_keys);
+    vectorFree(evict_relations);
+    zfree(evict_keys);
+    zfree(evict_relations);
+}
+
+/* Pop a job for worker 'id': first from its own ring, then from the rings
+ * of the other workers. Returns NULL if every ring is empty. */
+static tieringJob *tieringTakeJob(int id) {
+    tieringJob *job = NULL;
+    int j;
+
+    for (j = 0; j < tiering_num_workers && job == NULL; j++) {
+        int victim = (id + j) % tiering_num_workers;
+        job = tieringRingPop(&tiering_workers[victim].requests);
+    }
+    if (job) __atomic_sub_fetch(&tiering_queued,1,__ATOMIC_SEQ_CST);
+    return job;
+}
+
+/* Push a committed job to the completion ring and wake up the event loop,
+ * unless it was already woken up and didn't drain the ring yet. */
+static void tieringCompleteJob(tieringJob *job) {
+    while (!tieringRingPush(&tiering_completions,job)) sched_yield();
+
+    if (__atomic_exchange_n(&tiering_notified,1,__ATOMIC_SEQ_CST) == 0) {
+#ifdef HAVE_EVENTFD
+        uint64_t one = 1;
+        if (write(tiering_notify_fds[1],&one,sizeof(one)) == -1) {
+            /* Nothing to do, the counter is drained by the event loop. */
+        }
+#else
+        if (write(tiering_notify_fds[1],"x",1) == -1) {
+            /* The pipe is full, the event loop will be woken up anyway. */
+        }
+#endif
+    }
+}
+
+void *tieringProcessJobs(void *arg) {
+    int id = (int)(unsigned long) arg;
+    sigset_t sigset;
+
+    /* Make the thread killable at any time, so that tieringKillThreads()
+     * can work reliably. */
+    pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+    pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, NULL);
+
+    /* Block SIGALRM so we are sure that only the main thread will
+     * receive the watchdog signal. */
+    sigemptyset(&sigset);
+    sigaddset(&sigset, SIGALRM);
+    if (pthread_sigmask(SIG_BLOCK, &sigset, NULL))
+        serverLog(LL_WARNING,
+            "Warning: can't mask SIGALRM in tiering thread: %s",
+            strerror(errno));
+
+    while(1) {
+        tieringJob *job = tieringTakeJob(id);
+
+        if (job == NULL) {
+            /* We announce that we sleep before checking 'tiering_queued',
+             * while the main thread increments it before checking for
+             * sleepers, so either we see the job or the main thread sees
+             * us and signals the condition under the mutex. */
+            pthread_mutex_lock(&tiering_mutex);
+            __atomic_add_fetch(&tiering_sleeping,1,__ATOMIC_SEQ_CST);
+            while (__atomic_load_n(&tiering_queued,__ATOMIC_SEQ_CST) == 0)
+                pthread_cond_wait(&tiering_newjob_cond,&tiering_mutex);
+            __atomic_sub_fetch(&tiering_sleeping,1,__ATOMIC_SEQ_CST);
+            pthread_mutex_unlock(&tiering_mutex);
+            continue;
+        }
+
+        prepareBatchWriteToRocksDB(job->db, job->evict_keys,
+                                   job->evict_relations, job->row_counts);
+        tieringCompleteJob(job);
+    }
+}
+
+/* Event handler of the notification channel. It is also called directly
+ * (with fd set to -1) when the main thread has to wait for the pool. The
+ * committed rowgroups are marked as persisted, so that the tiering
+ * controller can clear them. */
+void tieringHandleCompletions(aeEventLoop *el, int fd, void *privdata, int mask) {
+    tieringJob *job;
+    UNUSED(el);
+    UNUSED(privdata);
+    UNUSED(mask);
+
+    if (fd != -1) {
+        char buf[64];
+        while (read(fd,buf,sizeof(buf)) > 0);
+    }
+    __atomic_store_n(&tiering_notified,0,__ATOMIC_SEQ_CST);
+
+    while ((job = tieringRingPop(&tiering_completions)) != NULL) {
+        size_t count = vectorCount(job->evict_relations), i;
+
+        for (i = 0; i < count; i++) {
+            robj *relation = vectorGet(job->evict_relations, i);
+            objSetLocation(relation, LOCATION_PERSISTED);
+        }
+        tiering_done_rowgroups += count;
+        tiering_workers[job->owner].pending--;
+        tiering_pending--;
+
+        vectorFree(job->evict_keys);
+        vectorFree(job->evict_relations);
+        zfree(job->evict_keys);
+        zfree(job->evict_relations);
+        zfree(job->row_counts);
+        zfree(job);
+    }
+}
+
+/* Return the number of submitted jobs which are not completed yet. */
+unsigned long long tieringPendingJobs(void) {
+    return tiering_pending;
+}
+
+/* Return the number of rowgroups committed to RocksDB since startup. */
+unsigned long long tieringCompletedRowgroups(void) {
+    return tiering_done_rowgroups;
+}
+
+/* Return the number of queued and running jobs of the worker 'id'. A job
+ * stolen by another worker is still accounted to the worker it was
+ * pushed to. */
+unsigned long long tieringPendingJobsOfWorker(int id) {
+    if (id < 0 || id >= tiering_num_workers) return 0;
+    return tiering_workers[id].pending;
+}
+
+int tieringNumWorkers(void) {
+    return tiering_num_workers;
+}
+
+/* Block until every submitted job was committed to RocksDB and its
+ * rowgroups are marked as persisted. This is used when the main thread
+ * needs a stable view of the persisted data. */
+void tieringWaitIdle(void) {
+    while (tiering_pending != 0) {
+        aeWait(tiering_notify_fds[0],AE_READABLE,100);
+        tieringHandleCompletions(NULL,tiering_notify_fds[0],NULL,0);
+    }
+}
+
+/* Kill the tiering workers in an unclean way. Like bioKillThreads() this
+ * is only used on crash to run the fast memory test. */
+void tieringKillThreads(void) {
+    int err, j;
+
+    for (j = 0; j < tiering_num_workers; j++) {
+        if (pthread_cancel(tiering_workers[j].thread) == 0) {
+            if ((err = pthread_join(tiering_workers[j].thread,NULL)) != 0) {
+                serverLog(LL_WARNING,
+                    "Tiering thread #%d can't be joined: %s",
+                        j, strerror(err));
+            } else {
+                serverLog(LL_WARNING,
+                    "Tiering thread #%d terminated",j);
+            }
+        }
+    }
+}
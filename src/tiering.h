@@ -0,0 +1,29 @@
+/*
+ * tiering.h
+ *
+ * ADDB tiering worker pool.
+ * Rowgroups chosen for eviction are handed to a pool of worker threads which
+ * serialize them and commit them to RocksDB in parallel.
+ */
+
+#ifndef __ADDB_TIERING_H
+#define __ADDB_TIERING_H
+
+#include "stl.h"
+
+#define TIERING_MAX_THREADS 64
+
+struct redisDb;
+
+/* Exported API */
+void tieringInit(void);
+void tieringSubmitBatch(struct redisDb *db, Vector *evict_keys,
+                        Vector *evict_relations);
+unsigned long long tieringPendingJobs(void);
+unsigned long long tieringCompletedRowgroups(void);
+unsigned long long tieringPendingJobsOfWorker(int id);
+int tieringNumWorkers(void);
+void tieringWaitIdle(void);
+void tieringKillThreads(void);
+
+#endif
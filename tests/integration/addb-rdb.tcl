@@ -0,0 +1,53 @@
+# ADDB: the rowgroups and the Metadict are saved in RDB files and in DUMP
+# payloads with their own types, see rdbSaveRowGroup() and rdbSaveMetadict().
+
+set addb_overrides {rowgroup_size 50 columnvector_size 50}
+
+start_server [list tags {"addb"} overrides $addb_overrides] {
+    r fpwrite {D:{100:1:2}} 1:2 2 0 a b
+    r fpwrite {D:{100:1:2}} 1:2 2 0 c d
+    r fpwrite {D:{100:1:3}} 1:3 2 0 e f
+
+    test {Rowgroups and the Metadict are created by FPWRITE} {
+        list [lsort [r keys D:*]] [lsort [r metakeys *]]
+    } {{D:{100:1:2}:G:1 D:{100:1:3}:G:1} {M:{100:1:2} M:{100:1:3}}}
+
+    test {Rowgroups and the Metadict survive DEBUG RELOAD} {
+        set dump [r dump {D:{100:1:2}:G:1}]
+        r debug reload
+        list [lsort [r metakeys *]] \
+             [r fpscan {D:{100:1:2}} 1,2] \
+             [r fpscan {D:{100:1:3}} 1,2] \
+             [r type {D:{100:1:2}:G:1}] \
+             [expr {[r dump {D:{100:1:2}:G:1}] eq $dump}]
+    } {{M:{100:1:2} M:{100:1:3}} {a b c d} {e f} hash 1}
+
+    test {FPWRITE appends to a reloaded rowgroup} {
+        r fpwrite {D:{100:1:2}} 1:2 2 0 g h
+        r debug reload
+        r fpscan {D:{100:1:2}} 1,2
+    } {a b c d g h}
+
+    start_server [list overrides $addb_overrides] {
+        set first [srv -1 client]
+
+        test {DUMP / RESTORE of a rowgroup} {
+            set dump [$first dump {D:{100:1:2}:G:1}]
+            r restore {D:{100:1:2}:G:1} 0 $dump
+            list [r type {D:{100:1:2}:G:1}] \
+                 [expr {[r dump {D:{100:1:2}:G:1}] eq $dump}]
+        } {hash 1}
+
+        test {A restored rowgroup survives DEBUG RELOAD} {
+            set dump [r dump {D:{100:1:2}:G:1}]
+            r debug reload
+            expr {[r dump {D:{100:1:2}:G:1}] eq $dump}
+        } {1}
+
+        test {RESTORE refuses a truncated rowgroup payload} {
+            set dump [$first dump {D:{100:1:3}:G:1}]
+            catch {r restore {D:{100:1:3}:G:1} 0 [string range $dump 0 end-12]} e
+            list [r exists {D:{100:1:3}:G:1}] [string match {*ERR*} $e]
+        } {0 1}
+    }
+}
@@ -39,6 +39,7 @@ set ::all_tests {
     integration/replication-psync
     integration/aof
     integration/rdb
+    integration/addb-rdb
     integration/convert-zipmap-hash-on-load
     integration/logging
     integration/psync2
@@ -405,6 +406,7 @@ proc print_help_screen {} {
         "--single <unit>    Just execute the specified unit (see next option)."
         "--list-tests       List all the available test units."
         "--clients <num>    Number of test clients (default 16)."
+        "--config <k> <v>   Extra config directive for every started server."
         "--timeout <sec>    Test timeout in seconds (default 10 min)."
         "--force-failure    Force the execution of a test that always fails."
         "--help             Print this help screen."
@@ -458,6 +460,9 @@ for {set j 0} {$j < [llength $argv]} {incr j} {
     } elseif {$opt eq {--clients}} {
         set ::numclients $arg
         incr j
+    } elseif {$opt eq {--config}} {
+        lappend ::global_overrides $arg [lindex $argv [expr $j+2]]
+        incr j 2
     } elseif {$opt eq {--timeout}} {
         set ::timeout $arg
         incr j